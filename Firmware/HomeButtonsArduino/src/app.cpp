@@ -3,12 +3,17 @@
 #include <Arduino.h>
 #include <esp_task_wdt.h>
 #include <SPIFFS.h>
-#include "esp_ota_ops.h"
 #include <ArduinoJson.h>
+#include "esp_ota_ops.h"
 
 #include "config.h"
 #include "factory.h"
 #include "hardware.h"
+#include "json_writer.h"
+#include "power.h"
+#include "print_utils.h"
+#include "wake_profiler.h"
+#include "wake_stub.h"
 
 extern "C" bool verifyRollbackLater() { return true; };
 
@@ -57,11 +62,12 @@ App::App()
 
 void App::setup() {
   info("starting...");
+  // above display and network, UI events are handled in the main task
   xTaskCreate(_main_task_helper,  // Function that should be called
               "MAIN",             // Name of the task (for debugging)
               20000,              // Stack size (bytes)
               this,               // Parameter to pass
-              tskIDLE_PRIORITY,   // Task priority
+              2,                  // Task priority
               &main_task_h_       // Task handle
   );
   debug("main task started.");
@@ -84,13 +90,18 @@ void App::_sleep_or_restart() {
 void App::_start_esp_sleep() {
 #if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
   esp_sleep_enable_ext1_wakeup(hw_.WAKE_BITMASK, ESP_EXT1_WAKEUP_ANY_HIGH);
+  WakeStub::arm(hw_.WAKE_BITMASK);
   if (device_state_.persisted().wifi_done &&
       device_state_.persisted().setup_done &&
       !device_state_.persisted().low_batt_mode &&
       !device_state_.persisted().check_connection) {
-    if (device_state_.flags().schedule_wakeup_time > 0) {
-      esp_sleep_enable_timer_wakeup(device_state_.flags().schedule_wakeup_time *
-                                    1000000UL);
+    uint32_t schedule_wakeup_time = device_state_.flags().schedule_wakeup_time;
+    if (schedule_wakeup_time > 0) {
+      esp_sleep_enable_timer_wakeup(schedule_wakeup_time * 1000000UL);
+#if defined(HAS_SENSOR_BATCH)
+      // connect on the scheduled wake
+      sensor_log_.request_upload();
+#endif
     } else {
       esp_sleep_enable_timer_wakeup(device_state_.sensor_interval() *
                                     60000000UL);
@@ -99,11 +110,15 @@ void App::_start_esp_sleep() {
 #elif defined(HOME_BUTTONS_PRO)
   esp_sleep_enable_ext1_wakeup(hw_.WAKE_BITMASK, ESP_EXT1_WAKEUP_ANY_HIGH);
 #endif
-  info("deep sleep... z z z");
+  info("deep sleep after %lu ms awake... z z z", millis());
+  WakeProfiler::mark(WakePhase::kSleep);
   esp_deep_sleep_start();
 }
 
 void App::_go_to_sleep() {
+#if defined(HAS_SENSOR_BATCH)
+  _confirm_sensor_log();
+#endif
   device_state_.save_all();
 #if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
   hw_.set_all_leds(0);
@@ -121,8 +136,11 @@ std::pair<BootCause, int16_t> App::_determine_boot_cause() {
 #if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
   switch (esp_sleep_get_wakeup_cause()) {
     case ESP_SLEEP_WAKEUP_EXT1: {
-      uint64_t GPIO_reason = esp_sleep_get_ext1_wakeup_status();
-      wakeup_pin = (log(GPIO_reason)) / log(2);
+      // the stub samples the pins earlier than the app
+      uint64_t GPIO_reason = WakeStub::wake_mask();
+      if (GPIO_reason == 0) GPIO_reason = esp_sleep_get_ext1_wakeup_status();
+      // lowest pin if more than one button woke the device
+      wakeup_pin = GPIO_reason ? __builtin_ctzll(GPIO_reason) : -1;
       debug("wakeup cause: PIN %d", wakeup_pin);
       wakeup_btn_id = bsl_input_.IdFromPin(wakeup_pin);
       if (wakeup_btn_id > 0) {
@@ -144,6 +162,18 @@ std::pair<BootCause, int16_t> App::_determine_boot_cause() {
   return std::make_pair(boot_cause, wakeup_btn_id);
 }
 
+#if defined(HAS_WAKE_STUB)
+// the wake button continues from the edges recorded before boot
+void App::_replay_wake_press() {
+  auto bls = bsl_input_.GetBtnSwLED(wakeup_btn_id_);
+  if (!bls) return;
+  ButtonEdge edges[WAKE_STUB_EDGES];
+  size_t count =
+      WakeStub::edges(bls.value().get().pin(), edges, WAKE_STUB_EDGES);
+  bls.value().get().ReplayPress(edges, count);
+}
+#endif
+
 void App::_log_task_stats() {
   const UBaseType_t maxTasks = 20;
   TaskStatus_t statusArray[maxTasks];
@@ -179,33 +209,76 @@ void App::_log_task_stats() {
   uint32_t rtos_free_heap = xPortGetFreeHeapSize();
   debug("Free heap: ESP %d, ESP MIN %d, RTOS %d\n", esp_free_heap,
         esp_min_free_heap, rtos_free_heap);
+  debug("Task wakeups: UI %u, display %u, main %u", ui_scheduler_.wakeups(),
+        display_scheduler_.wakeups(), main_scheduler_.wakeups());
+  // time at each CPU frequency, the share at the minimum is what DFS saves
+  if (Power::dfs_enabled()) {
+    debug("CPU freq: %u MHz", getCpuFrequencyMhz());
+    Power::dump_stats();
+  }
 }
 
-void App::_publish_system_state() {
+// published when the RSSI leaves its deadband or with the heartbeat
+void App::_publish_system_state(bool force) {
+  // read once, the payload is written twice (measure and write)
+  int32_t rssi = network_.get_rssi();
+  // the counters are only reported, a change doesn't publish: every
+  // suppressed sensor reading would bring a larger message instead
+  if (!_report(ReportChannel::kRssi, rssi, force)) return;
+
   uint32_t esp_free_heap = ESP.getFreeHeap();
   uint32_t esp_min_free_heap = ESP.getMinFreeHeap();
   uint32_t uptime = millis() / 1000;
-  int32_t rssi = network_.get_rssi();
   IPAddress ip = network_.get_ip();
-
-  StaticJsonDocument<512> doc;
-  doc["esp_free_heap"] = esp_free_heap;
-  doc["esp_min_free_heap"] = esp_min_free_heap;
-  doc["uptime_seconds"] = uptime;
-  doc["wifi_rssi"] = rssi;
-  doc["ip_address"] = ip.toString();
-  doc["sw_version"] = SW_VERSION;
+  Network::PublishStats publish_stats = network_.get_publish_stats();
+  uint32_t nvs_writes = device_state_.nvs_writes();
+  uint32_t ui_events_dropped = ui_events_.dropped();
+  constexpr size_t kNumChannels =
+      static_cast<size_t>(ReportChannel::kNumChannels);
+  uint32_t suppressed[kNumChannels];
+  for (size_t i = 0; i < kNumChannels; i++) {
+    suppressed[i] =
+        report_filter_.suppressed_count(static_cast<ReportChannel>(i));
+  }
 #if defined(HAS_BATTERY)
-  doc["batt_voltage"] = hw_.read_battery_voltage();
+  float batt_voltage = device_state_.sensors().battery_voltage;
 #endif
 
-  char buffer[512];
-  serializeJson(doc, buffer, sizeof(buffer));
-  network_.publish(topics_.t_system_state(), buffer, true);
+  network_.publish(
+      topics_.t_system_state(),
+      [&](Print& out) {
+        JsonWriter json(out);
+        json.begin_object();
+        json.add("esp_free_heap", esp_free_heap)
+            .add("esp_min_free_heap", esp_min_free_heap)
+            .add("uptime_seconds", uptime)
+            .add("wifi_rssi", rssi)
+            .add("ip_address", ip_address_to_static_string(ip))
+            .add("sw_version", SW_VERSION)
+            .add("mqtt_dropped", publish_stats.dropped)
+            .add("mqtt_coalesced", publish_stats.coalesced)
+            .add("mqtt_evt_latency_us", publish_stats.event_latency_us)
+            .add("mqtt_evt_latency_max_us",
+                 publish_stats.event_latency_max_us)
+            .add("nvs_writes", nvs_writes)
+            .add("ui_events_dropped", ui_events_dropped);
+        json.begin_object("suppressed");
+        for (size_t i = 0; i < kNumChannels; i++) {
+          json.add(ReportFilter::channel_name(static_cast<ReportChannel>(i)),
+                   suppressed[i]);
+        }
+        json.end_object();
+#if defined(HAS_BATTERY)
+        json.add("batt_voltage", batt_voltage);
+#endif
+        json.end_object();
+      },
+      true);
 }
 
 void App::_ui_task(void* param) {
   App* app = static_cast<App*>(param);
+  app->ui_scheduler_.bind();
   while (true) {
 #if defined(HAS_BUTTON_UI)
     app->bsl_input_.Loop();
@@ -214,14 +287,14 @@ void App::_ui_task(void* param) {
 #endif
 
 #if defined(HAS_FRONTLIGHT)
-    if (millis() - app->device_state_.flags().last_user_input_time >
-        FRONTLIGHT_TIMEOUT) {
-      if (!app->device_state_.flags().keep_frontlight_on) {
+    const auto flags = app->device_state_.flags();
+    if (millis() - flags.last_user_input_time > FRONTLIGHT_TIMEOUT) {
+      if (!flags.keep_frontlight_on) {
         app->hw_.set_frontlight(0);
       }
     }
 #endif
-    delay(5);
+    app->ui_scheduler_.wait();
   }
 }
 
@@ -242,9 +315,10 @@ void App::_start_ui_task() {
 #if defined(HAS_DISPLAY)
 void App::_display_task(void* param) {
   App* app = static_cast<App*>(param);
+  app->display_scheduler_.bind();
   while (true) {
     app->display_.update();
-    delay(50);
+    app->display_scheduler_.wait();
   }
 }
 
@@ -266,7 +340,12 @@ void App::_network_task(void* param) {
   app->network_.setup();
   while (true) {
     app->network_.update();
-    delay(10);
+#if defined(HAS_BUTTON_UI)
+    if (app->btn_conf_applied_.exchange(false)) {
+      app->_publish_btn_conf();
+    }
+#endif
+    app->network_.wait();
   }
 }
 
@@ -282,31 +361,82 @@ void App::_start_network_task() {
   );
 }
 
+bool App::_connect_expected() {
+  const auto& persisted = device_state_.persisted();
+  if (!persisted.wifi_done || !persisted.setup_done ||
+      persisted.low_batt_mode || persisted.restart_to_setup ||
+      persisted.restart_to_wifi_setup || batt_recheck_) {
+    return false;
+  }
+  switch (boot_cause_) {
+    case BootCause::BUTTON:
+      return device_state_.flags().awake_mode ||
+             (!persisted.charge_complete_showing &&
+              !persisted.user_msg_showing && !persisted.check_connection);
+    case BootCause::TIMER:
+      return true;
+    default:
+      // restart shows messages, may format the icon storage and sets the
+      // discovery and icon download flags before connecting
+      return false;
+  }
+}
+
+void App::_connect_early() {
+  _start_network_task();
+  network_.connect();
+  WakeProfiler::mark(WakePhase::kNetStarted);
+  debug("network started early");
+}
+
 void App::_begin_hw() {
 #if defined(HAS_DISPLAY)
   // must be before ledAttachPin (reserves GPIO37 = SPIDQS)
   display_.begin(hw_);
+  display_.set_scheduler(&display_scheduler_);
 #endif
   hw_.begin();
 #if defined(HAS_BUTTON_UI)
+  bsl_input_.SetScheduler(&ui_scheduler_);
   bsl_input_.Init();
   bsl_input_.LEDSetDefaultBrightnessAll(LED_DFLT_BRIGHT);
 #elif defined(HAS_TOUCH_UI)
+  touch_handler_.SetScheduler(&ui_scheduler_);
   touch_handler_.Init(hw_.TOUCH_CLICK_PIN, hw_.TOUCH_INT_PIN);
 #endif
 
-#if defined(HOME_BUTTONS_INDUSTRIAL)
-  // set button config based
-  auto conf = device_state_.user_preferences().btn_conf_string;
+#if defined(HAS_BUTTON_UI)
+  // the discovery config reads the modes from the buttons, it's updated
+  // once the UI task applied them
+  bsl_input_.SetConfigAppliedCallback([this]() {
+    btn_conf_applied_ = true;
+    network_.wake();
+  });
+  // applied when the buttons start
+  _apply_btn_conf();
+#endif
+}
+
+#if defined(HAS_BUTTON_UI)
+void App::_apply_btn_conf() {
+  const auto& conf = device_state_.user_preferences().btn_conf_string;
   debug("Button config: %s", conf.c_str());
-  for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
-    if (conf[i] == 'S') {
-      bsl_input_.SetSwitchMode(i + 1, true);
-    }
+  decltype(bsl_input_)::Config config = {};
+  uint8_t len = conf.length();
+  for (uint8_t i = 0; i < BTN_CONF_LEN; i++) {
+    char c = i < len ? conf[i] : 'B';
+    config[i].instant_mode = c == 'I';
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+    config[i].switch_mode = c == 'S';
+#endif
   }
-  sw_.SetSwitchMode(true);
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+  // the kill switch is always a switch
+  config[NUM_BUTTONS - 1].switch_mode = true;
 #endif
+  bsl_input_.SetConfig(config);
 }
+#endif
 
 void App::_start_tasks() {
   _start_ui_task();
@@ -323,12 +453,15 @@ void App::_start_tasks() {
 }
 
 void App::_main_task() {
+  WakeProfiler::begin();
+  main_scheduler_.bind();
   info("woke up.");
   info("cpu freq: %d MHz", getCpuFrequencyMhz());
   info("SW version: %s", SW_VERSION);
 
   // ------ init hardware ------
   bool hw_init_ok = hw_.init();
+  WakeProfiler::mark(WakePhase::kHwInit);
 
   // verify OTA if this is first boot after OTA
   const esp_partition_t* running = esp_ota_get_running_partition();
@@ -351,6 +484,7 @@ void App::_main_task() {
   }
 
   device_state_.load_all(hw_);
+  WakeProfiler::mark(WakePhase::kStateLoad);
 
   // ------ factory test ------
   FactoryTest factory_test(*this);
@@ -378,6 +512,29 @@ void App::_main_task() {
   }
 
   _begin_hw();
+  WakeProfiler::mark(WakePhase::kBeginHw);
+
+  // ------ boot cause ------
+  std::tie(boot_cause_, wakeup_btn_id_) = _determine_boot_cause();
+  info("boot cause: %d, wakeup btn id: %d", static_cast<int>(boot_cause_),
+       wakeup_btn_id_);
+
+  // set before the network task starts, it may connect before the state
+  // machine runs
+  network_.set_mqtt_callback([this](const char* topic, const char* payload) {
+    _mqtt_callback(topic, payload);
+    main_scheduler_.notify();
+  });
+  network_.set_on_connect(std::bind(&App::_net_on_connect, this));
+#if defined(HOME_BUTTONS_ORIGINAL)
+  mdi_.add_size(64);
+  mdi_.add_size(48);
+#elif defined(HOME_BUTTONS_MINI)
+  mdi_.add_size(100);
+#elif defined(HOME_BUTTONS_PRO)
+  mdi_.add_size(92);
+  mdi_.add_size(64);
+#endif
 
   // ------ test code ------
 
@@ -417,24 +574,23 @@ void App::_main_task() {
 
 // ------ determine power mode ------
 #if defined(HOME_BUTTONS_ORIGINAL)
-  device_state_.sensors().battery_present = hw_.is_battery_present();
-  device_state_.sensors().dc_connected = hw_.is_dc_connected();
-  info("batt present: %d, DC connected: %d",
-       device_state_.sensors().battery_present,
-       device_state_.sensors().dc_connected);
+  bool battery_present = hw_.is_battery_present();
+  bool dc_connected = hw_.is_dc_connected();
+  device_state_.set_power_source(battery_present, dc_connected);
+  info("batt present: %d, DC connected: %d", battery_present, dc_connected);
 
-  if (device_state_.sensors().battery_present) {
+  if (battery_present) {
     float batt_voltage = hw_.read_battery_voltage();
     info("batt volts: %f", batt_voltage);
-    if (device_state_.sensors().dc_connected) {
+    if (dc_connected) {
       // charging
       if (batt_voltage < hw_.CHARGE_HYSTERESIS_VOLT) {
-        device_state_.sensors().charging = true;
+        device_state_.set_charging(true);
         hw_.enable_charger(true);
-        device_state_.flags().awake_mode = true;
+        device_state_.set_awake_mode(true);
       } else {
-        device_state_.flags().awake_mode =
-            device_state_.persisted().user_awake_mode;
+        device_state_.set_awake_mode(
+            device_state_.persisted().user_awake_mode);
       }
       device_state_.persisted().low_batt_mode = false;
     } else {  // dc_connected == false
@@ -450,29 +606,19 @@ void App::_main_task() {
         }
       } else {  // low_batt_mode == false
         if (batt_voltage < hw_.MIN_BATT_VOLT) {
-          // check again
-          delay(1000);
-          batt_voltage = hw_.read_battery_voltage();
-          if (batt_voltage < hw_.MIN_BATT_VOLT) {
-            device_state_.persisted().low_batt_mode = true;
-            warning("batt voltage too low, low bat mode enabled");
-            display_.disp_message_large(
-                "Turned\nOFF\n\nPlease\nrecharge\nbattery!");
-            display_.update();
-            _go_to_sleep();
-          }
+          // checked again in BootState
+          batt_recheck_ = true;
         } else if (batt_voltage <= hw_.WARN_BATT_VOLT) {
-          device_state_.sensors().battery_low = true;
+          device_state_.set_battery_low(true);
         }
-        device_state_.flags().awake_mode = false;
+        device_state_.set_awake_mode(false);
       }
     }
   } else {  // battery_present == false
-    if (device_state_.sensors().dc_connected) {
+    if (dc_connected) {
       device_state_.persisted().low_batt_mode = false;
       // choose power mode based on user setting
-      device_state_.flags().awake_mode =
-          device_state_.persisted().user_awake_mode;
+      device_state_.set_awake_mode(device_state_.persisted().user_awake_mode);
     } else {
       // should never happen
       _go_to_sleep();
@@ -497,411 +643,596 @@ void App::_main_task() {
     }
   } else {  // low_batt_mode == false
     if (batt_voltage < hw_.MIN_BATT_VOLT) {
-      // check again
-      delay(1000);
-      batt_voltage = hw_.read_battery_voltage();
-      if (batt_voltage < hw_.MIN_BATT_VOLT) {
-        device_state_.persisted().low_batt_mode = true;
-        warning("batt voltage too low, low bat mode enabled");
-        display_.disp_message_large(
-            "Turned\nOFF\n\nPlease\nreplace\nbatteries!");
-        display_.update();
-        _go_to_sleep();
-      }
+      // checked again in BootState
+      batt_recheck_ = true;
     } else if (batt_voltage <= hw_.WARN_BATT_VOLT) {
-      device_state_.sensors().battery_low = true;
+      device_state_.set_battery_low(true);
     }
   }
   // mini doesn't have awake mode
-  device_state_.flags().awake_mode = false;
+  device_state_.set_awake_mode(false);
 #elif defined(HOME_BUTTONS_PRO) || defined(HOME_BUTTONS_INDUSTRIAL)
-  device_state_.flags().awake_mode = true;
-#endif
-
-#if defined(HAS_TH_SENSOR)
-  // ------ read sensors ------
-  hw_.read_temp_hmd(device_state_.sensors().temperature,
-                    device_state_.sensors().humidity,
-                    device_state_.get_use_fahrenheit());
+  device_state_.set_awake_mode(true);
 #endif
 #if defined(HAS_BATTERY)
-  device_state_.sensors().battery_pct = hw_.read_battery_percent();
-  device_state_.sensors().battery_voltage = hw_.read_battery_voltage();
-#endif
-
-  // ------ start tasks ------
-  _start_tasks();
-
-  // ------ boot cause ------
-  std::tie(boot_cause_, wakeup_btn_id_) = _determine_boot_cause();
-  info("boot cause: %d, wakeup btn id: %d", static_cast<int>(boot_cause_),
-       wakeup_btn_id_);
-
-  // ------ handle boot cause ------
-  switch (boot_cause_) {
-    case BootCause::RESET: {
-      if (!device_state_.persisted().silent_restart) {
-#if defined(HAS_BUTTON_UI)
-        bsl_input_.LEDOnAll();
-        delay(1000);
-#endif
-#if defined(HAS_FRONTLIGHT)
-        hw_.set_frontlight(hw_.FL_LED_BRIGHT_DFLT);
-#endif
-#if defined(HAS_DISPLAY)
-        display_.disp_message("RESTART...", 0);
-        delay(3000);
-#endif
-      }
-
-#if defined(HAS_DISPLAY)
-      // format SPIFFS if needed
-      if (!SPIFFS.begin()) {
-        info("Formatting icon storage...");
-        display_.disp_message("Formatting\nIcon\nStorage...", 0);
-        delay(3000);
-        SPIFFS.format();
-      } else {
-        SPIFFS.end();
-        debug("SPIFFS test mount OK");
-      }
+  // battery ADC is on ADC2, which the radio also uses, read it first
+  device_state_.set_battery(hw_.read_battery_percent(),
+                            hw_.read_battery_voltage());
 #endif
+  WakeProfiler::mark(WakePhase::kBattery);
 
-      // check if restart to setup or Wi-Fi setup is needed
-      if (device_state_.persisted().restart_to_wifi_setup) {
-        device_state_.clear_persisted_flags();
-        info("staring Wi-Fi setup...");
-        setup_.start_wifi_setup();  // resets ESP when done
-      } else if (device_state_.persisted().restart_to_setup) {
-        device_state_.clear_persisted_flags();
-        info("staring setup...");
-        setup_.start_setup();  // resets ESP when done
-      }
-
-      device_state_.clear_persisted_flags();
-
-      if (!device_state_.persisted().wifi_done ||
-          !device_state_.persisted().setup_done) {
-#if defined(HAS_DISPLAY)
-        display_.disp_welcome();
-        delay(3000);
-        display_.end();
-        delay(3000);
-#endif
-#if defined(HAS_SLEEP_MODE)
-        _go_to_sleep();
-#endif
-      } else {
-#if defined(HAS_DISPLAY)
-        display_.disp_main();
-        delay(3000);
-#endif
-      }
-      device_state_.persisted().download_mdi_icons = true;
-      device_state_.persisted().send_discovery_config = true;
-      device_state_.save_all();
-      if (device_state_.flags().awake_mode) {
-// proceed with awake mode
-#if defined(HAS_BUTTON_UI)
-        bsl_input_.LEDOffAll();
-#elif defined(HAS_FRONTLIGHT)
-        hw_.set_frontlight(0);
-#endif
-      } else {
-#if defined(HAS_DISPLAY)
-        display_.end();
-        delay(3000);
-#endif
-#if defined(HAS_SLEEP_MODE)
-        _go_to_sleep();
-#endif
-      }
-      break;
-    }
-    case BootCause::BUTTON: {
-#if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
-      if (!device_state_.flags().awake_mode) {
-        if (device_state_.persisted().charge_complete_showing) {
-          device_state_.persisted().charge_complete_showing = false;
-          display_.disp_main();
-          delay(3000);
-          display_.end();
-          delay(3000);
-          _go_to_sleep();
-        } else if (device_state_.persisted().user_msg_showing) {
-          device_state_.persisted().user_msg_showing = false;
-          display_.disp_main();
-          delay(3000);
-          display_.end();
-          delay(3000);
-          _go_to_sleep();
-        } else if (device_state_.persisted().check_connection) {
-          device_state_.persisted().check_connection = false;
-          display_.disp_main();
-          delay(3000);
-          display_.end();
-          delay(3000);
-          _go_to_sleep();
-        } else {
-          // proceed
-        }
-      } else {
-        // proceed with awake mode
-      }
-      break;
-#endif
-    }
+  // ------ start network ------
+  // wifi association runs in the network task while the sensors are read
+  // and the remaining tasks and the display start
+  if (boot_cause_ != BootCause::TIMER && _connect_expected()) {
+    _connect_early();
+  }
 
-#if defined(HOME_BUTTONS_ORIGINAL)
-    case BootCause::TIMER: {
-      if (device_state_.flags().awake_mode) {
-        // proceed with awake mode
-      } else {
-        if (hw_.is_charger_in_standby()) {  // hw <= 2.1 doesn't have awake
-          // mode when charging
-          if (!device_state_.persisted().charge_complete_showing) {
-            device_state_.persisted().charge_complete_showing = true;
-            display_.disp_message_large("Fully\ncharged!");
-          }
-        }
-        // proceed with sensor publish
-      }
-      break;
-    }
+#if defined(HAS_TH_SENSOR)
+  // ------ read sensors ------
+  float temperature, humidity;
+  hw_.read_temp_hmd(temperature, humidity, device_state_.get_use_fahrenheit());
+  device_state_.set_temp_hmd(temperature, humidity);
+#endif
+  WakeProfiler::mark(WakePhase::kSensors);
+
+#if defined(HAS_SENSOR_BATCH)
+  // timer wakes only log the sample until an upload is due, without
+  // starting any tasks or the radio
+  if (boot_cause_ == BootCause::TIMER && !device_state_.flags().awake_mode &&
+      !_sensor_upload_due()) {
+    _go_to_sleep();
+  }
 #endif
-    default:
-      break;
+  // timer wakes connect once the sensor read decided to publish
+  if (boot_cause_ == BootCause::TIMER && _connect_expected()) {
+    _connect_early();
   }
 
+  // ------ start tasks ------
 #if defined(HAS_DISPLAY)
   display_.init_ui_state(UIState{.page = DisplayPage::MAIN});
 #endif
-  network_.set_mqtt_callback(std::bind(&App::_mqtt_callback, this,
-                                       std::placeholders::_1,
-                                       std::placeholders::_2));
-  network_.set_on_connect(std::bind(&App::_net_on_connect, this));
-
-#if defined(HAS_TOUCH_UI)
-  touch_handler_.SetEventCallbackSecondary(
-      std::bind(&App::_handle_ui_event_global, this, std::placeholders::_1));
-#endif
+  _start_tasks();
+  WakeProfiler::mark(WakePhase::kTasksStarted);
 
   debug("Starting main state machine loop");
   while (true) {
+    _dispatch_ui_events();
     loop();
     esp_task_wdt_reset();
-    delay(10);
+    main_scheduler_.wait();
   }
 }
 
-void App::_handle_ui_event_global(UserInput::Event event) {
-  device_state_.flags().last_user_input_time = millis();
+// the input's callback is only set while a state handles events, an instant
+// wake press is held by its button until then
+void App::_set_ui_handler(UIHandler handler) {
+  // drops events meant for the previous state
+  ui_events_.clear();
+  ui_handler_ = handler;
+  auto post = std::bind(&App::_post_ui_event, this, std::placeholders::_1);
+#if defined(HAS_BUTTON_UI)
+  bsl_input_.SetEventCallback(post);
+#elif defined(HAS_TOUCH_UI)
+  touch_handler_.SetEventCallback(post);
+#endif
+}
+
+void App::_clear_ui_handler() {
+#if defined(HAS_BUTTON_UI)
+  bsl_input_.ClearEventCallback();
+#elif defined(HAS_TOUCH_UI)
+  touch_handler_.ClearEventCallback();
+#endif
+  ui_handler_ = nullptr;
+}
+
+// runs in the task that triggered the event, never blocks
+void App::_post_ui_event(UserInput::Event event) {
+  portENTER_CRITICAL(&ui_events_mux_);
+  ui_events_.push(event);
+  portEXIT_CRITICAL(&ui_events_mux_);
+  main_scheduler_.notify();
+}
+
+void App::_dispatch_ui_events() {
+  UserInput::Event event;
+  while (ui_events_.pop(event)) {
+    device_state_.set_last_user_input_time(millis());
+    if (!ui_handler_) continue;
+    // a transition replaces the handler while it runs
+    UIHandler handler = ui_handler_;
+    handler(event);
+  }
 }
 
 void App::_publish_ui_event(UserInput::Event event) {
-  TopicType topic = topics_.get_button_topic(event);
+  const char* topic = topics_.get_button_topic(event);
   if (event.type == UserInput::EventType::kClickSingle ||
       event.type == UserInput::EventType::kClickDouble ||
       event.type == UserInput::EventType::kClickTriple ||
       event.type == UserInput::EventType::kClickQuad) {
-    network_.publish(topic, BTN_PRESS_PAYLOAD);
+    network_.publish(topic, BTN_PRESS_PAYLOAD, false,
+                     Network::Priority::URGENT);
   } else if (event.type == UserInput::EventType::kSwitchOn) {
-    network_.publish(topic, "ON");
+    network_.publish(topic, "ON", false, Network::Priority::URGENT);
   } else if (event.type == UserInput::EventType::kSwitchOff) {
-    network_.publish(topic, "OFF");
+    network_.publish(topic, "OFF", false, Network::Priority::URGENT);
   }
 }
 
+// publishes events that were journaled while offline, oldest first, each
+// followed by an event_replay message with its sequence number and age
+void App::_replay_journaled_events() {
+  EventJournal::Entry entry;
+  int64_t now = EventJournal::now_us();
+  while (event_journal_.pop(entry)) {
+    int64_t age_ms = (now - entry.time_us) / 1000;
+    if (age_ms < 0 || age_ms > EVENT_JOURNAL_MAX_AGE * 1000LL) {
+      info("journaled event %u dropped, age: %lld ms", entry.seq, age_ms);
+      continue;
+    }
+    UserInput::Event event;
+    event.type = entry.type;
+    event.btn_id = entry.btn_id;
+    event.final = true;
+    const char* topic = topics_.get_button_topic(event);
+    info("replaying event %u (%s), age: %lld ms", entry.seq, topic, age_ms);
+    _publish_ui_event(event);
+    network_.publish(
+        topics_.t_event_replay(),
+        [&](Print& out) {
+          JsonWriter json(out);
+          json.begin_object()
+              .add("seq", entry.seq)
+              .add("topic", topic)
+              .add("age_ms", age_ms)
+              .end_object();
+        },
+        false, Network::Priority::URGENT);
+  }
+}
+
+// true if the value has to be published, see ReportFilter
+bool App::_report(ReportChannel channel, float value, bool force) {
+  return report_filter_.update(channel, value, device_state_.deadband(channel),
+                               device_state_.report_heartbeat() * 60, force);
+}
+
+bool App::_report_due(ReportChannel channel, float value) {
+  return report_filter_.due(channel, value, device_state_.deadband(channel),
+                            device_state_.report_heartbeat() * 60);
+}
+
 #if defined(HAS_TH_SENSOR)
-void App::_publish_sensors() {
-  network_.publish(topics_.t_temperature(),
-                   PayloadType("%.2f", device_state_.sensors().temperature));
-  network_.publish(topics_.t_humidity(),
-                   PayloadType("%.2f", device_state_.sensors().humidity));
-  network_.publish(topics_.t_battery(),
-                   PayloadType("%u", device_state_.sensors().battery_pct));
+void App::_publish_sensors(bool force) {
+  const auto sensors = device_state_.sensors();
+  if (_report(ReportChannel::kTemperature, sensors.temperature, force)) {
+    network_.publish(topics_.t_temperature(),
+                     PayloadType("%.2f", sensors.temperature));
+  }
+  if (_report(ReportChannel::kHumidity, sensors.humidity, force)) {
+    network_.publish(topics_.t_humidity(),
+                     PayloadType("%.2f", sensors.humidity));
+  }
+#if defined(HAS_BATTERY)
+  _publish_battery(force);
+#endif
+#if defined(HAS_SENSOR_BATCH)
+  _publish_sensor_log();
+  sensor_log_.set_uploaded(sensors.temperature, sensors.humidity);
+#endif
+}
+#endif
+
+#if defined(HAS_SENSOR_BATCH)
+// true if this timer wake has to connect: when the batch is full, or
+// without batching when a value left its deadband or the heartbeat expired
+bool App::_sensor_upload_due() {
+  const auto sensors = device_state_.sensors();
+  // a low voltage is checked again in BootState, which may enter the low
+  // battery mode
+  bool due = batt_recheck_ || sensors.battery_low ||
+             sensor_log_.upload_requested();
+#if defined(HOME_BUTTONS_ORIGINAL)
+  // the "Fully charged!" message needs the display task
+  due = due || (hw_.is_charger_in_standby() &&
+                !device_state_.persisted().charge_complete_showing);
+#endif
+
+  uint8_t batch = device_state_.sensor_batch();
+  if (batch > 1) {
+    bool changed = sensor_log_.changed(sensors.temperature, sensors.humidity);
+    sensor_log_.add(sensors.temperature, sensors.humidity,
+                    sensors.battery_pct);
+    due = due || changed || sensor_log_.size() >= batch;
+    info("sensor sample %u/%u logged%s", sensor_log_.size(), batch,
+         due ? ", uploading" : "");
+    return due;
+  }
+
+  due = due ||
+        _report_due(ReportChannel::kTemperature, sensors.temperature) ||
+        _report_due(ReportChannel::kHumidity, sensors.humidity) ||
+        _report_due(ReportChannel::kBattery, sensors.battery_pct);
+  if (!due) {
+    report_filter_.suppressed(ReportChannel::kTemperature);
+    report_filter_.suppressed(ReportChannel::kHumidity);
+    report_filter_.suppressed(ReportChannel::kBattery);
+    info("sensor values within deadbands, not connecting");
+  }
+  return due;
+}
+
+// samples logged on previous wakes, in one message
+void App::_publish_sensor_log() {
+  _confirm_sensor_log();
+  size_t samples = sensor_log_.size();
+  if (samples == 0) return;
+  uint32_t interval_s = device_state_.sensor_interval() * 60;
+  uint32_t now = SensorLog::now_s();
+  uint32_t payload_hash = network_.publish_confirmed(
+      topics_.t_sensor_log(),
+      [&](Print& out) { sensor_log_.write_batch(out, interval_s, now); });
+  sensor_log_upload_ = {payload_hash, samples};
+  debug("sensor log queued: %u samples", samples);
+}
+
+// removes the samples of the last upload if it was sent, else they are
+// uploaded again with the next batch
+void App::_confirm_sensor_log() {
+  if (sensor_log_upload_.samples == 0) return;
+  if (network_.sent(sensor_log_upload_.payload_hash)) {
+    sensor_log_.remove(sensor_log_upload_.samples);
+    debug("sensor log sent: %u samples", sensor_log_upload_.samples);
+  } else {
+    warning("sensor log not sent, %u samples kept",
+            sensor_log_upload_.samples);
+  }
+  sensor_log_upload_ = {};
 }
 #endif
 
 #if defined(HAS_BATTERY)
-void App::_publish_battery() {
-  network_.publish(topics_.t_battery(),
-                   PayloadType("%u", device_state_.sensors().battery_pct));
+void App::_publish_battery(bool force) {
+  uint8_t battery_pct = device_state_.sensors().battery_pct;
+  if (_report(ReportChannel::kBattery, battery_pct, force)) {
+    network_.publish(topics_.t_battery(), PayloadType("%u", battery_pct));
+  }
 }
 #endif
 
 #if defined(HAS_AWAKE_MODE)
 void App::_publish_awake_mode_avlb() {
   if (hw_.is_dc_connected()) {
-    network_.publish(topics_.t_awake_mode_avlb(), "online", true);
+    network_.publish_if_changed(topics_.t_awake_mode_avlb(), "online");
   } else {
-    network_.publish(topics_.t_awake_mode_avlb(), "offline", true);
+    network_.publish_if_changed(topics_.t_awake_mode_avlb(), "offline");
   }
 }
 #endif
 
 void App::_mqtt_callback(const char* topic, const char* payload) {
+  if (MQTT_REANNOUNCE_ON_HA_BIRTH &&
+      strcmp(topic, topics_.t_ha_status()) == 0) {
+    if (strcmp(payload, "online") == 0) {
+      info("Home Assistant online, sending discovery config...");
+      network_.reset_retained_ledger();
+      mqtt_.send_discovery_config();
+      _publish_retained_states();
 #if defined(HAS_TH_SENSOR)
-  if (strcmp(topic, topics_.t_sensor_interval_cmd().c_str()) == 0) {
-    uint16_t mins = atoi(payload);
-    if (mins >= SEN_INTERVAL_MIN && mins <= SEN_INTERVAL_MAX) {
-      device_state_.set_sensor_interval(mins);
-      device_state_.save_all();
-      network_.publish(topics_.t_sensor_interval_state(),
-                       PayloadType("%u", device_state_.sensor_interval()),
-                       true);
-      info("Updating discovery config...");
-      mqtt_.update_discovery_config();
-      debug("sensor interval set to %d minutes", mins);
-      _publish_sensors();
+      _publish_sensors(true);
+#endif
+      _publish_system_state(true);
     }
-    network_.publish(topics_.t_sensor_interval_cmd(), "", true);
     return;
   }
-#endif
 
-#if defined(HAS_DISPLAY)
-  for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
-    if (strcmp(topic, topics_.t_btn_label_cmd(i + 1).c_str()) == 0) {
-      ButtonLabel new_label(payload);
-      new_label = new_label.trim();
-      debug("button %d label changed to: %s", i + 1, new_label.c_str());
-      device_state_.set_btn_label(i + 1, new_label.c_str());
-
-      network_.publish(topics_.t_btn_label_state(i + 1),
-                       device_state_.get_btn_label(i + 1), true);
-      network_.publish(topics_.t_btn_label_cmd(i + 1), "", true);
-      device_state_.flags().display_redraw = true;
-      device_state_.save_all();
+  const char* cmd = topics_.t_cmd();
+  size_t cmd_len = strlen(cmd);
+  if (strncmp(topic, cmd, cmd_len) != 0) return;
 
-      ButtonLabel label(device_state_.get_btn_label(i + 1).c_str());
+  uint8_t id;
+  const auto* entry = find_cmd(MqttCmds<App>::kTable, topic + cmd_len, id);
+  if (entry == nullptr) {
+    debug("unknown cmd: %s", topic + cmd_len);
+    return;
+  }
+  (this->*entry->handler)(id, payload);
+}
 
-      if (label.substring(0, 4) == "mdi:") {
-        device_state_.persisted().download_mdi_icons = true;
+void App::_cmd_discovery_mode(uint8_t, const char* payload) {
+  bool device = strcmp(payload, "device") == 0;
+  if (device || strcmp(payload, "entity") == 0) {
+    device_state_.set_device_discovery(device);
+    device_state_.save_all();
+    info("Updating discovery config...");
+    mqtt_.send_discovery_config();
+    debug("discovery mode set to: %s", payload);
+  }
+  network_.publish(topics_.t_discovery_mode_cmd(), "", true);
+}
+
+// partial updates are accepted, e.g.
+// {"temperature":{"abs":0.5,"rel":0},"heartbeat":30}
+void App::_cmd_report_config(uint8_t, const char* payload) {
+  if (payload[0] == '\0') return;  // cleared below
+  StaticJsonDocument<384> doc;
+  DeserializationError json_error = deserializeJson(doc, payload);
+  if (json_error != DeserializationError::Ok) {
+    warning("invalid report config: %s", json_error.c_str());
+  } else {
+    for (size_t i = 0; i < static_cast<size_t>(ReportChannel::kNumChannels);
+         i++) {
+      ReportChannel channel = static_cast<ReportChannel>(i);
+      const char* name = ReportFilter::channel_name(channel);
+      JsonVariant band_json = doc[name];
+      if (band_json.isNull()) continue;
+      Deadband band = device_state_.deadband(channel);
+      if (!band_json["abs"].isNull()) band.abs = band_json["abs"].as<float>();
+      if (!band_json["rel"].isNull()) band.rel = band_json["rel"].as<float>();
+      if (band.abs < 0 || band.rel < 0 || band.rel > 100) {
+        warning("invalid %s deadband", name);
+        continue;
       }
-      return;
+      device_state_.set_deadband(channel, band);
+      debug("%s deadband set to %f abs, %f %% rel", name, band.abs, band.rel);
     }
+    if (!doc["heartbeat"].isNull()) {
+      uint32_t heartbeat = doc["heartbeat"].as<uint32_t>();
+      if (heartbeat >= 1 && heartbeat <= REPORT_HEARTBEAT_MAX) {
+        device_state_.set_report_heartbeat(heartbeat);
+        debug("report heartbeat set to %u minutes", heartbeat);
+      } else {
+        warning("invalid report heartbeat: %u", heartbeat);
+      }
+    }
+    device_state_.save_all();
+    _publish_report_config();
+    // expire_after follows the heartbeat
+    mqtt_.update_discovery_config();
   }
+  network_.publish(topics_.t_report_config_cmd(), "", true);
+}
+
+#if defined(HAS_BUTTON_UI)
+// one char per button: 'B' button, 'S' switch (industrial), 'I' instant
+void App::_cmd_btn_conf(uint8_t, const char* payload) {
+  if (payload[0] == '\0') return;  // cleared below
+  if (strlen(payload) > BTN_CONF_LEN) {
+    warning("invalid btn conf: %s", payload);
+  } else {
+    device_state_.set_btn_conf_string(BtnConfString{payload});
+    device_state_.save_all();
+    // published by _publish_btn_conf() once applied
+    _apply_btn_conf();
+  }
+  network_.publish(topics_.t_btn_conf_cmd(), "", true);
+}
+
+// network task, after the UI task applied a button config
+void App::_publish_btn_conf() {
+  // the config applied when the buttons start is published on connect
+  if (network_.get_state() != Network::State::M_CONNECTED) return;
+  network_.publish_if_changed(
+      topics_.t_btn_conf_state(),
+      device_state_.user_preferences().btn_conf_string.c_str());
+  info("Updating discovery config...");
+  mqtt_.update_discovery_config();
+}
 #endif
 
-#if defined(HAS_AWAKE_MODE)
-  if (strcmp(topic, topics_.t_awake_mode_cmd().c_str()) == 0) {
-    if (strcmp(payload, "ON") == 0) {
-      device_state_.persisted().user_awake_mode = true;
-      device_state_.flags().awake_mode = true;
-      device_state_.save_all();
-      network_.publish(topics_.t_awake_mode_state(), "ON", true);
-      debug("user awake mode set to: ON");
-      debug("resetting to awake mode...");
-    } else if (strcmp(payload, "OFF") == 0) {
-      device_state_.persisted().user_awake_mode = false;
-      device_state_.save_all();
-      network_.publish(topics_.t_awake_mode_state(), "OFF", true);
-      debug("user awake mode set to: OFF");
-    }
-    network_.publish(topics_.t_awake_mode_cmd(), "", true);
-    return;
+#if defined(HAS_TH_SENSOR)
+void App::_cmd_sensor_interval(uint8_t, const char* payload) {
+  uint16_t mins = atoi(payload);
+  if (mins >= SEN_INTERVAL_MIN && mins <= SEN_INTERVAL_MAX) {
+    device_state_.set_sensor_interval(mins);
+    device_state_.save_all();
+    network_.publish_if_changed(
+        topics_.t_sensor_interval_state(),
+        PayloadType("%u", device_state_.sensor_interval()));
+    info("Updating discovery config...");
+    mqtt_.update_discovery_config();
+    debug("sensor interval set to %d minutes", mins);
+    _publish_sensors(true);
   }
+  network_.publish(topics_.t_sensor_interval_cmd(), "", true);
+}
+#endif
+
+#if defined(HAS_SENSOR_BATCH)
+void App::_cmd_sensor_batch(uint8_t, const char* payload) {
+  uint16_t batch = atoi(payload);
+  if (batch >= 1 && batch <= SENSOR_BATCH_MAX) {
+    device_state_.set_sensor_batch(batch);
+    device_state_.save_all();
+    network_.publish_if_changed(
+        topics_.t_sensor_batch_state(),
+        PayloadType("%u", device_state_.sensor_batch()));
+    info("Updating discovery config...");
+    mqtt_.update_discovery_config();
+    debug("sensor batch set to %u samples", batch);
+  }
+  network_.publish(topics_.t_sensor_batch_cmd(), "", true);
+}
 #endif
 
 #if defined(HAS_DISPLAY)
-  // user message
-  if (strcmp(topic, topics_.t_disp_msg_cmd().c_str()) == 0) {
-    if (display_.get_ui_state().page == DisplayPage::MAIN) {
-      UserMessage msg(payload);
-      device_state_.persisted().user_msg_showing = true;
-      device_state_.save_all();
-      display_.disp_message_large(msg.c_str());
-    }
-    network_.publish(topics_.t_disp_msg_cmd(), "", true);
-    network_.publish(topics_.t_disp_msg_state(), "-", false);
+void App::_cmd_btn_label(uint8_t id, const char* payload) {
+  if (id < 1 || id > NUM_BUTTONS) return;
+  ButtonLabel new_label(payload);
+  new_label = new_label.trim();
+  debug("button %d label changed to: %s", id, new_label.c_str());
+  device_state_.set_btn_label(id, new_label.c_str());
+
+  network_.publish_if_changed(topics_.t_btn_label_state(id),
+                              device_state_.get_btn_label(id));
+  network_.publish(topics_.t_btn_label_cmd(id), "", true);
+  device_state_.save_all();
+
+  ButtonLabel label(device_state_.get_btn_label(id).c_str());
+
+  if (label.substring(0, 4) == "mdi:") {
+    device_state_.persisted().download_mdi_icons = true;
+  }
+}
+
+void App::_cmd_disp_msg(uint8_t, const char* payload) {
+  if (display_.get_ui_state().page == DisplayPage::MAIN) {
+    UserMessage msg(payload);
+    device_state_.persisted().user_msg_showing = true;
+    device_state_.save_all();
+    display_.disp_message_large(msg.c_str());
   }
+  network_.publish(topics_.t_disp_msg_cmd(), "", true);
+  network_.publish(topics_.t_disp_msg_state(), "-", false);
+}
+#endif
+
+#if defined(HAS_AWAKE_MODE)
+void App::_cmd_awake_mode(uint8_t, const char* payload) {
+  if (strcmp(payload, "ON") == 0) {
+    device_state_.persisted().user_awake_mode = true;
+    device_state_.set_awake_mode(true);
+    device_state_.save_all();
+    network_.publish_if_changed(topics_.t_awake_mode_state(), "ON");
+    debug("user awake mode set to: ON");
+    debug("resetting to awake mode...");
+  } else if (strcmp(payload, "OFF") == 0) {
+    device_state_.persisted().user_awake_mode = false;
+    device_state_.save_all();
+    network_.publish_if_changed(topics_.t_awake_mode_state(), "OFF");
+    debug("user awake mode set to: OFF");
+  }
+  network_.publish(topics_.t_awake_mode_cmd(), "", true);
+}
 #endif
 
 #if defined(HAS_SLEEP_MODE)
-  // schedule wakeup cmd
-  if (strcmp(topic, topics_.t_schedule_wakeup_cmd().c_str()) == 0) {
-    uint32_t secs = atoi(payload);
-    if (secs >= SCHEDULE_WAKEUP_MIN && secs <= SCHEDULE_WAKEUP_MAX) {
-      device_state_.flags().schedule_wakeup_time = secs;
-      network_.publish(topics_.t_schedule_wakeup_cmd(), "", true);
-      network_.publish(topics_.t_schedule_wakeup_state(), "None", true);
-      debug("schedule wakeup set to %d seconds", secs);
-    }
+void App::_cmd_schedule_wakeup(uint8_t, const char* payload) {
+  uint32_t secs = atoi(payload);
+  if (secs >= SCHEDULE_WAKEUP_MIN && secs <= SCHEDULE_WAKEUP_MAX) {
+    device_state_.set_schedule_wakeup_time(secs);
+    network_.publish(topics_.t_schedule_wakeup_cmd(), "", true);
+    network_.publish(topics_.t_schedule_wakeup_state(), "None", true);
+    debug("schedule wakeup set to %d seconds", secs);
   }
+}
 #endif
 
 #if defined(HOME_BUTTONS_INDUSTRIAL)
-  // led amb_bright cmd
-  if (strcmp(topic, topics_.t_led_amb_bright_cmd().c_str()) == 0) {
-    uint16_t amb_bright = atoi(payload);
-    if (amb_bright <= LED_MAX_AMB_BRIGHT) {
-      device_state_.set_led_brightness(amb_bright);
-      device_state_.save_all();
-      bsl_input_.LEDSetAmbientBrightnessAll(amb_bright);
-      bsl_input_.LEDSetDefaultBrightnessAll(
-          amb_bright * (LED_DFLT_BRIGHT / LED_MAX_AMB_BRIGHT));
-      network_.publish(topics_.t_led_amb_bright_state(),
-                       PayloadType("%u", amb_bright), true);
-      debug("LED amb_bright set to %d", amb_bright);
-    } else {
-      warning("Invalid amb_bright value: %d", amb_bright);
-    }
-    network_.publish(topics_.t_led_amb_bright_cmd(), "", true);
-    return;
+void App::_cmd_led_amb_bright(uint8_t, const char* payload) {
+  uint16_t amb_bright = atoi(payload);
+  if (amb_bright <= LED_MAX_AMB_BRIGHT) {
+    device_state_.set_led_brightness(amb_bright);
+    device_state_.save_all();
+    bsl_input_.LEDSetAmbientBrightnessAll(amb_bright);
+    bsl_input_.LEDSetDefaultBrightnessAll(
+        amb_bright * (LED_DFLT_BRIGHT / LED_MAX_AMB_BRIGHT));
+    network_.publish_if_changed(topics_.t_led_amb_bright_state(),
+                                PayloadType("%u", amb_bright));
+    debug("LED amb_bright set to %d", amb_bright);
+  } else {
+    warning("Invalid amb_bright value: %d", amb_bright);
   }
+  network_.publish(topics_.t_led_amb_bright_cmd(), "", true);
+}
 
-  // switch cmd
+void App::_cmd_switch(uint8_t id, const char* payload) {
   for (auto bsl_w : bsl_input_.GetBtnSwLEDs()) {
-    if (bsl_w.get().switch_mode() && !bsl_w.get().is_kill_switch()) {
-      if (strcmp(topic, topics_.t_switch_cmd(bsl_w.get().id()).c_str()) == 0) {
-        if (strcmp(payload, "ON") == 0) {
-          bsl_w.get().SetSwitchOn();
-          network_.publish(topics_.t_switch_state(bsl_w.get().id()), "ON",
-                           false);
-        } else if (strcmp(payload, "OFF") == 0) {
-          network_.publish(topics_.t_switch_state(bsl_w.get().id()), "OFF",
-                           false);
-          bsl_w.get().SetSwitchOff();
-        }
-        network_.publish(topics_.t_switch_cmd(bsl_w.get().id()), "", true);
-        return;
-      }
+    BtnSwLED& bsl = bsl_w.get();
+    if (bsl.id() != id || !bsl.switch_mode() || bsl.is_kill_switch()) {
+      continue;
+    }
+    if (strcmp(payload, "ON") == 0) {
+      bsl.SetSwitchOn();
+      network_.publish(topics_.t_switch_state(id), "ON", false);
+    } else if (strcmp(payload, "OFF") == 0) {
+      network_.publish(topics_.t_switch_state(id), "OFF", false);
+      bsl.SetSwitchOff();
     }
+    network_.publish(topics_.t_switch_cmd(id), "", true);
+    return;
   }
-#endif
 }
+#endif
 
-void App::_net_on_connect() {
-  if (device_state_.persisted().send_discovery_config) {
-    device_state_.persisted().send_discovery_config = false;
-    info("Sending discovery config...");
-    mqtt_.send_discovery_config();
+void App::_publish_report_config() {
+  char buffer[MQTT_PYLD_SIZE];
+  MemoryPrint out(buffer, sizeof(buffer) - 1);
+  JsonWriter json(out);
+  json.begin_object();
+  for (size_t i = 0; i < static_cast<size_t>(ReportChannel::kNumChannels);
+       i++) {
+    ReportChannel channel = static_cast<ReportChannel>(i);
+    const Deadband& band = device_state_.deadband(channel);
+    json.begin_object(ReportFilter::channel_name(channel))
+        .add("abs", band.abs)
+        .add("rel", band.rel)
+        .end_object();
   }
+  json.add("heartbeat", device_state_.report_heartbeat());
+  json.end_object();
+  buffer[out.size()] = '\0';
+  network_.publish_if_changed(topics_.t_report_config_state(), buffer);
+}
 
-  network_.subscribe(topics_.t_cmd() + "#");
+// unchanged states are skipped by the retained ledger
+void App::_publish_retained_states() {
+  _publish_report_config();
+#if defined(HAS_BUTTON_UI)
+  network_.publish_if_changed(
+      topics_.t_btn_conf_state(),
+      device_state_.user_preferences().btn_conf_string.c_str());
+#endif
 #if defined(HAS_AWAKE_MODE)
   _publish_awake_mode_avlb();
-  network_.publish(topics_.t_awake_mode_state(),
-                   (device_state_.persisted().user_awake_mode) ? "ON" : "OFF",
-                   true);
+  network_.publish_if_changed(
+      topics_.t_awake_mode_state(),
+      (device_state_.persisted().user_awake_mode) ? "ON" : "OFF");
 #endif
 #if defined(HAS_TH_SENSOR)
-  network_.publish(topics_.t_sensor_interval_state(),
-                   PayloadType("%u", device_state_.sensor_interval()), true);
+  network_.publish_if_changed(
+      topics_.t_sensor_interval_state(),
+      PayloadType("%u", device_state_.sensor_interval()));
+#endif
+#if defined(HAS_SENSOR_BATCH)
+  network_.publish_if_changed(topics_.t_sensor_batch_state(),
+                              PayloadType("%u", device_state_.sensor_batch()));
 #endif
 #if defined(HAS_DISPLAY)
   for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
-    auto t = topics_.t_btn_label_state(i + 1);
-    network_.publish(t, device_state_.get_btn_label(i + 1), true);
+    network_.publish_if_changed(topics_.t_btn_label_state(i + 1),
+                                device_state_.get_btn_label(i + 1));
   }
+#endif
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+  network_.publish_if_changed(
+      topics_.t_led_amb_bright_state(),
+      PayloadType("%u", device_state_.user_preferences().led_amb_bright));
+#endif
+}
+
+void App::_net_on_connect() {
+  if (device_state_.persisted().send_discovery_config) {
+    device_state_.persisted().send_discovery_config = false;
+    info("Sending discovery config...");
+    mqtt_.send_discovery_config();
+  }
+
+  _replay_journaled_events();
+
+  network_.subscribe(TopicType(topics_.t_cmd()) + "#");
+  if (MQTT_REANNOUNCE_ON_HA_BIRTH) {
+    network_.subscribe(TopicType(topics_.t_ha_status()));
+  }
+  _publish_retained_states();
+#if defined(HAS_DISPLAY)
   network_.publish(topics_.t_disp_msg_state(), "-", false);
 #endif
 
 #if defined(HOME_BUTTONS_INDUSTRIAL)
-  network_.publish(
-      topics_.t_led_amb_bright_state(),
-      PayloadType("%u", device_state_.user_preferences().led_amb_bright, true));
   network_.publish(topics_.t_avlb(), "online", true);
   for (auto bsl_w : bsl_input_.GetBtnSwLEDs()) {
     // publish switch state is switch mode
@@ -912,6 +1243,12 @@ void App::_net_on_connect() {
   }
 #endif
 
+  // timings of the wake cycles since the last connection
+  if (WakeProfiler::pending() > 0) {
+    network_.publish(topics_.t_wake_metrics(), WakeProfiler::write_pending);
+    WakeProfiler::mark_published();
+  }
+
 #if defined(HAS_DISPLAY)
   if (device_state_.persisted().download_mdi_icons) {
     device_state_.persisted().download_mdi_icons = false;
@@ -950,7 +1287,7 @@ void App::_download_mdi_icons() {
     warning("icon server NOT reachable");
     mdi_.end();
     display_.disp_error("Icon\nserver\nNOT\nreachable");
-    device_state_.flags().display_redraw = true;
+    device_state_.request_redraw();
     return;
   }
 
@@ -978,22 +1315,215 @@ void App::_download_mdi_icons() {
     }
   }
   mdi_.end();
-  device_state_.flags().display_redraw = true;
+  device_state_.request_redraw();
+}
+
+bool App::_display_outdated() const {
+  return device_state_.display_version() != drawn_display_version_;
+}
+
+void App::_redraw_main() {
+  // taken before the draw, changes during it cause another redraw
+  drawn_display_version_ = device_state_.display_version();
+  display_.disp_main();
 }
 #endif
 
+void AppSMStates::BootState::entry() {
+  if (sm().batt_recheck_) {
+    // the voltage may have sagged under load, check again before turning off
+    return _next(BootStep::kBatteryCheck, BATT_RECHECK_DELAY);
+  }
+  _handle_boot_cause();
+}
+
+void AppSMStates::BootState::loop() {
+  if (!_ready()) return;
+  auto& persisted = sm().device_state_.persisted();
+  switch (sm().boot_step_) {
+#if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
+    case BootStep::kBatteryCheck:
+      sm().batt_recheck_ = false;
+      if (sm().hw_.read_battery_voltage() >= sm().hw_.MIN_BATT_VOLT) {
+        return _handle_boot_cause();
+      }
+      persisted.low_batt_mode = true;
+      sm().warning("batt voltage too low, low bat mode enabled");
+#if defined(HOME_BUTTONS_ORIGINAL)
+      sm().display_.disp_message_large(
+          "Turned\nOFF\n\nPlease\nrecharge\nbattery!");
+#else
+      sm().display_.disp_message_large(
+          "Turned\nOFF\n\nPlease\nreplace\nbatteries!");
+#endif
+      return _next(BootStep::kEndDisplay);
+#endif
+    case BootStep::kIconStorage:
+#if defined(HAS_DISPLAY)
+      if (!SPIFFS.begin()) {
+        sm().info("Formatting icon storage...");
+        sm().display_.disp_message("Formatting\nIcon\nStorage...", 0);
+        return _next(BootStep::kFormatIconStorage);
+      }
+      SPIFFS.end();
+      sm().debug("SPIFFS test mount OK");
+#endif
+      return _next(BootStep::kSetupCheck);
+#if defined(HAS_DISPLAY)
+    case BootStep::kFormatIconStorage:
+      SPIFFS.format();
+      return _next(BootStep::kSetupCheck);
+#endif
+    case BootStep::kSetupCheck:
+      // check if restart to setup or Wi-Fi setup is needed
+      if (persisted.restart_to_wifi_setup) {
+        sm().device_state_.clear_persisted_flags();
+        sm().info("staring Wi-Fi setup...");
+        sm().setup_.start_wifi_setup();  // resets ESP when done
+      } else if (persisted.restart_to_setup) {
+        sm().device_state_.clear_persisted_flags();
+        sm().info("staring setup...");
+        sm().setup_.start_setup();  // resets ESP when done
+      }
+
+      sm().device_state_.clear_persisted_flags();
+
+      if (!persisted.wifi_done || !persisted.setup_done) {
+#if defined(HAS_DISPLAY)
+        sm().display_.disp_welcome();
+        return _next(BootStep::kEndDisplay);
+#elif defined(HAS_SLEEP_MODE)
+        sm()._go_to_sleep();
+#endif
+      } else {
+#if defined(HAS_DISPLAY)
+        sm().display_.disp_main();
+#endif
+      }
+      return _next(BootStep::kRestartDone);
+    case BootStep::kRestartDone:
+      persisted.download_mdi_icons = true;
+      persisted.send_discovery_config = true;
+      sm().device_state_.save_all();
+      if (!sm().device_state_.flags().awake_mode) {
+        return _next(BootStep::kEndDisplay);
+      }
+      // proceed with awake mode
+#if defined(HAS_BUTTON_UI)
+      sm().bsl_input_.LEDOffAll();
+#elif defined(HAS_FRONTLIGHT)
+      sm().hw_.set_frontlight(0);
+#endif
+      return _done();
+    case BootStep::kEndDisplay:
+#if defined(HAS_DISPLAY)
+      sm().display_.end();
+#endif
+      return _next(BootStep::kSleep);
+    case BootStep::kSleep:
+#if defined(HAS_SLEEP_MODE)
+      sm()._go_to_sleep();
+#endif
+      // without sleep mode, continue after the welcome screen
+      return _next(BootStep::kRestartDone);
+    default:
+      return _done();
+  }
+}
+
+void AppSMStates::BootState::_handle_boot_cause() {
+  auto& persisted = sm().device_state_.persisted();
+  switch (sm().boot_cause_) {
+    case BootCause::RESET:
+      if (!persisted.silent_restart) {
+#if defined(HAS_BUTTON_UI)
+        sm().bsl_input_.LEDOnAll();
+#endif
+#if defined(HAS_FRONTLIGHT)
+        sm().hw_.set_frontlight(sm().hw_.FL_LED_BRIGHT_DFLT);
+#endif
+#if defined(HAS_DISPLAY)
+        sm().display_.disp_message("RESTART...", 0);
+#endif
+        return _next(BootStep::kIconStorage, RESTART_LED_TIME);
+      }
+      return _next(BootStep::kIconStorage);
+#if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
+    case BootCause::BUTTON:
+      if (sm().device_state_.flags().awake_mode) {
+        // proceed with awake mode
+        break;
+      }
+      if (persisted.charge_complete_showing) {
+        persisted.charge_complete_showing = false;
+      } else if (persisted.user_msg_showing) {
+        persisted.user_msg_showing = false;
+      } else if (persisted.check_connection) {
+        persisted.check_connection = false;
+      } else {
+        // proceed
+        break;
+      }
+      sm().display_.disp_main();
+      return _next(BootStep::kEndDisplay);
+#endif
+#if defined(HOME_BUTTONS_ORIGINAL)
+    case BootCause::TIMER:
+      if (sm().device_state_.flags().awake_mode) {
+        // proceed with awake mode
+      } else {
+        // hw <= 2.1 doesn't have awake mode when charging
+        if (sm().hw_.is_charger_in_standby()) {
+          if (!persisted.charge_complete_showing) {
+            persisted.charge_complete_showing = true;
+            sm().display_.disp_message_large("Fully\ncharged!");
+          }
+        }
+        // proceed with sensor publish
+      }
+      break;
+#endif
+    default:
+      break;
+  }
+  _done();
+}
+
+// runs the step once wait_ms passed and the display finished the last
+// command, or ended before kSleep
+void AppSMStates::BootState::_next(BootStep step, uint32_t wait_ms) {
+  sm().boot_step_ = step;
+  sm().boot_step_time_ = millis();
+  sm().boot_step_wait_ = wait_ms;
+}
+
+bool AppSMStates::BootState::_ready() {
+  uint32_t elapsed = millis() - sm().boot_step_time_;
+  if (elapsed < sm().boot_step_wait_) return false;
+#if defined(HAS_DISPLAY)
+  bool settled = sm().boot_step_ == BootStep::kSleep
+                     ? sm().display_.get_state() == Display::State::IDLE
+                     : !sm().display_.pending();
+  if (!settled) {
+    if (elapsed < BOOT_DISPLAY_TIMEOUT) return false;
+    sm().warning("display not done after %u ms, continuing", elapsed);
+  }
+#endif
+  return true;
+}
+
+void AppSMStates::BootState::_done() {
+  sm().boot_step_ = BootStep::kDone;
+  WakeProfiler::mark(WakePhase::kBootDone);
+  transition_to<InitState>();
+}
+
 void AppSMStates::InitState::entry() {
   sm().network_.connect();
+#if defined(HAS_WAKE_STUB)
+  sm()._replay_wake_press();
+#else
   sm().bsl_input_.InitPress(sm().wakeup_btn_id_);
-
-#if defined(HOME_BUTTONS_ORIGINAL)
-  sm().mdi_.add_size(64);
-  sm().mdi_.add_size(48);
-#elif defined(HOME_BUTTONS_MINI)
-  sm().mdi_.add_size(100);
-#elif defined(HOME_BUTTONS_PRO)
-  sm().mdi_.add_size(92);
-  sm().mdi_.add_size(64);
 #endif
 
 #if defined(HOME_BUTTONS_INDUSTRIAL)
@@ -1028,6 +1558,11 @@ void AppSMStates::InitState::entry() {
     sm().device_state_.persisted().charge_complete_showing = false;
     esp_task_wdt_init(WDT_TIMEOUT_AWAKE, true);
     esp_task_wdt_add(NULL);
+    // sleep mode wakes stay at full speed, they are short anyway
+    if (Power::enable_dfs(AWAKE_CPU_FREQ_MAX, AWAKE_CPU_FREQ_MIN)) {
+      sm().info("CPU frequency scaling %u-%u MHz", AWAKE_CPU_FREQ_MIN,
+                AWAKE_CPU_FREQ_MAX);
+    }
 #if defined(HAS_DISPLAY)
     sm().display_.disp_main();
 #endif
@@ -1039,32 +1574,37 @@ void AppSMStates::AwakeModeIdleState::entry() {
 #if defined(HAS_DISPLAY)
   sm().display_.disp_main();
 #endif
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(
-      &AwakeModeIdleState::handle_ui_event, this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &AwakeModeIdleState::handle_ui_event, this, std::placeholders::_1));
-#endif
+  sm()._set_ui_handler(std::bind(&AwakeModeIdleState::handle_ui_event, this,
+                                 std::placeholders::_1));
 }
 
 void AppSMStates::AwakeModeIdleState::exit() {
-  sm().bsl_input_.ClearEventCallback();
+  sm()._clear_ui_handler();
 }
 
 void AppSMStates::AwakeModeIdleState::loop() {
+  // sleep until the next timer, UI events and MQTT commands notify the
+  // main task, DC and charger are polled
+  Scheduler& scheduler = sm().main_scheduler_;
+  scheduler.wake_at(sm().last_sensor_publish_ + AWAKE_SENSOR_INTERVAL);
+#if defined(HAS_DISPLAY)
+  scheduler.wake_at(sm().last_m_display_redraw_ + AWAKE_REDRAW_INTERVAL);
+#endif
+  scheduler.wake_in(AWAKE_POLL_INTERVAL);
+
+  // values are only published when they change, see ReportFilter
   if (millis() - sm().last_sensor_publish_ >= AWAKE_SENSOR_INTERVAL) {
+#if defined(HAS_BATTERY)
+    sm().device_state_.set_battery(sm().hw_.read_battery_percent(),
+                                   sm().hw_.read_battery_voltage());
+#endif
 #if defined(HAS_TH_SENSOR)
-    sm().hw_.read_temp_hmd(sm().device_state_.sensors().temperature,
-                           sm().device_state_.sensors().humidity,
+    float temperature, humidity;
+    sm().hw_.read_temp_hmd(temperature, humidity,
                            sm().device_state_.get_use_fahrenheit());
+    sm().device_state_.set_temp_hmd(temperature, humidity);
     sm()._publish_sensors();
-#endif
-
-#if defined(HAS_BATTERY)
-    sm().device_state_.sensors().battery_pct = sm().hw_.read_battery_percent();
-    sm().device_state_.sensors().battery_voltage =
-        sm().hw_.read_battery_voltage();
+#elif defined(HAS_BATTERY)
     sm()._publish_battery();
 #endif
     sm().last_sensor_publish_ = millis();
@@ -1076,13 +1616,12 @@ void AppSMStates::AwakeModeIdleState::loop() {
 
 #if defined(HAS_DISPLAY)
   if (millis() - sm().last_m_display_redraw_ >= AWAKE_REDRAW_INTERVAL) {
-    if (sm().device_state_.flags().display_redraw) {
-      sm().device_state_.flags().display_redraw = false;
+    if (sm()._display_outdated()) {
       if (sm().device_state_.persisted().download_mdi_icons) {
         sm()._download_mdi_icons();
         sm().device_state_.persisted().download_mdi_icons = false;
       }
-      sm().display_.disp_main();
+      sm()._redraw_main();
     }
     sm().last_m_display_redraw_ = millis();
   }
@@ -1098,12 +1637,12 @@ void AppSMStates::AwakeModeIdleState::loop() {
 #if defined(HAS_CHARGER)
   else if (!sm().hw_.is_dc_connected()) {
     sm()._publish_awake_mode_avlb();
-    sm().device_state_.sensors().charging = false;
+    sm().device_state_.set_charging(false);
     return transition_to<CmdShutdownState>();
   }
   if (sm().device_state_.sensors().charging) {
     if (sm().hw_.is_charger_in_standby()) {
-      sm().device_state_.sensors().charging = false;
+      sm().device_state_.set_charging(false);
       sm().display_.disp_main();
       if (!sm().device_state_.persisted().user_awake_mode) {
         return transition_to<CmdShutdownState>();
@@ -1118,7 +1657,7 @@ void AppSMStates::AwakeModeIdleState::loop() {
 }
 
 void AppSMStates::AwakeModeIdleState::handle_ui_event(UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
 #if defined(HAS_FRONTLIGHT)
   sm().hw_.set_frontlight(sm().hw_.FL_LED_BRIGHT_DFLT);
 #endif
@@ -1164,17 +1703,12 @@ void AppSMStates::AwakeModeIdleState::handle_ui_event(UserInput::Event event) {
 
 void AppSMStates::SleepModeHandleInput::entry() {
   sm().input_start_time_ = millis();
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(
-      &SleepModeHandleInput::handle_ui_event, this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &SleepModeHandleInput::handle_ui_event, this, std::placeholders::_1));
-#endif
+  sm()._set_ui_handler(std::bind(&SleepModeHandleInput::handle_ui_event, this,
+                                 std::placeholders::_1));
 }
 
 void AppSMStates::SleepModeHandleInput::exit() {
-  sm().bsl_input_.ClearEventCallback();
+  sm()._clear_ui_handler();
 }
 
 void AppSMStates::SleepModeHandleInput::loop() {
@@ -1185,7 +1719,7 @@ void AppSMStates::SleepModeHandleInput::loop() {
 
 void AppSMStates::SleepModeHandleInput::handle_ui_event(
     UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
   if (event.final) {
     switch (event.type) {
       case UserInput::EventType::kClickSingle:
@@ -1239,17 +1773,12 @@ void AppSMStates::SleepModeHandleInput::handle_ui_event(
 }
 
 void AppSMStates::NetConnectingState::entry() {
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(
-      &NetConnectingState::handle_ui_event, this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &NetConnectingState::handle_ui_event, this, std::placeholders::_1));
-#endif
+  sm()._set_ui_handler(std::bind(&NetConnectingState::handle_ui_event, this,
+                                 std::placeholders::_1));
 }
 
 void AppSMStates::NetConnectingState::exit() {
-  sm().bsl_input_.ClearEventCallback();
+  sm()._clear_ui_handler();
 }
 
 void AppSMStates::NetConnectingState::loop() {
@@ -1258,21 +1787,23 @@ void AppSMStates::NetConnectingState::loop() {
     if (sm().user_event_.type != UserInput::EventType::kNone) {
       sm()._publish_ui_event(sm().user_event_);
     }
+    // battery and sensors were read in setup, before the radio started
 #if defined(HAS_TH_SENSOR)
-    sm().hw_.read_temp_hmd(sm().device_state_.sensors().temperature,
-                           sm().device_state_.sensors().humidity,
-                           sm().device_state_.get_use_fahrenheit());
     sm()._publish_sensors();
     sm()._publish_system_state();
-#endif
-#if defined(HAS_BATTERY)
-    sm().device_state_.sensors().battery_pct = sm().hw_.read_battery_percent();
+#elif defined(HAS_BATTERY)
     sm()._publish_battery();
 #endif
     sm().device_state_.persisted().failed_connections = 0;
     return transition_to<CmdShutdownState>();
 
   } else if (millis() >= NET_CONNECT_TIMEOUT) {
+    if (sm().user_event_.type != UserInput::EventType::kNone) {
+      // replayed on the next connection
+      sm().event_journal_.add(sm().user_event_);
+      sm().user_event_ = {};
+      sm().info("event journaled, %u waiting", sm().event_journal_.size());
+    }
 #if defined(HAS_DISPLAY)
     sm().warning("network connect timeout.");
     if (sm().boot_cause_ == BootCause::BUTTON) {
@@ -1293,7 +1824,7 @@ void AppSMStates::NetConnectingState::loop() {
 }
 
 void AppSMStates::NetConnectingState::handle_ui_event(UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
   if (event.final) {
     switch (event.type) {
       case UserInput::EventType::kClickSingle:
@@ -1310,21 +1841,18 @@ void AppSMStates::InfoScreenState::entry() {
 #if defined(HAS_DISPLAY)
   sm().info_screen_start_time_ = millis();
   sm().display_.disp_info();
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(&InfoScreenState::handle_ui_event,
-                                             this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().device_state_.flags().keep_frontlight_on = true;
+#if defined(HAS_TOUCH_UI)
+  sm().device_state_.set_keep_frontlight_on(true);
   sm().hw_.set_frontlight(sm().hw_.FL_LED_BRIGHT_DFLT);
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &InfoScreenState::handle_ui_event, this, std::placeholders::_1));
 #endif
+  sm()._set_ui_handler(std::bind(&InfoScreenState::handle_ui_event, this,
+                                 std::placeholders::_1));
 #endif
 }
 
 void AppSMStates::InfoScreenState::exit() {
-  sm().bsl_input_.ClearEventCallback();
-  sm().device_state_.flags().keep_frontlight_on = false;
+  sm()._clear_ui_handler();
+  sm().device_state_.set_keep_frontlight_on(false);
 }
 
 void AppSMStates::InfoScreenState::loop() {
@@ -1342,7 +1870,7 @@ void AppSMStates::InfoScreenState::loop() {
 }
 
 void AppSMStates::InfoScreenState::handle_ui_event(UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
   if (event.final) {
     switch (event.type) {
       case UserInput::EventType::kSwipeUp:
@@ -1369,20 +1897,17 @@ void AppSMStates::SettingsMenuState::entry() {
 #else
   sm().bsl_input_.LEDPulseAll(0, 2000);
 #endif
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(
-      &SettingsMenuState::handle_ui_event, this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().device_state_.flags().keep_frontlight_on = true;
+#if defined(HAS_TOUCH_UI)
+  sm().device_state_.set_keep_frontlight_on(true);
   sm().hw_.set_frontlight(sm().hw_.FL_LED_BRIGHT_DFLT);
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &SettingsMenuState::handle_ui_event, this, std::placeholders::_1));
 #endif
+  sm()._set_ui_handler(std::bind(&SettingsMenuState::handle_ui_event, this,
+                                 std::placeholders::_1));
 }
 
 void AppSMStates::SettingsMenuState::exit() {
-  sm().bsl_input_.ClearEventCallback();
-  sm().device_state_.flags().keep_frontlight_on = false;
+  sm()._clear_ui_handler();
+  sm().device_state_.set_keep_frontlight_on(false);
 #if !defined(HAS_DISPLAY)
   sm().bsl_input_.LEDOffAll();
 #endif
@@ -1403,7 +1928,7 @@ void AppSMStates::SettingsMenuState::loop() {
 }
 
 void AppSMStates::SettingsMenuState::handle_ui_event(UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
 #if defined(HAS_BUTTON_UI)
   if (event.final) {
     switch (event.type) {
@@ -1508,20 +2033,17 @@ void AppSMStates::DeviceInfoState::entry() {
 #if defined(HAS_DISPLAY)
   sm().display_.disp_device_info();
 #endif
-#if defined(HAS_BUTTON_UI)
-  sm().bsl_input_.SetEventCallback(std::bind(&DeviceInfoState::handle_ui_event,
-                                             this, std::placeholders::_1));
-#elif defined(HAS_TOUCH_UI)
-  sm().device_state_.flags().keep_frontlight_on = true;
+#if defined(HAS_TOUCH_UI)
+  sm().device_state_.set_keep_frontlight_on(true);
   sm().hw_.set_frontlight(sm().hw_.FL_LED_BRIGHT_DFLT);
-  sm().touch_handler_.SetEventCallback(std::bind(
-      &DeviceInfoState::handle_ui_event, this, std::placeholders::_1));
 #endif
+  sm()._set_ui_handler(std::bind(&DeviceInfoState::handle_ui_event, this,
+                                 std::placeholders::_1));
 }
 
 void AppSMStates::DeviceInfoState::exit() {
-  sm().bsl_input_.ClearEventCallback();
-  sm().device_state_.flags().keep_frontlight_on = false;
+  sm()._clear_ui_handler();
+  sm().device_state_.set_keep_frontlight_on(false);
 }
 
 void AppSMStates::DeviceInfoState::loop() {
@@ -1536,7 +2058,7 @@ void AppSMStates::DeviceInfoState::loop() {
 }
 
 void AppSMStates::DeviceInfoState::handle_ui_event(UserInput::Event event) {
-  sm().device_state_.flags().last_user_input_time = millis();
+  sm().device_state_.set_last_user_input_time(millis());
 #if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_MINI)
   if (event.final) {
     switch (event.type) {
@@ -1570,6 +2092,7 @@ void AppSMStates::CmdShutdownState::entry() {
     sm().display_.disp_main();
   }
 #endif
+  WakeProfiler::mark(WakePhase::kShutdown);
   sm().shutdown_cmd_time_ = millis();
 }
 
@@ -1594,10 +2117,10 @@ void AppSMStates::NetDisconnectingState::loop() {
   conditions = conditions && !sm().display_.busy();
 #endif
   if (conditions) {
+    WakeProfiler::mark(WakePhase::kNetDisconnected);
 #if defined(HAS_DISPLAY)
-    if (sm().device_state_.flags().display_redraw) {
-      sm().device_state_.flags().display_redraw = false;
-      sm().display_.disp_main();
+    if (sm()._display_outdated()) {
+      sm()._redraw_main();
     }
     sm().display_.end();
 #endif
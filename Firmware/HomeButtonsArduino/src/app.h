@@ -2,6 +2,7 @@
 #define HOMEBUTTONS_APP_H
 
 #include <array>
+#include <atomic>
 #include "state.h"
 #include "network.h"
 #include "mqtt_helper.h"
@@ -9,6 +10,13 @@
 #include "logger.h"
 #include "hardware.h"
 #include "setup.h"
+#include "utils.h"
+#include "cmd_dispatch.h"
+#include "event_journal.h"
+#include "sensor_log.h"
+#include "report_filter.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
 
 #if defined(HAS_DISPLAY)
 #include "display/display.h"
@@ -27,8 +35,37 @@ class App;
 
 enum class BootCause { RESET, TIMER, BUTTON };
 
+// restart and wake sequences that wait for the display or a timeout before
+// the state machine proper, in the order they usually run
+enum class BootStep : uint8_t {
+  kBatteryCheck,
+  kIconStorage,
+  kFormatIconStorage,
+  kSetupCheck,
+  kRestartDone,
+  kEndDisplay,
+  kSleep,
+  kDone
+};
+
 namespace AppSMStates {
 
+class BootState : public State<App> {
+ public:
+  using State<App>::State;
+
+  void entry() override;
+  void loop() override;
+
+  const char* get_name() override { return "BootState"; }
+
+ private:
+  void _handle_boot_cause();
+  void _next(BootStep step, uint32_t wait_ms = 0);
+  bool _ready();
+  void _done();
+};
+
 class InitState : public State<App> {
  public:
   using State<App>::State;
@@ -151,7 +188,8 @@ class FactoryResetState : public State<App> {
 }  // namespace AppSMStates
 
 using AppStateMachine = StateMachine<
-    App, AppSMStates::InitState, AppSMStates::AwakeModeIdleState,
+    App, AppSMStates::BootState, AppSMStates::InitState,
+    AppSMStates::AwakeModeIdleState,
     AppSMStates::SleepModeHandleInput, AppSMStates::NetConnectingState,
     AppSMStates::InfoScreenState, AppSMStates::SettingsMenuState,
     AppSMStates::DeviceInfoState, AppSMStates::CmdShutdownState,
@@ -171,8 +209,11 @@ class App : public AppStateMachine, public Logger {
 #endif
   void _sleep_or_restart();
   std::pair<BootCause, int16_t> _determine_boot_cause();
+#if defined(HAS_WAKE_STUB)
+  void _replay_wake_press();
+#endif
   void _log_task_stats();
-  void _publish_system_state();
+  void _publish_system_state(bool force = false);
 
   static void _ui_task(void* app);
   void _start_ui_task();
@@ -184,6 +225,10 @@ class App : public AppStateMachine, public Logger {
 
   static void _network_task(void* app);
   void _start_network_task();
+  // true if this wake connects anyway, so wifi can start before the rest
+  // of the boot
+  bool _connect_expected();
+  void _connect_early();
 
   void _main_task();
   static void _main_task_helper(void* app) {
@@ -191,20 +236,69 @@ class App : public AppStateMachine, public Logger {
   }
 
   void _begin_hw();
+#if defined(HAS_BUTTON_UI)
+  // passes btn_conf_string to the buttons, 'S' only on industrial
+  void _apply_btn_conf();
+#endif
   void _start_tasks();
 
-  void _handle_ui_event_global(UserInput::Event event);
+  // the input task posts events, the main task runs the handler of the
+  // current state
+  using UIHandler = std::function<void(UserInput::Event)>;
+  void _set_ui_handler(UIHandler handler);
+  void _clear_ui_handler();
+  void _post_ui_event(UserInput::Event event);
+  void _dispatch_ui_events();
   void _publish_ui_event(UserInput::Event event);
+  void _replay_journaled_events();
   void _mqtt_callback(const char* topic, const char* payload);
+  void _cmd_discovery_mode(uint8_t id, const char* payload);
+#if defined(HAS_TH_SENSOR)
+  void _cmd_sensor_interval(uint8_t id, const char* payload);
+#endif
+#if defined(HAS_SENSOR_BATCH)
+  void _cmd_sensor_batch(uint8_t id, const char* payload);
+#endif
+  void _cmd_report_config(uint8_t id, const char* payload);
+#if defined(HAS_BUTTON_UI)
+  void _cmd_btn_conf(uint8_t id, const char* payload);
+  void _publish_btn_conf();
+#endif
+#if defined(HAS_DISPLAY)
+  void _cmd_btn_label(uint8_t id, const char* payload);
+  void _cmd_disp_msg(uint8_t id, const char* payload);
+#endif
+#if defined(HAS_AWAKE_MODE)
+  void _cmd_awake_mode(uint8_t id, const char* payload);
+#endif
+#if defined(HAS_SLEEP_MODE)
+  void _cmd_schedule_wakeup(uint8_t id, const char* payload);
+#endif
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+  void _cmd_led_amb_bright(uint8_t id, const char* payload);
+  void _cmd_switch(uint8_t id, const char* payload);
+#endif
+
   void _net_on_connect();
+  void _publish_retained_states();
+  bool _report(ReportChannel channel, float value, bool force);
+  bool _report_due(ReportChannel channel, float value);
+  void _publish_report_config();
 #if defined(HAS_TH_SENSOR)
-  void _publish_sensors();
+  void _publish_sensors(bool force = false);
+#endif
+#if defined(HAS_SENSOR_BATCH)
+  bool _sensor_upload_due();
+  void _publish_sensor_log();
+  void _confirm_sensor_log();
 #endif
 #if defined(HAS_BATTERY)
-  void _publish_battery();
+  void _publish_battery(bool force = false);
 #endif
 #if defined(HAS_DISPLAY)
   void _download_mdi_icons();
+  bool _display_outdated() const;
+  void _redraw_main();
 #endif
 
 #if defined(HAS_AWAKE_MODE)
@@ -216,6 +310,10 @@ class App : public AppStateMachine, public Logger {
   TaskHandle_t display_task_h_ = nullptr;
   TaskHandle_t network_task_h_ = nullptr;
   TaskHandle_t main_task_h_ = nullptr;
+  Scheduler ui_scheduler_{UI_POLL_INTERVAL, UI_IDLE_WAIT};
+  Scheduler display_scheduler_{DISPLAY_POLL_INTERVAL, DISPLAY_IDLE_WAIT};
+  // the state machine polls unless the state registers deadlines
+  Scheduler main_scheduler_{MAIN_POLL_INTERVAL, MAIN_POLL_INTERVAL};
 
 #if defined(HOME_BUTTONS_ORIGINAL)
   BtnSwLED b1_;
@@ -239,12 +337,33 @@ class App : public AppStateMachine, public Logger {
   BtnSwLED sw_;
   BtnSwLEDInput<NUM_BUTTONS> bsl_input_;
 #endif
+#if defined(HAS_BUTTON_UI)
+  // set by the UI task, the network task publishes the new config
+  std::atomic<bool> btn_conf_applied_{false};
+#endif
 
 #if defined(HAS_TOUCH_UI)
   TouchInput touch_handler_;
 #endif
 
+  // events come from the UI task, and from the main and network tasks
+  // through the buttons (wake press, switch commands), pushes are
+  // serialized with ui_events_mux_
+  SpscQueue<UserInput::Event, kUIEventQueueSize> ui_events_;
+  portMUX_TYPE ui_events_mux_ = portMUX_INITIALIZER_UNLOCKED;
+  UIHandler ui_handler_;
   UserInput::Event user_event_ = {};
+  EventJournal event_journal_;
+  ReportFilter report_filter_;
+#if defined(HAS_SENSOR_BATCH)
+  SensorLog sensor_log_;
+  // last sensor log publish, its samples stay in the log until it was sent
+  struct SensorLogUpload {
+    uint32_t payload_hash;
+    size_t samples;
+  };
+  SensorLogUpload sensor_log_upload_ = {};
+#endif
 
 #if defined(HAS_DISPLAY)
   MDIHelper mdi_;
@@ -258,9 +377,14 @@ class App : public AppStateMachine, public Logger {
 
   BootCause boot_cause_;
   uint8_t wakeup_btn_id_ = 0;
+  bool batt_recheck_ = false;
+  BootStep boot_step_ = BootStep::kDone;
+  uint32_t boot_step_time_ = 0;
+  uint32_t boot_step_wait_ = 0;
 
   uint32_t last_sensor_publish_ = 0;
   uint32_t last_m_display_redraw_ = 0;
+  uint32_t drawn_display_version_ = 0;
   uint32_t input_start_time_ = 0;
   uint32_t info_screen_start_time_ = 0;
   uint32_t settings_menu_start_time_ = 0;
@@ -268,8 +392,10 @@ class App : public AppStateMachine, public Logger {
   uint32_t shutdown_cmd_time_ = 0;
 
   friend class FactoryTest;
+  friend struct MqttCmds<App>;
   friend class HBSetup;
 
+  friend class AppSMStates::BootState;
   friend class AppSMStates::InitState;
   friend class AppSMStates::AwakeModeIdleState;
   friend class AppSMStates::SleepModeHandleInput;
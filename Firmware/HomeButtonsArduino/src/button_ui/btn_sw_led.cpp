@@ -1,4 +1,5 @@
 #include "btn_sw_led.h"
+#include <esp_timer.h>
 #include "FunctionalInterrupt.h"
 
 void BtnSwLEDStates::StoppedState::loop() {
@@ -12,11 +13,11 @@ void BtnSwLEDStates::StoppedState::loop() {
 }
 
 void BtnSwLEDStates::IdleState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
+  sm().press_lock_.release();
   sm().num_clicks_ = 0;
   if (sm().switch_mode_ && sm().is_kill_switch_) {
-    if (sm().hw_.button_pressed(sm().id_)) {
+    sm().SyncLevel();
+    if (sm().raw_level_) {
       return transition_to<SwOnState>();
     } else {
       return transition_to<SwOffState>();
@@ -25,25 +26,28 @@ void BtnSwLEDStates::IdleState::entry() {
 }
 
 void BtnSwLEDStates::IdleState::loop() {
-  if (sm().rising_flag_) {
+  if (sm().PopUntilLevel(true)) {
     return transition_to<RisingDebounceState>();
   }
 }
 
 void BtnSwLEDStates::RisingDebounceState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
-  start_time_ = millis();
-  sm().press_start_time_ = millis();
+  sm().press_lock_.acquire();
+  start_time_ = sm().edge_time_;
+  sm().press_start_time_ = sm().edge_time_;
 }
 
 void BtnSwLEDStates::RisingDebounceState::loop() {
+  sm().WakeAt(start_time_ + kBtnDebounceTimeout);
   if (millis() - start_time_ >= kBtnDebounceTimeout) {
-    if (sm().hw_.button_pressed(sm().id_)) {
+    if (sm().LevelAt(start_time_ + kBtnDebounceTimeout)) {
       if (sm().switch_mode_ && sm().is_kill_switch_) {
         sm().TriggerSwitch(true);
         return transition_to<SwOnState>();
       } else {
+        if (sm().instant_mode_ && !sm().switch_mode_) {
+          sm().instant_pending_++;
+        }
         return transition_to<PressedState>();
       }
     } else {
@@ -61,14 +65,19 @@ void BtnSwLEDStates::RisingDebounceState::loop() {
 }
 
 void BtnSwLEDStates::PressedState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
+  sm().press_lock_.acquire();
   last_trigger_time_ = millis();
 }
 
 void BtnSwLEDStates::PressedState::loop() {
-  // note: when waking from deep sleep on button, falling flage might be missed
-  if (sm().falling_flag_ || !sm().PinState()) {
+  bool released = sm().PopUntilLevel(false);
+  // when waking from deep sleep on button, the release may have happened
+  // before the interrupt was attached
+  if (!released && !sm().PinState()) {
+    sm().SyncLevel();
+    released = true;
+  }
+  if (released) {
     if (sm().switch_mode_) {
       if (!sm().is_kill_switch_) {
         if (sm().switch_state_) {
@@ -84,13 +93,14 @@ void BtnSwLEDStates::PressedState::loop() {
       }
     } else {
       sm().num_clicks_++;
-      sm().TriggerClick(millis() - sm().press_start_time_, sm().num_clicks_,
-                        false);
+      sm().TriggerClick(sm().edge_time_ - sm().press_start_time_,
+                        sm().num_clicks_, false);
       return transition_to<FallingDebounceState>();
     }
   }
   if (!sm().switch_mode_ || !sm().is_kill_switch_) {
     // keep triggering click if button is held
+    sm().WakeAt(last_trigger_time_ + kBtnTriggerInterval);
     if (millis() - last_trigger_time_ >= kBtnTriggerInterval) {
       last_trigger_time_ = millis();
       sm().TriggerClick(millis() - sm().press_start_time_, sm().num_clicks_,
@@ -100,13 +110,14 @@ void BtnSwLEDStates::PressedState::loop() {
 }
 
 void BtnSwLEDStates::FallingDebounceState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
-  start_time_ = millis();
+  start_time_ = sm().edge_time_;
 }
 
 void BtnSwLEDStates::FallingDebounceState::loop() {
+  sm().WakeAt(start_time_ + kBtnDebounceTimeout);
   if (millis() - start_time_ >= kBtnDebounceTimeout) {
+    // skip the bounces, a press that is still down is handled next
+    sm().LevelAt(start_time_ + kBtnDebounceTimeout);
     if (sm().switch_mode_) {
       sm().TriggerSwitch(false);
       return transition_to<SwOffState>();
@@ -116,14 +127,15 @@ void BtnSwLEDStates::FallingDebounceState::loop() {
   }
 }
 
-void BtnSwLEDStates::ReleasedState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
-  start_time_ = millis();
-}
+void BtnSwLEDStates::ReleasedState::entry() { start_time_ = millis(); }
 
 void BtnSwLEDStates::ReleasedState::loop() {
-  if (sm().rising_flag_) {
+  // the press was already final, no multi-clicks
+  if (sm().instant_mode_) {
+    return transition_to<IdleState>();
+  }
+  sm().WakeAt(start_time_ + kBtnPressTimeout);
+  if (sm().PopUntilLevel(true)) {
     return transition_to<RisingDebounceState>();
   }
   if (millis() - start_time_ >= kBtnPressTimeout) {
@@ -134,45 +146,112 @@ void BtnSwLEDStates::ReleasedState::loop() {
 }
 
 void BtnSwLEDStates::SwOnState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
+  sm().press_lock_.release();
   sm().switch_state_ = true;
   sm().LEDOn();
 }
 
 void BtnSwLEDStates::SwOnState::loop() {
   if (!sm().is_kill_switch_) {
-    if (sm().rising_flag_) {
+    if (sm().PopUntilLevel(true)) {
       return transition_to<RisingDebounceState>();
     }
   } else {
-    if (sm().falling_flag_) {
+    if (sm().PopUntilLevel(false)) {
       return transition_to<FallingDebounceState>();
     }
   }
 }
 
 void BtnSwLEDStates::SwOffState::entry() {
-  sm().rising_flag_ = false;
-  sm().falling_flag_ = false;
+  sm().press_lock_.release();
   sm().switch_state_ = false;
   sm().LEDOff();
 }
 
 void BtnSwLEDStates::SwOffState::loop() {
-  if (sm().rising_flag_) {
+  if (sm().PopUntilLevel(true)) {
     return transition_to<RisingDebounceState>();
   }
 }
 
 void BtnSwLED::InitPress() {
   press_start_time_ = millis();
+  raw_level_ = true;
+  edge_time_ = press_start_time_;
+  if (instant_mode_ && !switch_mode_) instant_pending_ = 1;
   debug("init press set");
   transition_to<BtnSwLEDStates::PressedState>();
+  Notify();
+}
+
+void BtnSwLED::ReplayPress(const ButtonEdge* edges, size_t count) {
+  if (count == 0 || switch_mode_) {
+    return InitPress();
+  }
+  press_lock_.acquire();
+  uint32_t now = millis();
+  uint32_t press_time = now;
+  uint32_t release_time = now;
+  bool pressed = false;
+  num_clicks_ = 0;
+  size_t i = 0;
+  while (i < count) {
+    uint32_t edge_time = now - edges[i].age_ms;
+    // like the debounce states, the level after kBtnDebounceTimeout counts
+    size_t last = i;
+    while (last + 1 < count &&
+           edges[i].age_ms - edges[last + 1].age_ms < kBtnDebounceTimeout) {
+      last++;
+    }
+    if (edges[last].pressed != pressed) {
+      pressed = edges[last].pressed;
+      if (pressed) {
+        if (num_clicks_ == 0) press_time = edge_time;
+      } else {
+        num_clicks_++;
+        release_time = edge_time;
+        TriggerClick(release_time - press_time, num_clicks_, false);
+      }
+    }
+    i = last + 1;
+  }
+  debug("replayed %u edges: clicks: %u, pressed: %d",
+        static_cast<unsigned>(count), num_clicks_, pressed);
+
+  press_start_time_ = press_time;
+  if (PinState()) {
+    // pressed again after the stub stopped recording
+    if (!pressed && num_clicks_ == 0) press_start_time_ = now;
+    raw_level_ = true;
+    transition_to<BtnSwLEDStates::PressedState>();
+  } else {
+    if (pressed) {
+      // released after the stub stopped recording
+      num_clicks_++;
+      release_time = now;
+      TriggerClick(release_time - press_start_time_, num_clicks_, false);
+    }
+    raw_level_ = false;
+    transition_to<BtnSwLEDStates::ReleasedState>();
+    // a start time after now would wrap in the timeout check
+    if (now - release_time >= kBtnDebounceTimeout) {
+      std::get<BtnSwLEDStates::ReleasedState>(states_).set_start_time(
+          release_time + kBtnDebounceTimeout);
+    }
+  }
+  if (instant_mode_) {
+    instant_pending_ = num_clicks_ + (PinState() ? 1 : 0);
+  }
+  Notify();
 }
 
 bool BtnSwLED::InternalStart() {
   led_.Start();
+  // a press already in progress is only handled by InitPress()
+  edges_.clear();
+  raw_level_ = false;
+  edge_time_ = millis();
   attachInterrupt(hw_.button_pin(id_), std::bind(&BtnSwLED::ISR, this), CHANGE);
   debug("attached interrupt on pin %d", hw_.button_pin(id_));
   transition_to<BtnSwLEDStates::IdleState>();
@@ -182,12 +261,31 @@ bool BtnSwLED::InternalStart() {
 bool BtnSwLED::InternalStop() {
   led_.Stop();
   detachInterrupt(hw_.button_pin(id_));
+  press_lock_.release();
   transition_to<BtnSwLEDStates::StoppedState>();
   return true;
 }
 
 void BtnSwLED::InternalLoop() {
+  size_t state = state_index();
   BtnSwLEDStateMachine::loop();
+  // the new state registers its deadline in its first loop
+  if (state_index() != state) WakeAt(millis());
+  if (instant_pending_ > 0) {
+    // after a wake, the app sets its callback after InitPress()
+    if (HasHandler()) {
+      instant_pending_--;
+      TriggerEvent(Event{EventType::kClickSingle, {0, 0}, id_, true});
+      if (instant_pending_ > 0) WakeAt(millis());
+    } else {
+      Poll();
+    }
+  }
+  uint32_t dropped = edges_.dropped();
+  if (dropped != edges_dropped_) {
+    warning("%u edges dropped", dropped - edges_dropped_);
+    edges_dropped_ = dropped;
+  }
   if (has_led_) {
     led_.Loop();
   }
@@ -254,10 +352,35 @@ void BtnSwLED::TriggerSwitch(bool on) {
   }
 }
 
-void BtnSwLED::ISR() {
-  if (hw_.button_pressed(id_)) {
-    rising_flag_ = true;
-  } else {
-    falling_flag_ = true;
+bool BtnSwLED::LevelAt(uint32_t time) {
+  const InputEdge* edge;
+  while ((edge = edges_.peek()) != nullptr &&
+         static_cast<int32_t>(edge->time - time) <= 0) {
+    raw_level_ = edge->pressed;
+    edge_time_ = edge->time;
+    edges_.pop();
   }
+  return raw_level_;
+}
+
+bool BtnSwLED::PopUntilLevel(bool pressed) {
+  InputEdge edge;
+  while (raw_level_ != pressed && edges_.pop(edge)) {
+    raw_level_ = edge.pressed;
+    edge_time_ = edge.time;
+  }
+  return raw_level_ == pressed;
+}
+
+void BtnSwLED::SyncLevel() {
+  edges_.clear();
+  raw_level_ = PinState();
+  edge_time_ = millis();
+}
+
+void BtnSwLED::ISR() {
+  // same time base as millis()
+  uint32_t time = static_cast<uint32_t>(esp_timer_get_time() / 1000ULL);
+  edges_.push(InputEdge{time, hw_.button_pressed(id_)});
+  NotifyFromISR();
 }
\ No newline at end of file
@@ -1,14 +1,27 @@
 #ifndef HOMEBUTTONS_BLS_H
 #define HOMEBUTTONS_BLS_H
 
+#include <atomic>
+#include <optional>
+
+#include "freertos/FreeRTOS.h"
 #include "types.h"
 #include "user_input.h"
 #include "hardware.h"
 #include "state_machine.h"
 #include "leds.h"
+#include "power.h"
+#include "spsc_queue.h"
+#include "wake_stub.h"
 
 class BtnSwLED;
 
+// pin change recorded by the ISR
+struct InputEdge {
+  uint32_t time;  // ms, same time base as millis()
+  bool pressed;
+};
+
 namespace BtnSwLEDStates {
 
 class StoppedState : public State<BtnSwLED> {
@@ -78,6 +91,9 @@ class ReleasedState : public State<BtnSwLED> {
 
   const char* get_name() override { return "ReleasedState"; }
 
+  // the press timeout counts from here, used when replaying edges
+  void set_start_time(uint32_t start_time) { start_time_ = start_time; }
+
  private:
   uint32_t start_time_ = 0;
 };
@@ -120,7 +136,8 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
         hw_(hw),
         is_kill_switch_(is_kill_switch_),
         has_led_(has_led),
-        led_(name, id, hw) {}
+        led_(name, id, hw),
+        press_lock_(name) {}
 
   uint16_t id() const { return id_; }
   uint8_t pin() const { return hw_.button_pin(id_); }
@@ -128,7 +145,14 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
 
   bool PinState() const { return hw_.button_pressed(id_); }
 
+  // input that forwards the events of this button, instant presses wait
+  // until it has a callback
+  void SetParent(const UserInput* parent) { parent_ = parent; }
+
   void InitPress();
+  // continues the press that woke the device from the edges recorded by the
+  // wake stub, so clicks released before boot are counted
+  void ReplayPress(const ButtonEdge* edges, size_t count);
 
   bool switch_mode() const { return switch_mode_; }
   bool is_kill_switch() const { return is_kill_switch_; }
@@ -175,6 +199,14 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
     transition_to<BtnSwLEDStates::SwOffState>();
   }
 
+  // a single press is final on the debounced press, without waiting for
+  // more clicks, for buttons that don't use multi-clicks
+  void SetInstantMode(bool on) {
+    debug("set instant mode: %d", on);
+    instant_mode_ = on;
+  }
+  bool instant_mode() const { return instant_mode_; }
+
   void SetAutoLED(bool on) {
     debug("set auto led: %d", on);
     auto_led_ = on;
@@ -219,6 +251,7 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
 
  private:
   bool InternalInit() override {
+    led_.SetScheduler(scheduler());
     led_.Init();
     return true;
   }
@@ -237,6 +270,8 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
   bool is_kill_switch_ = false;
   bool has_led_ = false;
   LED led_;
+  // full CPU speed from the first edge until the press is handled
+  PowerLock press_lock_;
 
   uint32_t press_start_time_ = 0;
   uint8_t num_clicks_ = 0;
@@ -247,11 +282,33 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
   bool saved_switch_mode_ = false;
   bool saved_switch_state_ = false;
 
-  bool rising_flag_ = false;
-  bool falling_flag_ = false;
+  // edges from the ISR, the states debounce and count clicks from their
+  // timestamps
+  SpscQueue<InputEdge, kBtnEdgeQueueSize> edges_;
+  uint32_t edges_dropped_ = 0;
+  bool raw_level_ = false;  // level after the last popped edge
+  uint32_t edge_time_ = 0;  // time of the last popped edge
+
+  // pops the edges up to time, returns the level at that time
+  bool LevelAt(uint32_t time);
+  // pops edges until the level is pressed, false if there is no such edge yet
+  bool PopUntilLevel(bool pressed);
+  // drops the queued edges and takes the level from the pin
+  void SyncLevel();
 
   bool auto_led_ = false;
 
+  bool instant_mode_ = false;
+  // instant presses not triggered yet, a wake press waits for a callback.
+  // InitPress() and ReplayPress() set it from the main task
+  std::atomic<uint8_t> instant_pending_{0};
+  const UserInput* parent_ = nullptr;
+
+  // callback of the parent input, or of this button without one
+  bool HasHandler() const {
+    return parent_ ? parent_->HasEventCallback() : HasEventCallback();
+  }
+
   void IRAM_ATTR ISR();
 
   friend class BtnSwLEDStates::StoppedState;
@@ -267,10 +324,31 @@ class BtnSwLED : public UserInput, public BtnSwLEDStateMachine {
 template <uint8_t N>
 class BtnSwLEDInput : public UserInput {
  public:
+  // modes of one button, in the order of the buttons
+  struct ButtonConfig {
+    bool instant_mode = false;
+    std::optional<bool> switch_mode;  // unchanged if empty
+  };
+  using Config = std::array<ButtonConfig, N>;
+
   BtnSwLEDInput(const char* name,
                 std::array<std::reference_wrapper<BtnSwLED>, N> bls)
       : UserInput(name), bls_(bls) {}
 
+  // safe from any task, applied on start or in the next loop of the UI task
+  void SetConfig(const Config& config) {
+    portENTER_CRITICAL(&config_mux_);
+    pending_config_ = config;
+    portEXIT_CRITICAL(&config_mux_);
+    config_pending_.store(true);
+    Notify();
+  }
+  bool ConfigPending() const { return config_pending_.load(); }
+  // called from the UI task after a config from SetConfig() was applied
+  void SetConfigAppliedCallback(std::function<void()> callback) {
+    config_applied_callback_ = callback;
+  }
+
   uint16_t IdFromPin(uint8_t pin) {
     for (auto& bls : bls_) {
       if (bls.get().pin() == pin) {
@@ -322,6 +400,13 @@ class BtnSwLEDInput : public UserInput {
     }
   }
 
+  void SetInstantMode(uint8_t bls_id, bool on) {
+    auto bls = GetBtnSwLED(bls_id);
+    if (bls) {
+      bls.value().get().SetInstantMode(on);
+    }
+  }
+
   void PauseSwitchMode(uint8_t bls_id) {
     auto bls = GetBtnSwLED(bls_id);
     if (bls) {
@@ -453,14 +538,17 @@ class BtnSwLEDInput : public UserInput {
  private:
   bool InternalInit() override {
     for (auto& bls : bls_) {
+      bls.get().SetScheduler(scheduler());
       bls.get().Init();
       bls.get().SetEventCallback(
           std::bind(&BtnSwLEDInput::Callback, this, std::placeholders::_1));
+      bls.get().SetParent(this);
     }
     return true;
   }
 
   bool InternalStart() override {
+    ApplyConfig();
     for (auto& bls : bls_) {
       bls.get().Start();
     }
@@ -475,6 +563,7 @@ class BtnSwLEDInput : public UserInput {
   }
 
   void InternalLoop() override {
+    ApplyConfig();
     for (auto& bls : bls_) {
       bls.get().Loop();
     }
@@ -506,7 +595,30 @@ class BtnSwLEDInput : public UserInput {
     }
   }
 
+  void ApplyConfig() {
+    if (!config_pending_.exchange(false)) return;
+    portENTER_CRITICAL(&config_mux_);
+    Config config = pending_config_;
+    portEXIT_CRITICAL(&config_mux_);
+    for (uint8_t i = 0; i < N; i++) {
+      BtnSwLED& bls = bls_[i].get();
+      bls.SetInstantMode(config[i].instant_mode);
+      // restarts the button, only on a change
+      if (config[i].switch_mode &&
+          bls.switch_mode() != config[i].switch_mode.value()) {
+        bls.SetSwitchMode(config[i].switch_mode.value());
+      }
+    }
+    if (config_applied_callback_) {
+      config_applied_callback_();
+    }
+  }
+
   std::array<std::reference_wrapper<BtnSwLED>, N> bls_;
+  portMUX_TYPE config_mux_ = portMUX_INITIALIZER_UNLOCKED;
+  Config pending_config_ = {};
+  std::atomic<bool> config_pending_{false};
+  std::function<void()> config_applied_callback_;
 };
 
 #endif  // HOMEBUTTONS_BLS_H
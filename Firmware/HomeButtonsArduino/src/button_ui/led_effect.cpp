@@ -0,0 +1,82 @@
+#include "led_effect.h"
+
+#include <algorithm>
+#include "config.h"
+
+namespace {
+// (1 - cos(pi * k / 4)) / 2 for k = 1..4, scaled to 255
+constexpr uint8_t kPulseCurve[] = {37, 128, 218, 255};
+constexpr uint8_t kPulseSteps = sizeof(kPulseCurve);
+
+uint16_t ramp_fade(uint16_t duration_ms) {
+  return duration_ms > LED_FADE_MARGIN ? duration_ms - LED_FADE_MARGIN
+                                       : duration_ms;
+}
+
+// short steps keep the margin too, the fade ends before the next keyframe
+uint16_t blink_fade(uint16_t duration_ms) {
+  return std::min(LED_DEFAULT_FADE_TIME, ramp_fade(duration_ms));
+}
+}  // namespace
+
+bool LEDEffect::Add(uint8_t level, uint16_t fade_ms, uint16_t duration_ms) {
+  if (num_frames >= kMaxFrames) return false;
+  frames[num_frames++] =
+      LEDKeyframe{level, std::min(fade_ms, duration_ms), duration_ms};
+  return true;
+}
+
+LEDEffect LEDEffect::Blink(uint8_t num_blinks, uint8_t brightness,
+                           uint16_t on_ms, uint16_t off_ms, bool hold,
+                           uint8_t ambient) {
+  LEDEffect effect;
+  if (num_blinks == 0) return effect;
+  effect.Add(brightness, blink_fade(on_ms), on_ms);
+  if (hold) {
+    // on, then (off, on) for every further blink
+    if (num_blinks > 1) {
+      effect.Add(ambient, blink_fade(off_ms), off_ms);
+      effect.Add(brightness, blink_fade(on_ms), on_ms);
+      effect.loop_start = 1;
+      effect.repeats = num_blinks - 2;
+    }
+  } else {
+    effect.Add(ambient, blink_fade(off_ms), off_ms);
+    effect.repeats = num_blinks - 1;
+  }
+  return effect;
+}
+
+LEDEffect LEDEffect::Pulse(uint8_t brightness, uint16_t cycle_ms) {
+  LEDEffect effect;
+  // frame k ends at cycle_ms * (k + 1) / 8, rounding doesn't accumulate
+  uint32_t frames = 2 * kPulseSteps;
+  for (uint32_t k = 0; k < frames; k++) {
+    uint8_t step = k < kPulseSteps ? k : frames - 2 - k;
+    uint8_t level =
+        k == frames - 1 ? 0 : (brightness * kPulseCurve[step] + 127) / 255;
+    uint16_t duration = cycle_ms * (k + 1) / frames - cycle_ms * k / frames;
+    effect.Add(level, ramp_fade(duration), duration);
+  }
+  effect.repeats = kForever;
+  return effect;
+}
+
+void LEDEffectPlayer::Start(const LEDEffect& effect) {
+  effect_ = effect;
+  frame_ = 0;
+  repeat_ = 0;
+}
+
+bool LEDEffectPlayer::Next(LEDKeyframe& frame) {
+  if (frame_ >= effect_.num_frames) {
+    if (effect_.loop_start >= effect_.num_frames) return false;
+    if (!effect_.endless()) {
+      if (repeat_ >= effect_.repeats) return false;
+      repeat_++;
+    }
+    frame_ = effect_.loop_start;
+  }
+  frame = effect_.frames[frame_++];
+  return true;
+}
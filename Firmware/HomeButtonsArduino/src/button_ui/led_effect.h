@@ -0,0 +1,52 @@
+#ifndef HOMEBUTTONS_LED_EFFECT_H
+#define HOMEBUTTONS_LED_EFFECT_H
+
+#include <cstdint>
+
+// One step of an LED effect: a hardware fade to level, then the level is
+// held until duration_ms has passed since the start of the step.
+struct LEDKeyframe {
+  uint8_t level = 0;         // pct
+  uint16_t fade_ms = 0;      // from the previous level, 0 = step
+  uint16_t duration_ms = 0;  // until the next keyframe, >= fade_ms
+};
+
+// Keyframe list of an effect. After the last frame, the frames from
+// loop_start are played again `repeats` times.
+struct LEDEffect {
+  static constexpr uint8_t kMaxFrames = 8;
+  static constexpr uint8_t kForever = 255;
+
+  LEDKeyframe frames[kMaxFrames] = {};
+  uint8_t num_frames = 0;
+  uint8_t loop_start = 0;
+  uint8_t repeats = 0;
+
+  bool endless() const { return repeats == kForever; }
+  bool Add(uint8_t level, uint16_t fade_ms, uint16_t duration_ms);
+
+  // ends on the ambient level, or on brightness with hold
+  static LEDEffect Blink(uint8_t num_blinks, uint8_t brightness,
+                         uint16_t on_ms, uint16_t off_ms, bool hold,
+                         uint8_t ambient);
+  // raised cosine from 0 to brightness and back, repeats forever
+  static LEDEffect Pulse(uint8_t brightness, uint16_t cycle_ms);
+};
+
+// Steps through the keyframes of an effect. Holds a copy of the effect, so
+// the caller can start a new one at any time.
+class LEDEffectPlayer {
+ public:
+  void Start(const LEDEffect& effect);
+  // next keyframe to start, false when the effect is over
+  bool Next(LEDKeyframe& frame);
+
+  const LEDEffect& effect() const { return effect_; }
+
+ private:
+  LEDEffect effect_;
+  uint8_t frame_ = 0;
+  uint8_t repeat_ = 0;
+};
+
+#endif  // HOMEBUTTONS_LED_EFFECT_H
@@ -8,14 +8,12 @@ void LEDSMStates::IdleState::loop() {
   if (sm().cmd_blink_.has_value()) {
     sm().current_blink_ = sm().cmd_blink_;
     sm().cmd_blink_ = std::nullopt;
-    sm().current_blink_num_ = 0;
 
-    if (sm().current_blink_->type == LEDBlinkType::kBlink) {
-      return transition_to<BlinkOnState>();
+    if (sm().current_blink_->type == LEDBlinkType::kBlink ||
+        sm().current_blink_->type == LEDBlinkType::kPulse) {
+      return transition_to<EffectState>();
     } else if (sm().current_blink_->type == LEDBlinkType::kConstant) {
       return transition_to<ConstOnState>();
-    } else if (sm().current_blink_->type == LEDBlinkType::kPulse) {
-      return transition_to<PulseState>();
     } else if (sm().current_blink_->type == LEDBlinkType::kOff) {
       return transition_to<IdleState>();
     }
@@ -25,38 +23,6 @@ void LEDSMStates::IdleState::loop() {
   }
 }
 
-void LEDSMStates::BlinkOnState::entry() {
-  sm().hw_.set_led_pct_num(sm().id_, sm().current_blink_->brightness);
-  sm().last_change_time_ = millis();
-}
-
-void LEDSMStates::BlinkOnState::loop() {
-  if (millis() - sm().last_change_time_ >= sm().current_blink_->on_ms) {
-    if (sm().current_blink_->hold &&
-        sm().current_blink_num_ == sm().current_blink_->num_blinks - 1) {
-      return transition_to<ConstOnState>();
-    } else {
-      return transition_to<BlinkOffState>();
-    }
-  }
-}
-
-void LEDSMStates::BlinkOffState::entry() {
-  sm().hw_.set_led_pct_num(sm().id_, sm().ambient_brightness_);
-  sm().last_change_time_ = millis();
-}
-
-void LEDSMStates::BlinkOffState::loop() {
-  if (millis() - sm().last_change_time_ >= sm().current_blink_->off_ms) {
-    if (sm().current_blink_num_ < sm().current_blink_->num_blinks - 1) {
-      sm().current_blink_num_++;
-      return transition_to<BlinkOnState>();
-    } else {
-      return transition_to<IdleState>();
-    }
-  }
-}
-
 void LEDSMStates::ConstOnState::entry() {
   brightness = sm().current_blink_->brightness;
   sm().hw_.set_led_pct_num(sm().id_, sm().current_blink_->brightness);
@@ -75,20 +41,54 @@ void LEDSMStates::ConstOnState::loop() {
   }
 }
 
-void LEDSMStates::PulseState::entry() { sm().last_change_time_ = millis(); }
+void LEDSMStates::EffectState::entry() {
+  const LEDBlink& blink = sm().current_blink_.value();
+  brightness_ = blink.brightness;
+  if (blink.type == LEDBlinkType::kPulse) {
+    player_.Start(LEDEffect::Pulse(blink.brightness, blink.cycle_ms));
+  } else {
+    player_.Start(LEDEffect::Blink(blink.num_blinks, blink.brightness,
+                                   blink.on_ms, blink.off_ms, blink.hold,
+                                   sm().ambient_brightness_));
+  }
+  sm().last_change_time_ = millis();
+  duration_ = 0;
+}
 
-void LEDSMStates::PulseState::loop() {
-  uint8_t b = sm().current_blink_->brightness *
-              (-0.5 * cos(2 * PI * (millis() - sm().last_change_time_) /
-                          sm().current_blink_->cycle_ms) +
-               0.5);
-  sm().hw_.set_led_pct_num(sm().id_, b);
-  if (sm().cmd_blink_.has_value()) {
+void LEDSMStates::EffectState::loop() {
+  // blinks play to the end, endless effects give way to the next command
+  if (player_.effect().endless()) {
+    if (sm().cmd_blink_.has_value()) {
+      return transition_to<IdleState>();
+    }
+    if (sm().cstate() == ComponentBase::ComponentState::kCmdStop) {
+      sm().SetStopped();
+      return;
+    }
+    if (sm().current_blink_->brightness != brightness_) {
+      return transition_to<EffectState>();
+    }
+  }
+
+  sm().WakeAt(sm().last_change_time_ + duration_);
+  if (millis() - sm().last_change_time_ < duration_) return;
+
+  LEDKeyframe frame;
+  if (!player_.Next(frame)) {
+    if (sm().current_blink_->hold) {
+      return transition_to<ConstOnState>();
+    }
     return transition_to<IdleState>();
   }
-  if (sm().cstate() == ComponentBase::ComponentState::kCmdStop) {
-    sm().SetStopped();
+  sm().hw_.set_led_pct_num(sm().id_, frame.level, frame.fade_ms);
+  // keyframes are timed from the previous deadline, unless the task was
+  // held up for longer than the new keyframe
+  sm().last_change_time_ += duration_;
+  if (millis() - sm().last_change_time_ > frame.duration_ms) {
+    sm().last_change_time_ = millis();
   }
+  duration_ = frame.duration_ms;
+  sm().WakeAt(sm().last_change_time_ + duration_);
 }
 
 void LEDSMStates::TransitionState::entry() {
@@ -97,6 +97,7 @@ void LEDSMStates::TransitionState::entry() {
 }
 
 void LEDSMStates::TransitionState::loop() {
+  sm().WakeAt(start_time_ + 1000);
   if (millis() - start_time_ >= 1000) {
     return transition_to<IdleState>();
   }
@@ -147,6 +148,7 @@ void LED::Blink(uint8_t num_blinks, uint8_t brightness, uint16_t on_ms,
   }
   cmd_blink_ = LEDBlink{
       LEDBlinkType::kBlink, brightness, num_blinks, on_ms, off_ms, hold};
+  Notify();
   debug("BLINK: led: %d, blinks: %d, bri: %d, on_ms: %d, off_ms: %d, hold: %d",
         id_, num_blinks, brightness, on_ms, off_ms, hold);
 }
@@ -156,11 +158,13 @@ void LED::On(uint8_t brightness) {
     brightness = default_brightness_;
   }
   cmd_blink_ = LEDBlink{LEDBlinkType::kConstant, brightness};
+  Notify();
   debug("ON: led: %d, bri: %d", id_, brightness);
 }
 
 void LED::Off() {
   cmd_blink_ = LEDBlink{LEDBlinkType::kOff};
+  Notify();
   debug("OFF: led: %d", id_);
 }
 
@@ -170,6 +174,7 @@ void LED::Pulse(uint8_t brightness, uint16_t cycle_ms) {
   }
   cmd_blink_ =
       LEDBlink{LEDBlinkType::kPulse, brightness, 0, 0, 0, false, cycle_ms};
+  Notify();
   debug("PULSE: led: %d, bri: %d, cycle_ms: %d", id_, brightness, cycle_ms);
 }
 
@@ -181,6 +186,7 @@ void LED::SetDefaultBrightness(uint8_t brightness) {
   if (current_blink_) {
     current_blink_.value().brightness = brightness;
   }
+  Notify();
 }
 
 void LED::SetAmbientBrightness(uint8_t brightness) {
@@ -196,11 +202,15 @@ void LED::SetAmbientBrightness(uint8_t brightness) {
 
 bool LED::InternalStop() { return true; }
 
-void LED::InternalLoop() { LEDStateMachine::loop(); }
+void LED::InternalLoop() {
+  size_t state = state_index();
+  LEDStateMachine::loop();
+  // the new state registers its deadline in its first loop
+  if (state_index() != state) WakeAt(millis());
+}
 
 void LED::InternalRestart() {
   cmd_blink_ = std::nullopt;
   current_blink_ = std::nullopt;
-  current_blink_num_ = 0;
   transition_to<LEDSMStates::IdleState>();
 }
@@ -6,6 +6,7 @@
 #include "config.h"
 #include "component_base.h"
 #include "hardware.h"
+#include "led_effect.h"
 #include "state_machine.h"
 
 class LED;
@@ -21,26 +22,6 @@ class IdleState : public State<LED> {
   const char* get_name() override { return "IdleState"; }
 };
 
-class BlinkOnState : public State<LED> {
- public:
-  using State<LED>::State;
-
-  void entry() override;
-  void loop() override;
-
-  const char* get_name() override { return "BlinkOnState"; }
-};
-
-class BlinkOffState : public State<LED> {
- public:
-  using State<LED>::State;
-
-  void entry() override;
-  void loop() override;
-
-  const char* get_name() override { return "BlinkOffState"; }
-};
-
 class ConstOnState : public State<LED> {
  public:
   using State<LED>::State;
@@ -54,14 +35,21 @@ class ConstOnState : public State<LED> {
   uint8_t brightness = 0;
 };
 
-class PulseState : public State<LED> {
+// plays blinks and pulses as keyframes, the LEDC hardware does the fades
+// and the task only wakes to start the next keyframe
+class EffectState : public State<LED> {
  public:
   using State<LED>::State;
 
   void entry() override;
   void loop() override;
 
-  const char* get_name() override { return "PulseState"; }
+  const char* get_name() override { return "EffectState"; }
+
+ private:
+  LEDEffectPlayer player_;
+  uint16_t duration_ = 0;
+  uint8_t brightness_ = 0;
 };
 
 class TransitionState : public State<LED> {
@@ -92,9 +80,8 @@ struct LEDBlink {
 };
 
 using LEDStateMachine =
-    StateMachine<LED, LEDSMStates::IdleState, LEDSMStates::BlinkOnState,
-                 LEDSMStates::BlinkOffState, LEDSMStates::ConstOnState,
-                 LEDSMStates::PulseState, LEDSMStates::TransitionState>;
+    StateMachine<LED, LEDSMStates::IdleState, LEDSMStates::ConstOnState,
+                 LEDSMStates::EffectState, LEDSMStates::TransitionState>;
 
 class LED : public ComponentBase, public LEDStateMachine {
  public:
@@ -128,7 +115,6 @@ class LED : public ComponentBase, public LEDStateMachine {
   HardwareDefinition& hw_;
 
   uint32_t last_change_time_ = 0;
-  uint8_t current_blink_num_ = 0;
 
   std::optional<LEDBlink> cmd_blink_;
   std::optional<LEDBlink> current_blink_;
@@ -137,10 +123,8 @@ class LED : public ComponentBase, public LEDStateMachine {
   uint8_t ambient_brightness_ = 0;
 
   friend class LEDSMStates::IdleState;
-  friend class LEDSMStates::BlinkOnState;
-  friend class LEDSMStates::BlinkOffState;
   friend class LEDSMStates::ConstOnState;
-  friend class LEDSMStates::PulseState;
+  friend class LEDSMStates::EffectState;
   friend class LEDSMStates::TransitionState;
 };
 #endif  // HOMEBUTTONS_LEDS_H
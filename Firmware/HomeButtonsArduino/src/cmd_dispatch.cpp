@@ -0,0 +1,27 @@
+#include "cmd_dispatch.h"
+
+#include <cctype>
+
+bool parse_cmd_suffix(const char* suffix, char* key, size_t size,
+                      uint8_t& id) {
+  bool number_done = false;
+  size_t len = 0;
+  id = 0;
+  while (*suffix) {
+    if (len + 1 >= size) return false;
+    if (!number_done && isdigit(*suffix)) {
+      uint16_t value = 0;
+      while (isdigit(*suffix)) {
+        value = value * 10 + (*suffix++ - '0');
+        if (value > UINT8_MAX) return false;
+      }
+      id = value;
+      number_done = true;
+      key[len++] = '#';
+    } else {
+      key[len++] = *suffix++;
+    }
+  }
+  key[len] = '\0';
+  return true;
+}
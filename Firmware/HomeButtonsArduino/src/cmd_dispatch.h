@@ -0,0 +1,74 @@
+#ifndef HOMEBUTTONS_CMD_DISPATCH_H
+#define HOMEBUTTONS_CMD_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "config.h"
+#include "utils.h"
+
+// MQTT commands are looked up by their topic suffix under <base>/<name>/cmd/,
+// with the button or switch number replaced by '#'.
+template <typename Handler>
+struct CmdEntry {
+  constexpr CmdEntry(const char* name, Handler handler)
+      : name(name), hash(fnv1a_32(name)), handler(handler) {}
+  const char* name;
+  uint32_t hash;
+  Handler handler;
+};
+
+// Copies the command suffix to key with the first number replaced by '#'
+// ("btn_3_label" -> "btn_#_label") and returns the number in id.
+bool parse_cmd_suffix(const char* suffix, char* key, size_t size,
+                      uint8_t& id);
+
+// entry of the command in table, nullptr if unknown
+template <typename Handler, size_t N>
+const CmdEntry<Handler>* find_cmd(const CmdEntry<Handler> (&table)[N],
+                                  const char* suffix, uint8_t& id) {
+  char key[24];
+  if (!parse_cmd_suffix(suffix, key, sizeof(key), id)) return nullptr;
+  uint32_t hash = fnv1a_32(key);
+  for (const auto& entry : table) {
+    if (entry.hash == hash && strcmp(entry.name, key) == 0) return &entry;
+  }
+  return nullptr;
+}
+
+// The commands of the enabled features. Target has a handler member
+// _cmd_<name>(uint8_t id, const char* payload) per command: App in the
+// firmware, a recorder in the tests.
+template <typename Target>
+struct MqttCmds {
+  using Handler = void (Target::*)(uint8_t id, const char* payload);
+  static constexpr CmdEntry<Handler> kTable[] = {
+#if defined(HAS_TH_SENSOR)
+      {"sensor_interval", &Target::_cmd_sensor_interval},
+#endif
+#if defined(HAS_SENSOR_BATCH)
+      {"sensor_batch", &Target::_cmd_sensor_batch},
+#endif
+#if defined(HAS_DISPLAY)
+      {"btn_#_label", &Target::_cmd_btn_label},
+      {"disp_msg", &Target::_cmd_disp_msg},
+#endif
+#if defined(HAS_AWAKE_MODE)
+      {"awake_mode", &Target::_cmd_awake_mode},
+#endif
+#if defined(HAS_SLEEP_MODE)
+      {"schedule_wakeup", &Target::_cmd_schedule_wakeup},
+#endif
+      {"discovery_mode", &Target::_cmd_discovery_mode},
+      {"report_config", &Target::_cmd_report_config},
+#if defined(HAS_BUTTON_UI)
+      {"btn_conf", &Target::_cmd_btn_conf},
+#endif
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+      {"led_amb_bright", &Target::_cmd_led_amb_bright},
+      {"switch_#", &Target::_cmd_switch},
+#endif
+  };
+};
+
+#endif  // HOMEBUTTONS_CMD_DISPATCH_H
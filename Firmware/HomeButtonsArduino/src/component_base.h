@@ -2,6 +2,7 @@
 #define COMPONENT_BASE_H
 
 #include "logger.h"
+#include "scheduler.h"
 
 class ComponentBase : public Logger {
  public:
@@ -52,6 +53,7 @@ class ComponentBase : public Logger {
       if (InternalStart()) {
         cstate_ = ComponentState::kRunning;
         debug("started");
+        Notify();
         return true;
       } else {
         debug("failed to start");
@@ -76,6 +78,7 @@ class ComponentBase : public Logger {
           cstate_ = ComponentState::kCmdStop;
           debug("cmd stop accepted");
         }
+        Notify();
         return true;
       } else if (cstate_ == ComponentState::kCmdStop) {
         debug("cmd stop, already stopping");
@@ -107,14 +110,21 @@ class ComponentBase : public Logger {
         cstate_ == ComponentState::kCmdStop) {
       InternalLoop();
     }
+    if (cstate_ == ComponentState::kCmdStop) {
+      // stopping takes a few passes
+      Poll();
+    }
   }
 
   void Restart() {
     InternalRestart();
     debug("restarted");
+    Notify();
   }
 
   ComponentState cstate() const { return cstate_; }
+  // scheduler of the task that runs Loop(), set before Init()
+  void SetScheduler(Scheduler* scheduler) { scheduler_ = scheduler; }
   virtual ~ComponentBase() = default;
   ComponentBase() = delete;
 
@@ -124,6 +134,22 @@ class ComponentBase : public Logger {
     debug("stopped");
   }
 
+  Scheduler* scheduler() const { return scheduler_; }
+  // without a scheduler the task polls, so these do nothing
+  void WakeAt(uint32_t time_ms) {
+    if (scheduler_) scheduler_->wake_at(time_ms);
+  }
+  void Poll() {
+    if (scheduler_) scheduler_->poll();
+  }
+  // runs Loop() soon, for changes made from other tasks
+  void Notify() {
+    if (scheduler_) scheduler_->notify();
+  }
+  void IRAM_ATTR NotifyFromISR() {
+    if (scheduler_) scheduler_->notify_from_isr();
+  }
+
  private:
   virtual bool InternalInit() = 0;
   virtual bool InternalStart() = 0;
@@ -133,6 +159,7 @@ class ComponentBase : public Logger {
   virtual void InternalRestart() = 0;
 
   ComponentState cstate_ = ComponentState::kUninitialized;
+  Scheduler* scheduler_ = nullptr;
 };
 
 #endif
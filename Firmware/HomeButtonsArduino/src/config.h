@@ -38,6 +38,14 @@
 #define HAS_BUTTON_UI
 #endif
 
+#if defined(HAS_SLEEP_MODE) && defined(HAS_TH_SENSOR)
+#define HAS_SENSOR_BATCH
+#endif
+
+#if defined(HAS_SLEEP_MODE) && defined(HAS_BUTTON_UI)
+#define HAS_WAKE_STUB
+#endif
+
 #include <WString.h>
 #include <IPAddress.h>
 
@@ -91,8 +99,16 @@ static constexpr char DEVICE_NAME_DFLT[] = "Home Buttons";
 static constexpr uint16_t MQTT_PORT_DFLT = 1883;
 static constexpr char BASE_TOPIC_DFLT[] = "homebuttons";
 static constexpr char DISCOVERY_PREFIX_DFLT[] = "homeassistant";
+// false: one retained discovery message per entity
+static constexpr bool DEVICE_DISCOVERY_DFLT = false;
 static constexpr char BNT_LABEL_DFLT_PREFIX[] = "B";
 static constexpr char BTN_CONF_DFLT[] = "BBBBBBBBBBBBBBBB";
+// configured buttons, not the industrial settings button
+#if defined(HOME_BUTTONS_INDUSTRIAL)
+static constexpr uint8_t BTN_CONF_LEN = NUM_BUTTONS - 1;
+#else
+static constexpr uint8_t BTN_CONF_LEN = NUM_BUTTONS;
+#endif
 
 // ------ sensors ------
 #if defined(HOME_BUTTONS_ORIGINAL) || defined(HOME_BUTTONS_PRO) || \
@@ -105,6 +121,24 @@ static constexpr uint16_t SEN_INTERVAL_DFLT = 30;  // min
 static constexpr uint16_t SEN_INTERVAL_MIN = 5;    // min
 static constexpr uint16_t SEN_INTERVAL_MAX = 60;   // min
 #endif
+// samples per upload in sleep mode, 1 uploads every sample
+static constexpr uint8_t SENSOR_BATCH_DFLT = 1;
+static constexpr uint8_t SENSOR_BATCH_MAX = 12;
+// ring of samples waiting for upload, room for a few failed uploads
+static constexpr size_t SENSOR_LOG_SIZE = 24;
+// a change this big since the last upload is uploaded right away
+static constexpr float SENSOR_BATCH_TEMP_DELTA = 1.0;  // deg C
+static constexpr float SENSOR_BATCH_HMD_DELTA = 5.0;   // %
+
+// ------ reporting ------
+// a value is published when it moves out of its deadband around the last
+// published value, or when it wasn't published for the heartbeat time
+static constexpr float DEADBAND_TEMP_DFLT = 0.2;        // deg
+static constexpr float DEADBAND_HMD_DFLT = 1.0;         // %
+static constexpr float DEADBAND_BATT_DFLT = 1.0;        // %
+static constexpr float DEADBAND_RSSI_DFLT = 5.0;        // dB
+static constexpr uint16_t REPORT_HEARTBEAT_DFLT = 60;   // min
+static constexpr uint16_t REPORT_HEARTBEAT_MAX = 1440;  // min
 
 // ----- timing ------
 static constexpr uint32_t SETUP_TIMEOUT = 600;                // s
@@ -118,6 +152,28 @@ static constexpr uint32_t DEVICE_INFO_TIMEOUT = 30000L;       // ms
 static constexpr uint32_t SHUTDOWN_DELAY = 500L;              // ms
 static constexpr uint32_t FRONTLIGHT_TIMEOUT = 5000L;         // ms
 static constexpr uint32_t SLEEP_MODE_INPUT_TIMEOUT = 10000L;  // ms
+static constexpr uint32_t BATT_RECHECK_DELAY = 1000L;         // ms
+static constexpr uint32_t RESTART_LED_TIME = 1000L;           // ms
+static constexpr uint32_t BOOT_DISPLAY_TIMEOUT = 15000L;      // ms
+
+// ------ task scheduling ------
+// poll intervals while a task has timed work, idle waits otherwise, the
+// tasks are also woken by notifications
+static constexpr uint32_t UI_POLL_INTERVAL = 5L;         // ms
+static constexpr uint32_t UI_IDLE_WAIT = 1000L;          // ms
+static constexpr uint32_t DISPLAY_POLL_INTERVAL = 50L;   // ms
+static constexpr uint32_t DISPLAY_IDLE_WAIT = 1000L;     // ms
+static constexpr uint32_t MAIN_POLL_INTERVAL = 10L;      // ms
+static constexpr uint32_t AWAKE_POLL_INTERVAL = 250L;    // ms
+
+// ------ power ------
+// CPU frequency range in awake mode, the CPU runs at the maximum while a
+// display update, network connect or button press is in progress
+static constexpr uint32_t AWAKE_CPU_FREQ_MAX = 240;  // MHz
+static constexpr uint32_t AWAKE_CPU_FREQ_MIN = 80;   // MHz
+// beacon intervals (~102 ms) the modem sleeps between wakes in awake mode,
+// incoming messages are delayed by up to this, outgoing ones are not
+static constexpr uint16_t WIFI_LISTEN_INTERVAL = 3;
 
 // ------ network ------
 static constexpr uint32_t QUICK_WIFI_TIMEOUT = 5000L;
@@ -125,6 +181,9 @@ static constexpr uint32_t WIFI_TIMEOUT = 20000L;
 static constexpr uint32_t MAX_WIFI_RETRIES_DURING_MQTT_SETUP = 2;
 static constexpr uint32_t MQTT_TIMEOUT = 5000L;
 static constexpr uint32_t NET_CONN_CHECK_INTERVAL = 1000L;
+// network task wait while connecting, when connected it sleeps until there is
+// something to publish, incoming data or the next connection check
+static constexpr uint32_t NET_POLL_INTERVAL = 10L;
 static constexpr uint32_t NET_CONNECT_TIMEOUT = 30000L;
 static constexpr uint8_t MAX_FAILED_CONNECTIONS = 5;
 static const IPAddress DEFAULT_DNS2 = IPAddress(1, 1, 1, 1);
@@ -133,6 +192,23 @@ static const IPAddress DEFAULT_DNS2 = IPAddress(1, 1, 1, 1);
 static constexpr uint16_t MQTT_PYLD_SIZE = 512;
 static constexpr uint16_t MQTT_BUFFER_SIZE = 777;
 static constexpr size_t MAX_TOPIC_LENGTH = 256;
+// both pools together stay within the 3084 B of the old 4 slot queue.
+// a record takes its topic and payload plus about 28 B of headers, the
+// largest record that fits is half the pool (test/test_publish_queue)
+static constexpr size_t MQTT_EVENT_QUEUE_SIZE = 512;     // bytes
+static constexpr size_t MQTT_PUBLISH_QUEUE_SIZE = 2560;  // bytes
+// true: a queued message is replaced by a newer one on the same topic
+// false: low priority messages are only dropped when the queue is full
+static constexpr bool MQTT_COALESCE_LOW_PRIO = true;
+// retained topics tracked to skip publishing unchanged payloads
+static constexpr size_t MQTT_RETAINED_LEDGER_SIZE = 128;
+// resend discovery and retained states when Home Assistant comes online
+static constexpr bool MQTT_REANNOUNCE_ON_HA_BIRTH = true;
+static constexpr size_t MQTT_STREAM_CHUNK_SIZE = 128;  // bytes
+// button events kept when the network can't be reached
+static constexpr size_t EVENT_JOURNAL_SIZE = 16;
+// older journaled events are dropped instead of replayed
+static constexpr uint32_t EVENT_JOURNAL_MAX_AGE = 300;  // s
 
 // ------ other ------
 static constexpr uint32_t MIN_FREE_HEAP = 10000UL;
@@ -140,6 +216,8 @@ static constexpr uint32_t SCHEDULE_WAKEUP_MIN = 5;                      // s
 static constexpr uint32_t SCHEDULE_WAKEUP_MAX = SEN_INTERVAL_MAX * 60;  // s
 static constexpr uint32_t MDI_FREE_SPACE_THRESHOLD = 100000UL;
 static constexpr uint16_t LED_DEFAULT_FADE_TIME = 50;  // ms
+// wake cycles kept in RTC memory for wake_metrics
+static constexpr size_t WAKE_PROFILER_CYCLES = 8;
 
 // ------ UI ------
 #if defined(HOME_BUTTONS_ORIGINAL)
@@ -155,10 +233,21 @@ static constexpr uint8_t LED_DFLT_BRIGHT = 100;    // pct
 static constexpr uint8_t LED_MIN_BRIGHT = 10;      // pct
 static constexpr uint8_t LED_MAX_AMB_BRIGHT = 20;  // pct
 static constexpr float LED_GAMMA = 2.2;
+// a fade waits for the previous one on the channel, ramps end this early
+static constexpr uint16_t LED_FADE_MARGIN = 5;  // ms
 
 // ------ BUTTONS ------
 static constexpr uint32_t kBtnDebounceTimeout = 50L;
 static constexpr uint32_t kBtnPressTimeout = 500L;
 static constexpr uint32_t kBtnTriggerInterval = 250L;
+// edges queued per button between two loops of the UI task, power of two
+static constexpr size_t kBtnEdgeQueueSize = 32;
+// events from the input task to the main task
+static constexpr size_t kUIEventQueueSize = 16;
+// the wake stub records button edges until the buttons were released for
+// WAKE_STUB_RELEASE_TIME, the boot is delayed by at most WAKE_STUB_WINDOW
+static constexpr uint32_t WAKE_STUB_WINDOW = 100L;       // ms
+static constexpr uint32_t WAKE_STUB_RELEASE_TIME = 50L;  // ms
+static constexpr size_t WAKE_STUB_EDGES = 16;
 
 #endif  // HOMEBUTTONS_CONFIG_H
@@ -8,6 +8,7 @@
 #include "bitmaps.h"
 #include "config.h"
 #include "hardware.h"
+#include "wake_profiler.h"
 
 #if defined(HOME_BUTTONS_ORIGINAL)
 static constexpr uint16_t ROTATION = 0;
@@ -103,6 +104,7 @@ void Display::end() {
   if (state != State::ACTIVE) return;
   state = State::CMD_END;
   debug("cmd end");
+  if (scheduler_) scheduler_->notify();
 }
 
 void Display::update() {
@@ -114,11 +116,16 @@ void Display::update() {
       draw_ui_state = pre_disappear_ui_state;
     } else {
       disp->hibernate();
+      WakeProfiler::mark(WakePhase::kDisplayHibernate);
       state = State::IDLE;
       info("ended.");
       return;
     }
   } else if (current_ui_state.disappearing) {
+    if (scheduler_) {
+      scheduler_->wake_at(current_ui_state.appear_time +
+                          current_ui_state.disappear_timeout);
+    }
     if (millis() - current_ui_state.appear_time >=
         current_ui_state.disappear_timeout) {
       if (new_ui_cmd) {
@@ -147,6 +154,7 @@ void Display::update() {
         static_cast<int>(draw_ui_state.page), draw_ui_state.disappearing,
         draw_ui_state.message.c_str());
 
+  draw_lock_.acquire();
   redraw_in_progress = true;
   switch (draw_ui_state.page) {
     case DisplayPage::EMPTY:
@@ -191,9 +199,17 @@ void Display::update() {
   current_ui_state.appear_time = millis();
   draw_ui_state = {};
   redraw_in_progress = false;
+  draw_lock_.release();
+
+  // next command or the end is handled in the next update
+  if (scheduler_ && (new_ui_cmd || state == State::CMD_END ||
+                     current_ui_state.disappearing)) {
+    scheduler_->wake_at(millis());
+  }
 
   if (state == State::ENDING) {
     disp->hibernate();
+    WakeProfiler::mark(WakePhase::kDisplayHibernate);
     state = State::IDLE;
     info("ended.");
   }
@@ -285,6 +301,7 @@ Display::State Display::get_state() { return state; }
 void Display::set_cmd_state(UIState cmd) {
   cmd_ui_state = cmd;
   new_ui_cmd = true;
+  if (scheduler_) scheduler_->notify();
 }
 
 void Display::draw_message(const UIState::MessageType &message, bool error,
@@ -375,6 +392,10 @@ void Display::draw_main() {
 
   disp->fillScreen(bg_color);
 
+  // all labels from the same version, they may change while drawing
+  ButtonLabel labels[NUM_BUTTONS];
+  device_state_.get_btn_labels(labels);
+
 #if defined(HOME_BUTTONS_ORIGINAL)
   const uint16_t min_btn_clearance = 14;
   const uint16_t h_padding = 5;
@@ -387,13 +408,12 @@ void Display::draw_main() {
   mdi_.begin();
   LabelType label_type[NUM_BUTTONS] = {};
   for (uint16_t i = 0; i < NUM_BUTTONS; i++) {
-    ButtonLabel label = device_state_.get_btn_label(i + 1);
-    label_type[i] = get_label_type(label);
+    label_type[i] = get_label_type(labels[i]);
   }
 
   // Loop through buttons
   for (uint16_t i = 0; i < NUM_BUTTONS; i++) {
-    ButtonLabel label = device_state_.get_btn_label(i + 1);
+    ButtonLabel& label = labels[i];
 
     if (label_type[i] == LabelType::Icon) {
       MDIName icon = get_mdi_name(label);
@@ -537,7 +557,7 @@ void Display::draw_main() {
   mdi_.begin();
   // Loop through buttons
   for (uint16_t i = 0; i < NUM_BUTTONS; i++) {
-    ButtonLabel label = device_state_.get_btn_label(i + 1);
+    ButtonLabel& label = labels[i];
     uint16_t size = 100;
     uint16_t x = i % 2 == 0 ? 0 : WIDTH - size;
     uint16_t y = i < 2 ? 0 : HEIGHT - size;
@@ -550,7 +570,7 @@ void Display::draw_main() {
   uint16_t tile_width = 132;
   uint16_t tile_height = 100;
   for (uint16_t i = 0; i < NUM_BUTTONS; i++) {
-    ButtonLabel label = device_state_.get_btn_label(i + 1);
+    ButtonLabel& label = labels[i];
 
     ButtonTile tile = {};
     tile.label_type = get_label_type(label);
@@ -584,6 +604,7 @@ void Display::draw_info() {
 
   disp->fillScreen(bg_color);
 
+  const auto sensors = device_state_.sensors();
   UIState::MessageType text;
 
 #if defined(HOME_BUTTONS_ORIGINAL)
@@ -595,7 +616,7 @@ void Display::draw_info() {
   u8g2.setCursor(WIDTH / 2 - w / 2, 30);
   u8g2.print(text.c_str());
 
-  text = UIState::MessageType("%.1f %s", device_state_.sensors().temperature,
+  text = UIState::MessageType("%.1f %s", sensors.temperature,
                               device_state_.get_temp_unit().c_str());
   u8g2.setFont(u8g2_font_helvB24_te);
   w = u8g2.getUTF8Width(text.c_str());
@@ -608,7 +629,7 @@ void Display::draw_info() {
   u8g2.setCursor(WIDTH / 2 - w / 2, 129);
   u8g2.print(text.c_str());
 
-  text = UIState::MessageType("%.0f %%", device_state_.sensors().humidity);
+  text = UIState::MessageType("%.0f %%", sensors.humidity);
   u8g2.setFont(u8g2_font_helvB24_te);
   w = u8g2.getUTF8Width(text.c_str());
   u8g2.setCursor(WIDTH / 2 - w / 2 - 2, 169);
@@ -620,8 +641,8 @@ void Display::draw_info() {
   u8g2.setCursor(WIDTH / 2 - w / 2, 228);
   u8g2.print(text.c_str());
 
-  if (device_state_.sensors().battery_present) {
-    text = UIState::MessageType("%d %%", device_state_.sensors().battery_pct);
+  if (sensors.battery_present) {
+    text = UIState::MessageType("%d %%", sensors.battery_pct);
   } else {
     text = "-";
   }
@@ -634,18 +655,18 @@ void Display::draw_info() {
   u8g2.setFont(u8g2_font_helvB24_tr);
 
   disp->drawXBitmap(5, 4, thermometer_64x64, 64, 64, text_color);
-  text = UIState::MessageType("%.1f %s", device_state_.sensors().temperature,
+  text = UIState::MessageType("%.1f %s", sensors.temperature,
                               device_state_.get_temp_unit().c_str());
   u8g2.setCursor(85, 50);
   u8g2.print(text.c_str());
 
   disp->drawXBitmap(5, 68, water_percent_64x64, 64, 64, text_color);
-  text = UIState::MessageType("%.0f %%", device_state_.sensors().humidity);
+  text = UIState::MessageType("%.0f %%", sensors.humidity);
   u8g2.setCursor(85, 116);
   u8g2.print(text.c_str());
 
   disp->drawXBitmap(5, 132, battery_64x64, 64, 64, text_color);
-  text = UIState::MessageType("%d %%", device_state_.sensors().battery_pct);
+  text = UIState::MessageType("%d %%", sensors.battery_pct);
   u8g2.setCursor(85, 180);
   u8g2.print(text.c_str());
 
@@ -653,14 +674,14 @@ void Display::draw_info() {
   u8g2.setFont(u8g2_font_helvB24_tr);
 
   disp->drawXBitmap(100, 30, thermometer_64x64, 64, 64, text_color);
-  text = UIState::MessageType("%.1f %s", device_state_.sensors().temperature,
+  text = UIState::MessageType("%.1f %s", sensors.temperature,
                               device_state_.get_temp_unit().c_str());
   int8_t ascent = u8g2.getFontAscent();
   u8g2.setCursor(180, 30 + 64 / 2 + ascent / 2);
   u8g2.print(text.c_str());
 
   disp->drawXBitmap(100, 110, water_percent_64x64, 64, 64, text_color);
-  text = UIState::MessageType("%.0f %%", device_state_.sensors().humidity);
+  text = UIState::MessageType("%.0f %%", sensors.humidity);
   u8g2.setCursor(180, 110 + 64 / 2 + ascent / 2);
   u8g2.print(text.c_str());
 
@@ -743,10 +764,11 @@ void Display::draw_device_info() {
   u8g2.setCursor(0, 140);
   u8g2.print(ip_info.c_str());
 
+  const auto sensors = device_state_.sensors();
   UIState::MessageType batt_volt;
-  if (device_state_.sensors().battery_present) {
-    batt_volt = UIState::MessageType("Battery: %.2f V",
-                                     device_state_.sensors().battery_voltage);
+  if (sensors.battery_present) {
+    batt_volt =
+        UIState::MessageType("Battery: %.2f V", sensors.battery_voltage);
   } else {
     batt_volt = UIState::MessageType("Battery: -");
   }
@@ -8,6 +8,8 @@
 #include "static_string.h"
 #include "state.h"
 #include "logger.h"
+#include "power.h"
+#include "scheduler.h"
 #include "mdi/mdi_helper.h"
 #include "types.h"
 
@@ -63,9 +65,14 @@ class Display : public Logger {
   void init_ui_state(UIState ui_state);  // used after wakeup
   State get_state();
   bool busy() { return redraw_in_progress; }
+  // a command is waiting or being drawn
+  bool pending() { return new_ui_cmd || redraw_in_progress; }
+  // scheduler of the task that calls update()
+  void set_scheduler(Scheduler* scheduler) { scheduler_ = scheduler; }
 
  private:
   State state = State::IDLE;
+  Scheduler* scheduler_ = nullptr;
 
   UIState current_ui_state = {};
   UIState cmd_ui_state = {};
@@ -74,6 +81,7 @@ class Display : public Logger {
 
   bool new_ui_cmd = false;
   bool redraw_in_progress = false;
+  PowerLock draw_lock_{"display"};
 
   uint16_t text_color = GxEPD_BLACK;
   uint16_t bg_color = GxEPD_WHITE;
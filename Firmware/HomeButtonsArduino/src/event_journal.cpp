@@ -0,0 +1,96 @@
+#include "event_journal.h"
+
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "rom/crc.h"
+#include "config.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48424a31;  // "HBJ1"
+
+struct Ring {
+  uint32_t magic;
+  uint32_t next_seq;
+  uint32_t dropped;
+  uint16_t head;  // oldest entry
+  uint16_t count;
+  EventJournal::Entry entries[EVENT_JOURNAL_SIZE];
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR Ring ring;
+
+uint32_t ring_crc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&ring),
+                  offsetof(Ring, crc));
+}
+}  // namespace
+
+void EventJournal::add(const UserInput::Event& event) {
+  int64_t now = now_us();
+  portENTER_CRITICAL(&mux_);
+  _check();
+  if (ring.count == EVENT_JOURNAL_SIZE) {
+    ring.head = (ring.head + 1) % EVENT_JOURNAL_SIZE;
+    ring.count--;
+    ring.dropped++;
+  }
+  ring.entries[(ring.head + ring.count) % EVENT_JOURNAL_SIZE] = {
+      now, ring.next_seq++, event.btn_id, event.type};
+  ring.count++;
+  _seal();
+  portEXIT_CRITICAL(&mux_);
+}
+
+bool EventJournal::pop(Entry& entry) {
+  bool ok = false;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  if (ring.count > 0) {
+    entry = ring.entries[ring.head];
+    ring.head = (ring.head + 1) % EVENT_JOURNAL_SIZE;
+    ring.count--;
+    _seal();
+    ok = true;
+  }
+  portEXIT_CRITICAL(&mux_);
+  return ok;
+}
+
+size_t EventJournal::size() {
+  portENTER_CRITICAL(&mux_);
+  _check();
+  size_t count = ring.count;
+  portEXIT_CRITICAL(&mux_);
+  return count;
+}
+
+uint32_t EventJournal::dropped() {
+  portENTER_CRITICAL(&mux_);
+  _check();
+  uint32_t dropped = ring.dropped;
+  portEXIT_CRITICAL(&mux_);
+  return dropped;
+}
+
+int64_t EventJournal::now_us() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return static_cast<int64_t>(tv.tv_sec) * 1000000LL + tv.tv_usec;
+}
+
+void EventJournal::_check() {
+  if (checked_) return;
+  checked_ = true;
+  if (ring.magic != kMagic || ring.head >= EVENT_JOURNAL_SIZE ||
+      ring.count > EVENT_JOURNAL_SIZE || ring.crc != ring_crc()) {
+    ring.magic = kMagic;
+    ring.next_seq = 0;
+    ring.dropped = 0;
+    ring.head = 0;
+    ring.count = 0;
+    _seal();
+  }
+}
+
+void EventJournal::_seal() { ring.crc = ring_crc(); }
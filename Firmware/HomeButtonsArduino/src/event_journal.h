@@ -0,0 +1,40 @@
+#ifndef HOMEBUTTONS_EVENT_JOURNAL_H
+#define HOMEBUTTONS_EVENT_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "user_input.h"
+
+// Button events that could not be published, replayed on the next
+// connection. The ring lives in RTC memory, so it survives deep sleep and
+// software resets, and is checked with a CRC on first use. When it is full
+// the oldest event is dropped.
+// Timestamps are system time, which keeps running during deep sleep, so the
+// age of an event stays correct across wakes.
+class EventJournal {
+ public:
+  struct Entry {
+    int64_t time_us;
+    uint32_t seq;  // increases with every event, for deduplication
+    uint16_t btn_id;
+    UserInput::EventType type;
+  };
+
+  void add(const UserInput::Event& event);
+  // removes the oldest event, false if empty
+  bool pop(Entry& entry);
+  size_t size();
+  uint32_t dropped();
+
+  static int64_t now_us();
+
+ private:
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+  bool checked_ = false;
+
+  void _check();
+  void _seal();
+};
+
+#endif  // HOMEBUTTONS_EVENT_JOURNAL_H
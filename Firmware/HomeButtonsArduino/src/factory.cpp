@@ -2,6 +2,8 @@
 
 #include "config.h"
 #include "static_string.h"
+#include "json_writer.h"
+#include "print_utils.h"
 
 #include <Preferences.h>
 #include <ArduinoJson.h>
@@ -16,6 +18,20 @@ static constexpr std::array<const char*, 8> TEST_SPEC_KEYS = {
     "temp_ref",       "temp_tol",       "humd_ref", "humd_tol",
     "batt_mvolt_ref", "batt_mvolt_tol", "mdi_name", "disp_text"};
 
+// payload is written twice, to measure it and to stream it to the client
+static bool publish_json(PubSubClient& client, const char* topic,
+                         const std::function<void(JsonWriter&)>& write) {
+  MeasuringPrint measure;
+  {
+    JsonWriter json(measure);
+    write(json);
+  }
+  if (!client.beginPublish(topic, measure.size(), false)) return false;
+  JsonWriter json(client);
+  write(json);
+  return client.endPublish() == 1;
+}
+
 void FactoryTest::_mqtt_callback(const char* topic, uint8_t* payload,
                                  uint32_t length) {
   StaticJsonDocument<512> doc;
@@ -130,19 +146,17 @@ bool FactoryTest::run_test() {
   mqtt_client.subscribe(test_topic.c_str());
 
   // send device discovery message
-  StaticJsonDocument<256> device_doc;
-  device_doc["serial"] = app_.hw_.get_serial_number();
-  device_doc["random_id"] = app_.hw_.get_random_id();
-  device_doc["model_id"] = app_.hw_.get_model_id();
-  device_doc["fw_version"] = SW_VERSION;
-  device_doc["hw_version"] = app_.hw_.get_hw_version();
-
-  char buffer[512];
-  serializeJson(device_doc, buffer, sizeof(buffer));
-
   StaticString<256> topic("%s/%s", FAC_TEST_BASE_TOPIC,
                           app_.hw_.get_serial_number());
-  mqtt_client.publish(topic.c_str(), buffer);
+  publish_json(mqtt_client, topic.c_str(), [&](JsonWriter& json) {
+    json.begin_object();
+    json.add("serial", app_.hw_.get_serial_number())
+        .add("random_id", app_.hw_.get_random_id())
+        .add("model_id", app_.hw_.get_model_id())
+        .add("fw_version", SW_VERSION)
+        .add("hw_version", app_.hw_.get_hw_version());
+    json.end_object();
+  });
 
   // wait for test start message
   while (!test_spec_.received) {
@@ -241,26 +255,25 @@ bool FactoryTest::run_test() {
 #endif
 
   // send test results
-  StaticJsonDocument<1024> result_doc;
-
-  JsonObject device = result_doc.createNestedObject("device");
-  device["serial"] = app_.hw_.get_serial_number();
-  device["random_id"] = app_.hw_.get_random_id();
-  device["model_id"] = app_.hw_.get_model_id();
-  device["fw_version"] = SW_VERSION;
-  device["hw_version"] = app_.hw_.get_hw_version();
-  result_doc["passed"] = passed;
-
-  JsonObject parameters = result_doc.createNestedObject("parameters");
-  parameters["measured_temp"] = temp_val;
-  parameters["measured_humidity"] = hmd_val;
-  parameters["measured_battery"] = batt_v;
-
-  serializeJson(result_doc, buffer, sizeof(buffer));
-
   StaticString<256> result_topic("%s/%s/test_result", FAC_TEST_BASE_TOPIC,
                                  app_.hw_.get_serial_number());
-  mqtt_client.publish(result_topic.c_str(), buffer);
+  publish_json(mqtt_client, result_topic.c_str(), [&](JsonWriter& json) {
+    json.begin_object();
+    json.begin_object("device")
+        .add("serial", app_.hw_.get_serial_number())
+        .add("random_id", app_.hw_.get_random_id())
+        .add("model_id", app_.hw_.get_model_id())
+        .add("fw_version", SW_VERSION)
+        .add("hw_version", app_.hw_.get_hw_version())
+        .end_object();
+    json.add("passed", passed);
+    json.begin_object("parameters")
+        .add("measured_temp", temp_val)
+        .add("measured_humidity", hmd_val)
+        .add("measured_battery", batt_v)
+        .end_object();
+    json.end_object();
+  });
 
   if (passed) {
     info("factory test passed");
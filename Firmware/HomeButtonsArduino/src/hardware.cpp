@@ -242,6 +242,14 @@ void HardwareDefinition::begin() {
   ledcAttachPin(LED4_PIN, LED4_CH);
 #endif
 
+#if defined(HAS_BUTTON_UI)
+  // gamma corrected duty for each brightness pct, so setting a level in a
+  // keyframe doesn't need pow()
+  for (uint8_t pct = 0; pct <= 100; pct++) {
+    led_pwm_lut_[pct] = LED_PCT2PWM(pct, LED_MAX_PWM);
+  }
+#endif
+
   // enable hardware ledc fading
   ledc_fade_func_install(0);
 }
@@ -420,14 +428,12 @@ void HardwareDefinition::set_all_leds(uint16_t brightness, uint16_t fade_time) {
 
 void HardwareDefinition::set_led_pct_num(uint8_t num, uint8_t brightness_pct,
                                          uint16_t fade_time) {
-  uint16_t brightness = LED_PCT2PWM(brightness_pct, LED_MAX_PWM);
-  set_led_num(num, brightness, fade_time);
+  set_led_num(num, led_pwm(brightness_pct), fade_time);
 }
 
 void HardwareDefinition::set_all_leds_pct(uint8_t brightness_pct,
                                           uint16_t fade_time) {
-  uint16_t brightness = LED_PCT2PWM(brightness_pct, LED_MAX_PWM);
-  set_all_leds(brightness, fade_time);
+  set_all_leds(led_pwm(brightness_pct), fade_time);
 }
 
 #endif
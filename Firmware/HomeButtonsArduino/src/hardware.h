@@ -124,6 +124,9 @@ struct HardwareDefinition : public Logger {
                     uint16_t fade_time = LED_DEFAULT_FADE_TIME);
   void set_all_leds_pct(uint8_t brightness_pct,
                         uint16_t fade_time = LED_DEFAULT_FADE_TIME);
+  uint16_t led_pwm(uint8_t brightness_pct) const {
+    return led_pwm_lut_[brightness_pct > 100 ? 100 : brightness_pct];
+  }
 
 #endif
 
@@ -200,6 +203,10 @@ struct HardwareDefinition : public Logger {
   char model_name_[30] = "";
   char unique_id_[22] = "";
 
+#if defined(HAS_BUTTON_UI)
+  uint16_t led_pwm_lut_[101] = {};  // filled in begin()
+#endif
+
   bool _efuse_burned();
   void _read_efuse();
   void _write_efuse();
@@ -0,0 +1,136 @@
+#include "json_writer.h"
+
+#include <cmath>
+#include <cstdio>
+
+JsonWriter& JsonWriter::begin_object(const char* key) {
+  _key(key);
+  _push('{');
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+  _pop('}');
+  return *this;
+}
+
+JsonWriter& JsonWriter::begin_array(const char* key) {
+  _key(key);
+  _push('[');
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+  _pop(']');
+  return *this;
+}
+
+JsonWriter& JsonWriter::add(const char* key, const char* value) {
+  _key(key);
+  if (value != nullptr) {
+    _string(value);
+  } else {
+    out_.print("null");
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::add(const char* key, bool value) {
+  _key(key);
+  out_.print(value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter& JsonWriter::_add_int(const char* key, long long value) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lld", value);
+  _key(key);
+  out_.print(buffer);
+  return *this;
+}
+
+JsonWriter& JsonWriter::_add_uint(const char* key, unsigned long long value) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%llu", value);
+  _key(key);
+  out_.print(buffer);
+  return *this;
+}
+
+JsonWriter& JsonWriter::_add_float(const char* key, double value) {
+  _key(key);
+  if (std::isfinite(value)) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%.7g", value);
+    out_.print(buffer);
+  } else {
+    out_.print("null");
+  }
+  return *this;
+}
+
+void JsonWriter::_key(const char* key) {
+  if (depth_ > 0 && depth_ <= kMaxDepth) {
+    uint8_t bit = 1 << (depth_ - 1);
+    if (has_items_ & bit) out_.write(',');
+    has_items_ |= bit;
+  }
+  if (key != nullptr) {
+    _string(key);
+    out_.write(':');
+  }
+}
+
+void JsonWriter::_string(const char* value) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out_.write('"');
+  const char* run = value;
+  for (const char* p = value; *p; p++) {
+    uint8_t c = static_cast<uint8_t>(*p);
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    // flush the unescaped run before the escaped character
+    out_.write(reinterpret_cast<const uint8_t*>(run), p - run);
+    run = p + 1;
+    out_.write('\\');
+    switch (c) {
+      case '"':
+      case '\\':
+        out_.write(c);
+        break;
+      case '\n':
+        out_.write('n');
+        break;
+      case '\r':
+        out_.write('r');
+        break;
+      case '\t':
+        out_.write('t');
+        break;
+      default:
+        out_.print("u00");
+        out_.write(kHex[c >> 4]);
+        out_.write(kHex[c & 0xf]);
+    }
+  }
+  out_.write(reinterpret_cast<const uint8_t*>(run), strlen(run));
+  out_.write('"');
+}
+
+void JsonWriter::_push(char bracket) {
+  out_.write(bracket);
+  if (depth_ >= kMaxDepth) {
+    ok_ = false;
+  } else {
+    has_items_ &= ~(1 << depth_);
+  }
+  depth_++;
+}
+
+void JsonWriter::_pop(char bracket) {
+  if (depth_ == 0) {
+    ok_ = false;
+    return;
+  }
+  depth_--;
+  out_.write(bracket);
+}
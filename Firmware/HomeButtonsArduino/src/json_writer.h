@@ -0,0 +1,68 @@
+#ifndef HOMEBUTTONS_JSON_WRITER_H
+#define HOMEBUTTONS_JSON_WRITER_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include "static_string.h"
+
+// Writes JSON directly to a Print, without building a document first.
+// Stack cost is fixed: nesting is tracked in a bitmask (up to kMaxDepth
+// levels) and numbers are formatted in a small local buffer.
+class JsonWriter {
+ public:
+  static constexpr uint8_t kMaxDepth = 8;
+
+  explicit JsonWriter(Print& out) : out_(out) {}
+  JsonWriter(const JsonWriter&) = delete;
+
+  // key is nullptr for the root and array elements
+  JsonWriter& begin_object(const char* key = nullptr);
+  JsonWriter& end_object();
+  JsonWriter& begin_array(const char* key = nullptr);
+  JsonWriter& end_array();
+
+  JsonWriter& add(const char* key, const char* value);
+  JsonWriter& add(const char* key, const String& value) {
+    return add(key, value.c_str());
+  }
+  template <size_t N>
+  JsonWriter& add(const char* key, const StaticString<N>& value) {
+    return add(key, value.c_str());
+  }
+  JsonWriter& add(const char* key, bool value);
+  template <typename T, typename std::enable_if<
+                            std::is_integral<T>::value &&
+                                !std::is_same<T, bool>::value,
+                            int>::type = 0>
+  JsonWriter& add(const char* key, T value) {
+    if (std::is_signed<T>::value) {
+      return _add_int(key, static_cast<long long>(value));
+    } else {
+      return _add_uint(key, static_cast<unsigned long long>(value));
+    }
+  }
+  template <typename T, typename std::enable_if<
+                            std::is_floating_point<T>::value, int>::type = 0>
+  JsonWriter& add(const char* key, T value) {
+    return _add_float(key, static_cast<double>(value));
+  }
+
+  // false if nesting was too deep or unbalanced
+  bool ok() const { return ok_; }
+
+ private:
+  Print& out_;
+  uint8_t depth_ = 0;
+  uint8_t has_items_ = 0;  // bit per level, set after the first item
+  bool ok_ = true;
+
+  void _key(const char* key);
+  void _string(const char* value);
+  void _push(char bracket);
+  void _pop(char bracket);
+  JsonWriter& _add_int(const char* key, long long value);
+  JsonWriter& _add_uint(const char* key, unsigned long long value);
+  JsonWriter& _add_float(const char* key, double value);
+};
+
+#endif  // HOMEBUTTONS_JSON_WRITER_H
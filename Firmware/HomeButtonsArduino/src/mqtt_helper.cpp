@@ -1,353 +1,331 @@
 #include "mqtt_helper.h"
 
 #include <Arduino.h>
-#include <ArduinoJson.h>
+#include <algorithm>
 
 #include "config.h"
 #include "network.h"
 #include "state.h"
 #include "hardware.h"
 #include "static_string.h"
-
-template <size_t SIZE>
-bool convertToJson(const StaticString<SIZE>& src, JsonVariant dst) {
-  return dst.set(
-      const_cast<char*>(src.c_str()));  // Warning: use char*, not const char*
-                                        // to force a copy in ArduinoJson.
-}
+#include "json_writer.h"
 
 using FormatterType = StaticString<64>;
 
-void MQTTHelper::send_discovery_config() {
-  // clear first
-  clear_discovery_config();
-
-  // device objects
-  StaticJsonDocument<256> device_full;
-  device_full["ids"][0] = _device_state.factory().unique_id;
-  device_full["mdl"] = _device_state.factory().model_name;
-  device_full["name"] = _device_state.device_name();
-  device_full["sw"] = SW_VERSION;
-  device_full["hw"] = _device_state.factory().hw_version;
-  device_full["mf"] = MANUFACTURER;
-  device_full["cu"] = StaticString<32>("http://%s", _device_state.ip());
-
-  StaticJsonDocument<128> device_short;
-  device_short["ids"][0] = _device_state.factory().unique_id;
-
-  uint16_t expire_after = _device_state.sensor_interval() * 60 + 60;  // seconds
-
-  char buffer[MQTT_PYLD_SIZE];
-
-  bool full_device_sent = false;
+template <typename Visitor>
+void MQTTHelper::_for_each_component(Visitor visit) {
+  const UniqueID& uid = _device_state.factory().unique_id;
+#if defined(HAS_SENSOR_BATCH)
+  // sensors are only published once per batch
+  uint8_t batch =
+      _device_state.sensor_batch() > 1 ? _device_state.sensor_batch() : 1;
+#else
+  uint8_t batch = 1;
+#endif
+  // longest time without a publish in minutes, unchanged values are only
+  // published with the heartbeat
+  uint32_t interval = _device_state.sensor_interval() * batch;
+  uint32_t silence =
+      std::max<uint32_t>(interval, _device_state.report_heartbeat());
+  uint32_t expire_after = silence * 60 + 60;  // seconds
+  auto no_fields = [](JsonWriter&) {};
 
 #if defined(HAS_BUTTON_UI)
   for (auto bsl_w : bsl_input_.GetBtnSwLEDs()) {
-    auto bsl = bsl_w.get();
+    auto& bsl = bsl_w.get();
+    uint16_t id = bsl.id();
+    FormatterType button("button_%d", id);
+    FormatterType button_double("button_%d_double", id);
+    FormatterType button_triple("button_%d_triple", id);
+    FormatterType button_quad("button_%d_quad", id);
+    FormatterType switch_id("switch_%d", id);
+    FormatterType kill_switch_id("kill_switch_%d", id);
+    auto trigger = [&](const char* topic, const char* type) {
+      return [&, topic, type](JsonWriter& json) {
+        json.add("atype", "trigger")
+            .add("t", topic)
+            .add("pl", BTN_PRESS_PAYLOAD)
+            .add("type", type)
+            .add("stype", button);
+      };
+    };
     if (!bsl.switch_mode()) {
-      // button single press
-      {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["atype"] = "trigger";
-        conf["t"] = topics_.t_btn_press(bsl.id());
-        conf["pl"] = BTN_PRESS_PAYLOAD;
-        conf["type"] = "button_short_press";
-        conf["stype"] = FormatterType("button_%d", bsl.id());
-        if (!full_device_sent) {
-          conf["dev"] = device_full;
-          full_device_sent = true;
-        } else {
-          conf["dev"] = device_short;
-        }
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_btn_config(bsl.id()), buffer, true);
-      }
-
-      // button double press
-      {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["atype"] = "trigger";
-        conf["t"] = topics_.t_btn_press(bsl.id()) + "_double";
-        conf["pl"] = BTN_PRESS_PAYLOAD;
-        conf["type"] = "button_double_press";
-        conf["stype"] = FormatterType("button_%d", bsl.id());
-        conf["dev"] = device_short;
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_btn_double_config(bsl.id()), buffer, true);
-      }
-
-      // button triple press
-      {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["atype"] = "trigger";
-        conf["t"] = topics_.t_btn_press(bsl.id()) + "_triple";
-        conf["pl"] = BTN_PRESS_PAYLOAD;
-        conf["type"] = "button_triple_press";
-        conf["stype"] = FormatterType("button_%d", bsl.id());
-        conf["dev"] = device_short;
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_btn_triple_config(bsl.id()), buffer, true);
-      }
-
-      // button quad press
-      {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["atype"] = "trigger";
-        conf["t"] = topics_.t_btn_press(bsl.id()) + "_quad";
-        conf["pl"] = BTN_PRESS_PAYLOAD;
-        conf["type"] = "button_quadruple_press";
-        conf["stype"] = FormatterType("button_%d", bsl.id());
-        conf["dev"] = device_short;
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_btn_quad_config(bsl.id()), buffer, true);
-      }
+      // remove switch entities left from switch mode
+      visit({"switch", switch_id.c_str(), topics_.t_switch_config(id), true},
+            no_fields);
+      visit({"binary_sensor", kill_switch_id.c_str(),
+             topics_.t_kill_switch_config(id), true},
+            no_fields);
+
+      // an instant button only sends single presses
+      bool instant = bsl.instant_mode();
+      visit({"device_automation", button.c_str(), topics_.t_btn_config(id)},
+            trigger(topics_.t_btn_press(id), "button_short_press"));
+      visit({"device_automation", button_double.c_str(),
+             topics_.t_btn_double_config(id), instant},
+            trigger(topics_.t_btn_double_press(id), "button_double_press"));
+      visit({"device_automation", button_triple.c_str(),
+             topics_.t_btn_triple_config(id), instant},
+            trigger(topics_.t_btn_triple_press(id), "button_triple_press"));
+      visit({"device_automation", button_quad.c_str(),
+             topics_.t_btn_quad_config(id), instant},
+            trigger(topics_.t_btn_quad_press(id), "button_quadruple_press"));
     } else {  // switch
+      // remove button triggers left from button mode
+      visit({"device_automation", button.c_str(), topics_.t_btn_config(id),
+             true},
+            no_fields);
+      visit({"device_automation", button_double.c_str(),
+             topics_.t_btn_double_config(id), true},
+            no_fields);
+      visit({"device_automation", button_triple.c_str(),
+             topics_.t_btn_triple_config(id), true},
+            no_fields);
+      visit({"device_automation", button_quad.c_str(),
+             topics_.t_btn_quad_config(id), true},
+            no_fields);
+
       if (!bsl.is_kill_switch()) {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["name"] = FormatterType("Switch %d", bsl.id());
-        conf["uniq_id"] = FormatterType{} + _device_state.factory().unique_id +
-                          "_switch_" + bsl.id();
-        conf["stat_t"] = topics_.t_switch_state(bsl.id());
-        conf["cmd_t"] = topics_.t_switch_cmd(bsl.id());
-        conf["ic"] = "mdi:radiobox-marked";
-        conf["avty_t"] = topics_.t_avlb();
-        conf["dev"] = device_short;
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_switch_config(bsl.id()), buffer, true);
+        visit({"switch", switch_id.c_str(), topics_.t_switch_config(id)},
+              [&](JsonWriter& json) {
+                json.add("name", FormatterType("Switch %d", id))
+                    .add("uniq_id", FormatterType{} + uid + "_switch_" + id)
+                    .add("stat_t", topics_.t_switch_state(id))
+                    .add("cmd_t", topics_.t_switch_cmd(id))
+                    .add("ic", "mdi:radiobox-marked")
+                    .add("avty_t", topics_.t_avlb());
+              });
       } else {
-        StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-        conf["name"] = "Kill Switch";
-        conf["uniq_id"] = FormatterType{} + _device_state.factory().unique_id +
-                          "_kill_switch";
-        conf["stat_t"] = topics_.t_switch_state(5);
-        conf["ic"] = "mdi:mushroom";
-        conf["avty_t"] = topics_.t_avlb();
-        conf["dev"] = device_short;
-        serializeJson(conf, buffer, sizeof(buffer));
-        _network.publish(topics_.t_kill_switch_config(bsl.id()), buffer, true);
+        visit({"binary_sensor", kill_switch_id.c_str(),
+               topics_.t_kill_switch_config(id)},
+              [&](JsonWriter& json) {
+                json.add("name", "Kill Switch")
+                    .add("uniq_id", FormatterType{} + uid + "_kill_switch")
+                    .add("stat_t", topics_.t_switch_state(5))
+                    .add("ic", "mdi:mushroom")
+                    .add("avty_t", topics_.t_avlb());
+              });
       }
     }
   }
 #endif
 
 #if defined(HAS_TH_SENSOR)
-  {
-    // temperature
-
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Temperature";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_temperature";
-    conf["stat_t"] = topics_.t_temperature();
-    conf["dev_cla"] = "temperature";
-    conf["unit_of_meas"] = _device_state.get_use_fahrenheit() ? "°F" : "°C";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_temperature_config(), buffer, true);
-  }
-
-  {
-    // humidity
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Humidity";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_humidity";
-    conf["stat_t"] = topics_.t_humidity();
-    conf["dev_cla"] = "humidity";
-    conf["unit_of_meas"] = "%";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_humidity_config(), buffer, true);
-  }
+  visit({"sensor", "temperature", topics_.t_temperature_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Temperature")
+              .add("uniq_id", FormatterType{} + uid + "_temperature")
+              .add("stat_t", topics_.t_temperature())
+              .add("dev_cla", "temperature")
+              .add("unit_of_meas",
+                   _device_state.get_use_fahrenheit() ? "°F" : "°C")
+              .add("exp_aft", expire_after);
+        });
+
+  visit({"sensor", "humidity", topics_.t_humidity_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Humidity")
+              .add("uniq_id", FormatterType{} + uid + "_humidity")
+              .add("stat_t", topics_.t_humidity())
+              .add("dev_cla", "humidity")
+              .add("unit_of_meas", "%")
+              .add("exp_aft", expire_after);
+        });
 #endif
 
 #if defined(HAS_BATTERY)
-  {
-    // battery
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Battery";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_battery";
-    conf["stat_t"] = topics_.t_battery();
-    conf["dev_cla"] = "battery";
-    conf["unit_of_meas"] = "%";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_battery_config(), buffer, true); 
-  }
+  visit({"sensor", "battery", topics_.t_battery_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Battery")
+              .add("uniq_id", FormatterType{} + uid + "_battery")
+              .add("stat_t", topics_.t_battery())
+              .add("dev_cla", "battery")
+              .add("unit_of_meas", "%")
+              .add("exp_aft", expire_after);
+        });
 #endif
 
 #if defined(HAS_TH_SENSOR)
-  {
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Sensor interval";
-    conf["uniq_id"] = FormatterType{} + _device_state.factory().unique_id +
-                      "_sensor_interval";
-    conf["cmd_t"] = topics_.t_sensor_interval_cmd();
-    conf["stat_t"] = topics_.t_sensor_interval_state();
-    conf["unit_of_meas"] = "min";
-    conf["min"] = SEN_INTERVAL_MIN;
-    conf["max"] = SEN_INTERVAL_MAX;
-    conf["mode"] = "slider";
-    conf["ic"] = "mdi:timer-sand";
-    conf["ret"] = "true";
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_sensor_interval_config(), buffer, true);
-  }
+  visit({"number", "sensor_interval", topics_.t_sensor_interval_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Sensor interval")
+              .add("uniq_id", FormatterType{} + uid + "_sensor_interval")
+              .add("cmd_t", topics_.t_sensor_interval_cmd())
+              .add("stat_t", topics_.t_sensor_interval_state())
+              .add("unit_of_meas", "min")
+              .add("min", SEN_INTERVAL_MIN)
+              .add("max", SEN_INTERVAL_MAX)
+              .add("mode", "slider")
+              .add("ic", "mdi:timer-sand")
+              .add("ret", "true");
+        });
+#endif
+
+#if defined(HAS_SENSOR_BATCH)
+  visit({"number", "sensor_batch", topics_.t_sensor_batch_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Sensor batch")
+              .add("uniq_id", FormatterType{} + uid + "_sensor_batch")
+              .add("cmd_t", topics_.t_sensor_batch_cmd())
+              .add("stat_t", topics_.t_sensor_batch_state())
+              .add("min", 1)
+              .add("max", SENSOR_BATCH_MAX)
+              .add("mode", "box")
+              .add("ic", "mdi:tray-full")
+              .add("ret", "true");
+        });
 #endif
 
 #if defined(HAS_DISPLAY)
   // button labels
   for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = FormatterType{} + "Button " + (i + 1) + " label";
-    conf["uniq_id"] = FormatterType{} + _device_state.factory().unique_id +
-                      "_button_" + (i + 1) + "_label";
-    conf["cmd_t"] = topics_.t_btn_label_cmd(i + 1);
-    conf["stat_t"] = topics_.t_btn_label_state(i + 1);
-    conf["max"] = BTN_LABEL_MAXLEN;
-    conf["ic"] = FormatterType("mdi:numeric-%d-box", i + 1);
-    conf["ret"] = "true";
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_btn_label_config(i + 1), buffer, true);
+    FormatterType label_id("button_%d_label", i + 1);
+    visit({"text", label_id.c_str(), topics_.t_btn_label_config(i + 1)},
+          [&](JsonWriter& json) {
+            json.add("name", FormatterType{} + "Button " + (i + 1) + " label")
+                .add("uniq_id", FormatterType{} + uid + "_" + label_id)
+                .add("cmd_t", topics_.t_btn_label_cmd(i + 1))
+                .add("stat_t", topics_.t_btn_label_state(i + 1))
+                .add("max", BTN_LABEL_MAXLEN)
+                .add("ic", FormatterType("mdi:numeric-%d-box", i + 1))
+                .add("ret", "true");
+          });
   }
 
-  {
-    // user message
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Show message";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_user_message";
-    conf["cmd_t"] = topics_.t_disp_msg_cmd();
-    conf["stat_t"] = topics_.t_disp_msg_state();
-    conf["max"] = USER_MSG_MAXLEN;
-    conf["ic"] = "mdi:message-text";
-    conf["ret"] = "true";
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_user_message_config(), buffer, true);
-  }
+  // user message
+  visit({"text", "user_message", topics_.t_user_message_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Show message")
+              .add("uniq_id", FormatterType{} + uid + "_user_message")
+              .add("cmd_t", topics_.t_disp_msg_cmd())
+              .add("stat_t", topics_.t_disp_msg_state())
+              .add("max", USER_MSG_MAXLEN)
+              .add("ic", "mdi:message-text")
+              .add("ret", "true");
+        });
 #endif
 
 #if defined(HAS_SLEEP_MODE)
-  {
-    // schedule wakeup
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Schedule wakeup";
-    conf["uniq_id"] = FormatterType{} + _device_state.factory().unique_id +
-                      "_schedule_wakeup";
-    conf["cmd_t"] = topics_.t_schedule_wakeup_cmd();
-    conf["stat_t"] = topics_.t_schedule_wakeup_state();
-    conf["unit_of_meas"] = "s";
-    conf["min"] = SCHEDULE_WAKEUP_MIN;
-    conf["max"] = SCHEDULE_WAKEUP_MAX;
-    conf["mode"] = "box";
-    conf["ic"] = "mdi:alarm";
-    conf["ret"] = "true";
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_schedule_wakeup_config(), buffer, true);
-  }
+  visit({"number", "schedule_wakeup", topics_.t_schedule_wakeup_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Schedule wakeup")
+              .add("uniq_id", FormatterType{} + uid + "_schedule_wakeup")
+              .add("cmd_t", topics_.t_schedule_wakeup_cmd())
+              .add("stat_t", topics_.t_schedule_wakeup_state())
+              .add("unit_of_meas", "s")
+              .add("min", SCHEDULE_WAKEUP_MIN)
+              .add("max", SCHEDULE_WAKEUP_MAX)
+              .add("mode", "box")
+              .add("ic", "mdi:alarm")
+              .add("ret", "true");
+        });
 #endif
 
 #if defined(HAS_AWAKE_MODE)
-  {
-    // awake mode toggle
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Awake mode";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_awake_mode";
-    conf["cmd_t"] = topics_.t_awake_mode_cmd();
-    conf["stat_t"] = topics_.t_awake_mode_state();
-    conf["ic"] = "mdi:coffee";
-    conf["ret"] = "true";
-    conf["avty_t"] = topics_.t_awake_mode_avlb();
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_awake_mode_config(), buffer, true);
-  }
+  visit({"switch", "awake_mode", topics_.t_awake_mode_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "Awake mode")
+              .add("uniq_id", FormatterType{} + uid + "_awake_mode")
+              .add("cmd_t", topics_.t_awake_mode_cmd())
+              .add("stat_t", topics_.t_awake_mode_state())
+              .add("ic", "mdi:coffee")
+              .add("ret", "true")
+              .add("avty_t", topics_.t_awake_mode_avlb());
+        });
 #endif
 
 #if defined(HOME_BUTTONS_INDUSTRIAL)
-  {
-    // led brightness slider
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "LED brightness";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_led_amb_bright";
-    conf["cmd_t"] = topics_.t_led_amb_bright_cmd();
-    conf["stat_t"] = topics_.t_led_amb_bright_state();
-    conf["avty_t"] = topics_.t_avlb();
-    conf["unit_of_meas"] = "%";
-    conf["min"] = 0;
-    conf["max"] = LED_MAX_AMB_BRIGHT;
-    conf["mode"] = "slider";
-    conf["ic"] = "mdi:led-on";
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_led_amb_bright_config(), buffer, true);
-  }
+  visit({"number", "led_amb_bright", topics_.t_led_amb_bright_config()},
+        [&](JsonWriter& json) {
+          json.add("name", "LED brightness")
+              .add("uniq_id", FormatterType{} + uid + "_led_amb_bright")
+              .add("cmd_t", topics_.t_led_amb_bright_cmd())
+              .add("stat_t", topics_.t_led_amb_bright_state())
+              .add("avty_t", topics_.t_avlb())
+              .add("unit_of_meas", "%")
+              .add("min", 0)
+              .add("max", LED_MAX_AMB_BRIGHT)
+              .add("mode", "slider")
+              .add("ic", "mdi:led-on");
+        });
 #endif
 }
 
-void MQTTHelper::update_discovery_config() {
-  StaticJsonDocument<128> device_short;
-  device_short["ids"][0] = _device_state.factory().unique_id;
-
-  char buffer[MQTT_PYLD_SIZE];
+void MQTTHelper::send_discovery_config() {
+  if (_device_state.user_preferences().device_discovery) {
+    _send_device_config();
+  } else {
+    _send_entity_configs();
+  }
+}
 
-  uint16_t expire_after = _device_state.sensor_interval() * 60 + 60;  // seconds
+void MQTTHelper::update_discovery_config() {
+  // unchanged configs are skipped by the retained ledger
+  send_discovery_config();
+}
 
-#if defined(HAS_TH_SENSOR)
-  {
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Temperature";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_temperature";
-    conf["stat_t"] = topics_.t_temperature();
-    conf["dev_cla"] = "temperature";
-    conf["unit_of_meas"] = _device_state.get_use_fahrenheit() ? "°F" : "°C";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_temperature_config(), buffer, true);
+void MQTTHelper::_write_device(JsonWriter& json, bool full) {
+  json.begin_object("dev");
+  json.begin_array("ids").add(nullptr, _device_state.factory().unique_id);
+  json.end_array();
+  if (full) {
+    json.add("mdl", _device_state.factory().model_name)
+        .add("name", _device_state.device_name())
+        .add("sw", SW_VERSION)
+        .add("hw", _device_state.factory().hw_version)
+        .add("mf", MANUFACTURER)
+        .add("cu", StaticString<32>("http://%s", _device_state.ip()));
   }
+  json.end_object();
+}
 
-  {
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Humidity";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_humidity";
-    conf["stat_t"] = topics_.t_humidity();
-    conf["dev_cla"] = "humidity";
-    conf["unit_of_meas"] = "%";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_humidity_config(), buffer, true);
-  }
-#endif
+void MQTTHelper::_send_entity_configs() {
+  bool full_device_sent = false;
+  _for_each_component([&](const Component& c, const auto& fields) {
+    if (c.remove) {
+      _network.publish_if_changed(c.config_topic, "");
+      return;
+    }
+    bool full_device = !full_device_sent;
+    full_device_sent = true;
+    _network.publish_streamed_if_changed(c.config_topic, [&](Print& out) {
+      JsonWriter json(out);
+      json.begin_object();
+      fields(json);
+      _write_device(json, full_device);
+      json.end_object();
+    });
+  });
+
+  // remove device config left from device discovery mode
+  _network.publish_if_changed(topics_.t_device_config(), "");
+}
 
-#if defined(HAS_BATTERY)
-  {
-    StaticJsonDocument<MQTT_PYLD_SIZE> conf;
-    conf["name"] = "Battery";
-    conf["uniq_id"] =
-        FormatterType{} + _device_state.factory().unique_id + "_battery";
-    conf["stat_t"] = topics_.t_battery();
-    conf["dev_cla"] = "battery";
-    conf["unit_of_meas"] = "%";
-    conf["exp_aft"] = expire_after;
-    conf["dev"] = device_short;
-    serializeJson(conf, buffer, sizeof(buffer));
-    _network.publish(topics_.t_battery_config(), buffer, true);
-  }
-#endif
+void MQTTHelper::_send_device_config() {
+  // remove entity configs left from entity discovery mode
+  _for_each_component([&](const Component& c, const auto&) {
+    _network.publish_if_changed(c.config_topic, "");
+  });
+
+  _network.publish_streamed_if_changed(
+      topics_.t_device_config(), [&](Print& out) {
+        JsonWriter json(out);
+        json.begin_object();
+        _write_device(json, true);
+        json.begin_object("o")
+            .add("name", DEVICE_NAME_DFLT)
+            .add("sw", SW_VERSION)
+            .end_object();
+        json.begin_object("cmps");
+        _for_each_component([&](const Component& c, const auto& fields) {
+          // a component with only the platform is removed
+          json.begin_object(c.object_id).add("p", c.platform);
+          if (!c.remove) fields(json);
+          json.end_object();
+        });
+        json.end_object();
+        json.end_object();
+      });
 }
 
 void MQTTHelper::clear_discovery_config() {
@@ -358,7 +336,7 @@ void MQTTHelper::clear_discovery_config() {
 
 #if defined(HAS_BUTTON_UI)
   for (auto bsl_w : bsl_input_.GetBtnSwLEDs()) {
-    auto bsl = bsl_w.get();
+    auto& bsl = bsl_w.get();
     _network.publish(topics_.t_btn_config(bsl.id()), empty_payload, true);
     _network.publish(topics_.t_btn_double_config(bsl.id()), empty_payload,
                      true);
@@ -377,6 +355,10 @@ void MQTTHelper::clear_discovery_config() {
   _network.publish(topics_.t_sensor_interval_config(), empty_payload, true);
 #endif
 
+#if defined(HAS_SENSOR_BATCH)
+  _network.publish(topics_.t_sensor_batch_config(), empty_payload, true);
+#endif
+
 #if defined(HAS_BATTERY)
   _network.publish(topics_.t_battery_config(), empty_payload, true);
 #endif
@@ -401,4 +383,6 @@ void MQTTHelper::clear_discovery_config() {
 #if defined(HOME_BUTTONS_INDUSTRIAL)
   _network.publish(topics_.t_led_amb_bright_config(), empty_payload, true);
 #endif
+
+  _network.publish(topics_.t_device_config(), empty_payload, true);
 }
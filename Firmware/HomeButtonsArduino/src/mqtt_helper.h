@@ -9,6 +9,7 @@
 #include "button_ui/btn_sw_led.h"
 
 class DeviceState;
+class JsonWriter;
 class Network;
 
 class MQTTHelper {
@@ -24,6 +25,21 @@ class MQTTHelper {
   void clear_discovery_config();
 
  private:
+  struct Component {
+    const char* platform;
+    const char* object_id;
+    const char* config_topic;  // used in entity discovery mode
+    bool remove = false;       // left from another button/switch mode
+  };
+
+  // calls visit(const Component&, fields) for every entity, fields(JsonWriter&)
+  // writes the entity specific config
+  template <typename Visitor>
+  void _for_each_component(Visitor visit);
+  void _write_device(JsonWriter& json, bool full);
+  void _send_entity_configs();
+  void _send_device_config();
+
   DeviceState& _device_state;
   BtnSwLEDInput<NUM_BUTTONS>& bsl_input_;
   Network& _network;
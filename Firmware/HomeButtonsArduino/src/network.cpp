@@ -1,11 +1,13 @@
 #include "network.h"
 #include <esp_wifi.h>
+#include <esp_vfs_eventfd.h>
+#include <esp_timer.h>
+#include <sys/select.h>
 #include "config.h"
 #include "state.h"
 #include "utils.h"
-
-static constexpr uint8_t MQTT_QUEUE_SIZE = 4;
-static constexpr uint8_t MQTT_QUEUE_ITEMS_PER_LOOP = 5;
+#include "print_utils.h"
+#include "wake_profiler.h"
 
 String mac2String(uint8_t ar[]) {
   String s;
@@ -21,6 +23,7 @@ String mac2String(uint8_t ar[]) {
 
 void NetworkSMStates::IdleState::loop() {
   if (sm().command_ == Network::Command::CONNECT) {
+    sm().connect_lock_.acquire();
     if (sm().device_state_.persisted().wifi_quick_connect) {
       return transition_to<QuickConnectState>();
     } else {
@@ -34,6 +37,14 @@ void NetworkSMStates::QuickConnectState::entry() {
   sm().info("connecting Wi-Fi (quick mode)...");
   WiFi.mode(WIFI_STA);
   WiFi.persistent(true);
+  // quick mode reuses the saved config, the listen interval is only applied
+  // when associating
+  wifi_config_t conf;
+  if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK &&
+      conf.sta.listen_interval != WIFI_LISTEN_INTERVAL) {
+    conf.sta.listen_interval = WIFI_LISTEN_INTERVAL;
+    esp_wifi_set_config(WIFI_IF_STA, &conf);
+  }
   start_time_ = millis();
   WiFi.begin();
 }
@@ -126,6 +137,7 @@ void NetworkSMStates::MQTTConnectState::loop() {
   if (sm().command_ == Network::Command::DISCONNECT) {
     return transition_to<DisconnectState>();
   } else if (sm().mqtt_client_.connected()) {
+    WakeProfiler::mark(WakePhase::kMqttConnected);
     sm().info("MQTT connected in %lu ms.", millis() - start_time_);
     sm().info("Network connected in %lu ms.",
               millis() - sm().cmd_connect_time_);
@@ -146,6 +158,7 @@ void NetworkSMStates::MQTTConnectState::loop() {
 }
 
 void NetworkSMStates::WifiConnectedState::loop() {
+  WakeProfiler::mark(WakePhase::kWifiConnected);
   sm().state_ = Network::State::W_CONNECTED;
   sm().device_state_.set_ip(WiFi.localIP());
   sm().info("Wi-Fi connected.");
@@ -165,6 +178,7 @@ void NetworkSMStates::DisconnectState::entry() {
   sm().wifi_client_.flush();
   WiFi.disconnect(true, sm().erase_);
   WiFi.mode(WIFI_OFF);
+  sm().connect_lock_.release();
   sm().state_ = Network::State::DISCONNECTED;
   sm().info("disconnected.");
 }
@@ -175,6 +189,12 @@ void NetworkSMStates::DisconnectState::loop() {
 
 void NetworkSMStates::FullyConnectedState::entry() {
   last_conn_check_time_ = millis();
+  sm().connect_lock_.release();
+  // the modem wakes for every listen interval instead of every beacon,
+  // sleep mode wakes are short and keep the default
+  if (sm().device_state_.flags().awake_mode) {
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+  }
   if (sm().on_connect_callback_) {
     sm().on_connect_callback_();
   }
@@ -183,9 +203,11 @@ void NetworkSMStates::FullyConnectedState::entry() {
 
 void NetworkSMStates::FullyConnectedState::loop() {
   if (sm().command_ == Network::Command::DISCONNECT &&
-      uxQueueMessagesWaiting(sm().mqtt_publish_queue_) == 0) {
+      sm().event_queue_.waiting() == 0 && sm().publish_queue_.waiting() == 0) {
     return transition_to<DisconnectState>();
-  } else if (millis() - last_conn_check_time_ > NET_CONN_CHECK_INTERVAL) {
+  }
+  uint32_t since_check = millis() - last_conn_check_time_;
+  if (since_check >= NET_CONN_CHECK_INTERVAL) {
     if (WiFi.status() != WL_CONNECTED) {
       sm().warning("Wi-Fi connection interrupted. Reconnecting...");
       return transition_to<DisconnectState>();
@@ -195,16 +217,19 @@ void NetworkSMStates::FullyConnectedState::loop() {
       return transition_to<MQTTConnectState>();
     }
     last_conn_check_time_ = millis();
+    since_check = 0;
+  }
+
+  // drain both queues in one wake, events always go first
+  while (true) {
+    if (sm()._publish_from_queue(sm().event_queue_)) continue;
+    if (!sm()._publish_from_queue(sm().publish_queue_)) break;
+  }
+
+  if (sm().command_ == Network::Command::DISCONNECT) {
+    sm().wait_timeout_ = 0;
   } else {
-    SM::PublishQueueElement element;
-    uint8_t max_element_to_process = MQTT_QUEUE_ITEMS_PER_LOOP;
-    while (max_element_to_process > 0 && sm().mqtt_publish_queue_ != nullptr &&
-           xQueueReceive(sm().mqtt_publish_queue_, &element, 0)) {
-      sm().debug("received payload (topic: %s)", element.topic.c_str());
-      sm()._publish_unsafe(element.topic, element.payload.c_str(),
-                           element.retained);
-      max_element_to_process--;
-    }
+    sm().wait_timeout_ = NET_CONN_CHECK_INTERVAL - since_check;
   }
 }
 
@@ -213,61 +238,221 @@ Network::Network(DeviceState &device_state, TopicHelper &topics)
       Logger("NET"),
       device_state_(device_state),
       mqtt_client_(wifi_client_),
-      topics_(topics) {
-  mqtt_publish_queue_ =
-      xQueueCreate(MQTT_QUEUE_SIZE, sizeof(PublishQueueElement));
-  if (mqtt_publish_queue_ == nullptr) error("Failed to create publish queue");
+      topics_(topics),
+      event_queue_(MQTT_EVENT_QUEUE_SIZE, false),
+      publish_queue_(MQTT_PUBLISH_QUEUE_SIZE, MQTT_COALESCE_LOW_PRIO) {
+  if (!event_queue_.valid() || !publish_queue_.valid())
+    error("Failed to create publish queue");
 }
 
-Network::~Network() {
-  if (mqtt_publish_queue_ != nullptr) {
-    vQueueDelete(mqtt_publish_queue_);
-  }
-}
+Network::~Network() {}
 
 void Network::connect() {
+  // may already be connecting since early in the boot
+  if (command_ == Command::CONNECT) return;
   command_ = Command::CONNECT;
   cmd_connect_time_ = millis();
   this->erase_ = false;
   debug("cmd connect");
+  _wake();
 }
 
 void Network::disconnect(bool erase) {
   command_ = Command::DISCONNECT;
   this->erase_ = erase;
   debug("cmd disconnect");
+  _wake();
 }
 
 void Network::update() {
+  wait_timeout_ = NET_POLL_INTERVAL;
   mqtt_client_.loop();
   loop();
 }
 
-void Network::setup() { network_task_handle_ = xTaskGetCurrentTaskHandle(); }
+void Network::wait() {
+  if (wait_timeout_ == 0) return;
+  if (wake_fd_ < 0) {
+    delay(wait_timeout_);
+    return;
+  }
+  bool connected = state_ == State::M_CONNECTED && mqtt_client_.connected();
+  if (connected && wifi_client_.available() > 0) {
+    return;  // already buffered by the client, select() would not see it
+  }
+  fd_set read_fds;
+  FD_ZERO(&read_fds);
+  FD_SET(wake_fd_, &read_fds);
+  int max_fd = wake_fd_;
+  int socket_fd = connected ? wifi_client_.fd() : -1;
+  if (socket_fd >= 0) {
+    FD_SET(socket_fd, &read_fds);
+    max_fd = std::max(max_fd, socket_fd);
+  }
+  timeval timeout = {static_cast<time_t>(wait_timeout_ / 1000),
+                     static_cast<suseconds_t>((wait_timeout_ % 1000) * 1000)};
+  int ret = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+  if (ret > 0 && FD_ISSET(wake_fd_, &read_fds)) {
+    uint64_t count;
+    read(wake_fd_, &count, sizeof(count));
+  }
+}
+
+void Network::setup() {
+  network_task_handle_ = xTaskGetCurrentTaskHandle();
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  esp_err_t err = esp_vfs_eventfd_register(&config);
+  if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+    wake_fd_ = eventfd(0, 0);
+  }
+  if (wake_fd_ < 0) {
+    error("eventfd failed, falling back to polling");
+  }
+}
+
+void Network::_wake() {
+  if (wake_fd_ < 0) return;
+  uint64_t one = 1;
+  write(wake_fd_, &one, sizeof(one));
+}
 
 Network::State Network::get_state() { return state_; }
 
-void Network::publish(const TopicType &topic, const PayloadType &payload,
-                      bool retained) {
+void Network::publish(const char *topic, const PayloadType &payload,
+                      bool retained, Priority priority) {
+  publish(topic, payload.c_str(), retained, priority);
+}
+
+void Network::publish(const char *topic, const char *payload, bool retained,
+                      Priority priority) {
+  if (retained) {
+    // payload not tracked, next publish_if_changed() must not skip
+    retained_ledger_.forget(topic);
+  }
+  _publish(topic, payload, retained, priority);
+}
+
+void Network::publish_if_changed(const char *topic, const PayloadType &payload,
+                                 Priority priority) {
+  publish_if_changed(topic, payload.c_str(), priority);
+}
+
+void Network::publish_if_changed(const char *topic, const char *payload,
+                                 Priority priority) {
+  uint32_t payload_hash = fnv1a_32(payload);
+  if (!retained_ledger_.stage(topic, payload_hash)) {
+    debug("unchanged, skipped (topic: %s)", topic);
+    return;
+  }
+  _publish(topic, payload, true, priority, &payload_hash);
+}
+
+void Network::publish(const char *topic,
+                      const std::function<void(Print &)> &write_payload,
+                      bool retained, Priority priority) {
+  if (retained) {
+    retained_ledger_.forget(topic);
+  }
+  MeasuringPrint measure;
+  write_payload(measure);
+  _publish_streamed(topic, measure.size(), write_payload, retained, priority);
+}
+
+uint32_t Network::publish_confirmed(
+    const char *topic, const std::function<void(Print &)> &write_payload,
+    Priority priority) {
+  MeasuringPrint measure;
+  write_payload(measure);
+  uint32_t payload_hash = measure.hash();
+  _publish_streamed(topic, measure.size(), write_payload, false, priority,
+                    &payload_hash);
+  return payload_hash;
+}
+
+void Network::_publish_streamed(
+    const char *topic, size_t length,
+    const std::function<void(Print &)> &write_payload, bool retained,
+    Priority priority, const uint32_t *sent_hash) {
+  if (xTaskGetCurrentTaskHandle() == network_task_handle_) {
+    bool sent = _stream_unsafe(topic, length, write_payload, retained);
+    if (sent && sent_hash != nullptr) {
+      sent_hash_ = *sent_hash;
+    }
+    return;
+  }
+  PublishQueue &queue =
+      priority == Priority::URGENT ? event_queue_ : publish_queue_;
+  size_t written = 0;
+  auto write_counted = [&](Print &out) {
+    CountingPrint counted(out);
+    write_payload(counted);
+    written = counted.size();
+  };
+  bool queued =
+      sent_hash != nullptr
+          ? queue.push_tracked(topic, length, write_counted, *sent_hash)
+          : queue.push(topic, length, write_counted, retained);
+  if (queued) {
+    debug("queue send successful (topic: %s, free: %u B)", topic,
+          queue.free_space());
+    if (written != length) {
+      // the record holds the bytes that fit in the measured length
+      error("payload changed between passes, wrote %u of %u B (topic: %s)",
+            written, length, topic);
+    }
+    _wake();
+  } else {
+    error("queue send failed, dropped (topic: %s)", topic);
+  }
+}
+
+void Network::publish_streamed_if_changed(
+    const char *topic, const std::function<void(Print &)> &write_payload) {
+  if (xTaskGetCurrentTaskHandle() != network_task_handle_) {
+    error("cannot stream from another task (topic: %s)", topic);
+    return;
+  }
+  MeasuringPrint measure;
+  write_payload(measure);
+  if (!retained_ledger_.stage(topic, measure.hash())) {
+    debug("unchanged, skipped (topic: %s)", topic);
+    return;
+  }
+  if (_stream_unsafe(topic, measure.size(), write_payload, true)) {
+    retained_ledger_.update_hash(topic, measure.hash());
+  }
+}
+
+void Network::_publish(const char *topic, const char *payload, bool retained,
+                       Priority priority, const uint32_t *ledger_hash) {
   auto current_task = xTaskGetCurrentTaskHandle();
 
   if (current_task == network_task_handle_) {
     debug("publish from same task, no need to queue");
-    _publish_unsafe(topic, payload.c_str(), retained);
+    if (_publish_unsafe(topic, payload, retained) && ledger_hash != nullptr) {
+      retained_ledger_.update_hash(topic, *ledger_hash);
+    }
   } else {
-    PublishQueueElement element{topic, payload, retained};
-    if (mqtt_publish_queue_ != nullptr &&
-        xQueueSend(mqtt_publish_queue_, (void *)&element, (TickType_t)100)) {
-      debug("queue send successful (topic: %s)", topic.c_str());
+    PublishQueue &queue =
+        priority == Priority::URGENT ? event_queue_ : publish_queue_;
+    bool queued = ledger_hash != nullptr
+                      ? queue.push_tracked(topic, payload, *ledger_hash)
+                      : queue.push(topic, payload, retained);
+    if (queued) {
+      debug("queue send successful (topic: %s, free: %u B)", topic,
+            queue.free_space());
+      _wake();
     } else {
-      error("queue send failed (topic: %s)", topic.c_str());
+      error("queue send failed, dropped (topic: %s)", topic);
+      if (retained) retained_ledger_.forget(topic);
     }
   }
 }
 
-void Network::publish(const TopicType &topic, const char *payload,
-                      bool retained) {
-  publish(topic, PayloadType{payload}, retained);
+Network::PublishStats Network::get_publish_stats() const {
+  return {event_queue_.dropped() + publish_queue_.dropped(),
+          publish_queue_.coalesced(), event_latency_us_,
+          event_latency_max_us_};
 }
 
 bool Network::subscribe(const TopicType &topic) {
@@ -326,11 +511,10 @@ bool Network::_connect_mqtt() {
         device_state_.factory().unique_id.c_str(),
         device_state_.user_preferences().mqtt.user.c_str(),
         device_state_.user_preferences().mqtt.password.c_str(),
-        topics_.t_avlb().c_str(), 1, true, "offline");
+        topics_.t_avlb(), 1, true, "offline");
   } else {
     return mqtt_client_.connect(device_state_.factory().unique_id.c_str(), NULL,
-                                NULL, topics_.t_avlb().c_str(), 1, true,
-                                "offline");
+                                NULL, topics_.t_avlb(), 1, true, "offline");
   }
 }
 
@@ -348,20 +532,72 @@ void Network::_mqtt_callback(const char *topic, uint8_t *payload,
   }
 }
 
-void Network::_publish_unsafe(const TopicType &topic, const char *payload,
+bool Network::_publish_unsafe(const char *topic, const char *payload,
                               bool retained) {
   bool ret;
   if (retained) {
-    ret = mqtt_client_.publish(topic.c_str(), payload, true);
+    ret = mqtt_client_.publish(topic, payload, true);
   } else {
-    ret = mqtt_client_.publish(topic.c_str(), payload);
+    ret = mqtt_client_.publish(topic, payload);
   }
   if (ret) {
-    debug("pub to: %s SUCCESS.", topic.c_str());
+    debug("pub to: %s SUCCESS.", topic);
     debug("content: %s", payload);
   } else {
-    error("pub to: %s FAIL.", topic.c_str());
+    error("pub to: %s FAIL.", topic);
+    if (retained) retained_ledger_.forget(topic);
+  }
+  return ret;
+}
+
+bool Network::_stream_unsafe(const char *topic, size_t length,
+                             const std::function<void(Print &)> &write_payload,
+                             bool retained) {
+  bool ret = mqtt_client_.beginPublish(topic, length, retained);
+  if (ret) {
+    BufferedPrint<MQTT_STREAM_CHUNK_SIZE> out(mqtt_client_);
+    CountingPrint counted(out);
+    write_payload(counted);
+    out.flush();
+    if (counted.size() != length) {
+      // the packet no longer matches its header, the broker would read the
+      // next packet as payload
+      error("payload changed between passes, wrote %u of %u B (topic: %s)",
+            counted.size(), length, topic);
+      mqtt_client_.disconnect();
+      return false;
+    }
+    ret = mqtt_client_.endPublish() == 1;
+  }
+  if (ret) {
+    debug("pub to: %s SUCCESS, streamed %u B.", topic, length);
+  } else {
+    error("pub to: %s FAIL.", topic);
+  }
+  return ret;
+}
+
+bool Network::_publish_from_queue(PublishQueue &queue) {
+  PublishQueue::Record record;
+  if (!queue.pop(record)) return false;
+  debug("received payload (topic: %s)", record.topic);
+  bool sent = _publish_unsafe(record.topic, record.payload, record.retained);
+  if (sent && record.tracked) {
+    if (record.retained) {
+      retained_ledger_.update_hash(record.topic, record.payload_hash);
+    } else {
+      sent_hash_ = record.payload_hash;
+    }
+  }
+  if (&queue == &event_queue_) {
+    WakeProfiler::mark(WakePhase::kFirstPublish);
+    event_latency_us_ =
+        static_cast<uint32_t>(esp_timer_get_time()) - record.queued_us;
+    event_latency_max_us_ = std::max(event_latency_max_us_, event_latency_us_);
+    debug("event sent %u us after queueing", event_latency_us_);
   }
+  queue.release(record);
+  return true;
 }
 
 StaticIPConfig validate_static_ip_config(StaticIPConfig config) {
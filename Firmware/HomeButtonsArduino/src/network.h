@@ -5,10 +5,14 @@
 #include <PubSubClient.h>
 #include <WiFi.h>
 
+#include <atomic>
+
 #include "state_machine.h"
 #include "mqtt_helper.h"  // For TopicType
-#include "freertos/queue.h"
 #include "logger.h"
+#include "power.h"
+#include "publish_queue.h"
+#include "retained_ledger.h"
 #include "state.h"
 
 class DeviceState;
@@ -115,6 +119,16 @@ class Network : public NetworkStateMachine, public Logger {
 
   enum class Command { NONE, CONNECT, DISCONNECT };
 
+  // URGENT is used for button and switch events and is always sent first
+  enum class Priority { URGENT, NORMAL };
+
+  struct PublishStats {
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t event_latency_us;  // last URGENT message, queued to sent
+    uint32_t event_latency_max_us;
+  };
+
   explicit Network(DeviceState &device_state, TopicHelper &topics);
   Network(const Network &) = delete;
   ~Network();
@@ -122,6 +136,9 @@ class Network : public NetworkStateMachine, public Logger {
   void connect();
   void disconnect(bool erase = false);
   void update();
+  // blocks until there is work for update(): a publish or command from
+  // another task, incoming MQTT data or the next timer deadline
+  void wait();
   void setup();  // Warning: must be called from same task (thread) as update()
 
   State get_state();
@@ -130,33 +147,65 @@ class Network : public NetworkStateMachine, public Logger {
 
   int32_t get_rssi() { return WiFi.RSSI(); }
 
-  void publish(const TopicType &topic, const PayloadType &payload,
-               bool retained = false);
-  void publish(const TopicType &topic, const char *payload,
-               bool retained = false);
+  // never blocks, messages that don't fit in the queue are dropped
+  void publish(const char *topic, const PayloadType &payload,
+               bool retained = false, Priority priority = Priority::NORMAL);
+  void publish(const char *topic, const char *payload, bool retained = false,
+               Priority priority = Priority::NORMAL);
+  // write_payload is called twice: once to measure, once to write the payload
+  // straight into the queued record (or the MQTT client)
+  void publish(const char *topic,
+               const std::function<void(Print &)> &write_payload,
+               bool retained = false, Priority priority = Priority::NORMAL);
+  // like publish(), not retained, returns the payload hash for sent()
+  uint32_t publish_confirmed(const char *topic,
+                             const std::function<void(Print &)> &write_payload,
+                             Priority priority = Priority::NORMAL);
+  // true once the last publish_confirmed() with payload_hash was handed to
+  // the MQTT client, false while queued or if it was dropped
+  bool sent(uint32_t payload_hash) const { return sent_hash_ == payload_hash; }
+  // retained, skipped if the same payload was already published on topic
+  // only for topics owned by the device (no cmd or LWT topics)
+  void publish_if_changed(const char *topic, const PayloadType &payload,
+                          Priority priority = Priority::NORMAL);
+  void publish_if_changed(const char *topic, const char *payload,
+                          Priority priority = Priority::NORMAL);
+  // retained, write_payload is called twice: once to measure length and hash,
+  // once to stream the payload without a full size buffer
+  // must be called from the network task
+  void publish_streamed_if_changed(
+      const char *topic, const std::function<void(Print &)> &write_payload);
+  // next publish_if_changed() publishes everything again
+  void reset_retained_ledger() { retained_ledger_.clear(); }
+  PublishStats get_publish_stats() const;
   bool subscribe(const TopicType &topic);
   void set_mqtt_callback(
       std::function<void(const char *, const char *)> callback);
   void set_on_connect(std::function<void()> on_connect);
+  // returns from wait() early, for work handed over by another task
+  void wake() { _wake(); }
 
  private:
   State state_ = State::DISCONNECTED;
   Command command_ = Command::NONE;
   uint32_t cmd_connect_time_ = 0;
   bool erase_ = false;
+  // full CPU speed from the connect command until MQTT is connected
+  PowerLock connect_lock_{"net_connect"};
 
   DeviceState &device_state_;
   WiFiClient wifi_client_;
   PubSubClient mqtt_client_;
   TopicHelper &topics_;
-  QueueHandle_t mqtt_publish_queue_ = nullptr;
+  PublishQueue event_queue_;
+  PublishQueue publish_queue_;
+  RetainedLedger retained_ledger_;
   TaskHandle_t network_task_handle_ = nullptr;
-
-  struct PublishQueueElement {
-    TopicType topic;
-    PayloadType payload;
-    bool retained;
-  };
+  int wake_fd_ = -1;  // eventfd, written by other tasks to wake wait()
+  uint32_t wait_timeout_ = NET_POLL_INTERVAL;  // ms
+  uint32_t event_latency_us_ = 0;
+  uint32_t event_latency_max_us_ = 0;
+  std::atomic<uint32_t> sent_hash_{0};  // written by the network task
 
   std::function<void(const char *, const char *)> usr_callback_;
   std::function<void()> on_connect_callback_;
@@ -164,8 +213,23 @@ class Network : public NetworkStateMachine, public Logger {
   void _pre_wifi_connect();
   bool _connect_mqtt();
   void _mqtt_callback(const char *topic, uint8_t *payload, uint32_t length);
-  void _publish_unsafe(const TopicType &topic, const char *payload,
+  // ledger_hash: payload hash recorded in the retained ledger once sent,
+  // nullptr if the topic isn't tracked
+  void _publish(const char *topic, const char *payload, bool retained,
+                Priority priority, const uint32_t *ledger_hash = nullptr);
+  bool _publish_unsafe(const char *topic, const char *payload,
                        bool retained = false);
+  bool _stream_unsafe(const char *topic, size_t length,
+                      const std::function<void(Print &)> &write_payload,
+                      bool retained);
+  // sent_hash: payload hash reported through sent() once sent, nullptr if
+  // not confirmed
+  void _publish_streamed(const char *topic, size_t length,
+                         const std::function<void(Print &)> &write_payload,
+                         bool retained, Priority priority,
+                         const uint32_t *sent_hash = nullptr);
+  bool _publish_from_queue(PublishQueue &queue);
+  void _wake();
 
   friend class NetworkSMStates::IdleState;
   friend class NetworkSMStates::QuickConnectState;
@@ -0,0 +1,42 @@
+#include "power.h"
+
+#include <cstdio>
+
+bool Power::dfs_enabled_ = false;
+
+void PowerLock::acquire() {
+#if CONFIG_PM_ENABLE
+  if (held_) return;
+  if (handle_ == nullptr &&
+      esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, name_, &handle_) != ESP_OK) {
+    handle_ = nullptr;
+    return;
+  }
+  held_ = esp_pm_lock_acquire(handle_) == ESP_OK;
+#endif
+}
+
+void PowerLock::release() {
+#if CONFIG_PM_ENABLE
+  if (!held_) return;
+  esp_pm_lock_release(handle_);
+  held_ = false;
+#endif
+}
+
+bool Power::enable_dfs(uint32_t max_mhz, uint32_t min_mhz) {
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32s2_t config = {};
+  config.max_freq_mhz = max_mhz;
+  config.min_freq_mhz = min_mhz;
+  config.light_sleep_enable = false;
+  dfs_enabled_ = esp_pm_configure(&config) == ESP_OK;
+#endif
+  return dfs_enabled_;
+}
+
+void Power::dump_stats() {
+#if CONFIG_PM_PROFILING
+  esp_pm_dump_locks(stdout);
+#endif
+}
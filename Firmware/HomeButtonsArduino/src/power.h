@@ -0,0 +1,41 @@
+#ifndef HOMEBUTTONS_POWER_H
+#define HOMEBUTTONS_POWER_H
+
+#include <cstdint>
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+// Keeps the CPU at its maximum frequency while held, once frequency scaling
+// is enabled with Power::enable_dfs(). Created on the first acquire().
+// Each instance holds at most one reference, acquire() and release() can be
+// called on every state change. Use an instance from one task only.
+class PowerLock {
+ public:
+  explicit PowerLock(const char* name) : name_(name) {}
+
+  void acquire();
+  void release();
+  bool held() const { return held_; }
+
+ private:
+  const char* name_;
+  esp_pm_lock_handle_t handle_ = nullptr;
+  bool held_ = false;
+};
+
+// Dynamic CPU frequency scaling for awake mode. The minimum frequency keeps
+// the APB clock at 80 MHz, so LEDC, UART, I2C and SPI timings don't change.
+// Automatic light sleep stays off: the buttons wake the tasks with GPIO edge
+// interrupts, which can't wake the chip from light sleep.
+class Power {
+ public:
+  static bool enable_dfs(uint32_t max_mhz, uint32_t min_mhz);
+  static bool dfs_enabled() { return dfs_enabled_; }
+  // time spent at each frequency and per lock, needs CONFIG_PM_PROFILING
+  static void dump_stats();
+
+ private:
+  static bool dfs_enabled_;
+};
+
+#endif  // HOMEBUTTONS_POWER_H
@@ -0,0 +1,117 @@
+#ifndef HOMEBUTTONS_PRINT_UTILS_H
+#define HOMEBUTTONS_PRINT_UTILS_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+
+// Discards the output, only counts bytes and hashes them (32-bit FNV-1a,
+// same result as fnv1a_32() on the whole string).
+class MeasuringPrint : public Print {
+ public:
+  size_t write(uint8_t c) override {
+    hash_ = (hash_ ^ c) * 16777619UL;
+    size_++;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      hash_ = (hash_ ^ buffer[i]) * 16777619UL;
+    }
+    size_ += size;
+    return size;
+  }
+
+  size_t size() const { return size_; }
+  uint32_t hash() const { return hash_; }
+
+ private:
+  size_t size_ = 0;
+  uint32_t hash_ = 2166136261UL;
+};
+
+// Writes into a fixed buffer, bytes that don't fit are dropped.
+class MemoryPrint : public Print {
+ public:
+  MemoryPrint(char* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  size_t write(uint8_t c) override {
+    if (len_ >= size_) return 0;
+    buffer_[len_++] = c;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t n = std::min(size, size_ - len_);
+    memcpy(buffer_ + len_, buffer, n);
+    len_ += n;
+    return n;
+  }
+
+  size_t size() const { return len_; }
+
+ private:
+  char* buffer_;
+  size_t size_;
+  size_t len_ = 0;
+};
+
+// Passes everything on to out and counts the bytes, including those out
+// didn't take.
+class CountingPrint : public Print {
+ public:
+  explicit CountingPrint(Print& out) : out_(out) {}
+
+  size_t write(uint8_t c) override {
+    size_++;
+    return out_.write(c);
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_ += size;
+    return out_.write(buffer, size);
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  Print& out_;
+  size_t size_ = 0;
+};
+
+// Collects small writes into chunks of SIZE bytes before passing them on.
+template <size_t SIZE>
+class BufferedPrint : public Print {
+ public:
+  explicit BufferedPrint(Print& out) : out_(out) {}
+  BufferedPrint(const BufferedPrint&) = delete;
+  ~BufferedPrint() { flush(); }
+
+  size_t write(uint8_t c) override {
+    if (len_ == SIZE) flush();
+    buffer_[len_++] = c;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t written = 0;
+    while (written < size) {
+      if (len_ == SIZE) flush();
+      size_t n = std::min(SIZE - len_, size - written);
+      memcpy(buffer_ + len_, buffer + written, n);
+      len_ += n;
+      written += n;
+    }
+    return written;
+  }
+  void flush() {
+    if (len_ > 0) {
+      out_.write(buffer_, len_);
+      len_ = 0;
+    }
+  }
+
+ private:
+  Print& out_;
+  uint8_t buffer_[SIZE];
+  size_t len_ = 0;
+};
+
+#endif  // HOMEBUTTONS_PRINT_UTILS_H
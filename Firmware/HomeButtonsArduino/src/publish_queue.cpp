@@ -0,0 +1,183 @@
+#include "publish_queue.h"
+
+#include <cstring>
+#include "esp_timer.h"
+#include "utils.h"
+#include "print_utils.h"
+
+PublishQueue::PublishQueue(size_t size, bool coalesce) : coalesce_(coalesce) {
+  ringbuf_ = xRingbufferCreate(size, RINGBUF_TYPE_NOSPLIT);
+}
+
+PublishQueue::~PublishQueue() {
+  if (ringbuf_ != nullptr) {
+    vRingbufferDelete(ringbuf_);
+  }
+}
+
+bool PublishQueue::push(const char* topic, const char* payload, bool retained,
+                        TickType_t ticks_to_wait) {
+  Header header{};
+  header.retained = retained;
+  return _push(topic, payload, header, ticks_to_wait);
+}
+
+bool PublishQueue::push_tracked(const char* topic, const char* payload,
+                                uint32_t payload_hash,
+                                TickType_t ticks_to_wait) {
+  Header header{};
+  header.retained = true;
+  header.tracked = true;
+  header.payload_hash = payload_hash;
+  return _push(topic, payload, header, ticks_to_wait);
+}
+
+bool PublishQueue::push(const char* topic, size_t payload_len,
+                        const std::function<void(Print&)>& write_payload,
+                        bool retained, TickType_t ticks_to_wait) {
+  Header header{};
+  header.retained = retained;
+  return _push(topic, payload_len, write_payload, header, ticks_to_wait);
+}
+
+bool PublishQueue::push_tracked(
+    const char* topic, size_t payload_len,
+    const std::function<void(Print&)>& write_payload, uint32_t payload_hash,
+    TickType_t ticks_to_wait) {
+  Header header{};
+  header.tracked = true;
+  header.payload_hash = payload_hash;
+  return _push(topic, payload_len, write_payload, header, ticks_to_wait);
+}
+
+bool PublishQueue::_push(const char* topic, size_t payload_len,
+                         const std::function<void(Print&)>& write_payload,
+                         const Header& header, TickType_t ticks_to_wait) {
+  void* item = nullptr;
+  char* dest = _acquire(topic, payload_len, header, ticks_to_wait, item);
+  if (dest == nullptr) return false;
+  MemoryPrint out(dest, payload_len);
+  write_payload(out);
+  dest[out.size()] = '\0';
+  return xRingbufferSendComplete(ringbuf_, item) == pdTRUE;
+}
+
+bool PublishQueue::pop(Record& record, TickType_t ticks_to_wait) {
+  if (ringbuf_ == nullptr) return false;
+  while (true) {
+    size_t size = 0;
+    void* item = xRingbufferReceive(ringbuf_, &size, ticks_to_wait);
+    if (item == nullptr) return false;
+
+    Header header;
+    const char* data = static_cast<const char*>(item);
+    memcpy(&header, data, sizeof(Header));
+    if (_is_superseded(header)) {
+      vRingbufferReturnItem(ringbuf_, item);
+      continue;
+    }
+    record.topic = data + sizeof(Header);
+    record.payload = record.topic + header.topic_len + 1;
+    record.retained = header.retained;
+    record.tracked = header.tracked;
+    record.payload_hash = header.payload_hash;
+    record.queued_us = header.queued_us;
+    record.item = item;
+    return true;
+  }
+}
+
+void PublishQueue::release(const Record& record) {
+  if (ringbuf_ != nullptr && record.item != nullptr) {
+    vRingbufferReturnItem(ringbuf_, record.item);
+  }
+}
+
+size_t PublishQueue::waiting() const {
+  if (ringbuf_ == nullptr) return 0;
+  UBaseType_t items_waiting = 0;
+  vRingbufferGetInfo(ringbuf_, nullptr, nullptr, nullptr, nullptr,
+                     &items_waiting);
+  return items_waiting;
+}
+
+size_t PublishQueue::free_space() const {
+  if (ringbuf_ == nullptr) return 0;
+  return xRingbufferGetCurFreeSize(ringbuf_);
+}
+
+bool PublishQueue::_push(const char* topic, const char* payload,
+                         const Header& header, TickType_t ticks_to_wait) {
+  size_t payload_len = strlen(payload);
+  void* item = nullptr;
+  char* dest = _acquire(topic, payload_len, header, ticks_to_wait, item);
+  if (dest == nullptr) return false;
+  memcpy(dest, payload, payload_len + 1);
+  return xRingbufferSendComplete(ringbuf_, item) == pdTRUE;
+}
+
+// reserves a record and writes header and topic, returns where the payload
+// goes
+char* PublishQueue::_acquire(const char* topic, size_t payload_len,
+                             Header header, TickType_t ticks_to_wait,
+                             void*& item) {
+  if (ringbuf_ == nullptr) return nullptr;
+  size_t topic_len = strlen(topic);
+  size_t size = sizeof(Header) + topic_len + 1 + payload_len + 1;
+  if (topic_len > UINT16_MAX || size > xRingbufferGetMaxItemSize(ringbuf_) ||
+      xRingbufferSendAcquire(ringbuf_, &item, size, ticks_to_wait) != pdTRUE) {
+    portENTER_CRITICAL(&mux_);
+    dropped_++;
+    portEXIT_CRITICAL(&mux_);
+    return nullptr;
+  }
+
+  header.topic_len = static_cast<uint16_t>(topic_len);
+  header.queued_us = static_cast<uint32_t>(esp_timer_get_time());
+  char* data = static_cast<char*>(item);
+  memcpy(data, &header, sizeof(Header));
+  memcpy(data + sizeof(Header), topic, topic_len + 1);
+  if (coalesce_) {
+    _track(data, topic);
+  }
+  return data + sizeof(Header) + topic_len + 1;
+}
+
+// assigns the record in data to the coalesce slot of its topic. the hash
+// only narrows the search, a slot matches if the stored topic is equal.
+void PublishQueue::_track(char* data, const char* topic) {
+  uint32_t topic_hash = fnv1a_32(topic);
+  const char* stored_topic = data + sizeof(Header);
+  portENTER_CRITICAL(&mux_);
+  CoalesceSlot* target = nullptr;
+  for (auto& slot : slots_) {
+    if (slot.pending > 0 && slot.topic_hash == topic_hash &&
+        strcmp(slot.topic, topic) == 0) {
+      target = &slot;
+      break;
+    } else if (slot.pending == 0 && target == nullptr) {
+      target = &slot;
+    }
+  }
+  if (target != nullptr) {
+    target->topic_hash = topic_hash;
+    target->topic = stored_topic;
+    target->seq++;
+    target->pending++;
+    Header* header = reinterpret_cast<Header*>(data);
+    header->slot = static_cast<uint8_t>(target - slots_) + 1;
+    header->seq = target->seq;
+  }
+  portEXIT_CRITICAL(&mux_);
+}
+
+bool PublishQueue::_is_superseded(const Header& header) {
+  if (header.slot == 0 || header.slot > kCoalesceSlots) return false;
+  portENTER_CRITICAL(&mux_);
+  CoalesceSlot& slot = slots_[header.slot - 1];
+  bool superseded = slot.seq != header.seq;
+  if (slot.pending > 0) slot.pending--;
+  if (superseded) coalesced_++;
+  portEXIT_CRITICAL(&mux_);
+  return superseded;
+}
@@ -0,0 +1,101 @@
+#ifndef HOMEBUTTONS_PUBLISH_QUEUE_H
+#define HOMEBUTTONS_PUBLISH_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+
+// Pool of outbound MQTT messages.
+// Each message is stored as one variable-length record [header|topic|payload]
+// in a no-split ring buffer, so only the actual string lengths are used
+// instead of the full TopicType + PayloadType size. Records are read in place
+// (zero-copy) and must be released after use.
+// With coalescing enabled, a queued record is superseded by a newer record on
+// the same topic and skipped by pop().
+class PublishQueue {
+ public:
+  struct Record {
+    const char* topic = nullptr;
+    const char* payload = nullptr;
+    bool retained = false;
+    // payload_hash is reported once the record is sent: to the retained
+    // ledger if retained, else as the last sent payload
+    bool tracked = false;
+    uint32_t payload_hash = 0;
+    uint32_t queued_us = 0;  // esp_timer time of push(), wraps
+    void* item = nullptr;
+  };
+
+  PublishQueue(size_t size, bool coalesce);
+  PublishQueue(const PublishQueue&) = delete;
+  ~PublishQueue();
+
+  bool valid() const { return ringbuf_ != nullptr; }
+
+  // copies topic and payload into one record, waits up to ticks_to_wait for
+  // free space
+  bool push(const char* topic, const char* payload, bool retained,
+            TickType_t ticks_to_wait = 0);
+  // retained record that carries payload_hash for the retained ledger
+  bool push_tracked(const char* topic, const char* payload,
+                    uint32_t payload_hash, TickType_t ticks_to_wait = 0);
+  // payload is written by write_payload straight into the record,
+  // payload_len must be the number of bytes it writes
+  bool push(const char* topic, size_t payload_len,
+            const std::function<void(Print&)>& write_payload, bool retained,
+            TickType_t ticks_to_wait = 0);
+  // not retained, streamed record that carries payload_hash
+  bool push_tracked(const char* topic, size_t payload_len,
+                    const std::function<void(Print&)>& write_payload,
+                    uint32_t payload_hash, TickType_t ticks_to_wait = 0);
+  // record points into the pool and is valid until release()
+  bool pop(Record& record, TickType_t ticks_to_wait = 0);
+  void release(const Record& record);
+
+  size_t waiting() const;
+  size_t free_space() const;
+  uint32_t dropped() const { return dropped_; }
+  uint32_t coalesced() const { return coalesced_; }
+
+ private:
+  static constexpr uint8_t kCoalesceSlots = 24;
+
+  struct Header {
+    uint8_t retained;
+    uint8_t slot;  // coalesce slot + 1, 0 if not coalesced
+    uint16_t topic_len;  // without trailing '\0'
+    uint16_t seq;
+    uint8_t tracked;
+    uint32_t payload_hash;
+    uint32_t queued_us;
+  };
+
+  struct CoalesceSlot {
+    uint32_t topic_hash;
+    const char* topic;  // in the newest queued record, valid while pending
+    uint16_t seq;       // seq of the newest queued record
+    uint16_t pending;  // number of queued records, slot free if 0
+  };
+
+  RingbufHandle_t ringbuf_ = nullptr;
+  const bool coalesce_;
+  CoalesceSlot slots_[kCoalesceSlots] = {};
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t dropped_ = 0;
+  uint32_t coalesced_ = 0;
+
+  bool _push(const char* topic, const char* payload, const Header& header,
+             TickType_t ticks_to_wait);
+  bool _push(const char* topic, size_t payload_len,
+             const std::function<void(Print&)>& write_payload,
+             const Header& header, TickType_t ticks_to_wait);
+  char* _acquire(const char* topic, size_t payload_len, Header header,
+                 TickType_t ticks_to_wait, void*& item);
+  void _track(char* data, const char* topic);
+  bool _is_superseded(const Header& header);
+};
+
+#endif  // HOMEBUTTONS_PUBLISH_QUEUE_H
@@ -0,0 +1,123 @@
+#include "report_filter.h"
+
+#include <math.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "rom/crc.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48425231;  // "HBR1"
+constexpr size_t kNumChannels =
+    static_cast<size_t>(ReportChannel::kNumChannels);
+
+const char* const kChannelNames[kNumChannels] = {"temperature", "humidity",
+                                                 "battery", "rssi"};
+
+struct Channel {
+  float value;
+  uint32_t time_s;
+  uint32_t suppressed;
+  uint8_t published;
+};
+
+struct Store {
+  uint32_t magic;
+  Channel channels[kNumChannels];
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR Store store;
+
+uint32_t store_crc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&store),
+                  offsetof(Store, crc));
+}
+
+uint32_t now_s() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return static_cast<uint32_t>(tv.tv_sec);
+}
+}  // namespace
+
+bool ReportFilter::due(ReportChannel channel, float value,
+                       const Deadband& band, uint32_t heartbeat_s) {
+  size_t index = static_cast<size_t>(channel);
+  if (index >= kNumChannels) return true;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  bool due = _due(index, value, band, heartbeat_s);
+  portEXIT_CRITICAL(&mux_);
+  return due;
+}
+
+bool ReportFilter::update(ReportChannel channel, float value,
+                          const Deadband& band, uint32_t heartbeat_s,
+                          bool force) {
+  size_t index = static_cast<size_t>(channel);
+  if (index >= kNumChannels) return true;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  Channel& c = store.channels[index];
+  bool due = force || _due(index, value, band, heartbeat_s);
+  if (due) {
+    c.value = value;
+    c.time_s = now_s();
+    c.published = 1;
+  } else {
+    c.suppressed++;
+  }
+  _seal();
+  portEXIT_CRITICAL(&mux_);
+  return due;
+}
+
+void ReportFilter::suppressed(ReportChannel channel) {
+  size_t index = static_cast<size_t>(channel);
+  if (index >= kNumChannels) return;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  store.channels[index].suppressed++;
+  _seal();
+  portEXIT_CRITICAL(&mux_);
+}
+
+uint32_t ReportFilter::suppressed_count(ReportChannel channel) {
+  size_t index = static_cast<size_t>(channel);
+  if (index >= kNumChannels) return 0;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  uint32_t count = store.channels[index].suppressed;
+  portEXIT_CRITICAL(&mux_);
+  return count;
+}
+
+const char* ReportFilter::channel_name(ReportChannel channel) {
+  size_t index = static_cast<size_t>(channel);
+  return index < kNumChannels ? kChannelNames[index] : "";
+}
+
+bool ReportFilter::_due(size_t index, float value, const Deadband& band,
+                        uint32_t heartbeat_s) {
+  const Channel& c = store.channels[index];
+  if (!c.published) return true;
+  if (now_s() - c.time_s >= heartbeat_s) return true;
+  if (band.abs <= 0 && band.rel <= 0) return true;
+  float delta = fabsf(value - c.value);
+  if (delta == 0) return false;
+  if (band.abs > 0 && delta >= band.abs) return true;
+  if (band.rel > 0 && delta >= fabsf(c.value) * band.rel / 100) return true;
+  return false;
+}
+
+void ReportFilter::_check() {
+  if (checked_) return;
+  checked_ = true;
+  if (store.magic != kMagic || store.crc != store_crc()) {
+    store = {};
+    store.magic = kMagic;
+    _seal();
+  }
+}
+
+void ReportFilter::_seal() { store.crc = store_crc(); }
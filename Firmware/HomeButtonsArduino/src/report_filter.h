@@ -0,0 +1,39 @@
+#ifndef HOMEBUTTONS_REPORT_FILTER_H
+#define HOMEBUTTONS_REPORT_FILTER_H
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "types.h"
+
+// Decides whether a value has to be published: when it moved out of its
+// deadband around the last published value, or when it wasn't published
+// for heartbeat_s seconds.
+// Last published values and suppression counters live in RTC memory, so
+// timer wakes can skip publishing too. Times are system time, which keeps
+// running during deep sleep.
+class ReportFilter {
+ public:
+  // only checks, nothing is recorded
+  bool due(ReportChannel channel, float value, const Deadband& band,
+           uint32_t heartbeat_s);
+  // records the value as published if due or forced, otherwise counts a
+  // suppression
+  bool update(ReportChannel channel, float value, const Deadband& band,
+              uint32_t heartbeat_s, bool force = false);
+  void suppressed(ReportChannel channel);
+  // publishes suppressed since power on
+  uint32_t suppressed_count(ReportChannel channel);
+
+  static const char* channel_name(ReportChannel channel);
+
+ private:
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+  bool checked_ = false;
+
+  bool _due(size_t index, float value, const Deadband& band,
+            uint32_t heartbeat_s);
+  void _check();
+  void _seal();
+};
+
+#endif  // HOMEBUTTONS_REPORT_FILTER_H
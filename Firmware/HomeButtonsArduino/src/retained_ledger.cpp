@@ -0,0 +1,130 @@
+#include "retained_ledger.h"
+
+#include "esp_attr.h"
+#include "config.h"
+#include "utils.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48424c31;  // "HBL1"
+
+struct Entry {
+  uint32_t topic_hash;
+  uint32_t payload_hash;
+};
+
+struct Table {
+  uint32_t magic;
+  uint32_t count;
+  Entry entries[MQTT_RETAINED_LEDGER_SIZE];
+  uint32_t check;  // entry_check() of all entries xor-ed together
+};
+
+RTC_NOINIT_ATTR Table table;
+
+// entries are xor-ed in and out of table.check one at a time, so a change
+// doesn't hash the whole table
+uint32_t entry_check(const Entry& entry) {
+  return (entry.topic_hash ^ (entry.payload_hash * 0x9e3779b1UL)) *
+         16777619UL;
+}
+
+uint32_t table_check() {
+  uint32_t check = kMagic;
+  for (uint32_t i = 0; i < table.count; i++) {
+    check ^= entry_check(table.entries[i]);
+  }
+  return check;
+}
+
+void add(const Entry& entry) {
+  table.entries[table.count++] = entry;
+  table.check ^= entry_check(entry);
+}
+
+void remove(Entry* entry) {
+  table.check ^= entry_check(*entry);
+  *entry = table.entries[--table.count];
+}
+
+void set_payload_hash(Entry* entry, uint32_t payload_hash) {
+  table.check ^= entry_check(*entry);
+  entry->payload_hash = payload_hash;
+  table.check ^= entry_check(*entry);
+}
+
+Entry* find(uint32_t topic_hash) {
+  for (uint32_t i = 0; i < table.count; i++) {
+    if (table.entries[i].topic_hash == topic_hash) return &table.entries[i];
+  }
+  return nullptr;
+}
+}  // namespace
+
+bool RetainedLedger::stage(const char* topic, uint32_t payload_hash) {
+  uint32_t topic_hash = fnv1a_32(topic);
+  bool changed = true;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  Entry* entry = find(topic_hash);
+  if (entry != nullptr) {
+    changed = entry->payload_hash != payload_hash;
+    if (changed) remove(entry);
+  }
+  portEXIT_CRITICAL(&mux_);
+  return changed;
+}
+
+bool RetainedLedger::update_hash(const char* topic, uint32_t payload_hash) {
+  uint32_t topic_hash = fnv1a_32(topic);
+  bool changed = true;
+  portENTER_CRITICAL(&mux_);
+  _check();
+  Entry* entry = find(topic_hash);
+  if (entry != nullptr) {
+    changed = entry->payload_hash != payload_hash;
+    if (changed) set_payload_hash(entry, payload_hash);
+  } else if (table.count < MQTT_RETAINED_LEDGER_SIZE) {
+    add({topic_hash, payload_hash});
+  }
+  portEXIT_CRITICAL(&mux_);
+  return changed;
+}
+
+void RetainedLedger::forget(const char* topic) {
+  uint32_t topic_hash = fnv1a_32(topic);
+  portENTER_CRITICAL(&mux_);
+  _check();
+  Entry* entry = find(topic_hash);
+  if (entry != nullptr) remove(entry);
+  portEXIT_CRITICAL(&mux_);
+}
+
+void RetainedLedger::clear() {
+  portENTER_CRITICAL(&mux_);
+  _reset();
+  checked_ = true;
+  portEXIT_CRITICAL(&mux_);
+}
+
+size_t RetainedLedger::size() {
+  portENTER_CRITICAL(&mux_);
+  _check();
+  size_t count = table.count;
+  portEXIT_CRITICAL(&mux_);
+  return count;
+}
+
+void RetainedLedger::_check() {
+  if (checked_) return;
+  checked_ = true;
+  if (table.magic != kMagic || table.count > MQTT_RETAINED_LEDGER_SIZE ||
+      table.check != table_check()) {
+    _reset();
+  }
+}
+
+void RetainedLedger::_reset() {
+  table.magic = kMagic;
+  table.count = 0;
+  table.check = table_check();
+}
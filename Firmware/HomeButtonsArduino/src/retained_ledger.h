@@ -0,0 +1,33 @@
+#ifndef HOMEBUTTONS_RETAINED_LEDGER_H
+#define HOMEBUTTONS_RETAINED_LEDGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+
+// Remembers a hash of the last retained payload published per topic.
+// The table lives in RTC memory, so it survives deep sleep and software
+// resets, and is checked on first use. After a power-on reset the table is
+// empty and everything is published once.
+class RetainedLedger {
+ public:
+  // before publishing, returns false if payload_hash (fnv1a_32() of the
+  // payload) is already recorded for topic. otherwise the record is dropped
+  // until the new payload is sent and recorded with update_hash().
+  bool stage(const char* topic, uint32_t payload_hash);
+  // records payload_hash for topic once it was sent, returns false if it was
+  // already recorded
+  bool update_hash(const char* topic, uint32_t payload_hash);
+  void forget(const char* topic);
+  void clear();
+  size_t size();
+
+ private:
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+  bool checked_ = false;
+
+  void _check();
+  void _reset();
+};
+
+#endif  // HOMEBUTTONS_RETAINED_LEDGER_H
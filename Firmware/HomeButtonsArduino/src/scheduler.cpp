@@ -0,0 +1,40 @@
+#include "scheduler.h"
+
+namespace {
+// true if a is before b, also across the millis() wraparound
+bool before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+}  // namespace
+
+void Scheduler::wake_at(uint32_t time_ms) {
+  if (!has_deadline_ || before(time_ms, deadline_)) {
+    deadline_ = time_ms;
+    has_deadline_ = true;
+  }
+}
+
+void Scheduler::notify() {
+  if (task_ != nullptr) xTaskNotifyGive(task_);
+}
+
+void IRAM_ATTR Scheduler::notify_from_isr() {
+  if (task_ == nullptr) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(task_, &woken);
+  if (woken == pdTRUE) portYIELD_FROM_ISR();
+}
+
+void Scheduler::wait() {
+  uint32_t wait_ms = next_wait(millis());
+  wakeups_++;
+  if (task_ == nullptr) {
+    delay(wait_ms);
+    return;
+  }
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+}
+
+uint32_t Scheduler::next_wait(uint32_t now_ms) {
+  if (!has_deadline_) return idle_ms_;
+  has_deadline_ = false;
+  return before(now_ms, deadline_) ? deadline_ - now_ms : 0;
+}
@@ -0,0 +1,49 @@
+#ifndef HOMEBUTTONS_SCHEDULER_H
+#define HOMEBUTTONS_SCHEDULER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Lets a task sleep until the next time one of its components has work,
+// instead of polling at a fixed interval.
+// During a pass of the task loop, components register the time they need
+// to run again with wake_at(). wait() then sleeps until the earliest of
+// those deadlines, or until another task or an ISR calls notify(). If no
+// deadline was registered, it sleeps for idle_ms.
+// wake_at() and wait() are only called from the bound task, notify() from
+// anywhere.
+class Scheduler {
+ public:
+  Scheduler(uint32_t poll_ms, uint32_t idle_ms)
+      : poll_ms_(poll_ms), idle_ms_(idle_ms) {}
+
+  // call from the task that waits, before the first notify()
+  void bind() { task_ = xTaskGetCurrentTaskHandle(); }
+
+  void wake_at(uint32_t time_ms);
+  void wake_in(uint32_t delay_ms) { wake_at(millis() + delay_ms); }
+  // run again after the poll interval, for state that has no interrupt
+  void poll() { wake_in(poll_ms_); }
+
+  void notify();
+  void IRAM_ATTR notify_from_isr();
+
+  void wait();
+
+  // ms until the task has to run again, registered deadlines are cleared
+  uint32_t next_wait(uint32_t now_ms);
+  // number of wait() calls, for comparing wakeup rates
+  uint32_t wakeups() const { return wakeups_; }
+
+ private:
+  TaskHandle_t task_ = nullptr;
+  uint32_t poll_ms_;
+  uint32_t idle_ms_;
+  bool has_deadline_ = false;
+  uint32_t deadline_ = 0;
+  uint32_t wakeups_ = 0;
+};
+
+#endif  // HOMEBUTTONS_SCHEDULER_H
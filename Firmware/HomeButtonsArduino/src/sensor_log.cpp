@@ -0,0 +1,141 @@
+#include "sensor_log.h"
+
+#include <math.h>
+#include <algorithm>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "rom/crc.h"
+#include "config.h"
+#include "json_writer.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48424c31;  // "HBL1"
+
+struct Ring {
+  uint32_t magic;
+  uint16_t head;  // oldest sample
+  uint16_t count;
+  uint8_t upload_requested;
+  uint8_t has_uploaded;
+  float uploaded_temperature;
+  float uploaded_humidity;
+  SensorLog::Sample samples[SENSOR_LOG_SIZE];
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR Ring ring;
+
+uint32_t ring_crc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&ring),
+                  offsetof(Ring, crc));
+}
+}  // namespace
+
+uint32_t SensorLog::now_s() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return static_cast<uint32_t>(tv.tv_sec);
+}
+
+void SensorLog::add(float temperature, float humidity, uint8_t battery_pct) {
+  _check();
+  if (ring.count == SENSOR_LOG_SIZE) {
+    ring.head = (ring.head + 1) % SENSOR_LOG_SIZE;
+    ring.count--;
+  }
+  ring.samples[(ring.head + ring.count) % SENSOR_LOG_SIZE] = {
+      now_s(), static_cast<int16_t>(lroundf(temperature * 100)),
+      static_cast<uint16_t>(lroundf(humidity * 100)), battery_pct};
+  ring.count++;
+  _seal();
+}
+
+size_t SensorLog::size() {
+  _check();
+  return ring.count;
+}
+
+bool SensorLog::changed(float temperature, float humidity) {
+  _check();
+  return !ring.has_uploaded ||
+         fabsf(temperature - ring.uploaded_temperature) >=
+             SENSOR_BATCH_TEMP_DELTA ||
+         fabsf(humidity - ring.uploaded_humidity) >= SENSOR_BATCH_HMD_DELTA;
+}
+
+void SensorLog::set_uploaded(float temperature, float humidity) {
+  _check();
+  ring.has_uploaded = 1;
+  ring.uploaded_temperature = temperature;
+  ring.uploaded_humidity = humidity;
+  _seal();
+}
+
+void SensorLog::request_upload() {
+  _check();
+  ring.upload_requested = 1;
+  _seal();
+}
+
+bool SensorLog::upload_requested() {
+  _check();
+  return ring.upload_requested;
+}
+
+void SensorLog::write_batch(Print& out, uint32_t interval_s, uint32_t now) {
+  _check();
+  auto sample = [](size_t i) -> const Sample& {
+    return ring.samples[(ring.head + i) % SENSOR_LOG_SIZE];
+  };
+  JsonWriter json(out);
+  json.begin_object();
+  json.add("interval_s", interval_s);
+  json.begin_array("age_s");
+  for (size_t i = 0; i < ring.count; i++) {
+    json.add(nullptr, now - sample(i).time_s);
+  }
+  json.end_array();
+  json.begin_array("temp");
+  for (size_t i = 0; i < ring.count; i++) {
+    json.add(nullptr, sample(i).temperature / 100.0);
+  }
+  json.end_array();
+  json.begin_array("hum");
+  for (size_t i = 0; i < ring.count; i++) {
+    json.add(nullptr, sample(i).humidity / 100.0);
+  }
+  json.end_array();
+  json.begin_array("batt");
+  for (size_t i = 0; i < ring.count; i++) {
+    json.add(nullptr, sample(i).battery_pct);
+  }
+  json.end_array();
+  json.end_object();
+}
+
+void SensorLog::remove(size_t count) {
+  _check();
+  count = std::min<size_t>(count, ring.count);
+  ring.head = (ring.head + count) % SENSOR_LOG_SIZE;
+  ring.count -= count;
+  ring.upload_requested = 0;
+  _seal();
+}
+
+void SensorLog::_check() {
+  if (checked_) return;
+  checked_ = true;
+  if (ring.magic != kMagic || ring.head >= SENSOR_LOG_SIZE ||
+      ring.count > SENSOR_LOG_SIZE || ring.crc != ring_crc()) {
+    ring.magic = kMagic;
+    ring.head = 0;
+    ring.count = 0;
+    ring.upload_requested = 0;
+    ring.has_uploaded = 0;
+    ring.uploaded_temperature = 0;
+    ring.uploaded_humidity = 0;
+    _seal();
+  }
+}
+
+void SensorLog::_seal() { ring.crc = ring_crc(); }
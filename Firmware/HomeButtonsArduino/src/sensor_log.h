@@ -0,0 +1,50 @@
+#ifndef HOMEBUTTONS_SENSOR_LOG_H
+#define HOMEBUTTONS_SENSOR_LOG_H
+
+#include <Arduino.h>
+#include <cstddef>
+#include <cstdint>
+
+// Sensor samples taken on timer wakes without connecting, uploaded later in
+// one batch. The ring lives in RTC memory, so it survives deep sleep and
+// software resets, and is checked with a CRC on first use. When it is full
+// the oldest sample is dropped.
+// Also keeps the last uploaded values, to upload early on a large change.
+// Only used from the main task.
+class SensorLog {
+ public:
+  struct Sample {
+    uint32_t time_s;      // system time, keeps running during deep sleep
+    int16_t temperature;  // 1/100 of the device temperature unit
+    uint16_t humidity;    // 1/100 %
+    uint8_t battery_pct;
+  };
+
+  void add(float temperature, float humidity, uint8_t battery_pct);
+  size_t size();
+  // true if the values differ from the last uploaded ones by more than
+  // the SENSOR_BATCH_*_DELTA thresholds, or nothing was uploaded yet
+  bool changed(float temperature, float humidity);
+  void set_uploaded(float temperature, float humidity);
+  // the next sample is uploaded right away
+  void request_upload();
+  bool upload_requested();
+
+  // {"interval_s":600,"age_s":[...],"temp":[...],"hum":[...],"batt":[...]},
+  // oldest sample first, ages in seconds at now (from now_s()). The same now
+  // gives the same payload, as the two passes of a streamed publish need.
+  void write_batch(Print& out, uint32_t interval_s, uint32_t now);
+  // system time in seconds, keeps running during deep sleep
+  static uint32_t now_s();
+  // removes the count oldest samples (an upload that was sent) and the
+  // upload request
+  void remove(size_t count);
+
+ private:
+  bool checked_ = false;
+
+  void _check();
+  void _seal();
+};
+
+#endif  // HOMEBUTTONS_SENSOR_LOG_H
@@ -0,0 +1,59 @@
+#ifndef HOMEBUTTONS_SEQLOCK_H
+#define HOMEBUTTONS_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include "freertos/FreeRTOS.h"
+
+// Versioned value for one or more writers and lock-free readers in other
+// tasks. A write runs in a critical section, so it can't be preempted and
+// must be short: no logging, no flash access, format values before.
+// Readers copy the value and retry if a write happened meanwhile.
+template <typename T>
+class SeqLock {
+ public:
+  // consistent copy
+  T read() const {
+    return read([](const T& value) { return value; });
+  }
+
+  // consistent copy of a part, e.g. one field
+  template <typename F>
+  auto read(F f) const -> decltype(f(std::declval<const T&>())) {
+    while (true) {
+      uint32_t seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) continue;  // only while a write runs on another core
+      auto copy = f(value_);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) return copy;
+    }
+  }
+
+  // latest value without a copy, only safe in the tasks that write it
+  const T& get() const { return value_; }
+
+  // f(T&) changes the value
+  template <typename F>
+  void write(F f) {
+    portENTER_CRITICAL(&mux_);
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    f(value_);
+    seq_.store(seq + 2, std::memory_order_release);
+    portEXIT_CRITICAL(&mux_);
+  }
+
+  // changes with every write
+  uint32_t version() const {
+    return seq_.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  T value_ = {};
+  std::atomic<uint32_t> seq_{0};
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif  // HOMEBUTTONS_SEQLOCK_H
@@ -34,9 +34,9 @@ static WiFiManagerParameter temp_unit_param("temp_unit", "Temperature Unit", "",
                                             1);
 #endif
 
-#if defined(HOME_BUTTONS_INDUSTRIAL)
+#if defined(HAS_BUTTON_UI)
 static WiFiManagerParameter button_config_param("btn_conf", "Button Config", "",
-                                                NUM_BUTTONS - 1);
+                                                BTN_CONF_LEN);
 #endif
 
 #if defined(HAS_DISPLAY)
@@ -195,7 +195,7 @@ void HBSetup::save_params_callback() {
   app_.device_state_.set_temp_unit(StaticString<1>(temp_unit_param.getValue()));
 #endif
 
-#if defined(HOME_BUTTONS_INDUSTRIAL)
+#if defined(HAS_BUTTON_UI)
   app_.device_state_.set_btn_conf_string(
       BtnConfString{button_config_param.getValue()});
 #endif
@@ -269,10 +269,10 @@ void HBSetup::start_setup() {
   temp_unit_param.setValue(app_.device_state_.get_temp_unit().c_str(), 1);
 #endif
 
-#if defined(HOME_BUTTONS_INDUSTRIAL)
+#if defined(HAS_BUTTON_UI)
   button_config_param.setValue(
       app_.device_state_.user_preferences().btn_conf_string.c_str(),
-      NUM_BUTTONS - 1);
+      BTN_CONF_LEN);
 #endif
 
   wifi_manager.addParameter(&device_name_param);
@@ -299,7 +299,7 @@ void HBSetup::start_setup() {
   wifi_manager.addParameter(&temp_unit_param);
 #endif
 
-#if defined(HOME_BUTTONS_INDUSTRIAL)
+#if defined(HAS_BUTTON_UI)
   wifi_manager.addParameter(&button_config_param);
 #endif
 
@@ -0,0 +1,71 @@
+#ifndef HOMEBUTTONS_SPSC_QUEUE_H
+#define HOMEBUTTONS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free queue for a single producer and a single consumer, e.g. an ISR
+// and a task. Neither side blocks, push() drops the item when the queue is
+// full and counts it. N must be a power of two.
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  // ------ producer ------
+  bool push(const T& item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= N) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // ------ consumer ------
+  // oldest item, nullptr if empty, valid until pop()
+  const T* peek() const {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return nullptr;
+    return &items_[tail & (N - 1)];
+  }
+
+  bool pop(T& item) {
+    const T* front = peek();
+    if (front == nullptr) return false;
+    item = *front;
+    pop();
+    return true;
+  }
+
+  void pop() {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return;
+    tail_.store(tail + 1, std::memory_order_release);
+  }
+
+  // drops everything pushed so far
+  void clear() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+  // ------ either side ------
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  T items_[N];
+  std::atomic<uint32_t> head_{0};  // written by the producer
+  std::atomic<uint32_t> tail_{0};  // written by the consumer
+  std::atomic<uint32_t> dropped_{0};
+};
+
+#endif  // HOMEBUTTONS_SPSC_QUEUE_H
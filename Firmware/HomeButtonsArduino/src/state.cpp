@@ -1,122 +1,287 @@
 #include "state.h"
+
+#include <esp_system.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include "esp_attr.h"
+#include "rom/crc.h"
 #include "utils.h"
 #include "config.h"
 
+namespace {
+constexpr uint32_t kSnapshotMagic = 0x48425331;  // "HBS1"
+constexpr uint16_t kSnapshotVersion = 5;         // bump on layout changes
+constexpr uint8_t kUserPart = 1 << 0;
+constexpr uint8_t kPersistedPart = 1 << 1;
+constexpr char kUserRecordKey[] = "prefs";
+constexpr uint16_t kUserRecordVersion = 1;
+
+// user preferences keys used before kUserRecordKey
+const char* const kLegacyUserKeys[] = {
+    "device_name", "mqtt_srv", "mqtt_port", "mqtt_user", "mqtt_pass",
+    "base_topic", "disc_prefix", "sen_itv", "use_f", "led_am_br",
+    "dev_disc", "btn_conf", "ssid", "sta_ip", "g_way",
+    "s_net", "dns", "dns2", "icon_srv"};
+
+// copies without the bytes after '\0', so records compare with memcmp()
+template <size_t N>
+void copy_string(StaticString<N>& destination, const StaticString<N>& source) {
+  destination.set(source.c_str());
+}
+
+// Writes only values that differ from their shadow (the value last saved to
+// or loaded from NVS) and updates the shadow. The namespace is opened on the
+// first write, so a save without changes doesn't touch NVS at all.
+class DiffWriter {
+ public:
+  DiffWriter(Preferences& prefs, const char* name, bool force)
+      : prefs_(prefs), name_(name), force_(force) {}
+  DiffWriter(const DiffWriter&) = delete;
+  ~DiffWriter() {
+    if (open_) prefs_.end();
+  }
+
+  template <size_t N>
+  void put(const char* key, const StaticString<N>& value,
+           StaticString<N>& shadow) {
+    if (!force_ && strcmp(value.c_str(), shadow.c_str()) == 0) return;
+    if (_open() && _put_string(key, value.c_str())) {
+      shadow = value;
+      writes_++;
+    } else {
+      failed_++;
+    }
+  }
+  void put(const char* key, bool value, bool& shadow) {
+    if (!force_ && value == shadow) return;
+    if (_open() && prefs_.putBool(key, value) > 0) {
+      shadow = value;
+      writes_++;
+    } else {
+      failed_++;
+    }
+  }
+  template <typename T>
+  void put_uint(const char* key, T value, T& shadow) {
+    if (!force_ && value == shadow) return;
+    if (_open() && prefs_.putUInt(key, value) > 0) {
+      shadow = value;
+      writes_++;
+    } else {
+      failed_++;
+    }
+  }
+  uint32_t writes() const { return writes_; }
+  uint32_t failed() const { return failed_; }
+
+ private:
+  Preferences& prefs_;
+  const char* name_;
+  const bool force_;
+  bool open_ = false;
+  uint32_t writes_ = 0;
+  uint32_t failed_ = 0;
+
+  bool _open() {
+    if (!open_) open_ = prefs_.begin(name_, false);
+    return open_;
+  }
+  // putString() returns the length, so an empty string is read back
+  bool _put_string(const char* key, const char* value) {
+    if (prefs_.putString(key, value) > 0) return true;
+    char empty;
+    return value[0] == '\0' && prefs_.getString(key, &empty, 1) == 1;
+  }
+};
+}  // namespace
+
+// UserPreferences as stored in NVS (one blob) and in the RTC snapshot.
+// Fields are only ever appended: a shorter record from older firmware keeps
+// defaults for the missing fields, a longer one from newer firmware is
+// truncated. Bump kUserRecordVersion if the meaning of a field changes.
+struct DeviceState::UserRecord {
+  uint16_t version;
+  uint16_t size;  // sizeof(UserRecord) of the firmware that wrote it
+  DeviceName device_name;
+  ButtonLabel btn_labels[NUM_BUTTONS];
+  uint16_t sensor_interval;
+  bool use_fahrenheit;
+  uint8_t led_amb_bright;
+  bool device_discovery;
+  BtnConfString btn_conf_string;
+  SSIDType ssid;
+  uint32_t static_ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t dns2;
+  MQTTParamType mqtt_server;
+  int32_t mqtt_port;
+  MQTTParamType mqtt_user;
+  MQTTParamType mqtt_password;
+  MQTTParamType mqtt_base_topic;
+  MQTTParamType mqtt_discovery_prefix;
+  IconServerType icon_server;
+  uint8_t sensor_batch;
+  Deadband deadbands[static_cast<size_t>(ReportChannel::kNumChannels)];
+  uint16_t report_heartbeat;
+};
+
+struct DeviceState::Snapshot {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint8_t parts;  // kUserPart | kPersistedPart, parts in sync with NVS
+  uint32_t nvs_writes;  // keys written since power on
+
+  UserRecord user;
+  Persisted persisted;
+
+  uint32_t crc;
+
+  uint32_t calc_crc() const {
+    return crc32_le(0, reinterpret_cast<const uint8_t*>(this),
+                    offsetof(Snapshot, crc));
+  }
+  bool valid() const {
+    return magic == kSnapshotMagic && version == kSnapshotVersion &&
+           size == sizeof(Snapshot) && crc == calc_crc();
+  }
+  void reset() {
+    magic = kSnapshotMagic;
+    version = kSnapshotVersion;
+    size = sizeof(Snapshot);
+    parts = 0;
+    nvs_writes = 0;
+  }
+  void seal() { crc = calc_crc(); }
+
+  static_assert(std::is_trivially_copyable<UserRecord>::value &&
+                    std::is_trivially_copyable<Persisted>::value,
+                "records are copied as raw bytes");
+};
+
+RTC_NOINIT_ATTR DeviceState::Snapshot DeviceState::rtc_snapshot_;
+
 void DeviceState::save_user() {
-  preferences_.begin("user", false);
-  preferences_.putString("device_name", user_preferences_.device_name.c_str());
-  preferences_.putString("mqtt_srv", user_preferences_.mqtt.server);
-  preferences_.putUInt("mqtt_port", user_preferences_.mqtt.port);
-  preferences_.putString("mqtt_user", user_preferences_.mqtt.user);
-  preferences_.putString("mqtt_pass", user_preferences_.mqtt.password);
-  preferences_.putString("base_topic", user_preferences_.mqtt.base_topic);
-  preferences_.putString("disc_prefix",
-                         user_preferences_.mqtt.discovery_prefix);
-  for (int i = 0; i < NUM_BUTTONS; i++) {
-    preferences_.putString(StaticString<9>("btn%d_txt", i + 1).c_str(),
-                           user_preferences_.btn_labels[i].c_str());
-  }
-  preferences_.putUInt("sen_itv", user_preferences_.sensor_interval);
-  preferences_.putBool("use_f", user_preferences_.use_fahrenheit);
-  preferences_.putUInt("led_am_br", user_preferences_.led_amb_bright);
-  preferences_.putString("btn_conf", user_preferences_.btn_conf_string.c_str());
-  preferences_.putString("ssid", user_preferences_.network.ssid.c_str());
-  preferences_.putString(
-      "sta_ip",
-      ip_address_to_static_string(user_preferences_.network.static_ip).c_str());
-  preferences_.putString(
-      "g_way",
-      ip_address_to_static_string(user_preferences_.network.gateway).c_str());
-  preferences_.putString(
-      "s_net",
-      ip_address_to_static_string(user_preferences_.network.subnet).c_str());
-  preferences_.putString(
-      "dns",
-      ip_address_to_static_string(user_preferences_.network.dns).c_str());
-  preferences_.putString(
-      "dns2",
-      ip_address_to_static_string(user_preferences_.network.dns2).c_str());
-  preferences_.putString("icon_srv", user_preferences_.icon_server.c_str());
-  preferences_.end();
+  Snapshot& s = rtc_snapshot_;
+  if (!s.valid()) s.reset();
+  UserRecord record;
+  _to_record(user_preferences_.read(), record);
+  if ((s.parts & kUserPart) &&
+      memcmp(&record, &s.user, sizeof(UserRecord)) == 0) {
+    return;
+  }
+  bool ok = _write_user_record(record);
+  if (ok) s.user = record;
+  _end_save(ok ? 1 : 0, ok ? 0 : 1, kUserPart);
 }
 
 void DeviceState::load_user() {
+  UserPreferences u = user_preferences_.get();
   preferences_.begin("user", true);
+  bool has_record = _read_user_record(u);
+  if (!has_record) {
+    _load_user_keys(u);
+  }
+  preferences_.end();
+  _set_user_preferences(u);
+  topics_version_++;
+  _snapshot_user();
+  if (!has_record) {
+    _migrate_user_keys();
+  }
+}
+
+void DeviceState::_load_user_keys(UserPreferences& u) {
   _load_to_static_string(
-      user_preferences_.device_name, "device_name",
+      u.device_name, "device_name",
       (DeviceName{DEVICE_NAME_DFLT} + " " + factory_.random_id).c_str());
-  user_preferences_.mqtt.server = preferences_.getString("mqtt_srv", "");
-  user_preferences_.mqtt.port =
+  _load_to_static_string(u.mqtt.server, "mqtt_srv", "");
+  u.mqtt.port =
       preferences_.getUInt("mqtt_port", MQTT_PORT_DFLT);
-  user_preferences_.mqtt.user = preferences_.getString("mqtt_user", "");
-  user_preferences_.mqtt.password = preferences_.getString("mqtt_pass", "");
-  user_preferences_.mqtt.base_topic =
-      preferences_.getString("base_topic", BASE_TOPIC_DFLT);
-  user_preferences_.mqtt.discovery_prefix =
-      preferences_.getString("disc_prefix", DISCOVERY_PREFIX_DFLT);
+  _load_to_static_string(u.mqtt.user, "mqtt_user", "");
+  _load_to_static_string(u.mqtt.password, "mqtt_pass", "");
+  _load_to_static_string(u.mqtt.base_topic, "base_topic",
+                         BASE_TOPIC_DFLT);
+  _load_to_static_string(u.mqtt.discovery_prefix,
+                         "disc_prefix", DISCOVERY_PREFIX_DFLT);
 
   for (int i = 0; i < NUM_BUTTONS; i++) {
-    _load_to_static_string(user_preferences_.btn_labels[i],
+    _load_to_static_string(u.btn_labels[i],
                            StaticString<9>("btn%d_txt", i + 1).c_str(),
                            StaticString<16>("mdi:numeric-%d", i + 1).c_str());
   }
 
-  user_preferences_.sensor_interval =
+  u.sensor_interval =
       preferences_.getUInt("sen_itv", SEN_INTERVAL_DFLT);
-  user_preferences_.use_fahrenheit = preferences_.getBool("use_f", false);
-  user_preferences_.led_amb_bright =
+  u.sensor_batch = SENSOR_BATCH_DFLT;
+  _set_report_defaults(u);
+  u.use_fahrenheit = preferences_.getBool("use_f", false);
+  u.led_amb_bright =
       preferences_.getUInt("led_am_br", LED_MAX_AMB_BRIGHT);
+  u.device_discovery =
+      preferences_.getBool("dev_disc", DEVICE_DISCOVERY_DFLT);
 
-  _load_to_static_string(user_preferences_.btn_conf_string, "btn_conf",
+  _load_to_static_string(u.btn_conf_string, "btn_conf",
                          BTN_CONF_DFLT);
 
-  _load_to_static_string(user_preferences_.network.ssid, "ssid", "");
-  _load_to_ip_address(user_preferences_.network.static_ip, "sta_ip", "0.0.0.0");
-  _load_to_ip_address(user_preferences_.network.gateway, "g_way", "0.0.0.0");
-  _load_to_ip_address(user_preferences_.network.subnet, "s_net", "0.0.0.0");
-  _load_to_ip_address(user_preferences_.network.dns, "dns", "0.0.0.0");
-  _load_to_ip_address(user_preferences_.network.dns2, "dns2", "0.0.0.0");
+  _load_to_static_string(u.network.ssid, "ssid", "");
+  _load_to_ip_address(u.network.static_ip, "sta_ip", "0.0.0.0");
+  _load_to_ip_address(u.network.gateway, "g_way", "0.0.0.0");
+  _load_to_ip_address(u.network.subnet, "s_net", "0.0.0.0");
+  _load_to_ip_address(u.network.dns, "dns", "0.0.0.0");
+  _load_to_ip_address(u.network.dns2, "dns2", "0.0.0.0");
 
-  _load_to_static_string(user_preferences_.icon_server, "icon_srv",
+  _load_to_static_string(u.icon_server, "icon_srv",
                          ICON_URL_DFLT);
-
-  preferences_.end();
 }
 
 void DeviceState::clear_user() {
   preferences_.begin("user", false);
   preferences_.clear();
   preferences_.end();
+  _drop_snapshot(kUserPart);
 }
 
 void DeviceState::clear_static_ip_config() {
-  user_preferences_.network.static_ip = IPAddress();
-  user_preferences_.network.gateway = IPAddress();
-  user_preferences_.network.subnet = IPAddress();
-  user_preferences_.network.dns = IPAddress();
-  user_preferences_.network.dns2 = IPAddress();
+  user_preferences_.write([](UserPreferences& u) {
+    u.network.static_ip = IPAddress();
+    u.network.gateway = IPAddress();
+    u.network.subnet = IPAddress();
+    u.network.dns = IPAddress();
+    u.network.dns2 = IPAddress();
+  });
   save_user();
 }
 
 void DeviceState::save_persisted() {
-  preferences_.begin("persisted", false);
-  preferences_.putBool("lb_mode", persisted_.low_batt_mode);
-  preferences_.putBool("wifi_done", persisted_.wifi_done);
-  preferences_.putBool("setup_done", persisted_.setup_done);
-  preferences_.putString("last_sw", persisted_.last_sw_ver);
-  preferences_.putBool("u_awake", persisted_.user_awake_mode);
-  preferences_.putBool("wifi_qc", persisted_.wifi_quick_connect);
-  preferences_.putBool("chg_cpt_shwn", persisted_.charge_complete_showing);
-  preferences_.putBool("u_msg_shwn", persisted_.user_msg_showing);
-  preferences_.putBool("chk_conn", persisted_.check_connection);
-  preferences_.putUInt("faild_cons", persisted_.failed_connections);
-  preferences_.putBool("rst_to_w_stp", persisted_.restart_to_wifi_setup);
-  preferences_.putBool("rst_to_stp", persisted_.restart_to_setup);
-  preferences_.putBool("send_adisc", persisted_.send_discovery_config);
-  preferences_.putBool("silent_rst", persisted_.silent_restart);
-  preferences_.putBool("dl_mdi", persisted_.download_mdi_icons);
-  preferences_.putBool("con_on_r", persisted_.connect_on_restart);
-  preferences_.end();
+  Snapshot& s = rtc_snapshot_;
+  if (!s.valid()) s.reset();
+  const Persisted& p = persisted_;
+  Persisted& shadow = s.persisted;
+  DiffWriter w(preferences_, "persisted", !(s.parts & kPersistedPart));
+  w.put("lb_mode", p.low_batt_mode, shadow.low_batt_mode);
+  w.put("wifi_done", p.wifi_done, shadow.wifi_done);
+  w.put("setup_done", p.setup_done, shadow.setup_done);
+  w.put("last_sw", p.last_sw_ver, shadow.last_sw_ver);
+  w.put("u_awake", p.user_awake_mode, shadow.user_awake_mode);
+  w.put("wifi_qc", p.wifi_quick_connect, shadow.wifi_quick_connect);
+  w.put("chg_cpt_shwn", p.charge_complete_showing,
+        shadow.charge_complete_showing);
+  w.put("u_msg_shwn", p.user_msg_showing, shadow.user_msg_showing);
+  w.put("chk_conn", p.check_connection, shadow.check_connection);
+  w.put_uint("faild_cons", p.failed_connections, shadow.failed_connections);
+  w.put("rst_to_w_stp", p.restart_to_wifi_setup, shadow.restart_to_wifi_setup);
+  w.put("rst_to_stp", p.restart_to_setup, shadow.restart_to_setup);
+  w.put("send_adisc", p.send_discovery_config, shadow.send_discovery_config);
+  w.put("silent_rst", p.silent_restart, shadow.silent_restart);
+  w.put("dl_mdi", p.download_mdi_icons, shadow.download_mdi_icons);
+  w.put("con_on_r", p.connect_on_restart, shadow.connect_on_restart);
+  _end_save(w.writes(), w.failed(), kPersistedPart);
 }
 
 void DeviceState::load_persisted() {
@@ -124,7 +289,7 @@ void DeviceState::load_persisted() {
   persisted_.low_batt_mode = preferences_.getBool("lb_mode", false);
   persisted_.wifi_done = preferences_.getBool("wifi_done", false);
   persisted_.setup_done = preferences_.getBool("setup_done", false);
-  persisted_.last_sw_ver = preferences_.getString("last_sw", "");
+  _load_to_static_string(persisted_.last_sw_ver, "last_sw", "");
   persisted_.user_awake_mode = preferences_.getBool("u_awake", false);
   persisted_.wifi_quick_connect = preferences_.getBool("wifi_qc", false);
   persisted_.charge_complete_showing =
@@ -140,12 +305,14 @@ void DeviceState::load_persisted() {
   persisted_.download_mdi_icons = preferences_.getBool("dl_mdi", false);
   persisted_.connect_on_restart = preferences_.getBool("con_on_r", false);
   preferences_.end();
+  _snapshot_persisted();
 }
 
 void DeviceState::clear_persisted() {
   preferences_.begin("persisted", false);
   preferences_.clear();
   preferences_.end();
+  _drop_snapshot(kPersistedPart);
 }
 
 void DeviceState::clear_persisted_flags() {
@@ -168,6 +335,7 @@ void DeviceState::_load_factory(HardwareDefinition& hw) {
   factory_.model_id = hw.get_model_id();
   factory_.hw_version = hw.get_hw_version();
   factory_.unique_id = hw.get_unique_id();
+  topics_version_++;
 }
 
 void DeviceState::save_all() {
@@ -178,9 +346,16 @@ void DeviceState::save_all() {
 
 void DeviceState::load_all(HardwareDefinition& hw) {
   debug("state load all");
+  uint32_t start = micros();
   _load_factory(hw);
+  // RTC memory is only trusted after deep sleep, every other reset reads NVS
+  if (esp_reset_reason() == ESP_RST_DEEPSLEEP && _restore_snapshot()) {
+    info("state restored from RTC in %lu us", micros() - start);
+    return;
+  }
   load_user();
   load_persisted();
+  info("state loaded from NVS in %lu us", micros() - start);
   size_t free_entries = get_free_entries();
   info("nvs free entries: %d", free_entries);
 }
@@ -193,18 +368,28 @@ void DeviceState::clear_all() {
 
 size_t DeviceState::get_free_entries() { return preferences_.freeEntries(); }
 
-const ButtonLabel& DeviceState::get_btn_label(uint8_t i) const {
-  static ButtonLabel noLabel;
+ButtonLabel DeviceState::get_btn_label(uint8_t i) const {
   if (i > 0 && i <= NUM_BUTTONS) {
-    return user_preferences_.btn_labels[i - 1];
+    return user_preferences_.read(
+        [&](const UserPreferences& u) { return u.btn_labels[i - 1]; });
   } else {
-    return noLabel;
+    return ButtonLabel{};
   }
 }
 
+void DeviceState::get_btn_labels(ButtonLabel (&labels)[NUM_BUTTONS]) const {
+  user_preferences_.read([&](const UserPreferences& u) {
+    std::copy(std::begin(u.btn_labels), std::end(u.btn_labels), labels);
+    return true;
+  });
+}
+
 void DeviceState::set_btn_label(uint8_t i, const char* label) {
   if (i > 0 && i <= NUM_BUTTONS) {
-    user_preferences_.btn_labels[i - 1].set(label);
+    ButtonLabel new_label{label};
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.btn_labels[i - 1] = new_label; });
+    request_redraw();
   }
 }
 
@@ -216,4 +401,217 @@ void DeviceState::_load_to_ip_address(IPAddress& destination, const char* key,
     destination.fromString(defaultValue);
   else
     destination.fromString(buffer);
-}
\ No newline at end of file
+}
+
+bool DeviceState::_restore_snapshot() {
+  const Snapshot& s = rtc_snapshot_;
+  if (!s.valid() || s.parts != (kUserPart | kPersistedPart)) {
+    debug("no valid RTC snapshot");
+    return false;
+  }
+  UserPreferences u = user_preferences_.get();
+  _from_record(s.user, u);
+  _set_user_preferences(u);
+  persisted_ = s.persisted;
+  topics_version_++;
+  return true;
+}
+
+void DeviceState::_snapshot_user() {
+  Snapshot& s = rtc_snapshot_;
+  if (!s.valid()) s.reset();
+  _to_record(user_preferences_.read(), s.user);
+  s.parts |= kUserPart;
+  s.seal();
+}
+
+void DeviceState::_snapshot_persisted() {
+  Snapshot& s = rtc_snapshot_;
+  if (!s.valid()) s.reset();
+  s.persisted = persisted_;
+  s.parts |= kPersistedPart;
+  s.seal();
+}
+
+void DeviceState::_drop_snapshot(uint8_t parts) {
+  Snapshot& s = rtc_snapshot_;
+  if (!s.valid()) s.reset();
+  s.parts &= ~parts;
+  s.seal();
+}
+
+// a part is only marked in sync if every key was written
+void DeviceState::_end_save(uint32_t writes, uint32_t failed, uint8_t part) {
+  Snapshot& s = rtc_snapshot_;
+  if (writes == 0 && failed == 0 && (s.parts & part)) return;  // no change
+  if (failed > 0) {
+    error("nvs save failed for %u keys", failed);
+    s.parts &= ~part;
+  } else {
+    s.parts |= part;
+  }
+  s.nvs_writes += writes;
+  s.seal();
+  if (writes > 0) debug("nvs keys written: %u", writes);
+}
+
+uint32_t DeviceState::nvs_writes() const {
+  return rtc_snapshot_.valid() ? rtc_snapshot_.nvs_writes : 0;
+}
+
+void DeviceState::_to_record(const UserPreferences& u,
+                             UserRecord& record) const {
+  memset(static_cast<void*>(&record), 0, sizeof(UserRecord));
+  record.version = kUserRecordVersion;
+  record.size = sizeof(UserRecord);
+  copy_string(record.device_name, u.device_name);
+  for (int i = 0; i < NUM_BUTTONS; i++) {
+    copy_string(record.btn_labels[i], u.btn_labels[i]);
+  }
+  record.sensor_interval = u.sensor_interval;
+  record.use_fahrenheit = u.use_fahrenheit;
+  record.led_amb_bright = u.led_amb_bright;
+  record.device_discovery = u.device_discovery;
+  copy_string(record.btn_conf_string, u.btn_conf_string);
+  copy_string(record.ssid, u.network.ssid);
+  record.static_ip = u.network.static_ip;
+  record.gateway = u.network.gateway;
+  record.subnet = u.network.subnet;
+  record.dns = u.network.dns;
+  record.dns2 = u.network.dns2;
+  copy_string(record.mqtt_server, u.mqtt.server);
+  record.mqtt_port = u.mqtt.port;
+  copy_string(record.mqtt_user, u.mqtt.user);
+  copy_string(record.mqtt_password, u.mqtt.password);
+  copy_string(record.mqtt_base_topic, u.mqtt.base_topic);
+  copy_string(record.mqtt_discovery_prefix, u.mqtt.discovery_prefix);
+  copy_string(record.icon_server, u.icon_server);
+  record.sensor_batch = u.sensor_batch;
+  memcpy(record.deadbands, u.deadbands, sizeof(record.deadbands));
+  record.report_heartbeat = u.report_heartbeat;
+}
+
+void DeviceState::_from_record(const UserRecord& record,
+                               UserPreferences& u) {
+  u.device_name = record.device_name;
+  for (int i = 0; i < NUM_BUTTONS; i++) {
+    u.btn_labels[i] = record.btn_labels[i];
+  }
+  u.sensor_interval = record.sensor_interval;
+  u.use_fahrenheit = record.use_fahrenheit;
+  u.led_amb_bright = record.led_amb_bright;
+  u.device_discovery = record.device_discovery;
+  u.btn_conf_string = record.btn_conf_string;
+  u.network.ssid = record.ssid;
+  u.network.static_ip = IPAddress(record.static_ip);
+  u.network.gateway = IPAddress(record.gateway);
+  u.network.subnet = IPAddress(record.subnet);
+  u.network.dns = IPAddress(record.dns);
+  u.network.dns2 = IPAddress(record.dns2);
+  u.mqtt.server = record.mqtt_server;
+  u.mqtt.port = record.mqtt_port;
+  u.mqtt.user = record.mqtt_user;
+  u.mqtt.password = record.mqtt_password;
+  u.mqtt.base_topic = record.mqtt_base_topic;
+  u.mqtt.discovery_prefix = record.mqtt_discovery_prefix;
+  u.icon_server = record.icon_server;
+  u.sensor_batch = record.sensor_batch;
+  memcpy(u.deadbands, record.deadbands, sizeof(u.deadbands));
+  u.report_heartbeat = record.report_heartbeat;
+}
+
+void DeviceState::_set_user_defaults(UserPreferences& u) {
+  u.device_name.set("%s %s", DEVICE_NAME_DFLT, factory_.random_id.c_str());
+  for (int i = 0; i < NUM_BUTTONS; i++) {
+    u.btn_labels[i].set("mdi:numeric-%d", i + 1);
+  }
+  u.sensor_interval = SEN_INTERVAL_DFLT;
+  u.use_fahrenheit = false;
+  u.led_amb_bright = LED_MAX_AMB_BRIGHT;
+  u.device_discovery = DEVICE_DISCOVERY_DFLT;
+  u.btn_conf_string = BTN_CONF_DFLT;
+  u.network.ssid = "";
+  u.network.static_ip = IPAddress();
+  u.network.gateway = IPAddress();
+  u.network.subnet = IPAddress();
+  u.network.dns = IPAddress();
+  u.network.dns2 = IPAddress();
+  u.mqtt.server = "";
+  u.mqtt.port = MQTT_PORT_DFLT;
+  u.mqtt.user = "";
+  u.mqtt.password = "";
+  u.mqtt.base_topic = BASE_TOPIC_DFLT;
+  u.mqtt.discovery_prefix = DISCOVERY_PREFIX_DFLT;
+  u.icon_server = ICON_URL_DFLT;
+  u.sensor_batch = SENSOR_BATCH_DFLT;
+  _set_report_defaults(u);
+}
+
+void DeviceState::_set_report_defaults(UserPreferences& u) {
+  u.deadbands[static_cast<size_t>(ReportChannel::kTemperature)] = {
+      DEADBAND_TEMP_DFLT, 0};
+  u.deadbands[static_cast<size_t>(ReportChannel::kHumidity)] = {
+      DEADBAND_HMD_DFLT, 0};
+  u.deadbands[static_cast<size_t>(ReportChannel::kBattery)] = {
+      DEADBAND_BATT_DFLT, 0};
+  u.deadbands[static_cast<size_t>(ReportChannel::kRssi)] = {
+      DEADBAND_RSSI_DFLT, 0};
+  u.report_heartbeat = REPORT_HEARTBEAT_DFLT;
+}
+
+// preferences_ must be open
+bool DeviceState::_read_user_record(UserPreferences& u) {
+  size_t length = preferences_.getBytesLength(kUserRecordKey);
+  if (length < offsetof(UserRecord, device_name)) return false;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[length]);
+  if (preferences_.getBytes(kUserRecordKey, buffer.get(), length) != length) {
+    error("user record read failed");
+    return false;
+  }
+
+  // fields missing in older records keep their defaults
+  _set_user_defaults(u);
+  UserRecord record;
+  _to_record(u, record);
+  memcpy(&record, buffer.get(), std::min(length, sizeof(UserRecord)));
+  if (record.size != length) {
+    error("user record corrupt (size %u, stored %u)", record.size, length);
+    return false;
+  }
+  if (record.version != kUserRecordVersion) {
+    // no conversions needed yet, fields were only appended
+    info("user record v%u read as v%u", record.version,
+         kUserRecordVersion);
+  }
+  _from_record(record, u);
+  return true;
+}
+
+bool DeviceState::_write_user_record(const UserRecord& record) {
+  bool ok = preferences_.begin("user", false) &&
+            preferences_.putBytes(kUserRecordKey, &record,
+                                  sizeof(UserRecord)) == sizeof(UserRecord);
+  preferences_.end();
+  if (!ok) error("user record write failed");
+  return ok;
+}
+
+// moves user preferences from one key per field to one record
+void DeviceState::_migrate_user_keys() {
+  Snapshot& s = rtc_snapshot_;
+  if (!_write_user_record(s.user)) {
+    _end_save(0, 1, kUserPart);
+    return;
+  }
+  preferences_.begin("user", false);
+  for (const char* key : kLegacyUserKeys) {
+    preferences_.remove(key);
+  }
+  for (int i = 1; i <= NUM_BUTTONS; i++) {
+    preferences_.remove(StaticString<9>("btn%d_txt", i).c_str());
+  }
+  preferences_.end();
+  _end_save(1, 0, kUserPart);
+  info("user preferences moved to record v%u (%u B)", kUserRecordVersion,
+       sizeof(UserRecord));
+}
@@ -2,11 +2,13 @@
 #define HOMEBUTTONS_STATE_H
 
 #include <Preferences.h>
+#include <atomic>
 
 #include "config.h"
 #include "types.h"
 #include "logger.h"
 #include "hardware.h"
+#include "seqlock.h"
 #include <IPAddress.h>
 
 struct StaticIPConfig {
@@ -34,30 +36,35 @@ class DeviceState : public Logger {
     DeviceName device_name;
     ButtonLabel btn_labels[NUM_BUTTONS];
     uint16_t sensor_interval = 0;  // minutes
+    uint8_t sensor_batch = 0;      // samples per upload
+    Deadband deadbands[static_cast<size_t>(ReportChannel::kNumChannels)] = {};
+    uint16_t report_heartbeat = 0;  // minutes
     bool use_fahrenheit = false;
     uint8_t led_amb_bright = 0;  // 0-100
+    bool device_discovery = false;  // one discovery message for the device
     BtnConfString btn_conf_string;
 
     StaticIPConfig network;
 
     struct {
-      String server = "";
+      MQTTParamType server;
       int32_t port = 0;
-      String user = "";
-      String password = "";
-      String base_topic = "";
-      String discovery_prefix = "";
+      MQTTParamType user;
+      MQTTParamType password;
+      MQTTParamType base_topic;
+      MQTTParamType discovery_prefix;
     } mqtt;
 
     IconServerType icon_server;
-  } user_preferences_;
+  };
+  SeqLock<UserPreferences> user_preferences_;
 
   struct Persisted {
     // Vars
     bool low_batt_mode = false;
     bool wifi_done = false;
     bool setup_done = false;
-    String last_sw_ver = "";
+    SWVersionType last_sw_ver;
     bool user_awake_mode = false;
 
     // Flags
@@ -75,12 +82,12 @@ class DeviceState : public Logger {
   } persisted_;
 
   struct Flags {
-    bool display_redraw = false;
     bool awake_mode = false;
     uint32_t schedule_wakeup_time = 0;
     uint32_t last_user_input_time = 0;
     bool keep_frontlight_on = false;
-  } flags_;
+  };
+  SeqLock<Flags> flags_;
 
   struct Sensors {
     float temperature = 0;
@@ -91,7 +98,10 @@ class DeviceState : public Logger {
     bool dc_connected = false;
     bool battery_present = false;
     bool battery_low = false;
-  } sensors_;
+  };
+  SeqLock<Sensors> sensors_;
+  // changes when the main screen has to be redrawn
+  std::atomic<uint32_t> display_version_{0};
 
  public:
   DeviceState() : Logger("State") {}
@@ -101,76 +111,130 @@ class DeviceState : public Logger {
   const Factory& factory() const { return factory_; }
 
   // User preferences
-  const UserPreferences& user_preferences() const { return user_preferences_; }
-  void set_mqtt_parameters(const String& server, int32_t port,
-                           const String& user, const String& password,
-                           const String& base_topic,
-                           const String& discovery_prefix) {
-    user_preferences_.mqtt = {server,   port,       user,
-                              password, base_topic, discovery_prefix};
+  // The network task changes labels and settings from MQTT commands while
+  // other tasks read them. Values that change at runtime are returned as
+  // consistent copies, user_preferences() is for settings that only change
+  // in setup.
+  const UserPreferences& user_preferences() const {
+    return user_preferences_.get();
+  }
+  void set_mqtt_parameters(const char* server, int32_t port, const char* user,
+                           const char* password, const char* base_topic,
+                           const char* discovery_prefix) {
+    MQTTParamType server_s{server}, user_s{user}, password_s{password},
+        base_topic_s{base_topic}, discovery_prefix_s{discovery_prefix};
+    user_preferences_.write([&](UserPreferences& u) {
+      u.mqtt.server = server_s;
+      u.mqtt.port = port;
+      u.mqtt.user = user_s;
+      u.mqtt.password = password_s;
+      u.mqtt.base_topic = base_topic_s;
+      u.mqtt.discovery_prefix = discovery_prefix_s;
+    });
+    topics_version_++;
   }
   void set_static_ip_config(SSIDType ssid, const IPAddress& static_ip,
                             const IPAddress& gateway, const IPAddress& subnet,
                             const IPAddress& dns = IPAddress(),
                             const IPAddress& dns2 = IPAddress()) {
-    user_preferences_.network.valid = false;
-    user_preferences_.network.ssid = ssid;
-    user_preferences_.network.static_ip = static_ip;
-    user_preferences_.network.gateway = gateway;
-    user_preferences_.network.subnet = subnet;
-    user_preferences_.network.dns = dns;
-    user_preferences_.network.dns2 = dns2;
+    user_preferences_.write([&](UserPreferences& u) {
+      u.network.valid = false;
+      u.network.ssid = ssid;
+      u.network.static_ip = static_ip;
+      u.network.gateway = gateway;
+      u.network.subnet = subnet;
+      u.network.dns = dns;
+      u.network.dns2 = dns2;
+    });
   }
 
   const StaticIPConfig get_static_ip_config() const {
-    return user_preferences_.network;
+    return user_preferences_.read(
+        [](const UserPreferences& u) { return u.network; });
   }
 
   void clear_static_ip_config();
 
   const DeviceName& device_name() const {
-    return user_preferences_.device_name;
+    return user_preferences_.get().device_name;
   }
   void set_device_name(const DeviceName& device_name) {
-    user_preferences_.device_name = device_name;
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.device_name = device_name; });
+    topics_version_++;
+  }
+  uint16_t sensor_interval() const {
+    return user_preferences_.get().sensor_interval;
   }
-  uint16_t sensor_interval() const { return user_preferences_.sensor_interval; }
   void set_sensor_interval(uint16_t interval_min) {
-    user_preferences_.sensor_interval = interval_min;
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.sensor_interval = interval_min; });
+  }
+  uint8_t sensor_batch() const { return user_preferences_.get().sensor_batch; }
+  void set_sensor_batch(uint8_t batch) {
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.sensor_batch = batch; });
+  }
+  Deadband deadband(ReportChannel channel) const {
+    return user_preferences_.read([&](const UserPreferences& u) {
+      return u.deadbands[static_cast<size_t>(channel)];
+    });
+  }
+  void set_deadband(ReportChannel channel, const Deadband& band) {
+    user_preferences_.write([&](UserPreferences& u) {
+      u.deadbands[static_cast<size_t>(channel)] = band;
+    });
+  }
+  uint16_t report_heartbeat() const {
+    return user_preferences_.get().report_heartbeat;
+  }
+  void set_report_heartbeat(uint16_t heartbeat_min) {
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.report_heartbeat = heartbeat_min; });
   }
-  const ButtonLabel& get_btn_label(uint8_t i) const;
+  ButtonLabel get_btn_label(uint8_t i) const;
+  // all labels from the same version
+  void get_btn_labels(ButtonLabel (&labels)[NUM_BUTTONS]) const;
   void set_btn_label(uint8_t i, const char* label);
 
-  bool get_use_fahrenheit() const { return user_preferences_.use_fahrenheit; }
+  bool get_use_fahrenheit() const {
+    return user_preferences_.get().use_fahrenheit;
+  }
   StaticString<1> get_temp_unit() const {
-    return StaticString<1>(user_preferences_.use_fahrenheit ? "F" : "C");
+    return StaticString<1>(get_use_fahrenheit() ? "F" : "C");
   }
   void set_temp_unit(StaticString<1> unit) {
     bool f = unit == "F" || unit == "f";
-    user_preferences_.use_fahrenheit = f;
+    user_preferences_.write([&](UserPreferences& u) { u.use_fahrenheit = f; });
   }
 
   void set_led_brightness(uint8_t brightness) {
-    user_preferences_.led_amb_bright = brightness;
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.led_amb_bright = brightness; });
+  }
+
+  void set_device_discovery(bool device_discovery) {
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.device_discovery = device_discovery; });
   }
 
   void set_btn_conf_string(const BtnConfString& btn_conf_string) {
     BtnConfString btn_conf_string_upper(btn_conf_string);
     btn_conf_string_upper.to_upper_case();
     for (char& c : btn_conf_string_upper) {
-      if (c != 'B' && c != 'S') {
+      if (c != 'B' && c != 'S' && c != 'I') {
         c = 'B';
       }
-      user_preferences_.btn_conf_string = btn_conf_string_upper;
     }
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.btn_conf_string = btn_conf_string_upper; });
   }
 
   void set_icon_server(const IconServerType& icon_server) {
-    if (!icon_server.empty()) {
-      user_preferences_.icon_server = icon_server;
-    } else {
-      user_preferences_.icon_server = ICON_URL_DFLT;
-    }
+    IconServerType server =
+        icon_server.empty() ? IconServerType{ICON_URL_DFLT} : icon_server;
+    user_preferences_.write(
+        [&](UserPreferences& u) { u.icon_server = server; });
   }
 
   void save_user();
@@ -180,22 +244,70 @@ class DeviceState : public Logger {
   // Others
   const Persisted& persisted() const { return persisted_; }
   Persisted& persisted() { return persisted_; }
-  const Flags& flags() const { return flags_; }
-  Flags& flags() { return flags_; }
-  const Sensors& sensors() const { return sensors_; }
-  Sensors& sensors() { return sensors_; }
+  // flags and sensors are read as consistent copies from any task
+  Flags flags() const { return flags_.read(); }
+  void set_awake_mode(bool awake_mode) {
+    flags_.write([&](Flags& f) { f.awake_mode = awake_mode; });
+  }
+  void set_schedule_wakeup_time(uint32_t secs) {
+    flags_.write([&](Flags& f) { f.schedule_wakeup_time = secs; });
+  }
+  void set_last_user_input_time(uint32_t time) {
+    flags_.write([&](Flags& f) { f.last_user_input_time = time; });
+  }
+  void set_keep_frontlight_on(bool on) {
+    flags_.write([&](Flags& f) { f.keep_frontlight_on = on; });
+  }
+
+  Sensors sensors() const { return sensors_.read(); }
+  void set_temp_hmd(float temperature, float humidity) {
+    sensors_.write([&](Sensors& s) {
+      s.temperature = temperature;
+      s.humidity = humidity;
+    });
+  }
+  void set_battery(uint8_t pct, float voltage) {
+    sensors_.write([&](Sensors& s) {
+      s.battery_pct = pct;
+      s.battery_voltage = voltage;
+    });
+  }
+  void set_power_source(bool battery_present, bool dc_connected) {
+    sensors_.write([&](Sensors& s) {
+      s.battery_present = battery_present;
+      s.dc_connected = dc_connected;
+    });
+  }
+  void set_charging(bool charging) {
+    sensors_.write([&](Sensors& s) { s.charging = charging; });
+  }
+  void set_battery_low(bool battery_low) {
+    sensors_.write([&](Sensors& s) { s.battery_low = battery_low; });
+  }
+
+  // changes with the labels and icons on the main screen, redraw when it
+  // differs from the drawn version
+  uint32_t display_version() const { return display_version_.load(); }
+  void request_redraw() { display_version_++; }
 
   void save_persisted();
   void load_persisted();
   void clear_persisted();
   void clear_persisted_flags();
 
+  // saves write only the keys that changed since the last save or load, so
+  // calling them often is cheap
   void save_all();
   void load_all(HardwareDefinition& hw);
   void clear_all();
+  // NVS keys written since power on, kept across deep sleep
+  uint32_t nvs_writes() const;
 
   size_t get_free_entries();
 
+  // changes whenever a setting used in MQTT topics changes
+  uint32_t topics_version() const { return topics_version_; }
+
   SSIDType get_ap_ssid() const {
     return SSIDType("HB-") + factory_.random_id.c_str();
   }
@@ -218,7 +330,30 @@ class DeviceState : public Logger {
   }
 
  private:
+  // copy of the user preferences and persisted state as saved in NVS, kept
+  // in RTC memory to skip NVS reads on wake from deep sleep
+  struct UserRecord;
+  struct Snapshot;
+  static Snapshot rtc_snapshot_;
+
   void _load_factory(HardwareDefinition& hw);
+  // staged in a copy, then written at once
+  void _load_user_keys(UserPreferences& u);
+  void _set_user_defaults(UserPreferences& u);
+  void _set_report_defaults(UserPreferences& u);
+  bool _read_user_record(UserPreferences& u);
+  bool _write_user_record(const UserRecord& record);
+  void _migrate_user_keys();
+  void _to_record(const UserPreferences& u, UserRecord& record) const;
+  void _from_record(const UserRecord& record, UserPreferences& u);
+  void _set_user_preferences(const UserPreferences& u) {
+    user_preferences_.write([&](UserPreferences& p) { p = u; });
+  }
+  bool _restore_snapshot();
+  void _snapshot_user();
+  void _snapshot_persisted();
+  void _drop_snapshot(uint8_t parts);
+  void _end_save(uint32_t writes, uint32_t failed, uint8_t part);
 
   template <std::size_t MAX_SIZE>
   void _load_to_static_string(StaticString<MAX_SIZE>& destination,
@@ -236,6 +371,7 @@ class DeviceState : public Logger {
 
   Preferences preferences_;
   StaticString<15> ip_address_;
+  uint32_t topics_version_ = 1;
 };
 
 #endif  // HOMEBUTTONS_STATE_H
@@ -66,6 +66,9 @@ class StateMachine {
     std::visit([](auto statePtr) { statePtr->loop(); }, current_state_);
   }
 
+  // changes on every transition to another state
+  size_t state_index() const { return current_state_.index(); }
+
   template <typename State>
   bool is_current_state() const {
     return std::holds_alternative<State *>(current_state_);
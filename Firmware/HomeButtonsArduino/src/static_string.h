@@ -174,6 +174,8 @@ class StaticString {
                                  StaticString<_OTHER_MAX_SIZE>::MAX_SIZE)) == 0;
   }
 
+  bool operator!=(const char* other) const { return !(*this == other); }
+
   char operator[](unsigned int i) const {
     if (i >= length()) {
       return '\0';
@@ -1,219 +1,157 @@
 #include "topics.h"
 
-TopicType TopicHelper::get_button_topic(UserInput::Event event) const {
-  if (event.btn_id < 1 || event.btn_id > NUM_BUTTONS) return {};
+namespace {
+// Writes topics back to back into arena. With arena == nullptr it only
+// measures the required size.
+class TopicTableBuilder {
+ public:
+  TopicTableBuilder(char* arena, size_t size, uint16_t* offsets)
+      : arena_(arena), size_(size), offsets_(offsets) {}
+
+  template <typename... Args>
+  void add(size_t index, const char* format, Args... args) {
+    char* dest = arena_ != nullptr ? arena_ + cursor_ : nullptr;
+    size_t remaining = arena_ != nullptr ? size_ - cursor_ : 0;
+    int n = snprintf(dest, remaining, format, args...);
+    if (n < 0) n = 0;
+    if (offsets_ != nullptr) offsets_[index] = cursor_;
+    cursor_ += n + 1;
+  }
+
+  size_t size() const { return cursor_; }
+
+ private:
+  char* arena_;
+  size_t size_;
+  uint16_t* offsets_;
+  size_t cursor_ = 0;
+};
+}  // namespace
+
+const char* TopicHelper::get_button_topic(UserInput::Event event) const {
+  if (event.btn_id < 1 || event.btn_id > NUM_BUTTONS) return "";
 
   if (event.type == UserInput::EventType::kClickSingle)
-    return t_common() + "button_" + event.btn_id;
+    return t_btn_press(event.btn_id);
   else if (event.type == UserInput::EventType::kClickDouble)
-    return t_common() + "button_" + event.btn_id + "_double";
+    return t_btn_double_press(event.btn_id);
   else if (event.type == UserInput::EventType::kClickTriple)
-    return t_common() + "button_" + event.btn_id + "_triple";
+    return t_btn_triple_press(event.btn_id);
   else if (event.type == UserInput::EventType::kClickQuad)
-    return t_common() + "button_" + event.btn_id + "_quad";
+    return t_btn_quad_press(event.btn_id);
   else if (event.type == UserInput::EventType::kSwitchOn)
-    return t_common() + "switch_" + event.btn_id;
+    return t_switch_state(event.btn_id);
   else if (event.type == UserInput::EventType::kSwitchOff)
-    return t_common() + "switch_" + event.btn_id;
+    return t_switch_state(event.btn_id);
   else
-    return {};
-}
-
-TopicType TopicHelper::t_switch_state(uint8_t switch_idx) const {
-  if (switch_idx > 0 && switch_idx <= NUM_BUTTONS)
-    return t_common() + "switch_" + (switch_idx);
-  else
-    return {};
-}
-
-TopicType TopicHelper::t_switch_cmd(uint8_t switch_idx) const {
-  if (switch_idx > 0 && switch_idx <= NUM_BUTTONS)
-    return t_cmd() + "switch_" + (switch_idx);
-  else
-    return {};
-}
-
-TopicType TopicHelper::t_common() const {
-  return TopicType(_device_state.user_preferences().mqtt.base_topic.c_str()) +
-         "/" + _device_state.user_preferences().device_name.c_str() + "/";
-}
-
-TopicType TopicHelper::t_cmd() const { return t_common() + "cmd/"; }
-TopicType TopicHelper::t_temperature() const {
-  return t_common() + "temperature";
-}
-TopicType TopicHelper::t_humidity() const { return t_common() + "humidity"; }
-TopicType TopicHelper::t_battery() const { return t_common() + "battery"; }
-TopicType TopicHelper::t_btn_press(uint8_t btn_idx) const {
-  if (btn_idx <= NUM_BUTTONS)
-    return t_common() + "button_" + (btn_idx);
-  else
-    return {};
-}
-
-TopicType TopicHelper::t_btn_label_state(uint8_t btn_idx) const {
-  if (btn_idx > 0 && btn_idx <= NUM_BUTTONS)
-    return t_common() + "btn_" + (btn_idx) + "_label";
-  else
-    return {};
-}
-
-TopicType TopicHelper::t_btn_label_cmd(uint8_t btn_idx) const {
-  if (btn_idx > 0 && btn_idx <= NUM_BUTTONS)
-    return t_cmd() + "btn_" + (btn_idx) + "_label";
-  else
-    return {};
-}
-
-TopicType TopicHelper::t_sensor_interval_state() const {
-  return t_common() + "sensor_interval";
-}
-
-TopicType TopicHelper::t_sensor_interval_cmd() const {
-  return t_cmd() + "sensor_interval";
-}
-
-TopicType TopicHelper::t_awake_mode_state() const {
-  return t_common() + "awake_mode";
-}
-
-TopicType TopicHelper::t_awake_mode_cmd() const {
-  return t_cmd() + "awake_mode";
-}
-
-TopicType TopicHelper::t_awake_mode_avlb() const {
-  return t_awake_mode_state() + "/available";
-}
-
-TopicType TopicHelper::t_disp_msg_cmd() const { return t_cmd() + "disp_msg"; }
-
-TopicType TopicHelper::t_disp_msg_state() const {
-  return t_common() + "disp_msg";
-}
-
-TopicType TopicHelper::t_schedule_wakeup_cmd() const {
-  return t_cmd() + "schedule_wakeup";
-}
-
-TopicType TopicHelper::t_schedule_wakeup_state() const {
-  return t_common() + "schedule_wakeup";
-}
-
-TopicType TopicHelper::t_led_amb_bright_cmd() const {
-  return t_cmd() + "led_amb_bright";
-}
-
-TopicType TopicHelper::t_led_amb_bright_state() const {
-  return t_common() + "led_amb_bright";
-}
-
-TopicType TopicHelper::t_avlb() const { return t_common() + "available"; }
-
-TopicType TopicHelper::t_system_state() const {
-  return t_common() + "system_state";
-}
-
-TopicType TopicHelper::t_btn_config(uint8_t btn_id) {
-  return TopicType(
-      "%s/device_automation/%s/button_%d/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), btn_id);
-}
-
-TopicType TopicHelper::t_btn_double_config(uint8_t btn_id) {
-  return TopicType(
-      "%s/device_automation/%s/button_%d_double/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), btn_id);
-}
-
-TopicType TopicHelper::t_btn_triple_config(uint8_t btn_id) {
-  return TopicType(
-      "%s/device_automation/%s/button_%d_triple/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), btn_id);
-}
-
-TopicType TopicHelper::t_btn_quad_config(uint8_t btn_id) {
-  return TopicType(
-      "%s/device_automation/%s/button_%d_quad/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), btn_id);
-}
-
-TopicType TopicHelper::t_switch_config(uint8_t switch_id) {
-  return TopicType(
-      "%s/switch/%s/switch_%d/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), switch_id);
-}
-
-TopicType TopicHelper::t_kill_switch_config(uint8_t switch_id) {
-  return TopicType(
-      "%s/binary_sensor/%s/kill_switch_%d/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), switch_id);
-}
-
-TopicType TopicHelper::t_temperature_config() {
-  return TopicType(
-      "%s/sensor/%s/temperature/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_humidity_config() {
-  return TopicType(
-      "%s/sensor/%s/humidity/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_sensor_interval_config() {
-  return TopicType(
-      "%s/number/%s/sensor_interval/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_battery_config() {
-  return TopicType(
-      "%s/sensor/%s/battery/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_btn_label_config(uint8_t btn_idx) {
-  return TopicType(
-      "%s/text/%s/button_%d_label/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str(), btn_idx);
-}
-
-TopicType TopicHelper::t_user_message_config() {
-  return TopicType(
-      "%s/text/%s/user_message/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_schedule_wakeup_config() {
-  return TopicType(
-      "%s/number/%s/schedule_wakeup/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_awake_mode_config() {
-  return TopicType(
-      "%s/switch/%s/awake_mode/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
-}
-
-TopicType TopicHelper::t_led_amb_bright_config() {
-  return TopicType(
-      "%s/number/%s/led_amb_bright/config",
-      _device_state.user_preferences().mqtt.discovery_prefix.c_str(),
-      _device_state.factory().unique_id.c_str());
+    return "";
+}
+
+const char* TopicHelper::_get(size_t index) const {
+  if (_version != _device_state.topics_version()) {
+    _rebuild();
+  }
+  if (!_arena || index >= kTableSize) return "";
+  return &_arena[_offsets[index]];
+}
+
+const char* TopicHelper::_get_btn(ButtonTopic topic, uint8_t btn_id) const {
+  if (btn_id < 1 || btn_id > NUM_BUTTONS) return "";
+  return _get(kNumTopics + topic * NUM_BUTTONS + btn_id - 1);
+}
+
+void TopicHelper::_rebuild() const {
+  uint32_t start = micros();
+  size_t size = _build(nullptr, 0);
+  if (size > UINT16_MAX) {
+    error("topic table too large: %u B", size);
+    _arena.reset();
+  } else {
+    _arena.reset(new char[size]);
+    _build(_arena.get(), size);
+  }
+  _version = _device_state.topics_version();
+  debug("topic table built: %u topics, %u B in %lu us", kTableSize, size,
+        micros() - start);
+}
+
+size_t TopicHelper::_build(char* arena, size_t size) const {
+  const char* base = _device_state.user_preferences().mqtt.base_topic.c_str();
+  const char* name = _device_state.user_preferences().device_name.c_str();
+  const char* disc =
+      _device_state.user_preferences().mqtt.discovery_prefix.c_str();
+  const char* uid = _device_state.factory().unique_id.c_str();
+  TopicTableBuilder b(arena, size, arena != nullptr ? _offsets : nullptr);
+
+  b.add(kCommon, "%s/%s/", base, name);
+  b.add(kCmd, "%s/%s/cmd/", base, name);
+  b.add(kTemperature, "%s/%s/temperature", base, name);
+  b.add(kHumidity, "%s/%s/humidity", base, name);
+  b.add(kBattery, "%s/%s/battery", base, name);
+  b.add(kSensorIntervalState, "%s/%s/sensor_interval", base, name);
+  b.add(kSensorIntervalCmd, "%s/%s/cmd/sensor_interval", base, name);
+  b.add(kSensorBatchState, "%s/%s/sensor_batch", base, name);
+  b.add(kSensorBatchCmd, "%s/%s/cmd/sensor_batch", base, name);
+  b.add(kSensorLog, "%s/%s/sensor_log", base, name);
+  b.add(kReportConfigState, "%s/%s/report_config", base, name);
+  b.add(kReportConfigCmd, "%s/%s/cmd/report_config", base, name);
+  b.add(kBtnConfState, "%s/%s/btn_conf", base, name);
+  b.add(kBtnConfCmd, "%s/%s/cmd/btn_conf", base, name);
+  b.add(kAwakeModeState, "%s/%s/awake_mode", base, name);
+  b.add(kAwakeModeCmd, "%s/%s/cmd/awake_mode", base, name);
+  b.add(kAwakeModeAvlb, "%s/%s/awake_mode/available", base, name);
+  b.add(kDispMsgCmd, "%s/%s/cmd/disp_msg", base, name);
+  b.add(kDispMsgState, "%s/%s/disp_msg", base, name);
+  b.add(kScheduleWakeupCmd, "%s/%s/cmd/schedule_wakeup", base, name);
+  b.add(kScheduleWakeupState, "%s/%s/schedule_wakeup", base, name);
+  b.add(kLedAmbBrightCmd, "%s/%s/cmd/led_amb_bright", base, name);
+  b.add(kLedAmbBrightState, "%s/%s/led_amb_bright", base, name);
+  b.add(kDiscoveryModeCmd, "%s/%s/cmd/discovery_mode", base, name);
+  b.add(kAvlb, "%s/%s/available", base, name);
+  b.add(kSystemState, "%s/%s/system_state", base, name);
+  b.add(kWakeMetrics, "%s/%s/wake_metrics", base, name);
+  b.add(kEventReplay, "%s/%s/event_replay", base, name);
+  b.add(kHaStatus, "%s/status", disc);
+
+  b.add(kTemperatureConfig, "%s/sensor/%s/temperature/config", disc, uid);
+  b.add(kHumidityConfig, "%s/sensor/%s/humidity/config", disc, uid);
+  b.add(kSensorIntervalConfig, "%s/number/%s/sensor_interval/config", disc,
+        uid);
+  b.add(kSensorBatchConfig, "%s/number/%s/sensor_batch/config", disc, uid);
+  b.add(kBatteryConfig, "%s/sensor/%s/battery/config", disc, uid);
+  b.add(kUserMessageConfig, "%s/text/%s/user_message/config", disc, uid);
+  b.add(kScheduleWakeupConfig, "%s/number/%s/schedule_wakeup/config", disc,
+        uid);
+  b.add(kAwakeModeConfig, "%s/switch/%s/awake_mode/config", disc, uid);
+  b.add(kLedAmbBrightConfig, "%s/number/%s/led_amb_bright/config", disc, uid);
+  b.add(kDeviceConfig, "%s/device/%s/config", disc, uid);
+
+  for (int id = 1; id <= NUM_BUTTONS; id++) {
+    auto index = [id](ButtonTopic topic) {
+      return kNumTopics + topic * NUM_BUTTONS + id - 1;
+    };
+    b.add(index(kBtnPress), "%s/%s/button_%d", base, name, id);
+    b.add(index(kBtnDoublePress), "%s/%s/button_%d_double", base, name, id);
+    b.add(index(kBtnTriplePress), "%s/%s/button_%d_triple", base, name, id);
+    b.add(index(kBtnQuadPress), "%s/%s/button_%d_quad", base, name, id);
+    b.add(index(kBtnLabelState), "%s/%s/btn_%d_label", base, name, id);
+    b.add(index(kBtnLabelCmd), "%s/%s/cmd/btn_%d_label", base, name, id);
+    b.add(index(kSwitchState), "%s/%s/switch_%d", base, name, id);
+    b.add(index(kSwitchCmd), "%s/%s/cmd/switch_%d", base, name, id);
+    b.add(index(kBtnConfig), "%s/device_automation/%s/button_%d/config", disc,
+          uid, id);
+    b.add(index(kBtnDoubleConfig),
+          "%s/device_automation/%s/button_%d_double/config", disc, uid, id);
+    b.add(index(kBtnTripleConfig),
+          "%s/device_automation/%s/button_%d_triple/config", disc, uid, id);
+    b.add(index(kBtnQuadConfig),
+          "%s/device_automation/%s/button_%d_quad/config", disc, uid, id);
+    b.add(index(kSwitchConfig), "%s/switch/%s/switch_%d/config", disc, uid,
+          id);
+    b.add(index(kKillSwitchConfig), "%s/binary_sensor/%s/kill_switch_%d/config",
+          disc, uid, id);
+    b.add(index(kBtnLabelConfig), "%s/text/%s/button_%d_label/config", disc,
+          uid, id);
+  }
+  return b.size();
 }
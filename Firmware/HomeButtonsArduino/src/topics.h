@@ -1,61 +1,204 @@
 #ifndef HOMEBUTTONS_TOPICS_H
 #define HOMEBUTTONS_TOPICS_H
 
+#include <memory>
 #include "types.h"
 #include "user_input.h"
 #include "state.h"
+#include "logger.h"
 
-class TopicHelper {
+// All topics are built once into one interned table and rebuilt only when
+// device name, base topic, discovery prefix or unique id change.
+// Returned pointers point into the table and stay valid until the next
+// rebuild. Those settings only change before a restart, so topics are never
+// rebuilt while other tasks use them.
+class TopicHelper : public Logger {
  public:
-  TopicHelper(DeviceState& device_state) : _device_state(device_state) {}
+  TopicHelper(DeviceState& device_state)
+      : Logger("Topics"), _device_state(device_state) {}
+  TopicHelper(const TopicHelper&) = delete;
 
   // btn_id [1:NUM_BUTTONS]
-  TopicType get_button_topic(UserInput::Event event) const;
-
-  // btn_idx [0:NUM_BUTTONS-1]
-  TopicType t_common() const;
-  TopicType t_cmd() const;
-  TopicType t_temperature() const;
-  TopicType t_humidity() const;
-  TopicType t_battery() const;
-  TopicType t_btn_press(uint8_t btn_idx) const;
-  TopicType t_btn_label_state(uint8_t btn_idx) const;
-  TopicType t_btn_label_cmd(uint8_t btn_idx) const;
-  TopicType t_sensor_interval_state() const;
-  TopicType t_sensor_interval_cmd() const;
-  TopicType t_awake_mode_state() const;
-  TopicType t_awake_mode_cmd() const;
-  TopicType t_awake_mode_avlb() const;
-  TopicType t_disp_msg_cmd() const;
-  TopicType t_disp_msg_state() const;
-  TopicType t_schedule_wakeup_cmd() const;
-  TopicType t_schedule_wakeup_state() const;
-  TopicType t_led_amb_bright_cmd() const;
-  TopicType t_led_amb_bright_state() const;
-  TopicType t_avlb() const;
-  TopicType t_switch_state(uint8_t switch_idx) const;
-  TopicType t_switch_cmd(uint8_t switch_idx) const;
-  TopicType t_system_state() const;
+  const char* get_button_topic(UserInput::Event event) const;
+
+  // btn_idx [1:NUM_BUTTONS]
+  const char* t_common() const { return _get(kCommon); }
+  const char* t_cmd() const { return _get(kCmd); }
+  const char* t_temperature() const { return _get(kTemperature); }
+  const char* t_humidity() const { return _get(kHumidity); }
+  const char* t_battery() const { return _get(kBattery); }
+  const char* t_btn_press(uint8_t btn_idx) const {
+    return _get_btn(kBtnPress, btn_idx);
+  }
+  const char* t_btn_double_press(uint8_t btn_idx) const {
+    return _get_btn(kBtnDoublePress, btn_idx);
+  }
+  const char* t_btn_triple_press(uint8_t btn_idx) const {
+    return _get_btn(kBtnTriplePress, btn_idx);
+  }
+  const char* t_btn_quad_press(uint8_t btn_idx) const {
+    return _get_btn(kBtnQuadPress, btn_idx);
+  }
+  const char* t_btn_label_state(uint8_t btn_idx) const {
+    return _get_btn(kBtnLabelState, btn_idx);
+  }
+  const char* t_btn_label_cmd(uint8_t btn_idx) const {
+    return _get_btn(kBtnLabelCmd, btn_idx);
+  }
+  const char* t_sensor_interval_state() const {
+    return _get(kSensorIntervalState);
+  }
+  const char* t_sensor_interval_cmd() const { return _get(kSensorIntervalCmd); }
+  const char* t_sensor_batch_state() const { return _get(kSensorBatchState); }
+  const char* t_sensor_batch_cmd() const { return _get(kSensorBatchCmd); }
+  const char* t_sensor_log() const { return _get(kSensorLog); }
+  const char* t_report_config_state() const { return _get(kReportConfigState); }
+  const char* t_report_config_cmd() const { return _get(kReportConfigCmd); }
+  const char* t_btn_conf_state() const { return _get(kBtnConfState); }
+  const char* t_btn_conf_cmd() const { return _get(kBtnConfCmd); }
+  const char* t_awake_mode_state() const { return _get(kAwakeModeState); }
+  const char* t_awake_mode_cmd() const { return _get(kAwakeModeCmd); }
+  const char* t_awake_mode_avlb() const { return _get(kAwakeModeAvlb); }
+  const char* t_disp_msg_cmd() const { return _get(kDispMsgCmd); }
+  const char* t_disp_msg_state() const { return _get(kDispMsgState); }
+  const char* t_schedule_wakeup_cmd() const { return _get(kScheduleWakeupCmd); }
+  const char* t_schedule_wakeup_state() const {
+    return _get(kScheduleWakeupState);
+  }
+  const char* t_led_amb_bright_cmd() const { return _get(kLedAmbBrightCmd); }
+  const char* t_discovery_mode_cmd() const { return _get(kDiscoveryModeCmd); }
+  const char* t_led_amb_bright_state() const {
+    return _get(kLedAmbBrightState);
+  }
+  const char* t_avlb() const { return _get(kAvlb); }
+  const char* t_switch_state(uint8_t switch_idx) const {
+    return _get_btn(kSwitchState, switch_idx);
+  }
+  const char* t_switch_cmd(uint8_t switch_idx) const {
+    return _get_btn(kSwitchCmd, switch_idx);
+  }
+  const char* t_system_state() const { return _get(kSystemState); }
+  const char* t_wake_metrics() const { return _get(kWakeMetrics); }
+  const char* t_event_replay() const { return _get(kEventReplay); }
+  // home assistant birth and last will
+  const char* t_ha_status() const { return _get(kHaStatus); }
 
   // config topics
-  TopicType t_btn_config(uint8_t btn_id);
-  TopicType t_btn_double_config(uint8_t btn_id);
-  TopicType t_btn_triple_config(uint8_t btn_id);
-  TopicType t_btn_quad_config(uint8_t btn_id);
-  TopicType t_switch_config(uint8_t switch_id);
-  TopicType t_kill_switch_config(uint8_t switch_id);
-  TopicType t_temperature_config();
-  TopicType t_humidity_config();
-  TopicType t_sensor_interval_config();
-  TopicType t_battery_config();
-  TopicType t_btn_label_config(uint8_t btn_idx);
-  TopicType t_user_message_config();
-  TopicType t_schedule_wakeup_config();
-  TopicType t_awake_mode_config();
-  TopicType t_led_amb_bright_config();
+  const char* t_btn_config(uint8_t btn_id) const {
+    return _get_btn(kBtnConfig, btn_id);
+  }
+  const char* t_btn_double_config(uint8_t btn_id) const {
+    return _get_btn(kBtnDoubleConfig, btn_id);
+  }
+  const char* t_btn_triple_config(uint8_t btn_id) const {
+    return _get_btn(kBtnTripleConfig, btn_id);
+  }
+  const char* t_btn_quad_config(uint8_t btn_id) const {
+    return _get_btn(kBtnQuadConfig, btn_id);
+  }
+  const char* t_switch_config(uint8_t switch_id) const {
+    return _get_btn(kSwitchConfig, switch_id);
+  }
+  const char* t_kill_switch_config(uint8_t switch_id) const {
+    return _get_btn(kKillSwitchConfig, switch_id);
+  }
+  const char* t_temperature_config() const { return _get(kTemperatureConfig); }
+  const char* t_humidity_config() const { return _get(kHumidityConfig); }
+  const char* t_sensor_interval_config() const {
+    return _get(kSensorIntervalConfig);
+  }
+  const char* t_sensor_batch_config() const { return _get(kSensorBatchConfig); }
+  const char* t_battery_config() const { return _get(kBatteryConfig); }
+  const char* t_btn_label_config(uint8_t btn_idx) const {
+    return _get_btn(kBtnLabelConfig, btn_idx);
+  }
+  const char* t_user_message_config() const { return _get(kUserMessageConfig); }
+  const char* t_schedule_wakeup_config() const {
+    return _get(kScheduleWakeupConfig);
+  }
+  const char* t_awake_mode_config() const { return _get(kAwakeModeConfig); }
+  const char* t_led_amb_bright_config() const {
+    return _get(kLedAmbBrightConfig);
+  }
+  // all components in one message
+  const char* t_device_config() const { return _get(kDeviceConfig); }
 
  private:
+  enum Topic : uint8_t {
+    kCommon,
+    kCmd,
+    kTemperature,
+    kHumidity,
+    kBattery,
+    kSensorIntervalState,
+    kSensorIntervalCmd,
+    kSensorBatchState,
+    kSensorBatchCmd,
+    kSensorLog,
+    kReportConfigState,
+    kReportConfigCmd,
+    kBtnConfState,
+    kBtnConfCmd,
+    kAwakeModeState,
+    kAwakeModeCmd,
+    kAwakeModeAvlb,
+    kDispMsgCmd,
+    kDispMsgState,
+    kScheduleWakeupCmd,
+    kScheduleWakeupState,
+    kLedAmbBrightCmd,
+    kLedAmbBrightState,
+    kDiscoveryModeCmd,
+    kAvlb,
+    kSystemState,
+    kWakeMetrics,
+    kEventReplay,
+    kHaStatus,
+    kTemperatureConfig,
+    kHumidityConfig,
+    kSensorIntervalConfig,
+    kSensorBatchConfig,
+    kBatteryConfig,
+    kUserMessageConfig,
+    kScheduleWakeupConfig,
+    kAwakeModeConfig,
+    kLedAmbBrightConfig,
+    kDeviceConfig,
+    kNumTopics
+  };
+
+  // one entry per button
+  enum ButtonTopic : uint8_t {
+    kBtnPress,
+    kBtnDoublePress,
+    kBtnTriplePress,
+    kBtnQuadPress,
+    kBtnLabelState,
+    kBtnLabelCmd,
+    kSwitchState,
+    kSwitchCmd,
+    kBtnConfig,
+    kBtnDoubleConfig,
+    kBtnTripleConfig,
+    kBtnQuadConfig,
+    kSwitchConfig,
+    kKillSwitchConfig,
+    kBtnLabelConfig,
+    kNumButtonTopics
+  };
+
+  static constexpr size_t kTableSize =
+      kNumTopics + kNumButtonTopics * NUM_BUTTONS;
+
   DeviceState& _device_state;
+  mutable std::unique_ptr<char[]> _arena;
+  mutable uint16_t _offsets[kTableSize] = {};
+  mutable uint32_t _version = 0;
+
+  const char* _get(size_t index) const;
+  const char* _get_btn(ButtonTopic topic, uint8_t btn_id) const;
+  void _rebuild() const;
+  size_t _build(char* arena, size_t size) const;
 };
 
-#endif  // HOMEBUTTONS_TOPICS_H
\ No newline at end of file
+#endif  // HOMEBUTTONS_TOPICS_H
@@ -24,6 +24,8 @@ bool TouchInput::InternalStop() {
 }
 
 void TouchInput::InternalLoop() {
+  // the touch controller and the button timing are polled
+  Poll();
   BtnUpdate();
   touch_controller_->loop();
 }
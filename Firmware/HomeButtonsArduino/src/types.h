@@ -28,6 +28,9 @@ using HostnameType = StaticString<32>;
 
 using IconServerType = StaticString<128>;
 
+using MQTTParamType = StaticString<64>;
+using SWVersionType = StaticString<16>;
+
 enum class DisplayPage {
   EMPTY,
   MAIN,
@@ -58,4 +61,19 @@ struct UIState {
 
 enum class LabelType : uint8_t { None, Text, Icon, Mixed };
 
+// values that are only published when they change enough
+enum class ReportChannel : uint8_t {
+  kTemperature,
+  kHumidity,
+  kBattery,
+  kRssi,
+  kNumChannels
+};
+
+// 0 disables a band, a value with both bands disabled is always published
+struct Deadband {
+  float abs;  // in the unit of the value
+  float rel;  // % of the last published value
+};
+
 #endif  // HOMEBUTTONS_TYPES_H;
\ No newline at end of file
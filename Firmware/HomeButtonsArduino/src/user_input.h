@@ -95,6 +95,7 @@ class UserInput : public ComponentBase {
   }
 
   void ClearEventCallback() { event_callback_ = nullptr; }
+  bool HasEventCallback() const { return static_cast<bool>(event_callback_); }
   void ClearEventCallbackSecondary() { event_callback_secondary_ = nullptr; }
 
   static uint8_t EventType2NumClicks(EventType type) {
@@ -21,4 +21,12 @@ inline StaticString<15> ip_address_to_static_string(
                           ip_address[2], ip_address[3]);
 }
 
+// 32-bit FNV-1a hash
+constexpr uint32_t fnv1a_32(const char* str, uint32_t hash = 2166136261UL) {
+  while (*str) {
+    hash = (hash ^ static_cast<uint8_t>(*str++)) * 16777619UL;
+  }
+  return hash;
+}
+
 #endif  // HOMEBUTTON_UTILS_H
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "wake_profiler.h"
+
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "rom/crc.h"
+#include "config.h"
+#include "json_writer.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48425733;  // "HBW3"
+constexpr size_t kNumPhases = static_cast<size_t>(WakePhase::kNumPhases);
+
+const char* const kPhaseNames[kNumPhases] = {
+    "hw_init", "state_load", "begin_hw", "battery", "net_start",
+    "sensors", "tasks_started", "boot_done", "wifi", "mqtt",
+    "first_pub", "shutdown", "net_down", "disp_hibernate", "sleep"};
+
+struct Cycle {
+  uint16_t seq;
+  uint8_t cause;  // esp_sleep_source_t
+  uint8_t published;
+  uint32_t marks_us[kNumPhases];  // 0 if not reached
+};
+
+struct Ring {
+  uint32_t magic;
+  uint16_t seq;
+  uint8_t head;   // current cycle
+  uint8_t count;  // valid cycles, including the current one
+  Cycle cycles[WAKE_PROFILER_CYCLES];
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR Ring ring;
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+bool started = false;
+
+uint32_t ring_crc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&ring),
+                  offsetof(Ring, crc));
+}
+
+void seal() { ring.crc = ring_crc(); }
+
+// i = 1 is the newest closed cycle
+Cycle& closed_cycle(size_t i) {
+  return ring.cycles[(ring.head + WAKE_PROFILER_CYCLES - i) %
+                     WAKE_PROFILER_CYCLES];
+}
+}  // namespace
+
+void WakeProfiler::begin() {
+  uint8_t cause = static_cast<uint8_t>(esp_sleep_get_wakeup_cause());
+  portENTER_CRITICAL(&mux);
+  if (ring.magic != kMagic || ring.count == 0 ||
+      ring.count > WAKE_PROFILER_CYCLES ||
+      ring.head >= WAKE_PROFILER_CYCLES || ring.crc != ring_crc()) {
+    ring.magic = kMagic;
+    ring.seq = 0;
+    ring.head = 0;
+    ring.count = 1;
+  } else {
+    ring.head = (ring.head + 1) % WAKE_PROFILER_CYCLES;
+    if (ring.count < WAKE_PROFILER_CYCLES) ring.count++;
+  }
+  Cycle& cycle = ring.cycles[ring.head];
+  cycle = {};
+  cycle.seq = ++ring.seq;
+  cycle.cause = cause;
+  seal();
+  started = true;
+  portEXIT_CRITICAL(&mux);
+}
+
+void WakeProfiler::mark(WakePhase phase) {
+  size_t index = static_cast<size_t>(phase);
+  if (index >= kNumPhases) return;
+  uint32_t now = static_cast<uint32_t>(esp_timer_get_time());
+  portENTER_CRITICAL(&mux);
+  uint32_t& mark = ring.cycles[ring.head].marks_us[index];
+  if (started && mark == 0) {
+    mark = now > 0 ? now : 1;
+    seal();
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+size_t WakeProfiler::pending() {
+  size_t n = 0;
+  portENTER_CRITICAL(&mux);
+  if (started) {
+    for (size_t i = 1; i < ring.count; i++) {
+      if (!closed_cycle(i).published) n++;
+    }
+  }
+  portEXIT_CRITICAL(&mux);
+  return n;
+}
+
+// closed cycles are only changed by begin() and mark_published(), so they
+// are read without the lock and both passes of a publish write the same
+// payload
+void WakeProfiler::write_pending(Print& out) {
+  JsonWriter json(out);
+  json.begin_object();
+  json.begin_array("phases");
+  for (const char* name : kPhaseNames) {
+    json.add(nullptr, name);
+  }
+  json.end_array();
+  json.begin_array("cycles");
+  if (started) {
+    for (size_t i = ring.count - 1; i >= 1; i--) {
+      const Cycle& cycle = closed_cycle(i);
+      if (cycle.published) continue;
+      json.begin_object();
+      json.add("seq", cycle.seq);
+      json.add("cause", cycle.cause);
+      json.begin_array("t");
+      for (uint32_t mark : cycle.marks_us) {
+        json.add(nullptr, mark);
+      }
+      json.end_array();
+      json.end_object();
+    }
+  }
+  json.end_array();
+  json.end_object();
+}
+
+void WakeProfiler::mark_published() {
+  portENTER_CRITICAL(&mux);
+  if (started) {
+    for (size_t i = 1; i < ring.count; i++) {
+      closed_cycle(i).published = 1;
+    }
+    seal();
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+const char* WakeProfiler::phase_name(WakePhase phase) {
+  size_t index = static_cast<size_t>(phase);
+  return index < kNumPhases ? kPhaseNames[index] : "";
+}
@@ -0,0 +1,50 @@
+#ifndef HOMEBUTTONS_WAKE_PROFILER_H
+#define HOMEBUTTONS_WAKE_PROFILER_H
+
+#include <Arduino.h>
+#include <cstddef>
+#include <cstdint>
+
+// order is the usual order within a wake cycle, names in wake_metrics
+// payloads follow the same order
+enum class WakePhase : uint8_t {
+  kHwInit,
+  kStateLoad,
+  kBeginHw,
+  kBattery,
+  kNetStarted,
+  kSensors,
+  kTasksStarted,
+  kBootDone,
+  kWifiConnected,
+  kMqttConnected,
+  kFirstPublish,
+  kShutdown,
+  kNetDisconnected,
+  kDisplayHibernate,
+  kSleep,
+  kNumPhases
+};
+
+// Records when each phase of a wake cycle is reached, in us since boot.
+// The last WAKE_PROFILER_CYCLES cycles are kept in a ring in RTC memory, so
+// they survive deep sleep and software resets, and are published on the next
+// connection. Only the first mark of a phase per cycle is recorded.
+class WakeProfiler {
+ public:
+  // closes the previous cycle and starts a new one, call once at boot
+  static void begin();
+  // safe to call from any task
+  static void mark(WakePhase phase);
+
+  // number of closed cycles that were not published yet
+  static size_t pending();
+  // writes pending cycles as one JSON object:
+  // {"phases":[names],"cycles":[{"seq":n,"cause":c,"t":[us or 0]}]}
+  static void write_pending(Print& out);
+  static void mark_published();
+
+  static const char* phase_name(WakePhase phase);
+};
+
+#endif  // HOMEBUTTONS_WAKE_PROFILER_H
@@ -0,0 +1,113 @@
+#include "wake_stub.h"
+
+#include "config.h"
+
+#if defined(HAS_WAKE_STUB)
+#include <esp_sleep.h>
+#include "esp_attr.h"
+#include "esp_private/esp_clk.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "soc/soc.h"
+
+namespace {
+constexpr uint32_t kMagic = 0x48425331;  // "HBS1"
+
+struct Edge {
+  uint32_t ticks;  // RTC slow clock, low 32 bits
+  uint32_t pins;   // pin levels after the edge
+};
+
+// only RTC memory is accessible from the wake stub
+struct Log {
+  uint32_t magic;  // written by the stub when the log is complete
+  uint32_t pin_mask;
+  uint32_t window_ticks;
+  uint32_t release_ticks;
+  uint32_t wake_mask;
+  uint32_t count;
+  Edge edges[WAKE_STUB_EDGES];
+};
+
+RTC_DATA_ATTR Log wake_log;
+
+RTC_IRAM_ATTR uint32_t rtc_ticks() {
+  SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+  return READ_PERI_REG(RTC_CNTL_TIME0_REG);
+}
+}  // namespace
+
+// replaces the default stub, runs from RTC fast memory before the bootloader
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void) {
+  esp_default_wake_deep_sleep();
+  wake_log.magic = 0;
+  wake_log.count = 0;
+  wake_log.wake_mask = REG_GET_FIELD(RTC_CNTL_EXT_WAKEUP1_STATUS_REG,
+                                     RTC_CNTL_EXT_WAKEUP1_STATUS);
+  if (wake_log.wake_mask == 0 || wake_log.pin_mask == 0) return;
+
+  uint32_t start = rtc_ticks();
+  uint32_t last_edge = start;
+  uint32_t last_pins = 0;  // all released before the wake
+  while (true) {
+    uint32_t now = rtc_ticks();
+    // on the S2, RTC GPIO numbers are the same as GPIO numbers
+    uint32_t pins =
+        (REG_READ(RTC_GPIO_IN_REG) >> RTC_GPIO_IN_NEXT_S) & wake_log.pin_mask;
+    if (pins != last_pins) {
+      if (wake_log.count < WAKE_STUB_EDGES) {
+        wake_log.edges[wake_log.count].ticks = now;
+        wake_log.edges[wake_log.count].pins = pins;
+        wake_log.count++;
+      }
+      last_pins = pins;
+      last_edge = now;
+    }
+    if (now - start >= wake_log.window_ticks) break;
+    if (pins == 0 && now - last_edge >= wake_log.release_ticks) break;
+  }
+  wake_log.magic = kMagic;
+}
+
+void WakeStub::arm(uint64_t pin_mask) {
+  uint32_t cal = esp_clk_slowclk_cal_get();
+  wake_log.magic = 0;
+  wake_log.count = 0;
+  wake_log.pin_mask = static_cast<uint32_t>(pin_mask);
+  wake_log.window_ticks = rtc_time_us_to_slowclk(WAKE_STUB_WINDOW * 1000, cal);
+  wake_log.release_ticks =
+      rtc_time_us_to_slowclk(WAKE_STUB_RELEASE_TIME * 1000, cal);
+}
+
+uint64_t WakeStub::wake_mask() {
+  if (wake_log.magic != kMagic) return 0;
+  return wake_log.wake_mask;
+}
+
+size_t WakeStub::edges(uint8_t pin, ButtonEdge* out, size_t max) {
+  if (wake_log.magic != kMagic || pin >= 32) return 0;
+  uint32_t count = wake_log.count;
+  if (count > WAKE_STUB_EDGES) return 0;
+  uint32_t cal = esp_clk_slowclk_cal_get();
+  uint32_t now = static_cast<uint32_t>(rtc_time_get());
+  uint32_t bit = 1UL << pin;
+  bool pressed = false;
+  size_t n = 0;
+  for (uint32_t i = 0; i < count && n < max; i++) {
+    const Edge& edge = wake_log.edges[i];
+    if (((edge.pins & bit) != 0) == pressed) continue;
+    pressed = !pressed;
+    out[n].age_ms = rtc_time_slowclk_to_us(now - edge.ticks, cal) / 1000;
+    out[n].pressed = pressed;
+    n++;
+  }
+  return n;
+}
+#else
+void WakeStub::arm(uint64_t) {}
+
+uint64_t WakeStub::wake_mask() { return 0; }
+
+size_t WakeStub::edges(uint8_t, ButtonEdge*, size_t) { return 0; }
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOMEBUTTONS_WAKE_STUB_H
+#define HOMEBUTTONS_WAKE_STUB_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct ButtonEdge {
+  uint32_t age_ms;  // before the call to WakeStub::edges()
+  bool pressed;
+};
+
+// Records button edges from the first microseconds of an ext1 wake.
+// The deep sleep wake stub runs before the bootloader and samples the wake
+// pins until they were released for WAKE_STUB_RELEASE_TIME, or at most for
+// WAKE_STUB_WINDOW. The log is kept in RTC memory, the app reads it after
+// boot and replays the edges into the button state machines.
+// Wake pins are active high (ESP_EXT1_WAKEUP_ANY_HIGH).
+class WakeStub {
+ public:
+  // call before deep sleep, pins in the mask are recorded on the next wake
+  static void arm(uint64_t pin_mask);
+  // ext1 wake pins seen by the stub, 0 if it didn't record this wake
+  static uint64_t wake_mask();
+  // edges of one pin, oldest first, returns the number written to out
+  static size_t edges(uint8_t pin, ButtonEdge* out, size_t max);
+};
+
+#endif  // HOMEBUTTONS_WAKE_STUB_H
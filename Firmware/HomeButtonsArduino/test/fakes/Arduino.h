@@ -0,0 +1,60 @@
+#ifndef HOMEBUTTONS_FAKE_ARDUINO_H
+#define HOMEBUTTONS_FAKE_ARDUINO_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include "IPAddress.h"
+#include "WString.h"
+#include "esp_log.h"
+#include "fake_clock.h"
+#include "freertos/FreeRTOS.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 1
+#define OUTPUT 2
+#define INPUT_PULLUP 3
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define PI 3.1415926535897932384626433832795
+
+inline uint32_t millis() { return static_cast<uint32_t>(fake::time_us / 1000); }
+inline uint32_t micros() { return static_cast<uint32_t>(fake::time_us); }
+inline void delay(uint32_t ms) { fake::advance_ms(ms); }
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* str) {
+    return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+  }
+  size_t print(const char* str) { return write(str); }
+};
+
+// collects everything written, for checking streamed payloads
+class StringPrint : public Print {
+ public:
+  size_t write(uint8_t c) override {
+    str_ += static_cast<char>(c);
+    return 1;
+  }
+  const std::string& str() const { return str_; }
+  void clear() { str_.clear(); }
+
+ private:
+  std::string str_;
+};
+
+#endif  // HOMEBUTTONS_FAKE_ARDUINO_H
@@ -0,0 +1,19 @@
+#ifndef HOMEBUTTONS_FAKE_FUNCTIONAL_INTERRUPT_H
+#define HOMEBUTTONS_FAKE_FUNCTIONAL_INTERRUPT_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+
+namespace fake {
+// attached handlers by pin, a test calls them to simulate a pin change
+inline std::map<uint8_t, std::function<void()>> interrupts;
+}  // namespace fake
+
+inline void attachInterrupt(uint8_t pin, std::function<void()> handler,
+                            int mode) {
+  fake::interrupts[pin] = handler;
+}
+inline void detachInterrupt(uint8_t pin) { fake::interrupts.erase(pin); }
+
+#endif  // HOMEBUTTONS_FAKE_FUNCTIONAL_INTERRUPT_H
@@ -0,0 +1,49 @@
+#ifndef HOMEBUTTONS_FAKE_IPADDRESS_H
+#define HOMEBUTTONS_FAKE_IPADDRESS_H
+
+#include <cstdint>
+#include <cstdio>
+#include "WString.h"
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+};
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{a, b, c, d} {}
+  IPAddress(uint32_t address) {
+    for (int i = 0; i < 4; i++) bytes_[i] = (address >> (8 * i)) & 0xff;
+  }
+
+  uint8_t operator[](int i) const { return bytes_[i]; }
+  uint8_t& operator[](int i) { return bytes_[i]; }
+  operator uint32_t() const {
+    return bytes_[0] | bytes_[1] << 8 | bytes_[2] << 16 |
+           static_cast<uint32_t>(bytes_[3]) << 24;
+  }
+  bool operator==(const IPAddress& other) const {
+    return static_cast<uint32_t>(*this) == static_cast<uint32_t>(other);
+  }
+  bool operator!=(const IPAddress& other) const { return !(*this == other); }
+
+  bool fromString(const char* str) {
+    unsigned a, b, c, d;
+    if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  String toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes_[0], bytes_[1],
+             bytes_[2], bytes_[3]);
+    return String(buffer);
+  }
+
+ private:
+  uint8_t bytes_[4] = {};
+};
+
+#endif  // HOMEBUTTONS_FAKE_IPADDRESS_H
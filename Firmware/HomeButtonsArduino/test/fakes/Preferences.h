@@ -0,0 +1,141 @@
+#ifndef HOMEBUTTONS_FAKE_PREFERENCES_H
+#define HOMEBUTTONS_FAKE_PREFERENCES_H
+
+// NVS kept in a map shared by all Preferences objects. Counts writes and can
+// be made to fail, see fake::nvs.
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "WString.h"
+
+namespace fake {
+struct Nvs {
+  using Namespace = std::map<std::string, std::vector<uint8_t>>;
+  std::map<std::string, Namespace> namespaces;
+  uint32_t writes = 0;   // put calls that stored a value
+  uint32_t removes = 0;  // remove and clear calls
+  uint32_t opens = 0;    // begin calls
+  bool fail_writes = false;
+
+  void reset() { *this = Nvs(); }
+  bool has(const char* name, const char* key) const {
+    auto ns = namespaces.find(name);
+    return ns != namespaces.end() && ns->second.count(key) > 0;
+  }
+};
+inline Nvs nvs;
+}  // namespace fake
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool read_only = false,
+             const char* partition_label = nullptr) {
+    if (open_) return false;
+    name_ = name;
+    read_only_ = read_only;
+    open_ = true;
+    fake::nvs.opens++;
+    return true;
+  }
+  void end() { open_ = false; }
+
+  bool clear() {
+    if (!_writable()) return false;
+    fake::nvs.namespaces.erase(name_);
+    fake::nvs.removes++;
+    return true;
+  }
+  bool remove(const char* key) {
+    if (!_writable()) return false;
+    fake::nvs.removes++;
+    return fake::nvs.namespaces[name_].erase(key) > 0;
+  }
+  bool isKey(const char* key) {
+    return open_ && fake::nvs.has(name_.c_str(), key);
+  }
+
+  size_t putBool(const char* key, bool value) {
+    uint8_t byte = value;
+    return _put(key, &byte, 1);
+  }
+  size_t putUInt(const char* key, uint32_t value) {
+    return _put(key, &value, sizeof(value));
+  }
+  size_t putString(const char* key, const char* value) {
+    // stored with '\0', returns the string length like the ESP32 library
+    return _put(key, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+  }
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    return _put(key, value, len);
+  }
+
+  bool getBool(const char* key, bool default_value = false) {
+    auto value = _get(key);
+    return value != nullptr && value->size() == 1 ? (*value)[0] != 0
+                                                   : default_value;
+  }
+  uint32_t getUInt(const char* key, uint32_t default_value = 0) {
+    auto value = _get(key);
+    if (value == nullptr || value->size() != sizeof(uint32_t)) {
+      return default_value;
+    }
+    uint32_t result;
+    memcpy(&result, value->data(), sizeof(result));
+    return result;
+  }
+  // returns the length including '\0', 0 if missing or too long for buffer
+  size_t getString(const char* key, char* buffer, size_t max_len) {
+    auto value = _get(key);
+    if (value == nullptr || value->size() > max_len) return 0;
+    memcpy(buffer, value->data(), value->size());
+    return value->size();
+  }
+  String getString(const char* key, const String& default_value = String()) {
+    auto value = _get(key);
+    if (value == nullptr) return default_value;
+    return String(reinterpret_cast<const char*>(value->data()));
+  }
+  size_t getBytesLength(const char* key) {
+    auto value = _get(key);
+    return value != nullptr ? value->size() : 0;
+  }
+  size_t getBytes(const char* key, void* buffer, size_t max_len) {
+    auto value = _get(key);
+    if (value == nullptr || value->size() > max_len) return 0;
+    memcpy(buffer, value->data(), value->size());
+    return value->size();
+  }
+
+  size_t freeEntries() {
+    size_t used = 0;
+    for (auto& ns : fake::nvs.namespaces) used += ns.second.size();
+    return used < 630 ? 630 - used : 0;
+  }
+
+ private:
+  std::string name_;
+  bool read_only_ = true;
+  bool open_ = false;
+
+  bool _writable() const {
+    return open_ && !read_only_ && !fake::nvs.fail_writes;
+  }
+  size_t _put(const char* key, const void* value, size_t len) {
+    if (!_writable()) return 0;
+    auto bytes = static_cast<const uint8_t*>(value);
+    fake::nvs.namespaces[name_][key].assign(bytes, bytes + len);
+    fake::nvs.writes++;
+    return len;
+  }
+  const std::vector<uint8_t>* _get(const char* key) const {
+    if (!open_) return nullptr;
+    auto ns = fake::nvs.namespaces.find(name_);
+    if (ns == fake::nvs.namespaces.end()) return nullptr;
+    auto value = ns->second.find(key);
+    return value != ns->second.end() ? &value->second : nullptr;
+  }
+};
+
+#endif  // HOMEBUTTONS_FAKE_PREFERENCES_H
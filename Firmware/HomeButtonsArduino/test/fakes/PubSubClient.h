@@ -0,0 +1,78 @@
+#ifndef HOMEBUTTONS_FAKE_PUBSUBCLIENT_H
+#define HOMEBUTTONS_FAKE_PUBSUBCLIENT_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+namespace fake {
+struct MqttMessage {
+  std::string topic;
+  std::string payload;
+  bool retained;
+};
+
+// everything published by any client, a streamed payload is added by
+// endPublish()
+inline std::vector<MqttMessage> mqtt_published;
+inline bool mqtt_fail_publish = false;
+}  // namespace fake
+
+class PubSubClient : public Print {
+ public:
+  using Callback = std::function<void(char*, uint8_t*, unsigned int)>;
+
+  explicit PubSubClient(WiFiClient&) {}
+
+  PubSubClient& setServer(const char*, uint16_t) { return *this; }
+  PubSubClient& setCallback(Callback callback) {
+    callback_ = callback;
+    return *this;
+  }
+  bool setBufferSize(uint16_t) { return true; }
+
+  bool connect(const char*, const char*, const char*, const char*, uint8_t,
+               bool, const char*) {
+    connected_ = true;
+    return true;
+  }
+  void disconnect() { connected_ = false; }
+  bool connected() { return connected_; }
+  bool loop() { return connected_; }
+  bool subscribe(const char*) { return connected_; }
+
+  bool publish(const char* topic, const char* payload, bool retained = false) {
+    if (fake::mqtt_fail_publish) return false;
+    fake::mqtt_published.push_back({topic, payload, retained});
+    return true;
+  }
+
+  bool beginPublish(const char* topic, unsigned int length, bool retained) {
+    if (fake::mqtt_fail_publish) return false;
+    stream_ = {topic, "", retained};
+    return true;
+  }
+  size_t write(uint8_t c) override {
+    stream_.payload += static_cast<char>(c);
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    stream_.payload.append(reinterpret_cast<const char*>(buffer), size);
+    return size;
+  }
+  using Print::write;
+  // like the real client, doesn't check the length given to beginPublish()
+  int endPublish() {
+    fake::mqtt_published.push_back(stream_);
+    return 1;
+  }
+
+ private:
+  Callback callback_;
+  bool connected_ = false;
+  fake::MqttMessage stream_;
+};
+
+#endif  // HOMEBUTTONS_FAKE_PUBSUBCLIENT_H
@@ -0,0 +1,37 @@
+#ifndef HOMEBUTTONS_FAKE_WSTRING_H
+#define HOMEBUTTONS_FAKE_WSTRING_H
+
+#include <cstdlib>
+#include <string>
+
+class String {
+ public:
+  String(const char* str = "") : str_(str != nullptr ? str : "") {}
+  String(int value) : str_(std::to_string(value)) {}
+
+  const char* c_str() const { return str_.c_str(); }
+  size_t length() const { return str_.size(); }
+  bool isEmpty() const { return str_.empty(); }
+  int toInt() const { return atoi(str_.c_str()); }
+
+  bool operator==(const String& other) const { return str_ == other.str_; }
+  bool operator!=(const String& other) const { return str_ != other.str_; }
+  String& operator+=(const String& other) {
+    str_ += other.str_;
+    return *this;
+  }
+  String& operator+=(char c) {
+    str_ += c;
+    return *this;
+  }
+  String operator+(const String& other) const {
+    String result(*this);
+    result += other;
+    return result;
+  }
+
+ private:
+  std::string str_;
+};
+
+#endif  // HOMEBUTTONS_FAKE_WSTRING_H
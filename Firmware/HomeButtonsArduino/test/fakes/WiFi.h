@@ -0,0 +1,60 @@
+#ifndef HOMEBUTTONS_FAKE_WIFI_H
+#define HOMEBUTTONS_FAKE_WIFI_H
+
+#include <cstdint>
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WString.h"
+#include "esp_wifi.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2 } wifi_mode_t;
+
+// always connected with a fixed address, a test changes the members directly
+class WiFiClass {
+ public:
+  wl_status_t status() { return status_; }
+  wl_status_t begin(const char* ssid = nullptr, const char* psk = nullptr,
+                    int32_t channel = 0, const uint8_t* bssid = nullptr,
+                    bool connect = true) {
+    return status_;
+  }
+  bool mode(wifi_mode_t) { return true; }
+  void persistent(bool) {}
+  bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress(),
+              IPAddress = IPAddress()) {
+    return true;
+  }
+  bool disconnect(bool wifioff = false, bool eraseap = false) { return true; }
+  bool setSleep(wifi_ps_type_t) { return true; }
+  static void useStaticBuffers(bool) {}
+  IPAddress localIP() { return local_ip_; }
+  int32_t RSSI() { return rssi_; }
+  String SSID() { return String("ssid"); }
+  String psk() { return String("psk"); }
+  uint8_t* BSSID() { return bssid_; }
+  int32_t channel() { return 1; }
+
+  wl_status_t status_ = WL_CONNECTED;
+  IPAddress local_ip_ = IPAddress(192, 168, 1, 50);
+  int32_t rssi_ = -60;
+  uint8_t bssid_[6] = {};
+};
+
+inline WiFiClass WiFi;
+
+class WiFiClient {
+ public:
+  int available() { return 0; }
+  int fd() const { return -1; }
+  void flush() {}
+};
+
+#endif  // HOMEBUTTONS_FAKE_WIFI_H
@@ -0,0 +1,38 @@
+#ifndef HOMEBUTTONS_BENCH_H
+#define HOMEBUTTONS_BENCH_H
+
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+// host timing, only to compare two implementations in the same run
+namespace fake {
+// average wall time of one call of fn in ns
+template <typename Fn>
+double bench_ns(int rounds, Fn&& fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) fn(i);
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  return static_cast<double>(ns) / rounds;
+}
+
+// "<ns> ns per <what> on host" in the test output
+inline void bench_report(const char* what, double ns) {
+  char message[96];
+  snprintf(message, sizeof(message), "%.0f ns per %s on host", ns, what);
+  TEST_MESSAGE(message);
+}
+
+// "<ns> ns, <bytes> B copied per <what> on host"
+inline void bench_report(const char* what, double ns, size_t bytes) {
+  char message[128];
+  snprintf(message, sizeof(message), "%.0f ns, %zu B copied per %s on host",
+           ns, bytes, what);
+  TEST_MESSAGE(message);
+}
+}  // namespace fake
+
+#endif  // HOMEBUTTONS_BENCH_H
@@ -0,0 +1,10 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_ATTR_H
+#define HOMEBUTTONS_FAKE_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_IRAM_ATTR
+
+#endif  // HOMEBUTTONS_FAKE_ESP_ATTR_H
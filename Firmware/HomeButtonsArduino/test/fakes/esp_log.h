@@ -0,0 +1,44 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_LOG_H
+#define HOMEBUTTONS_FAKE_ESP_LOG_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "fake_clock.h"
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define LOG_COLOR_E ""
+#define LOG_COLOR_W ""
+#define LOG_COLOR_I ""
+#define LOG_COLOR_D ""
+#define LOG_RESET_COLOR ""
+
+inline void esp_log_level_set(const char*, esp_log_level_t) {}
+inline uint32_t esp_log_timestamp() {
+  return static_cast<uint32_t>(fake::time_us / 1000);
+}
+// quiet unless HB_TEST_LOG is set in the environment
+inline void esp_log_write(esp_log_level_t, const char*, const char* fmt, ...) {
+  static const bool enabled = getenv("HB_TEST_LOG") != nullptr;
+  if (!enabled) return;
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+#define ESP_LOGE(tag, ...) esp_log_write(ESP_LOG_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) esp_log_write(ESP_LOG_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) esp_log_write(ESP_LOG_INFO, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) esp_log_write(ESP_LOG_DEBUG, tag, __VA_ARGS__)
+
+#endif  // HOMEBUTTONS_FAKE_ESP_LOG_H
@@ -0,0 +1,6 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_PM_H
+#define HOMEBUTTONS_FAKE_ESP_PM_H
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+#endif  // HOMEBUTTONS_FAKE_ESP_PM_H
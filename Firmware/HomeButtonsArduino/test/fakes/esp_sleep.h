@@ -0,0 +1,20 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_SLEEP_H
+#define HOMEBUTTONS_FAKE_ESP_SLEEP_H
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+} esp_sleep_source_t;
+
+namespace fake {
+inline esp_sleep_source_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+}  // namespace fake
+
+inline esp_sleep_source_t esp_sleep_get_wakeup_cause() {
+  return fake::wakeup_cause;
+}
+
+#endif  // HOMEBUTTONS_FAKE_ESP_SLEEP_H
@@ -0,0 +1,31 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_SYSTEM_H
+#define HOMEBUTTONS_FAKE_ESP_SYSTEM_H
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+namespace fake {
+inline esp_reset_reason_t reset_reason = ESP_RST_POWERON;
+inline uint32_t free_heap = 200000;
+}  // namespace fake
+
+inline esp_reset_reason_t esp_reset_reason() { return fake::reset_reason; }
+inline uint32_t esp_get_free_heap_size() { return fake::free_heap; }
+inline uint32_t esp_get_minimum_free_heap_size() { return fake::free_heap; }
+inline void esp_restart() {}
+
+#endif  // HOMEBUTTONS_FAKE_ESP_SYSTEM_H
@@ -0,0 +1,8 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_TIMER_H
+#define HOMEBUTTONS_FAKE_ESP_TIMER_H
+
+#include "fake_clock.h"
+
+inline int64_t esp_timer_get_time() { return fake::time_us; }
+
+#endif  // HOMEBUTTONS_FAKE_ESP_TIMER_H
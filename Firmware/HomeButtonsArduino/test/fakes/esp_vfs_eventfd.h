@@ -0,0 +1,20 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_VFS_EVENTFD_H
+#define HOMEBUTTONS_FAKE_ESP_VFS_EVENTFD_H
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() \
+  { .max_fds = 5 }
+
+// fails, so Network polls instead of waiting on an eventfd
+inline esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t*) {
+  return ESP_FAIL;
+}
+
+#endif  // HOMEBUTTONS_FAKE_ESP_VFS_EVENTFD_H
@@ -0,0 +1,32 @@
+#ifndef HOMEBUTTONS_FAKE_ESP_WIFI_H
+#define HOMEBUTTONS_FAKE_ESP_WIFI_H
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP } wifi_interface_t;
+typedef enum {
+  WIFI_PS_NONE,
+  WIFI_PS_MIN_MODEM,
+  WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint16_t listen_interval;
+} wifi_sta_config_t;
+
+typedef union {
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+inline esp_err_t esp_wifi_get_config(wifi_interface_t, wifi_config_t* conf) {
+  *conf = {};
+  return ESP_OK;
+}
+inline esp_err_t esp_wifi_set_config(wifi_interface_t, wifi_config_t*) {
+  return ESP_OK;
+}
+
+#endif  // HOMEBUTTONS_FAKE_ESP_WIFI_H
@@ -0,0 +1,49 @@
+#ifndef HOMEBUTTONS_FAKE_BUTTONS_H
+#define HOMEBUTTONS_FAKE_BUTTONS_H
+
+// button and LED functions of hardware.cpp, which is not built on the host.
+// Buttons are on pin 10 + id, include this in one file of a suite.
+
+#include "FunctionalInterrupt.h"
+#include "hardware.h"
+
+namespace fake {
+inline bool button_level[NUM_BUTTONS + 1] = {};
+inline uint8_t led_pct[NUM_BUTTONS + 1] = {};
+inline uint16_t led_fade_ms[NUM_BUTTONS + 1] = {};
+
+inline uint8_t button_pin(uint8_t id) { return 10 + id; }
+
+// sets the level and runs the ISR like a pin change would
+inline void set_button(uint8_t id, bool pressed) {
+  button_level[id] = pressed;
+  auto handler = interrupts.find(button_pin(id));
+  if (handler != interrupts.end()) handler->second();
+}
+
+inline void reset_buttons() {
+  for (uint8_t i = 0; i <= NUM_BUTTONS; i++) {
+    button_level[i] = false;
+    led_pct[i] = 0;
+    led_fade_ms[i] = 0;
+  }
+  interrupts.clear();
+}
+}  // namespace fake
+
+uint8_t HardwareDefinition::button_pin(uint8_t id) {
+  return id >= 1 && id <= NUM_BUTTONS ? fake::button_pin(id) : 0;
+}
+
+bool HardwareDefinition::button_pressed(uint8_t id) {
+  return id >= 1 && id <= NUM_BUTTONS && fake::button_level[id];
+}
+
+void HardwareDefinition::set_led_pct_num(uint8_t num, uint8_t brightness_pct,
+                                         uint16_t fade_time) {
+  if (num < 1 || num > NUM_BUTTONS) return;
+  fake::led_pct[num] = brightness_pct;
+  fake::led_fade_ms[num] = fade_time;
+}
+
+#endif  // HOMEBUTTONS_FAKE_BUTTONS_H
@@ -0,0 +1,16 @@
+#ifndef HOMEBUTTONS_FAKE_CLOCK_H
+#define HOMEBUTTONS_FAKE_CLOCK_H
+
+#include <cstdint>
+
+// simulated time, advanced by the tests
+namespace fake {
+inline int64_t time_us = 0;
+
+inline void set_ms(uint32_t ms) { time_us = static_cast<int64_t>(ms) * 1000; }
+inline void advance_ms(uint32_t ms) {
+  time_us += static_cast<int64_t>(ms) * 1000;
+}
+}  // namespace fake
+
+#endif  // HOMEBUTTONS_FAKE_CLOCK_H
@@ -0,0 +1,42 @@
+#ifndef HOMEBUTTONS_FAKE_FREERTOS_H
+#define HOMEBUTTONS_FAKE_FREERTOS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void* TaskHandle_t;
+typedef int esp_err_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 25
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+
+// a critical section is a recursive mutex, like the nesting spinlock
+struct portMUX_TYPE {
+  std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED \
+  {}
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+#define portENTER_CRITICAL_ISR(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL_ISR(mux) (mux)->mutex.unlock()
+#define portYIELD_FROM_ISR(...) \
+  do {                          \
+  } while (0)
+
+#endif  // HOMEBUTTONS_FAKE_FREERTOS_H
@@ -0,0 +1,172 @@
+#ifndef HOMEBUTTONS_FAKE_RINGBUF_H
+#define HOMEBUTTONS_FAKE_RINGBUF_H
+
+// Host model of a no-split ring buffer. Like ESP-IDF, every item takes an
+// 8 byte header plus its size rounded up to 4 bytes, never wraps around the
+// end of the storage, and the largest item is half the buffer. Calls never
+// block, ticks_to_wait is ignored.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+  RINGBUF_TYPE_NOSPLIT = 0,
+  RINGBUF_TYPE_ALLOWSPLIT,
+  RINGBUF_TYPE_BYTEBUF,
+} RingbufferType_t;
+
+struct FakeRingbuffer {
+  static constexpr size_t kHeaderSize = 8;
+
+  struct Block {
+    size_t offset;
+    size_t len;  // including header
+    bool complete;
+    bool received;
+    bool returned;
+  };
+
+  std::vector<uint8_t> storage;
+  std::deque<Block> blocks;
+  size_t write = 0;
+
+  static size_t align(size_t size) { return (size + 3) & ~size_t(3); }
+  size_t max_item_size() const { return align(storage.size() / 2) - kHeaderSize; }
+
+  // largest contiguous free region
+  size_t contiguous_free() const {
+    if (blocks.empty()) return storage.size();
+    size_t head = blocks.front().offset;
+    if (write > head) return std::max(storage.size() - write, head);
+    return head - write;
+  }
+
+  void* acquire(size_t size) {
+    size_t len = kHeaderSize + align(size);
+    if (size > max_item_size()) return nullptr;
+    if (blocks.empty()) write = 0;
+    size_t offset;
+    if (blocks.empty()) {
+      offset = 0;
+    } else {
+      size_t head = blocks.front().offset;
+      if (write > head) {
+        if (storage.size() - write >= len) {
+          offset = write;
+        } else if (head >= len) {
+          offset = 0;  // rest of the storage is wasted until the wrap
+        } else {
+          return nullptr;
+        }
+      } else if (head - write >= len) {
+        offset = write;
+      } else {
+        return nullptr;
+      }
+    }
+    blocks.push_back({offset, len, false, false, false});
+    write = offset + len;
+    return storage.data() + offset + kHeaderSize;
+  }
+
+  Block* find(const void* item) {
+    for (auto& block : blocks) {
+      if (storage.data() + block.offset + kHeaderSize == item) return &block;
+    }
+    return nullptr;
+  }
+};
+
+typedef FakeRingbuffer* RingbufHandle_t;
+
+inline RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type) {
+  if (type != RINGBUF_TYPE_NOSPLIT) return nullptr;
+  auto ringbuf = new FakeRingbuffer();
+  ringbuf->storage.resize(size & ~size_t(3));
+  return ringbuf;
+}
+
+inline void vRingbufferDelete(RingbufHandle_t ringbuf) { delete ringbuf; }
+
+inline size_t xRingbufferGetMaxItemSize(RingbufHandle_t ringbuf) {
+  return ringbuf->max_item_size();
+}
+
+inline size_t xRingbufferGetCurFreeSize(RingbufHandle_t ringbuf) {
+  size_t free = ringbuf->contiguous_free();
+  free = free > FakeRingbuffer::kHeaderSize
+             ? free - FakeRingbuffer::kHeaderSize
+             : 0;
+  return std::min(free, ringbuf->max_item_size());
+}
+
+inline BaseType_t xRingbufferSendAcquire(RingbufHandle_t ringbuf, void** item,
+                                         size_t size, TickType_t) {
+  *item = ringbuf->acquire(size);
+  return *item != nullptr ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xRingbufferSendComplete(RingbufHandle_t ringbuf,
+                                          void* item) {
+  auto block = ringbuf->find(item);
+  if (block == nullptr || block->complete) return pdFALSE;
+  block->complete = true;
+  return pdTRUE;
+}
+
+inline BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, const void* data,
+                                  size_t size, TickType_t ticks_to_wait) {
+  void* item = nullptr;
+  if (xRingbufferSendAcquire(ringbuf, &item, size, ticks_to_wait) != pdTRUE) {
+    return pdFALSE;
+  }
+  memcpy(item, data, size);
+  return xRingbufferSendComplete(ringbuf, item);
+}
+
+// items are received in the order they were acquired
+inline void* xRingbufferReceive(RingbufHandle_t ringbuf, size_t* size,
+                                TickType_t) {
+  for (auto& block : ringbuf->blocks) {
+    if (block.received) continue;
+    if (!block.complete) return nullptr;
+    block.received = true;
+    if (size != nullptr) *size = block.len - FakeRingbuffer::kHeaderSize;
+    return ringbuf->storage.data() + block.offset +
+           FakeRingbuffer::kHeaderSize;
+  }
+  return nullptr;
+}
+
+inline void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item) {
+  auto block = ringbuf->find(item);
+  if (block == nullptr) return;
+  block->returned = true;
+  while (!ringbuf->blocks.empty() && ringbuf->blocks.front().returned) {
+    ringbuf->blocks.pop_front();
+  }
+}
+
+inline void vRingbufferGetInfo(RingbufHandle_t ringbuf, UBaseType_t* free,
+                               UBaseType_t* read, UBaseType_t* write,
+                               UBaseType_t* acquire,
+                               UBaseType_t* items_waiting) {
+  if (free != nullptr) *free = 0;
+  if (read != nullptr) *read = 0;
+  if (write != nullptr) *write = ringbuf->write;
+  if (acquire != nullptr) *acquire = ringbuf->write;
+  if (items_waiting != nullptr) {
+    UBaseType_t count = 0;
+    for (auto& block : ringbuf->blocks) {
+      if (block.complete && !block.received) count++;
+    }
+    *items_waiting = count;
+  }
+}
+
+#endif  // HOMEBUTTONS_FAKE_RINGBUF_H
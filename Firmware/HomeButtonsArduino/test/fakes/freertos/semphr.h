@@ -0,0 +1,27 @@
+#ifndef HOMEBUTTONS_FAKE_SEMPHR_H
+#define HOMEBUTTONS_FAKE_SEMPHR_H
+
+#include <mutex>
+#include "freertos/FreeRTOS.h"
+
+typedef std::recursive_timed_mutex* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new std::recursive_timed_mutex();
+}
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return new std::recursive_timed_mutex();
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t) {
+  semaphore->lock();
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  semaphore->unlock();
+  return pdTRUE;
+}
+#define xSemaphoreTakeRecursive xSemaphoreTake
+#define xSemaphoreGiveRecursive xSemaphoreGive
+
+#endif  // HOMEBUTTONS_FAKE_SEMPHR_H
@@ -0,0 +1,36 @@
+#ifndef HOMEBUTTONS_FAKE_TASK_H
+#define HOMEBUTTONS_FAKE_TASK_H
+
+#include <atomic>
+#include <thread>
+#include "fake_clock.h"
+#include "freertos/FreeRTOS.h"
+
+namespace fake {
+// notifications given to any task
+inline std::atomic<uint32_t> task_notifications{0};
+inline thread_local char current_task;
+// timeout of the last ulTaskNotifyTake()
+inline TickType_t notify_wait_ticks = 0;
+}  // namespace fake
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return &fake::current_task; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) {
+  fake::task_notifications++;
+  return pdPASS;
+}
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t* woken) {
+  fake::task_notifications++;
+  if (woken != nullptr) *woken = pdFALSE;
+}
+// doesn't block, time only moves when a test advances it
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t ticks_to_wait) {
+  fake::notify_wait_ticks = ticks_to_wait;
+  return fake::task_notifications.exchange(0);
+}
+inline void vTaskDelay(TickType_t) { std::this_thread::yield(); }
+inline TickType_t xTaskGetTickCount() {
+  return static_cast<TickType_t>(fake::time_us / 1000);
+}
+
+#endif  // HOMEBUTTONS_FAKE_TASK_H
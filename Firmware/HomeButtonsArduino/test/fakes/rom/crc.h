@@ -0,0 +1,31 @@
+#ifndef HOMEBUTTONS_FAKE_ROM_CRC_H
+#define HOMEBUTTONS_FAKE_ROM_CRC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace fake {
+inline const std::array<uint32_t, 256> crc32_table = [] {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    table[i] = crc;
+  }
+  return table;
+}();
+}  // namespace fake
+
+// CRC-32 (IEEE 802.3), table driven like the ROM function
+inline uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc = fake::crc32_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#endif  // HOMEBUTTONS_FAKE_ROM_CRC_H
@@ -0,0 +1,6 @@
+#ifndef HOMEBUTTONS_FAKE_SDKCONFIG_H
+#define HOMEBUTTONS_FAKE_SDKCONFIG_H
+
+// CONFIG_PM_ENABLE is not set, power locks do nothing on the host
+
+#endif  // HOMEBUTTONS_FAKE_SDKCONFIG_H
@@ -0,0 +1,25 @@
+#ifndef HOMEBUTTONS_FAKE_SEMVER_HPP
+#define HOMEBUTTONS_FAKE_SEMVER_HPP
+
+#include <cstdint>
+#include <tuple>
+
+namespace semver {
+struct version {
+  uint8_t major = 0;
+  uint8_t minor = 1;
+  uint8_t patch = 0;
+
+  bool operator<(const version& other) const {
+    return std::tie(major, minor, patch) <
+           std::tie(other.major, other.minor, other.patch);
+  }
+  bool operator>=(const version& other) const { return !(*this < other); }
+  bool operator==(const version& other) const {
+    return std::tie(major, minor, patch) ==
+           std::tie(other.major, other.minor, other.patch);
+  }
+};
+}  // namespace semver
+
+#endif  // HOMEBUTTONS_FAKE_SEMVER_HPP
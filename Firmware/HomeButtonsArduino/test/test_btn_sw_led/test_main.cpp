@@ -0,0 +1,216 @@
+#include <unity.h>
+
+#include <utility>
+#include <vector>
+
+#include "button_ui/btn_sw_led.cpp"
+#include "button_ui/led_effect.cpp"
+#include "button_ui/leds.cpp"
+#include "power.cpp"
+#include "scheduler.cpp"
+#include "fake_buttons.h"
+#include "fake_hardware.h"
+
+using EventType = UserInput::EventType;
+// (time ms, pressed)
+using Trace = std::vector<std::pair<uint32_t, bool>>;
+
+static HardwareDefinition hw;
+static BtnSwLED* button;
+static std::vector<UserInput::Event> events;
+static std::vector<uint32_t> event_times;
+
+static void start(bool instant = false, bool switch_mode = false) {
+  button->SetInstantMode(instant);
+  button->SetSwitchMode(switch_mode);
+  button->SetEventCallback([](UserInput::Event event) {
+    if (!event.final) return;
+    events.push_back(event);
+    event_times.push_back(millis());
+  });
+  button->Init();
+  button->Start();
+  for (int i = 0; i < 3; i++) button->Loop();
+}
+
+// plays the edges of the trace until end, the UI task only runs every 20
+// ms, so edges between loops are queued by the ISR
+static void run(const Trace& trace, uint32_t end) {
+  size_t next = 0;
+  for (; millis() < end; fake::advance_ms(1)) {
+    while (next < trace.size() && trace[next].first == millis()) {
+      fake::set_button(1, trace[next].second);
+      next++;
+    }
+    if (millis() % 20 == 0) button->Loop();
+  }
+}
+
+static void expect_events(std::vector<EventType> types) {
+  TEST_ASSERT_EQUAL(types.size(), events.size());
+  for (size_t i = 0; i < types.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING(UserInput::EventType2Str(types[i]),
+                             UserInput::EventType2Str(events[i].type));
+    TEST_ASSERT_EQUAL(1, events[i].btn_id);
+  }
+}
+
+void setUp() {
+  fake::reset_buttons();
+  fake::set_ms(1000);
+  events.clear();
+  event_times.clear();
+  hw.init();
+  button = new BtnSwLED("B1", 1, false, false, hw);
+}
+
+void tearDown() { delete button; }
+
+void test_bounced_single_click() {
+  start();
+  run({{1100, 1}, {1101, 0}, {1102, 1}, {1180, 0}, {1182, 1}, {1183, 0}},
+      3000);
+  expect_events({EventType::kClickSingle});
+}
+
+void test_double_click_between_loops() {
+  start();
+  run({{1100, 1}, {1160, 0}, {1230, 1}, {1290, 0}}, 3000);
+  expect_events({EventType::kClickDouble});
+}
+
+void test_triple_click() {
+  start();
+  run({{1100, 1}, {1160, 0}, {1230, 1}, {1290, 0}, {1360, 1}, {1420, 0}},
+      3000);
+  expect_events({EventType::kClickTriple});
+}
+
+void test_glitch_ignored() {
+  start();
+  run({{1100, 1}, {1110, 0}}, 3000);
+  expect_events({});
+}
+
+void test_long_hold() {
+  start();
+  run({{1100, 1}, {3500, 0}}, 5000);
+  expect_events({EventType::kHoldLong2s});
+}
+
+void test_wake_press_released_before_start() {
+  start();
+  // the pin is already released when the interrupt is attached
+  button->InitPress();
+  run({}, 3000);
+  expect_events({EventType::kClickSingle});
+}
+
+void test_replayed_double_click() {
+  start();
+  // recorded by the wake stub before boot, oldest first, with a bounce
+  const ButtonEdge edges[] = {
+      {400, true}, {399, false}, {398, true}, {330, false}, {260, true},
+      {200, false}};
+  button->ReplayPress(edges, sizeof(edges) / sizeof(edges[0]));
+  run({}, 3000);
+  expect_events({EventType::kClickDouble});
+}
+
+void test_instant_single_on_press() {
+  start(true);
+  run({{1100, 1}, {1101, 0}, {1102, 1}, {1180, 0}}, 3000);
+  expect_events({EventType::kClickSingle});
+  // final once debounced, not after the multi-click timeout
+  TEST_ASSERT_LESS_OR_EQUAL(1100 + kBtnDebounceTimeout + 20, event_times[0]);
+
+  // every click is a single
+  events.clear();
+  run({{3100, 1}, {3160, 0}, {3230, 1}, {3290, 0}}, 5000);
+  expect_events({EventType::kClickSingle, EventType::kClickSingle});
+}
+
+void test_instant_wake_press() {
+  start(true);
+  button->InitPress();
+  run({}, 3000);
+  expect_events({EventType::kClickSingle});
+  TEST_ASSERT_LESS_OR_EQUAL(1020, event_times[0]);
+}
+
+void test_instant_wake_press_waits_for_input_callback() {
+  BtnSwLEDInput<1> input("BSLInput", {*button});
+  button->SetInstantMode(true);
+  input.Init();
+  input.Start();
+  button->InitPress();
+  // the buttons always have the input's callback, the press waits for the
+  // callback of the input
+  for (int i = 0; i < 5; i++) {
+    fake::advance_ms(20);
+    input.Loop();
+  }
+  input.SetEventCallback(
+      [](UserInput::Event event) { events.push_back(event); });
+  input.Loop();
+  expect_events({EventType::kClickSingle});
+  TEST_ASSERT_TRUE(events[0].final);
+}
+
+void test_config_applied_in_loop() {
+  BtnSwLEDInput<1> input("BSLInput", {*button});
+  input.Init();
+  int applied = 0;
+  input.SetConfigAppliedCallback([&applied]() { applied++; });
+  BtnSwLEDInput<1>::Config config = {};
+  config[0].instant_mode = true;
+  input.SetConfig(config);
+  TEST_ASSERT_FALSE(button->instant_mode());
+  input.Start();
+  TEST_ASSERT_TRUE(button->instant_mode());
+  TEST_ASSERT_FALSE(input.ConfigPending());
+  TEST_ASSERT_EQUAL(1, applied);
+
+  // later changes wait for the next loop of the UI task
+  config[0].instant_mode = false;
+  config[0].switch_mode = true;
+  input.SetConfig(config);
+  TEST_ASSERT_TRUE(input.ConfigPending());
+  TEST_ASSERT_TRUE(button->instant_mode());
+  input.Loop();
+  TEST_ASSERT_FALSE(button->instant_mode());
+  TEST_ASSERT_TRUE(button->switch_mode());
+  TEST_ASSERT_EQUAL(2, applied);
+  input.Loop();
+  TEST_ASSERT_EQUAL(2, applied);
+
+  // an empty switch mode keeps it
+  config[0].switch_mode.reset();
+  input.SetConfig(config);
+  input.Loop();
+  TEST_ASSERT_TRUE(button->switch_mode());
+}
+
+void test_switch_mode_toggles() {
+  start(false, true);
+  run({{1100, 1}, {1180, 0}, {1500, 1}, {1580, 0}}, 3000);
+  expect_events({EventType::kSwitchOn, EventType::kSwitchOff});
+  TEST_ASSERT_FALSE(button->switch_state());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bounced_single_click);
+  RUN_TEST(test_double_click_between_loops);
+  RUN_TEST(test_triple_click);
+  RUN_TEST(test_glitch_ignored);
+  RUN_TEST(test_long_hold);
+  RUN_TEST(test_wake_press_released_before_start);
+  RUN_TEST(test_replayed_double_click);
+  RUN_TEST(test_instant_single_on_press);
+  RUN_TEST(test_instant_wake_press);
+  RUN_TEST(test_instant_wake_press_waits_for_input_callback);
+  RUN_TEST(test_config_applied_in_loop);
+  RUN_TEST(test_switch_mode_toggles);
+  return UNITY_END();
+}
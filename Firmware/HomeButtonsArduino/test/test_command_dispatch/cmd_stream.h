@@ -0,0 +1,54 @@
+#ifndef HOMEBUTTONS_TEST_CMD_STREAM_H
+#define HOMEBUTTONS_TEST_CMD_STREAM_H
+
+// messages an ORIGINAL receives from Home Assistant while it is set up:
+// labels and settings from the UI, each followed by the empty retained
+// payload the device publishes to clear the command, which comes back
+// through its own cmd/# subscription
+
+struct CmdMessage {
+  const char* topic;
+  const char* payload;
+};
+
+#define CMD_TOPIC(suffix) "homebuttons/Home Buttons a1b2c3/cmd/" suffix
+
+static const CmdMessage kCmdStream[] = {
+    {"homeassistant/status", "online"},
+    {CMD_TOPIC("btn_1_label"), "Lights"},
+    {CMD_TOPIC("btn_1_label"), ""},
+    {CMD_TOPIC("btn_2_label"), "Blinds"},
+    {CMD_TOPIC("btn_2_label"), ""},
+    {CMD_TOPIC("btn_3_label"), "TV"},
+    {CMD_TOPIC("btn_3_label"), ""},
+    {CMD_TOPIC("btn_4_label"), "mdi:fan"},
+    {CMD_TOPIC("btn_4_label"), ""},
+    {CMD_TOPIC("btn_5_label"), "Scene"},
+    {CMD_TOPIC("btn_5_label"), ""},
+    {CMD_TOPIC("btn_6_label"), "All off"},
+    {CMD_TOPIC("btn_6_label"), ""},
+    {CMD_TOPIC("btn_conf"), R"({"id":3,"mode":"switch"})"},
+    {CMD_TOPIC("btn_conf"), ""},
+    {CMD_TOPIC("sensor_interval"), "5"},
+    {CMD_TOPIC("sensor_interval"), ""},
+    {CMD_TOPIC("sensor_batch"), "6"},
+    {CMD_TOPIC("sensor_batch"), ""},
+    {CMD_TOPIC("report_config"), R"({"heartbeat":30})"},
+    {CMD_TOPIC("report_config"), ""},
+    {CMD_TOPIC("awake_mode"), "ON"},
+    {CMD_TOPIC("awake_mode"), ""},
+    {CMD_TOPIC("disp_msg"), "Dinner is ready"},
+    {CMD_TOPIC("disp_msg"), ""},
+    {CMD_TOPIC("schedule_wakeup"), "30"},
+    {CMD_TOPIC("schedule_wakeup"), ""},
+    {CMD_TOPIC("discovery_mode"), "device"},
+    {CMD_TOPIC("discovery_mode"), ""},
+    // left retained by an INDUSTRIAL with the same name
+    {CMD_TOPIC("switch_1"), "ON"},
+    {CMD_TOPIC("awake_mode"), "OFF"},
+    {CMD_TOPIC("awake_mode"), ""},
+};
+
+#undef CMD_TOPIC
+
+#endif  // HOMEBUTTONS_TEST_CMD_STREAM_H
@@ -0,0 +1,164 @@
+#include <unity.h>
+
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "cmd_dispatch.cpp"
+
+#include "bench.h"
+#include "cmd_stream.h"
+
+// handlers of App::_mqtt_callback, recording the calls
+struct Recorder {
+  int calls = 0;
+  uint8_t last_id = 0;
+  const char* last_cmd = "";
+
+  void record(const char* name, uint8_t id) {
+    calls++;
+    last_id = id;
+    last_cmd = name;
+  }
+
+#define HANDLER(name) \
+  void _cmd_##name(uint8_t id, const char*) { record(#name, id); }
+  HANDLER(sensor_interval)
+  HANDLER(sensor_batch)
+  HANDLER(btn_label)
+  HANDLER(disp_msg)
+  HANDLER(awake_mode)
+  HANDLER(schedule_wakeup)
+  HANDLER(discovery_mode)
+  HANDLER(report_config)
+  HANDLER(btn_conf)
+  HANDLER(led_amb_bright)
+  HANDLER(switch)
+#undef HANDLER
+};
+
+static Recorder recorder;
+
+static bool dispatch(const char* suffix) {
+  uint8_t id;
+  const auto* entry = find_cmd(MqttCmds<Recorder>::kTable, suffix, id);
+  if (entry == nullptr) return false;
+  (recorder.*entry->handler)(id, "");
+  return true;
+}
+
+// same steps as App::_mqtt_callback, false if not a known command
+static bool dispatch_message(const CmdMessage& message) {
+  static const char kCmd[] = "homebuttons/Home Buttons a1b2c3/cmd/";
+  size_t cmd_len = sizeof(kCmd) - 1;
+  if (strncmp(message.topic, kCmd, cmd_len) != 0) return false;
+  uint8_t id;
+  const auto* entry =
+      find_cmd(MqttCmds<Recorder>::kTable, message.topic + cmd_len, id);
+  if (entry == nullptr) return false;
+  (recorder.*entry->handler)(id, message.payload);
+  return true;
+}
+
+void setUp() { recorder = Recorder(); }
+
+void tearDown() {}
+
+void test_parse_without_number() {
+  char key[24];
+  uint8_t id = 7;
+  TEST_ASSERT_TRUE(parse_cmd_suffix("disp_msg", key, sizeof(key), id));
+  TEST_ASSERT_EQUAL_STRING("disp_msg", key);
+  TEST_ASSERT_EQUAL_UINT8(0, id);
+}
+
+void test_parse_replaces_first_number() {
+  char key[24];
+  uint8_t id;
+  TEST_ASSERT_TRUE(parse_cmd_suffix("btn_3_label", key, sizeof(key), id));
+  TEST_ASSERT_EQUAL_STRING("btn_#_label", key);
+  TEST_ASSERT_EQUAL_UINT8(3, id);
+
+  TEST_ASSERT_TRUE(parse_cmd_suffix("switch_12", key, sizeof(key), id));
+  TEST_ASSERT_EQUAL_STRING("switch_#", key);
+  TEST_ASSERT_EQUAL_UINT8(12, id);
+
+  // later numbers are kept
+  TEST_ASSERT_TRUE(parse_cmd_suffix("btn_2_x4", key, sizeof(key), id));
+  TEST_ASSERT_EQUAL_STRING("btn_#_x4", key);
+  TEST_ASSERT_EQUAL_UINT8(2, id);
+}
+
+void test_parse_rejects_bad_input() {
+  char key[24];
+  uint8_t id;
+  TEST_ASSERT_FALSE(parse_cmd_suffix("btn_256_label", key, sizeof(key), id));
+  TEST_ASSERT_FALSE(parse_cmd_suffix("a_suffix_longer_than_the_key_buffer",
+                                     key, sizeof(key), id));
+  TEST_ASSERT_TRUE(parse_cmd_suffix("", key, sizeof(key), id));
+  TEST_ASSERT_EQUAL_STRING("", key);
+}
+
+void test_dispatch_commands() {
+  TEST_ASSERT_TRUE(dispatch("sensor_interval"));
+  TEST_ASSERT_EQUAL_STRING("sensor_interval", recorder.last_cmd);
+
+  TEST_ASSERT_TRUE(dispatch("btn_5_label"));
+  TEST_ASSERT_EQUAL_STRING("btn_label", recorder.last_cmd);
+  TEST_ASSERT_EQUAL_UINT8(5, recorder.last_id);
+
+  TEST_ASSERT_TRUE(dispatch("disp_msg"));
+  TEST_ASSERT_EQUAL_STRING("disp_msg", recorder.last_cmd);
+  TEST_ASSERT_EQUAL(3, recorder.calls);
+}
+
+void test_unknown_commands() {
+  TEST_ASSERT_FALSE(dispatch("sensor_intervals"));
+  TEST_ASSERT_FALSE(dispatch("btn_label"));
+  TEST_ASSERT_FALSE(dispatch("switch_"));
+  TEST_ASSERT_FALSE(dispatch("btn_1_label/set"));
+  // INDUSTRIAL only
+  TEST_ASSERT_FALSE(dispatch("switch_2"));
+  TEST_ASSERT_FALSE(dispatch("led_amb_bright"));
+  TEST_ASSERT_EQUAL(0, recorder.calls);
+}
+
+void test_command_stream() {
+  int unknown = 0;
+  std::map<std::string, int> counts;
+  for (const CmdMessage& message : kCmdStream) {
+    if (dispatch_message(message)) {
+      counts[recorder.last_cmd]++;
+    } else {
+      unknown++;
+    }
+  }
+  // the HA birth message and the INDUSTRIAL switch
+  TEST_ASSERT_EQUAL(2, unknown);
+  TEST_ASSERT_EQUAL(12, counts["btn_label"]);
+  TEST_ASSERT_EQUAL(4, counts["awake_mode"]);
+  TEST_ASSERT_EQUAL(2, counts["discovery_mode"]);
+  TEST_ASSERT_EQUAL(0, counts["switch"]);
+  TEST_ASSERT_EQUAL(sizeof(kCmdStream) / sizeof(kCmdStream[0]) - 2,
+                    recorder.calls);
+}
+
+void test_benchmark_stream() {
+  constexpr size_t kMessages = sizeof(kCmdStream) / sizeof(kCmdStream[0]);
+  double ns = fake::bench_ns(20000 * kMessages, [](int i) {
+    dispatch_message(kCmdStream[i % kMessages]);
+  });
+  fake::bench_report("command message", ns);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_without_number);
+  RUN_TEST(test_parse_replaces_first_number);
+  RUN_TEST(test_parse_rejects_bad_input);
+  RUN_TEST(test_dispatch_commands);
+  RUN_TEST(test_unknown_commands);
+  RUN_TEST(test_command_stream);
+  RUN_TEST(test_benchmark_stream);
+  return UNITY_END();
+}
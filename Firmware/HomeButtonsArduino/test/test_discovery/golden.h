@@ -0,0 +1,171 @@
+#ifndef HOMEBUTTONS_TEST_DISCOVERY_GOLDEN_H
+#define HOMEBUTTONS_TEST_DISCOVERY_GOLDEN_H
+
+// discovery payloads of an ORIGINAL with button 2 in instant mode and button 3
+// in switch mode, $SW stands for SW_VERSION
+
+static const char* kButton1Config =
+    R"({"atype":"trigger","t":"homebuttons/Home Buttons a1b2c3/button_1",)"
+    R"("pl":"PRESS","type":"button_short_press","stype":"button_1",)"
+    R"("dev":{"ids":["HBTNS-12345678-a1b2c3"],"mdl":"Home Buttons",)"
+    R"("name":"Home Buttons a1b2c3","sw":"$SW","hw":"2.5","mf":"PLab",)"
+    R"("cu":"http://192.168.1.50"}})";
+
+static const char* kSwitch3Config =
+    R"({"name":"Switch 3","uniq_id":"HBTNS-12345678-a1b2c3_switch_3",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/switch_3",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/switch_3",)"
+    R"("ic":"mdi:radiobox-marked",)"
+    R"("avty_t":"homebuttons/Home Buttons a1b2c3/available",)"
+    R"("dev":{"ids":["HBTNS-12345678-a1b2c3"]}})";
+
+static const char* kTemperatureConfig =
+    R"({"name":"Temperature","uniq_id":"HBTNS-12345678-a1b2c3_temperature",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/temperature",)"
+    R"("dev_cla":"temperature","unit_of_meas":"°C","exp_aft":3660,)"
+    R"("dev":{"ids":["HBTNS-12345678-a1b2c3"]}})";
+
+static const char* kDeviceConfig =
+    R"({"dev":{"ids":["HBTNS-12345678-a1b2c3"],"mdl":"Home Buttons",)"
+    R"("name":"Home Buttons a1b2c3","sw":"$SW","hw":"2.5","mf":"PLab",)"
+    R"("cu":"http://192.168.1.50"},"o":{"name":"Home Buttons","sw":"$SW"},)"
+    R"("cmps":{"switch_1":{"p":"switch"},)"
+    R"("kill_switch_1":{"p":"binary_sensor"},)"
+    R"("button_1":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_1","pl":"PRESS",)"
+    R"("type":"button_short_press","stype":"button_1"},)"
+    R"("button_1_double":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_1_double","pl":"PRESS",)"
+    R"("type":"button_double_press","stype":"button_1"},)"
+    R"("button_1_triple":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_1_triple","pl":"PRESS",)"
+    R"("type":"button_triple_press","stype":"button_1"},)"
+    R"("button_1_quad":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_1_quad","pl":"PRESS",)"
+    R"("type":"button_quadruple_press","stype":"button_1"},)"
+    R"("switch_2":{"p":"switch"},"kill_switch_2":{"p":"binary_sensor"},)"
+    R"("button_2":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_2","pl":"PRESS",)"
+    R"("type":"button_short_press","stype":"button_2"},)"
+    R"("button_2_double":{"p":"device_automation"},)"
+    R"("button_2_triple":{"p":"device_automation"},)"
+    R"("button_2_quad":{"p":"device_automation"},)"
+    R"("button_3":{"p":"device_automation"},)"
+    R"("button_3_double":{"p":"device_automation"},)"
+    R"("button_3_triple":{"p":"device_automation"},)"
+    R"("button_3_quad":{"p":"device_automation"},"switch_3":{"p":"switch",)"
+    R"("name":"Switch 3","uniq_id":"HBTNS-12345678-a1b2c3_switch_3",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/switch_3",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/switch_3",)"
+    R"("ic":"mdi:radiobox-marked",)"
+    R"("avty_t":"homebuttons/Home Buttons a1b2c3/available"},)"
+    R"("switch_4":{"p":"switch"},"kill_switch_4":{"p":"binary_sensor"},)"
+    R"("button_4":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_4","pl":"PRESS",)"
+    R"("type":"button_short_press","stype":"button_4"},)"
+    R"("button_4_double":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_4_double","pl":"PRESS",)"
+    R"("type":"button_double_press","stype":"button_4"},)"
+    R"("button_4_triple":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_4_triple","pl":"PRESS",)"
+    R"("type":"button_triple_press","stype":"button_4"},)"
+    R"("button_4_quad":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_4_quad","pl":"PRESS",)"
+    R"("type":"button_quadruple_press","stype":"button_4"},)"
+    R"("switch_5":{"p":"switch"},"kill_switch_5":{"p":"binary_sensor"},)"
+    R"("button_5":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_5","pl":"PRESS",)"
+    R"("type":"button_short_press","stype":"button_5"},)"
+    R"("button_5_double":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_5_double","pl":"PRESS",)"
+    R"("type":"button_double_press","stype":"button_5"},)"
+    R"("button_5_triple":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_5_triple","pl":"PRESS",)"
+    R"("type":"button_triple_press","stype":"button_5"},)"
+    R"("button_5_quad":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_5_quad","pl":"PRESS",)"
+    R"("type":"button_quadruple_press","stype":"button_5"},)"
+    R"("switch_6":{"p":"switch"},"kill_switch_6":{"p":"binary_sensor"},)"
+    R"("button_6":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_6","pl":"PRESS",)"
+    R"("type":"button_short_press","stype":"button_6"},)"
+    R"("button_6_double":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_6_double","pl":"PRESS",)"
+    R"("type":"button_double_press","stype":"button_6"},)"
+    R"("button_6_triple":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_6_triple","pl":"PRESS",)"
+    R"("type":"button_triple_press","stype":"button_6"},)"
+    R"("button_6_quad":{"p":"device_automation","atype":"trigger",)"
+    R"("t":"homebuttons/Home Buttons a1b2c3/button_6_quad","pl":"PRESS",)"
+    R"("type":"button_quadruple_press","stype":"button_6"},)"
+    R"("temperature":{"p":"sensor","name":"Temperature",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_temperature",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/temperature",)"
+    R"("dev_cla":"temperature","unit_of_meas":"°C","exp_aft":3660},)"
+    R"("humidity":{"p":"sensor","name":"Humidity",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_humidity",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/humidity",)"
+    R"("dev_cla":"humidity","unit_of_meas":"%","exp_aft":3660},)"
+    R"("battery":{"p":"sensor","name":"Battery",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_battery",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/battery",)"
+    R"("dev_cla":"battery","unit_of_meas":"%","exp_aft":3660},)"
+    R"("sensor_interval":{"p":"number","name":"Sensor interval",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_sensor_interval",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/sensor_interval",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/sensor_interval",)"
+    R"("unit_of_meas":"min","min":1,"max":30,"mode":"slider",)"
+    R"("ic":"mdi:timer-sand","ret":"true"},"sensor_batch":{"p":"number",)"
+    R"("name":"Sensor batch",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_sensor_batch",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/sensor_batch",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/sensor_batch","min":1,)"
+    R"("max":12,"mode":"box","ic":"mdi:tray-full","ret":"true"},)"
+    R"("button_1_label":{"p":"text","name":"Button 1 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_1_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_1_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_1_label","max":56,)"
+    R"("ic":"mdi:numeric-1-box","ret":"true"},"button_2_label":{"p":"text",)"
+    R"("name":"Button 2 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_2_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_2_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_2_label","max":56,)"
+    R"("ic":"mdi:numeric-2-box","ret":"true"},"button_3_label":{"p":"text",)"
+    R"("name":"Button 3 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_3_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_3_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_3_label","max":56,)"
+    R"("ic":"mdi:numeric-3-box","ret":"true"},"button_4_label":{"p":"text",)"
+    R"("name":"Button 4 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_4_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_4_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_4_label","max":56,)"
+    R"("ic":"mdi:numeric-4-box","ret":"true"},"button_5_label":{"p":"text",)"
+    R"("name":"Button 5 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_5_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_5_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_5_label","max":56,)"
+    R"("ic":"mdi:numeric-5-box","ret":"true"},"button_6_label":{"p":"text",)"
+    R"("name":"Button 6 label",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_button_6_label",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/btn_6_label",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/btn_6_label","max":56,)"
+    R"("ic":"mdi:numeric-6-box","ret":"true"},"user_message":{"p":"text",)"
+    R"("name":"Show message",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_user_message",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/disp_msg",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/disp_msg","max":64,)"
+    R"("ic":"mdi:message-text","ret":"true"},)"
+    R"("schedule_wakeup":{"p":"number","name":"Schedule wakeup",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_schedule_wakeup",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/schedule_wakeup",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/schedule_wakeup",)"
+    R"("unit_of_meas":"s","min":5,"max":1800,"mode":"box","ic":"mdi:alarm",)"
+    R"("ret":"true"},"awake_mode":{"p":"switch","name":"Awake mode",)"
+    R"("uniq_id":"HBTNS-12345678-a1b2c3_awake_mode",)"
+    R"("cmd_t":"homebuttons/Home Buttons a1b2c3/cmd/awake_mode",)"
+    R"("stat_t":"homebuttons/Home Buttons a1b2c3/awake_mode",)"
+    R"("ic":"mdi:coffee","ret":"true",)"
+    R"("avty_t":"homebuttons/Home Buttons a1b2c3/awake_mode/available"}}})";
+
+#endif  // HOMEBUTTONS_TEST_DISCOVERY_GOLDEN_H
@@ -0,0 +1,216 @@
+#include <unity.h>
+
+#include <string>
+
+#include "button_ui/btn_sw_led.cpp"
+#include "button_ui/led_effect.cpp"
+#include "button_ui/leds.cpp"
+#include "json_writer.cpp"
+#include "mqtt_helper.cpp"
+#include "network.cpp"
+#include "power.cpp"
+#include "publish_queue.cpp"
+#include "retained_ledger.cpp"
+#include "scheduler.cpp"
+#include "state.cpp"
+#include "topics.cpp"
+#include "fake_buttons.h"
+#include "fake_hardware.h"
+#include "golden.h"
+
+// wake_profiler.cpp can't share a translation unit with retained_ledger.cpp
+void WakeProfiler::mark(WakePhase) {}
+
+static HardwareDefinition hw;
+static DeviceState* device_state;
+static TopicHelper* topics;
+static Network* network;
+static BtnSwLED* buttons[NUM_BUTTONS];
+static BtnSwLEDInput<NUM_BUTTONS>* bsl_input;
+static MQTTHelper* mqtt_helper;
+
+static std::string golden(const char* payload) {
+  std::string str(payload);
+  size_t pos;
+  while ((pos = str.find("$SW")) != std::string::npos) {
+    str.replace(pos, 3, SW_VERSION);
+  }
+  return str;
+}
+
+// payload of the last message on topic, nullptr if nothing was published
+static const fake::MqttMessage* published(const char* topic) {
+  for (auto it = fake::mqtt_published.rbegin();
+       it != fake::mqtt_published.rend(); ++it) {
+    if (it->topic == topic) return &*it;
+  }
+  return nullptr;
+}
+
+static void expect_payload(const char* topic, const std::string& payload) {
+  const fake::MqttMessage* message = published(topic);
+  TEST_ASSERT_NOT_NULL_MESSAGE(message, topic);
+  TEST_ASSERT_TRUE(message->retained);
+  TEST_ASSERT_EQUAL_STRING(payload.c_str(), message->payload.c_str());
+}
+
+void setUp() {
+  fake::nvs.reset();
+  fake::reset_buttons();
+  fake::mqtt_published.clear();
+  fake::mqtt_fail_publish = false;
+  hw.init();
+  device_state = new DeviceState();
+  device_state->load_all(hw);
+  device_state->set_ip(IPAddress(192, 168, 1, 50));
+  topics = new TopicHelper(*device_state);
+  network = new Network(*device_state, *topics);
+  network->setup();  // publishes from this thread go straight to the client
+  network->reset_retained_ledger();
+  for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
+    buttons[i] = new BtnSwLED("BTN", i + 1, false, true, hw);
+  }
+  bsl_input = new BtnSwLEDInput<NUM_BUTTONS>(
+      "BSLInput", {*buttons[0], *buttons[1], *buttons[2], *buttons[3],
+                   *buttons[4], *buttons[5]});
+  mqtt_helper = new MQTTHelper(*device_state, *bsl_input, *network, *topics);
+
+  buttons[1]->SetInstantMode(true);
+  buttons[2]->SetSwitchMode(true);
+}
+
+void tearDown() {
+  delete mqtt_helper;
+  delete bsl_input;
+  for (auto button : buttons) delete button;
+  delete network;
+  delete topics;
+  delete device_state;
+}
+
+void test_entity_configs() {
+  mqtt_helper->send_discovery_config();
+
+  // 6 per button and 5 for the switch, 5 sensors and numbers, 7 texts,
+  // wakeup, awake mode and the removed device config
+  TEST_ASSERT_EQUAL(50, fake::mqtt_published.size());
+  expect_payload(topics->t_btn_config(1), golden(kButton1Config));
+  expect_payload(topics->t_switch_config(3), golden(kSwitch3Config));
+  expect_payload(topics->t_temperature_config(), golden(kTemperatureConfig));
+
+  // entities left from other modes are removed
+  expect_payload(topics->t_btn_double_config(2), "");
+  expect_payload(topics->t_btn_config(3), "");
+  expect_payload(topics->t_switch_config(1), "");
+  expect_payload(topics->t_device_config(), "");
+
+  // only the first entity carries the full device
+  size_t full_devices = 0;
+  for (const auto& message : fake::mqtt_published) {
+    if (message.payload.find("\"mdl\":") != std::string::npos) full_devices++;
+  }
+  TEST_ASSERT_EQUAL(1, full_devices);
+}
+
+void test_device_config() {
+  device_state->set_device_discovery(true);
+  mqtt_helper->send_discovery_config();
+
+  expect_payload(topics->t_device_config(), golden(kDeviceConfig));
+  // every entity config is removed
+  for (const auto& message : fake::mqtt_published) {
+    if (message.topic == topics->t_device_config()) continue;
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("", message.payload.c_str(),
+                                     message.topic.c_str());
+  }
+  TEST_ASSERT_EQUAL(50, fake::mqtt_published.size());
+}
+
+void test_unchanged_configs_skipped() {
+  mqtt_helper->update_discovery_config();
+  fake::mqtt_published.clear();
+  mqtt_helper->update_discovery_config();
+  TEST_ASSERT_EQUAL(0, fake::mqtt_published.size());
+
+  // button 1 to switch mode: its 4 triggers are removed and the switch added,
+  // the kill switch stays removed
+  buttons[0]->SetSwitchMode(true);
+  mqtt_helper->update_discovery_config();
+  TEST_ASSERT_EQUAL(5, fake::mqtt_published.size());
+  expect_payload(topics->t_btn_config(1), "");
+  expect_payload(topics->t_btn_quad_config(1), "");
+  TEST_ASSERT_NOT_NULL(published(topics->t_switch_config(1)));
+}
+
+void test_mode_change_replaces_configs() {
+  mqtt_helper->send_discovery_config();
+  fake::mqtt_published.clear();
+
+  device_state->set_device_discovery(true);
+  mqtt_helper->send_discovery_config();
+  // the entity configs that were published are removed, the device config
+  // sent, configs already removed are skipped
+  expect_payload(topics->t_device_config(), golden(kDeviceConfig));
+  expect_payload(topics->t_btn_config(1), "");
+  expect_payload(topics->t_temperature_config(), "");
+  TEST_ASSERT_NULL(published(topics->t_btn_double_config(2)));
+  TEST_ASSERT_NULL(published(topics->t_switch_config(1)));
+
+  fake::mqtt_published.clear();
+  device_state->set_device_discovery(false);
+  mqtt_helper->send_discovery_config();
+  expect_payload(topics->t_device_config(), "");
+  expect_payload(topics->t_btn_config(1), golden(kButton1Config));
+}
+
+void test_failed_publish_sent_again() {
+  fake::mqtt_fail_publish = true;
+  mqtt_helper->send_discovery_config();
+  TEST_ASSERT_EQUAL(0, fake::mqtt_published.size());
+
+  // nothing was recorded in the retained ledger
+  fake::mqtt_fail_publish = false;
+  mqtt_helper->send_discovery_config();
+  TEST_ASSERT_EQUAL(50, fake::mqtt_published.size());
+  expect_payload(topics->t_btn_config(1), golden(kButton1Config));
+}
+
+void test_fahrenheit_changes_temperature_only() {
+  mqtt_helper->send_discovery_config();
+  fake::mqtt_published.clear();
+
+  device_state->set_temp_unit(StaticString<1>("F"));
+  mqtt_helper->update_discovery_config();
+  TEST_ASSERT_EQUAL(1, fake::mqtt_published.size());
+  std::string payload = golden(kTemperatureConfig);
+  payload.replace(payload.find("°C"), strlen("°C"), "°F");
+  expect_payload(topics->t_temperature_config(), payload);
+}
+
+void test_changed_stream_not_sent() {
+  // the second pass writes more than was measured
+  int passes = 0;
+  auto write_payload = [&](Print& out) {
+    out.write(passes++ == 0 ? "{}" : "{\"a\":1}");
+  };
+  network->publish_streamed_if_changed("hb/state", write_payload);
+  TEST_ASSERT_EQUAL(2, passes);
+  TEST_ASSERT_EQUAL(0, fake::mqtt_published.size());
+
+  // not recorded, sent once the payload is stable
+  network->publish_streamed_if_changed(
+      "hb/state", [](Print& out) { out.write("{}"); });
+  expect_payload("hb/state", "{}");
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_entity_configs);
+  RUN_TEST(test_device_config);
+  RUN_TEST(test_unchanged_configs_skipped);
+  RUN_TEST(test_mode_change_replaces_configs);
+  RUN_TEST(test_failed_publish_sent_again);
+  RUN_TEST(test_fahrenheit_changes_temperature_only);
+  RUN_TEST(test_changed_stream_not_sent);
+  return UNITY_END();
+}
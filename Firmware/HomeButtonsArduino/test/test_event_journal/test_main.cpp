@@ -0,0 +1,116 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "event_journal.cpp"
+
+using EventType = UserInput::EventType;
+
+static UserInput::Event event(uint16_t btn_id, EventType type) {
+  UserInput::Event e;
+  e.btn_id = btn_id;
+  e.type = type;
+  return e;
+}
+
+static void pop_expect(EventJournal& journal, uint16_t btn_id, EventType type,
+                       uint32_t seq) {
+  EventJournal::Entry entry;
+  TEST_ASSERT_TRUE(journal.pop(entry));
+  TEST_ASSERT_EQUAL(btn_id, entry.btn_id);
+  TEST_ASSERT_TRUE(type == entry.type);
+  TEST_ASSERT_EQUAL_UINT32(seq, entry.seq);
+}
+
+void setUp() {
+  // RTC memory after power on
+  memset(&ring, 0xa5, sizeof(ring));
+}
+
+void tearDown() {}
+
+void test_empty_after_power_on() {
+  EventJournal journal;
+  EventJournal::Entry entry;
+  TEST_ASSERT_EQUAL(0, journal.size());
+  TEST_ASSERT_EQUAL(0, journal.dropped());
+  TEST_ASSERT_FALSE(journal.pop(entry));
+}
+
+void test_oldest_first() {
+  EventJournal journal;
+  int64_t start = EventJournal::now_us();
+  journal.add(event(1, EventType::kClickSingle));
+  journal.add(event(4, EventType::kClickDouble));
+  journal.add(event(2, EventType::kSwitchOn));
+  TEST_ASSERT_EQUAL(3, journal.size());
+
+  EventJournal::Entry entry;
+  TEST_ASSERT_TRUE(journal.pop(entry));
+  TEST_ASSERT_EQUAL(1, entry.btn_id);
+  TEST_ASSERT_TRUE(entry.time_us >= start);
+  TEST_ASSERT_TRUE(entry.time_us <= EventJournal::now_us());
+  pop_expect(journal, 4, EventType::kClickDouble, 1);
+  pop_expect(journal, 2, EventType::kSwitchOn, 2);
+  TEST_ASSERT_EQUAL(0, journal.size());
+}
+
+void test_full_drops_oldest() {
+  EventJournal journal;
+  for (uint16_t i = 0; i < EVENT_JOURNAL_SIZE + 3; i++) {
+    journal.add(event(i % NUM_BUTTONS + 1, EventType::kClickSingle));
+  }
+  TEST_ASSERT_EQUAL(EVENT_JOURNAL_SIZE, journal.size());
+  TEST_ASSERT_EQUAL(3, journal.dropped());
+  for (uint32_t seq = 3; seq < EVENT_JOURNAL_SIZE + 3; seq++) {
+    pop_expect(journal, seq % NUM_BUTTONS + 1, EventType::kClickSingle, seq);
+  }
+  TEST_ASSERT_EQUAL(0, journal.size());
+}
+
+void test_survives_deep_sleep() {
+  {
+    EventJournal journal;
+    journal.add(event(3, EventType::kClickTriple));
+    journal.add(event(5, EventType::kHoldLong2s));
+    EventJournal::Entry entry;
+    TEST_ASSERT_TRUE(journal.pop(entry));
+  }
+  // a new instance after wake, the ring is kept in RTC memory
+  EventJournal journal;
+  TEST_ASSERT_EQUAL(1, journal.size());
+  pop_expect(journal, 5, EventType::kHoldLong2s, 1);
+
+  // sequence numbers continue
+  journal.add(event(1, EventType::kClickSingle));
+  pop_expect(journal, 1, EventType::kClickSingle, 2);
+}
+
+void test_corrupt_ring_reset() {
+  {
+    EventJournal journal;
+    journal.add(event(2, EventType::kClickSingle));
+    journal.add(event(3, EventType::kClickSingle));
+  }
+  ring.entries[ring.head].btn_id = 6;
+  EventJournal journal;
+  TEST_ASSERT_EQUAL(0, journal.size());
+  TEST_ASSERT_EQUAL(0, journal.dropped());
+
+  // out of range indexes with a valid crc are rejected too
+  journal.add(event(2, EventType::kClickSingle));
+  ring.count = EVENT_JOURNAL_SIZE + 1;
+  ring.crc = ring_crc();
+  EventJournal reloaded;
+  TEST_ASSERT_EQUAL(0, reloaded.size());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_after_power_on);
+  RUN_TEST(test_oldest_first);
+  RUN_TEST(test_full_drops_oldest);
+  RUN_TEST(test_survives_deep_sleep);
+  RUN_TEST(test_corrupt_ring_reset);
+  return UNITY_END();
+}
@@ -0,0 +1,263 @@
+#include <unity.h>
+
+#include <cmath>
+#include <string>
+
+#include "json_writer.cpp"
+#include "publish_queue.cpp"
+#include "config.h"
+#include "print_utils.h"
+#include "bench.h"
+
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define HAS_ARDUINOJSON
+#endif
+
+static std::string write(const std::function<void(JsonWriter&)>& fn) {
+  StringPrint out;
+  JsonWriter json(out);
+  fn(json);
+  TEST_ASSERT_TRUE(json.ok());
+  return out.str();
+}
+
+// same fields as App::_publish_system_state on an ORIGINAL
+static void system_state(Print& out) {
+  JsonWriter json(out);
+  json.begin_object();
+  json.add("esp_free_heap", 182340u)
+      .add("esp_min_free_heap", 150212u)
+      .add("uptime_seconds", 3621u)
+      .add("wifi_rssi", -67)
+      .add("ip_address", "192.168.1.50")
+      .add("sw_version", SW_VERSION)
+      .add("mqtt_dropped", 0u)
+      .add("mqtt_coalesced", 3u)
+      .add("mqtt_evt_latency_us", 1840u)
+      .add("mqtt_evt_latency_max_us", 5120u)
+      .add("nvs_writes", 12u)
+      .add("ui_events_dropped", 0u);
+  json.begin_object("suppressed");
+  json.add("temperature", 4u).add("humidity", 7u).add("battery", 2u);
+  json.end_object();
+  json.add("batt_voltage", 4.12);
+  json.end_object();
+}
+
+// button trigger of the entity discovery mode
+static void discovery(Print& out) {
+  JsonWriter json(out);
+  json.begin_object();
+  json.add("atype", "trigger")
+      .add("t", "homebuttons/Home Buttons a1b2c3/button_1")
+      .add("pl", "PRESS")
+      .add("type", "button_short_press")
+      .add("stype", "button_1");
+  json.begin_object("dev");
+  json.begin_array("ids").add(nullptr, "HBTNS-12345678-a1b2c3").end_array();
+  json.add("mdl", "Home Buttons")
+      .add("name", "Home Buttons a1b2c3")
+      .add("sw", SW_VERSION)
+      .add("hw", "2.5")
+      .add("mf", "PLab")
+      .add("cu", "http://192.168.1.50");
+  json.end_object();
+  json.end_object();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_escaping() {
+  TEST_ASSERT_EQUAL_STRING(
+      R"({"a\"b":"q\"s\\b\n\r\t"})", write([](JsonWriter& json) {
+        json.begin_object().add("a\"b", "q\"s\\b\n\r\t").end_object();
+      }).c_str());
+  // other control characters as \u00xx, UTF-8 is passed through
+  TEST_ASSERT_EQUAL_STRING(
+      R"(["\u0001x\u001f","°C"])", write([](JsonWriter& json) {
+        json.begin_array().add(nullptr, "\x01x\x1f").add(nullptr, "°C");
+        json.end_array();
+      }).c_str());
+  TEST_ASSERT_EQUAL_STRING(R"({"s":null})", write([](JsonWriter& json) {
+                             const char* missing = nullptr;
+                             json.begin_object().add("s", missing);
+                             json.end_object();
+                           }).c_str());
+}
+
+void test_numbers() {
+  TEST_ASSERT_EQUAL_STRING(
+      R"([-5,4294967295,true,21.5,0.1])", write([](JsonWriter& json) {
+        json.begin_array()
+            .add(nullptr, static_cast<int8_t>(-5))
+            .add(nullptr, UINT32_MAX)
+            .add(nullptr, true)
+            .add(nullptr, 21.5f)
+            .add(nullptr, 0.1)
+            .end_array();
+      }).c_str());
+}
+
+void test_nan_and_inf_are_null() {
+  TEST_ASSERT_EQUAL_STRING(
+      R"({"nan":null,"inf":null,"-inf":null})", write([](JsonWriter& json) {
+        json.begin_object()
+            .add("nan", NAN)
+            .add("inf", INFINITY)
+            .add("-inf", -INFINITY)
+            .end_object();
+      }).c_str());
+}
+
+void test_nesting() {
+  StringPrint out;
+  JsonWriter json(out);
+  for (int i = 0; i < JsonWriter::kMaxDepth; i++) json.begin_array();
+  for (int i = 0; i < JsonWriter::kMaxDepth; i++) json.end_array();
+  TEST_ASSERT_TRUE(json.ok());
+
+  json.begin_object("too");
+  for (int i = 0; i < JsonWriter::kMaxDepth; i++) json.begin_array();
+  TEST_ASSERT_FALSE(json.ok());
+
+  JsonWriter unbalanced(out);
+  unbalanced.begin_object().end_object().end_object();
+  TEST_ASSERT_FALSE(unbalanced.ok());
+}
+
+void test_measure_matches_write() {
+  for (auto payload : {system_state, discovery}) {
+    MeasuringPrint measure;
+    payload(measure);
+    StringPrint out;
+    payload(out);
+    TEST_ASSERT_EQUAL(out.str().size(), measure.size());
+    TEST_ASSERT_EQUAL_HEX32(fnv1a_32(out.str().c_str()), measure.hash());
+
+    // a record of the measured length takes the whole payload
+    std::string record(measure.size() + 1, '\0');
+    MemoryPrint memory(&record[0], measure.size());
+    payload(memory);
+    TEST_ASSERT_EQUAL(measure.size(), memory.size());
+    TEST_ASSERT_EQUAL_STRING(out.str().c_str(), record.c_str());
+  }
+}
+
+// measured, then written straight into the queued record, as
+// Network::publish() does
+static size_t queue_streamed(PublishQueue& queue,
+                             void (*payload)(Print& out)) {
+  MeasuringPrint measure;
+  payload(measure);
+  TEST_ASSERT_TRUE(queue.push("hb/payload", measure.size(), payload, true));
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  queue.release(record);
+  return measure.size();
+}
+
+#if defined(HAS_ARDUINOJSON)
+static void system_state_doc(JsonDocument& doc) {
+  doc["esp_free_heap"] = 182340u;
+  doc["esp_min_free_heap"] = 150212u;
+  doc["uptime_seconds"] = 3621u;
+  doc["wifi_rssi"] = -67;
+  // IPAddress::toString() gave a String, copied into the document
+  doc["ip_address"] = std::string("192.168.1.50");
+  doc["sw_version"] = SW_VERSION;
+  doc["mqtt_dropped"] = 0u;
+  doc["mqtt_coalesced"] = 3u;
+  doc["mqtt_evt_latency_us"] = 1840u;
+  doc["mqtt_evt_latency_max_us"] = 5120u;
+  doc["nvs_writes"] = 12u;
+  doc["ui_events_dropped"] = 0u;
+  JsonObject suppressed = doc.createNestedObject("suppressed");
+  suppressed["temperature"] = 4u;
+  suppressed["humidity"] = 7u;
+  suppressed["battery"] = 2u;
+  doc["batt_voltage"] = 4.12;
+}
+
+static void discovery_doc(JsonDocument& doc) {
+  doc["atype"] = "trigger";
+  doc["t"] = "homebuttons/Home Buttons a1b2c3/button_1";
+  doc["pl"] = "PRESS";
+  doc["type"] = "button_short_press";
+  doc["stype"] = "button_1";
+  JsonObject dev = doc.createNestedObject("dev");
+  dev.createNestedArray("ids").add("HBTNS-12345678-a1b2c3");
+  dev["mdl"] = "Home Buttons";
+  dev["name"] = "Home Buttons a1b2c3";
+  dev["sw"] = SW_VERSION;
+  dev["hw"] = "2.5";
+  dev["mf"] = "PLab";
+  dev["cu"] = "http://192.168.1.50";
+}
+
+// the document of the firmware had 512 B, the slots are twice as large with
+// 64-bit pointers
+using PayloadDocument = StaticJsonDocument<1024>;
+
+// document, serialized into a stack buffer, then copied into the queue as
+// before the writer
+static size_t queue_document(PublishQueue& queue,
+                             void (*fill)(JsonDocument& doc)) {
+  PayloadDocument doc;
+  fill(doc);
+  char buffer[512];
+  size_t len = serializeJson(doc, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(queue.push("hb/payload", buffer, true));
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  queue.release(record);
+  return len * 2;
+}
+#endif
+
+void test_benchmark_payloads() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  size_t copied = 0;
+  double ns = fake::bench_ns(
+      20000, [&](int) { copied = queue_streamed(queue, system_state); });
+  fake::bench_report("system_state, JsonWriter", ns, copied);
+  ns = fake::bench_ns(
+      20000, [&](int) { copied = queue_streamed(queue, discovery); });
+  fake::bench_report("discovery, JsonWriter", ns, copied);
+
+#if defined(HAS_ARDUINOJSON)
+  // both paths give the same payloads
+  for (auto payload : {std::make_pair(system_state, system_state_doc),
+                       std::make_pair(discovery, discovery_doc)}) {
+    StringPrint out;
+    payload.first(out);
+    PayloadDocument doc;
+    payload.second(doc);
+    TEST_ASSERT_FALSE(doc.overflowed());
+    std::string serialized;
+    serializeJson(doc, serialized);
+    TEST_ASSERT_EQUAL_STRING(serialized.c_str(), out.str().c_str());
+  }
+  ns = fake::bench_ns(
+      20000, [&](int) { copied = queue_document(queue, system_state_doc); });
+  fake::bench_report("system_state, ArduinoJson", ns, copied);
+  ns = fake::bench_ns(
+      20000, [&](int) { copied = queue_document(queue, discovery_doc); });
+  fake::bench_report("discovery, ArduinoJson", ns, copied);
+#else
+  TEST_MESSAGE("ArduinoJson not found, no comparison");
+#endif
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_escaping);
+  RUN_TEST(test_numbers);
+  RUN_TEST(test_nan_and_inf_are_null);
+  RUN_TEST(test_nesting);
+  RUN_TEST(test_measure_matches_write);
+  RUN_TEST(test_benchmark_payloads);
+  return UNITY_END();
+}
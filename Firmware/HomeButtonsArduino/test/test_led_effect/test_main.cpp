@@ -0,0 +1,180 @@
+#include <unity.h>
+
+#include <vector>
+
+#include "button_ui/led_effect.cpp"
+#include "button_ui/leds.cpp"
+#include "power.cpp"
+#include "scheduler.cpp"
+#include "fake_hardware.h"
+
+// LED updates, in the order the hardware got them
+struct LEDCall {
+  uint32_t time;
+  uint8_t level;
+  uint16_t fade_ms;
+};
+static std::vector<LEDCall> calls;
+
+void HardwareDefinition::set_led_pct_num(uint8_t, uint8_t brightness_pct,
+                                         uint16_t fade_time) {
+  calls.push_back({millis(), brightness_pct, fade_time});
+}
+
+static HardwareDefinition hw;
+static LED* led;
+
+static std::vector<uint8_t> levels(const LEDEffect& effect) {
+  LEDEffectPlayer player;
+  LEDKeyframe frame;
+  std::vector<uint8_t> result;
+  player.Start(effect);
+  while (player.Next(frame) && result.size() < 100) {
+    result.push_back(frame.level);
+  }
+  return result;
+}
+
+static void expect_levels(const std::vector<uint8_t>& expected,
+                          const LEDEffect& effect) {
+  std::vector<uint8_t> actual = levels(effect);
+  TEST_ASSERT_EQUAL(expected.size(), actual.size());
+  if (expected.empty()) return;
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), actual.data(),
+                                expected.size());
+}
+
+// every fade ends before the next keyframe starts
+static void expect_fade_margin(const LEDEffect& effect) {
+  for (uint8_t i = 0; i < effect.num_frames; i++) {
+    const LEDKeyframe& frame = effect.frames[i];
+    if (frame.duration_ms > LED_FADE_MARGIN) {
+      TEST_ASSERT_LESS_OR_EQUAL(frame.duration_ms - LED_FADE_MARGIN,
+                                frame.fade_ms);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(LED_DEFAULT_FADE_TIME, frame.fade_ms);
+  }
+}
+
+// runs the LED every ms, like the UI task would when woken
+static void run_until(uint32_t time_ms) {
+  while (millis() < time_ms) {
+    led->Loop();
+    fake::advance_ms(1);
+  }
+}
+
+void setUp() {
+  calls.clear();
+  fake::set_ms(1000);
+  hw.init();
+  led = new LED("L1", 1, hw);
+  led->SetDefaultBrightness(80);
+  led->SetAmbientBrightness(0);
+  led->Init();
+  led->Start();
+  run_until(1010);
+  calls.clear();
+}
+
+void tearDown() { delete led; }
+
+void test_blink_keyframes() {
+  expect_levels({80, 5, 80, 5, 80, 5},
+                LEDEffect::Blink(3, 80, 100, 300, false, 5));
+  // hold ends on
+  expect_levels({80, 5, 80, 5, 80},
+                LEDEffect::Blink(3, 80, 100, 300, true, 5));
+  expect_levels({80}, LEDEffect::Blink(1, 80, 400, 400, true, 5));
+  expect_levels({}, LEDEffect::Blink(0, 80, 400, 400, false, 5));
+}
+
+void test_blink_fades_keep_margin() {
+  expect_fade_margin(LEDEffect::Blink(3, 80, 100, 300, false, 5));
+  // steps shorter than the default fade
+  LEDEffect fast = LEDEffect::Blink(4, 80, 30, 20, false, 0);
+  expect_fade_margin(fast);
+  TEST_ASSERT_EQUAL(25, fast.frames[0].fade_ms);
+  TEST_ASSERT_EQUAL(15, fast.frames[1].fade_ms);
+  TEST_ASSERT_EQUAL(LED_DEFAULT_FADE_TIME,
+                    LEDEffect::Blink(1, 80, 400, 400, false, 0)
+                        .frames[0]
+                        .fade_ms);
+}
+
+void test_pulse_keyframes() {
+  LEDEffect effect = LEDEffect::Pulse(100, 1000);
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < effect.num_frames; i++) {
+    total += effect.frames[i].duration_ms;
+    TEST_ASSERT_LESS_THAN(effect.frames[i].duration_ms,
+                          effect.frames[i].fade_ms);
+  }
+  TEST_ASSERT_EQUAL(1000, total);
+  TEST_ASSERT_EQUAL(50, effect.frames[1].level);
+  TEST_ASSERT_EQUAL(100, effect.frames[3].level);
+  TEST_ASSERT_EQUAL(0, effect.frames[7].level);
+  TEST_ASSERT_TRUE(effect.endless());
+  TEST_ASSERT_EQUAL(100, levels(effect).size());
+
+  // durations that don't divide evenly still add up to the cycle
+  effect = LEDEffect::Pulse(60, 999);
+  total = 0;
+  for (uint8_t i = 0; i < effect.num_frames; i++) {
+    total += effect.frames[i].duration_ms;
+  }
+  TEST_ASSERT_EQUAL(999, total);
+}
+
+void test_blink_timed_from_command() {
+  led->Blink(2);
+  run_until(3000);
+  // on, off, on, off
+  TEST_ASSERT_GREATER_OR_EQUAL(4, calls.size());
+  const uint8_t expected_levels[] = {80, 0, 80, 0};
+  const uint32_t expected_times[] = {0, 100, 400, 500};
+  for (size_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(expected_levels[i], calls[i].level);
+    TEST_ASSERT_UINT32_WITHIN(1, expected_times[i], calls[i].time - 1010);
+  }
+  TEST_ASSERT_TRUE(led->is_current_state<LEDSMStates::IdleState>());
+}
+
+void test_pulse_does_not_drift() {
+  uint32_t start = millis();
+  led->Pulse(100, 1000);
+  run_until(start + 10000 + 5);
+  // 8 keyframes per cycle
+  TEST_ASSERT_EQUAL(81, calls.size());
+  TEST_ASSERT_EQUAL(9000, calls[80].time - calls[8].time);
+  TEST_ASSERT_EQUAL(125, calls[9].time - calls[8].time);
+  for (size_t i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL(calls[i].level, calls[i + 8].level);
+  }
+
+  // a new command ends the pulse
+  calls.clear();
+  led->On();
+  run_until(millis() + 50);
+  TEST_ASSERT_TRUE(led->is_current_state<LEDSMStates::ConstOnState>());
+  TEST_ASSERT_EQUAL(80, calls.back().level);
+}
+
+void test_blink_hold_stays_on() {
+  led->Blink(3, 0, 0, 0, true);
+  run_until(millis() + 3000);
+  TEST_ASSERT_GREATER_OR_EQUAL(5, calls.size());
+  TEST_ASSERT_EQUAL(80, calls[4].level);
+  TEST_ASSERT_TRUE(led->is_current_state<LEDSMStates::ConstOnState>());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blink_keyframes);
+  RUN_TEST(test_blink_fades_keep_margin);
+  RUN_TEST(test_pulse_keyframes);
+  RUN_TEST(test_blink_timed_from_command);
+  RUN_TEST(test_pulse_does_not_drift);
+  RUN_TEST(test_blink_hold_stays_on);
+  return UNITY_END();
+}
@@ -0,0 +1,139 @@
+#include <unity.h>
+
+
+#include "state.cpp"
+#include "fake_hardware.h"
+
+// keys in the "persisted" namespace, see DeviceState::save_persisted()
+static constexpr uint32_t kPersistedKeys = 16;
+
+static HardwareDefinition hw;
+static DeviceState* device_state;
+
+// a cold boot, loads from NVS
+static void boot() {
+  delete device_state;
+  device_state = new DeviceState();
+  device_state->load_all(hw);
+}
+
+void setUp() {
+  fake::nvs.reset();
+  fake::reset_reason = ESP_RST_POWERON;
+  hw.init();
+  device_state = nullptr;
+  boot();
+  device_state->save_all();  // first save writes every key
+  fake::nvs.writes = 0;
+  fake::nvs.opens = 0;
+}
+
+void tearDown() {
+  delete device_state;
+  device_state = nullptr;
+}
+
+void test_unchanged_save_skips_nvs() {
+  uint32_t nvs_writes = device_state->nvs_writes();
+  device_state->save_all();
+  device_state->save_user();
+  device_state->save_persisted();
+  TEST_ASSERT_EQUAL(0, fake::nvs.writes);
+  TEST_ASSERT_EQUAL(0, fake::nvs.opens);
+  TEST_ASSERT_EQUAL(nvs_writes, device_state->nvs_writes());
+}
+
+void test_only_changed_keys_written() {
+  uint32_t nvs_writes = device_state->nvs_writes();
+  device_state->persisted().wifi_done = true;
+  device_state->persisted().failed_connections = 3;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(2, fake::nvs.writes);
+  TEST_ASSERT_EQUAL(1, fake::nvs.opens);
+  TEST_ASSERT_EQUAL(nvs_writes + 2, device_state->nvs_writes());
+
+  // the user preferences are one record
+  device_state->set_sensor_interval(7);
+  device_state->set_device_name(DeviceName("hall"));
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(3, fake::nvs.writes);
+
+  // setting a value back to the saved one is a change too
+  device_state->persisted().wifi_done = false;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(4, fake::nvs.writes);
+}
+
+void test_saved_values_load() {
+  device_state->persisted().setup_done = true;
+  device_state->persisted().failed_connections = 5;
+  device_state->persisted().last_sw_ver.set("v1.2.3");
+  device_state->set_sensor_interval(12);
+  device_state->save_all();
+
+  boot();
+  TEST_ASSERT_TRUE(device_state->persisted().setup_done);
+  TEST_ASSERT_EQUAL(5, device_state->persisted().failed_connections);
+  TEST_ASSERT_EQUAL_STRING("v1.2.3",
+                           device_state->persisted().last_sw_ver.c_str());
+  TEST_ASSERT_EQUAL(12, device_state->sensor_interval());
+
+  // loaded values are in sync with NVS
+  fake::nvs.writes = 0;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(0, fake::nvs.writes);
+}
+
+void test_clear_writes_all_keys() {
+  device_state->clear_persisted();
+  TEST_ASSERT_FALSE(fake::nvs.has("persisted", "wifi_done"));
+  device_state->save_persisted();
+  TEST_ASSERT_EQUAL(kPersistedKeys, fake::nvs.writes);
+  TEST_ASSERT_TRUE(fake::nvs.has("persisted", "wifi_done"));
+
+  fake::nvs.writes = 0;
+  device_state->clear_user();
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(1, fake::nvs.writes);
+}
+
+void test_failed_save_writes_all_keys() {
+  fake::nvs.fail_writes = true;
+  device_state->persisted().wifi_done = true;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(0, fake::nvs.writes);
+
+  // NVS may hold anything now, the next save writes every key
+  fake::nvs.fail_writes = false;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(kPersistedKeys, fake::nvs.writes);
+  fake::nvs.writes = 0;
+  device_state->save_all();
+  TEST_ASSERT_EQUAL(0, fake::nvs.writes);
+}
+
+void test_deep_sleep_wake_skips_nvs() {
+  device_state->persisted().user_awake_mode = true;
+  device_state->set_sensor_interval(9);
+  device_state->save_all();
+  uint32_t nvs_writes = device_state->nvs_writes();
+
+  fake::reset_reason = ESP_RST_DEEPSLEEP;
+  fake::nvs.opens = 0;
+  boot();
+  TEST_ASSERT_EQUAL(0, fake::nvs.opens);
+  TEST_ASSERT_TRUE(device_state->persisted().user_awake_mode);
+  TEST_ASSERT_EQUAL(9, device_state->sensor_interval());
+  TEST_ASSERT_EQUAL(nvs_writes, device_state->nvs_writes());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_unchanged_save_skips_nvs);
+  RUN_TEST(test_only_changed_keys_written);
+  RUN_TEST(test_saved_values_load);
+  RUN_TEST(test_clear_writes_all_keys);
+  RUN_TEST(test_failed_save_writes_all_keys);
+  RUN_TEST(test_deep_sleep_wake_skips_nvs);
+  return UNITY_END();
+}
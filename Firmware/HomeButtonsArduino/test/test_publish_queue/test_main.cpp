@@ -0,0 +1,248 @@
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "publish_queue.cpp"
+#include "bench.h"
+#include "config.h"
+
+// footprint of the queue PublishQueue replaced: 4 x {TopicType, PayloadType,
+// bool}
+static constexpr size_t OLD_QUEUE_BYTES =
+    4 * ((MAX_TOPIC_LENGTH + 1) + (MQTT_PYLD_SIZE + 1) + 1);
+
+static void push_ok(PublishQueue& queue, const char* topic,
+                    const char* payload, bool retained = false) {
+  TEST_ASSERT_TRUE(queue.push(topic, payload, retained));
+}
+
+static void pop_expect(PublishQueue& queue, const char* topic,
+                       const char* payload) {
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_EQUAL_STRING(topic, record.topic);
+  TEST_ASSERT_EQUAL_STRING(payload, record.payload);
+  queue.release(record);
+}
+
+void setUp() { fake::time_us = 0; }
+
+void tearDown() {}
+
+void test_push_pop_in_order() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  TEST_ASSERT_TRUE(queue.valid());
+
+  push_ok(queue, "hb/a", "1", true);
+  fake::advance_ms(5);
+  push_ok(queue, "hb/b", "2");
+  TEST_ASSERT_EQUAL(2, queue.waiting());
+
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_EQUAL_STRING("hb/a", record.topic);
+  TEST_ASSERT_EQUAL_STRING("1", record.payload);
+  TEST_ASSERT_TRUE(record.retained);
+  TEST_ASSERT_EQUAL_UINT32(0, record.queued_us);
+  queue.release(record);
+
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_EQUAL_STRING("hb/b", record.topic);
+  TEST_ASSERT_FALSE(record.retained);
+  TEST_ASSERT_EQUAL_UINT32(5000, record.queued_us);
+  queue.release(record);
+
+  TEST_ASSERT_FALSE(queue.pop(record));
+  TEST_ASSERT_EQUAL(0, queue.waiting());
+}
+
+void test_tracked_record_carries_hash() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  TEST_ASSERT_TRUE(queue.push_tracked("hb/state", "ON", fnv1a_32("ON")));
+  push_ok(queue, "hb/plain", "1", true);
+
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_TRUE(record.retained);
+  TEST_ASSERT_TRUE(record.tracked);
+  TEST_ASSERT_EQUAL_HEX32(fnv1a_32("ON"), record.payload_hash);
+  queue.release(record);
+
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_TRUE(record.retained);
+  TEST_ASSERT_FALSE(record.tracked);
+  queue.release(record);
+}
+
+void test_streamed_payload() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  const char* payload = "{\"temperature\":21.5}";
+  TEST_ASSERT_TRUE(queue.push(
+      "hb/sensor", strlen(payload),
+      [payload](Print& out) { out.write(payload); }, false));
+  pop_expect(queue, "hb/sensor", payload);
+}
+
+void test_streamed_tracked_record() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  const char* payload = "{\"age_s\":[600,0]}";
+  TEST_ASSERT_TRUE(queue.push_tracked(
+      "hb/sensor_log", strlen(payload),
+      [payload](Print& out) { out.write(payload); }, fnv1a_32(payload)));
+
+  PublishQueue::Record record;
+  TEST_ASSERT_TRUE(queue.pop(record));
+  TEST_ASSERT_EQUAL_STRING(payload, record.payload);
+  TEST_ASSERT_FALSE(record.retained);
+  TEST_ASSERT_TRUE(record.tracked);
+  TEST_ASSERT_EQUAL_HEX32(fnv1a_32(payload), record.payload_hash);
+  queue.release(record);
+}
+
+void test_wraps_around() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  // records of varying size, several times the pool, always 3 in flight
+  std::vector<std::string> payloads;
+  for (int i = 0; i < 200; i++) {
+    payloads.push_back(std::string(10 + (i * 37) % 300, 'a' + i % 26));
+  }
+  size_t pushed = 0;
+  size_t popped = 0;
+  while (popped < payloads.size()) {
+    while (pushed < payloads.size() && pushed - popped < 3) {
+      std::string topic = "hb/t" + std::to_string(pushed);
+      push_ok(queue, topic.c_str(), payloads[pushed].c_str());
+      pushed++;
+    }
+    std::string topic = "hb/t" + std::to_string(popped);
+    pop_expect(queue, topic.c_str(), payloads[popped].c_str());
+    popped++;
+  }
+  TEST_ASSERT_EQUAL(0, queue.dropped());
+  TEST_ASSERT_EQUAL(0, queue.waiting());
+}
+
+void test_full_pool_drops() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  std::string payload(200, 'x');
+  size_t count = 0;
+  while (queue.push("hb/full", payload.c_str(), false)) count++;
+  TEST_ASSERT_GREATER_THAN(8, count);
+  TEST_ASSERT_EQUAL(1, queue.dropped());
+
+  // space is back once the oldest record is released
+  pop_expect(queue, "hb/full", payload.c_str());
+  push_ok(queue, "hb/full", payload.c_str());
+  TEST_ASSERT_EQUAL(count, queue.waiting());
+}
+
+void test_largest_record_fits() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  std::string topic(MAX_TOPIC_LENGTH, 't');
+  std::string payload(MQTT_PYLD_SIZE, 'p');
+  push_ok(queue, topic.c_str(), payload.c_str());
+  push_ok(queue, topic.c_str(), payload.c_str());
+  pop_expect(queue, topic.c_str(), payload.c_str());
+  pop_expect(queue, topic.c_str(), payload.c_str());
+
+  // too large for any pool is dropped, not truncated
+  std::string huge(MQTT_PUBLISH_QUEUE_SIZE, 'h');
+  TEST_ASSERT_FALSE(queue.push("hb/huge", huge.c_str(), false));
+  TEST_ASSERT_EQUAL(1, queue.dropped());
+}
+
+void test_coalesces_same_topic() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, true);
+  push_ok(queue, "hb/a", "1");
+  push_ok(queue, "hb/b", "1");
+  push_ok(queue, "hb/a", "2");
+  push_ok(queue, "hb/a", "3");
+
+  pop_expect(queue, "hb/b", "1");
+  pop_expect(queue, "hb/a", "3");
+  PublishQueue::Record record;
+  TEST_ASSERT_FALSE(queue.pop(record));
+  TEST_ASSERT_EQUAL(2, queue.coalesced());
+
+  // the slot is free again once nothing is queued on the topic
+  push_ok(queue, "hb/a", "4");
+  pop_expect(queue, "hb/a", "4");
+  TEST_ASSERT_EQUAL(2, queue.coalesced());
+}
+
+void test_hash_collision_not_coalesced() {
+  // different topics with the same FNV-1a hash
+  const char* topic_a = "hb/t31899";
+  const char* topic_b = "hb/t120740";
+  TEST_ASSERT_EQUAL_HEX32(fnv1a_32(topic_a), fnv1a_32(topic_b));
+
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, true);
+  push_ok(queue, topic_a, "1");
+  push_ok(queue, topic_b, "2");
+  push_ok(queue, topic_a, "3");
+  pop_expect(queue, topic_b, "2");
+  pop_expect(queue, topic_a, "3");
+  TEST_ASSERT_EQUAL(1, queue.coalesced());
+}
+
+void test_no_coalescing_keeps_all() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  push_ok(queue, "hb/a", "1");
+  push_ok(queue, "hb/a", "2");
+  pop_expect(queue, "hb/a", "1");
+  pop_expect(queue, "hb/a", "2");
+  TEST_ASSERT_EQUAL(0, queue.coalesced());
+}
+
+void test_ram_budget() {
+  TEST_ASSERT_LESS_OR_EQUAL(OLD_QUEUE_BYTES,
+                            MQTT_EVENT_QUEUE_SIZE + MQTT_PUBLISH_QUEUE_SIZE);
+
+  // typical state message: 48 B topic, 8 B payload
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, false);
+  std::string topic(48, 't');
+  size_t count = 0;
+  while (queue.push(topic.c_str(), "12345678", false)) count++;
+  size_t record_bytes = MQTT_PUBLISH_QUEUE_SIZE / count;
+  TEST_ASSERT_LESS_OR_EQUAL(48 + 8 + 32, record_bytes);
+
+  char message[96];
+  snprintf(message, sizeof(message),
+           "%zu B per state message, %zu fit in %zu B (old queue: 4 in %zu B)",
+           record_bytes, count, MQTT_PUBLISH_QUEUE_SIZE, OLD_QUEUE_BYTES);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_GREATER_OR_EQUAL(25, count);
+}
+
+void test_benchmark_push_pop() {
+  PublishQueue queue(MQTT_PUBLISH_QUEUE_SIZE, true);
+  const char* topics[] = {"homebuttons/abc/btn_1", "homebuttons/abc/btn_2",
+                          "homebuttons/abc/temperature"};
+  double ns = fake::bench_ns(100000, [&](int i) {
+    queue.push(topics[i % 3], "PRESS", false);
+    if (i % 4 == 3) {
+      PublishQueue::Record record;
+      while (queue.pop(record)) queue.release(record);
+    }
+  });
+  fake::bench_report("push + pop", ns);
+  TEST_ASSERT_EQUAL(0, queue.dropped());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_pop_in_order);
+  RUN_TEST(test_tracked_record_carries_hash);
+  RUN_TEST(test_streamed_payload);
+  RUN_TEST(test_streamed_tracked_record);
+  RUN_TEST(test_wraps_around);
+  RUN_TEST(test_full_pool_drops);
+  RUN_TEST(test_largest_record_fits);
+  RUN_TEST(test_coalesces_same_topic);
+  RUN_TEST(test_hash_collision_not_coalesced);
+  RUN_TEST(test_no_coalescing_keeps_all);
+  RUN_TEST(test_ram_budget);
+  RUN_TEST(test_benchmark_push_pop);
+  return UNITY_END();
+}
@@ -0,0 +1,84 @@
+#include <unity.h>
+
+#include "retained_ledger.cpp"
+
+static RetainedLedger ledger;
+
+// what the network task does once a staged payload was sent
+static void sent(const char* topic, const char* payload) {
+  ledger.update_hash(topic, fnv1a_32(payload));
+}
+
+void setUp() { ledger.clear(); }
+
+void tearDown() {}
+
+void test_first_publish_goes_out() {
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("1")));
+  sent("hb/a", "1");
+  TEST_ASSERT_FALSE(ledger.stage("hb/a", fnv1a_32("1")));
+  TEST_ASSERT_EQUAL(1, ledger.size());
+}
+
+void test_unsent_payload_not_recorded() {
+  // queued, then dropped on sleep or disconnect before it was sent
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("1")));
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("1")));
+  TEST_ASSERT_EQUAL(0, ledger.size());
+}
+
+void test_change_back_before_send() {
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("A")));
+  sent("hb/a", "A");
+  // B is queued, then A again before B was sent: A must not be skipped
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("B")));
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("A")));
+  sent("hb/a", "B");
+  sent("hb/a", "A");
+  TEST_ASSERT_FALSE(ledger.stage("hb/a", fnv1a_32("A")));
+}
+
+void test_forget_and_clear() {
+  sent("hb/a", "1");
+  sent("hb/b", "2");
+  ledger.forget("hb/a");
+  TEST_ASSERT_TRUE(ledger.stage("hb/a", fnv1a_32("1")));
+  TEST_ASSERT_FALSE(ledger.stage("hb/b", fnv1a_32("2")));
+  ledger.clear();
+  TEST_ASSERT_TRUE(ledger.stage("hb/b", fnv1a_32("2")));
+}
+
+void test_full_table_keeps_publishing() {
+  char topic[16];
+  for (size_t i = 0; i < MQTT_RETAINED_LEDGER_SIZE + 4; i++) {
+    snprintf(topic, sizeof(topic), "hb/t%zu", i);
+    sent(topic, "x");
+  }
+  TEST_ASSERT_EQUAL(MQTT_RETAINED_LEDGER_SIZE, ledger.size());
+  // not recorded, so never skipped
+  TEST_ASSERT_TRUE(ledger.stage(topic, fnv1a_32("x")));
+}
+
+void test_corrupt_table_reset() {
+  sent("hb/a", "1");
+  sent("hb/b", "2");
+  ledger.forget("hb/a");
+  sent("hb/b", "3");
+  // the check follows every change
+  TEST_ASSERT_EQUAL_HEX32(table_check(), table.check);
+
+  table.entries[0].payload_hash ^= 1;
+  RetainedLedger reloaded;
+  TEST_ASSERT_EQUAL(0, reloaded.size());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_publish_goes_out);
+  RUN_TEST(test_unsent_payload_not_recorded);
+  RUN_TEST(test_change_back_before_send);
+  RUN_TEST(test_forget_and_clear);
+  RUN_TEST(test_full_table_keeps_publishing);
+  RUN_TEST(test_corrupt_table_reset);
+  return UNITY_END();
+}
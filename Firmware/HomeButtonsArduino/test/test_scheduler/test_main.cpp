@@ -0,0 +1,102 @@
+#include <unity.h>
+
+#include "scheduler.cpp"
+
+static constexpr uint32_t kPollMs = 10;
+static constexpr uint32_t kIdleMs = 1000;
+
+void setUp() {
+  fake::set_ms(5000);
+  fake::task_notifications = 0;
+  fake::notify_wait_ticks = 0;
+}
+
+void tearDown() {}
+
+void test_idle_without_deadline() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  TEST_ASSERT_EQUAL_UINT32(kIdleMs, scheduler.next_wait(millis()));
+}
+
+void test_earliest_deadline() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  scheduler.wake_at(5500);
+  scheduler.wake_at(5200);
+  scheduler.wake_at(5800);
+  TEST_ASSERT_EQUAL_UINT32(200, scheduler.next_wait(millis()));
+  // deadlines are cleared by next_wait()
+  TEST_ASSERT_EQUAL_UINT32(kIdleMs, scheduler.next_wait(millis()));
+}
+
+void test_deadline_in_the_past() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  scheduler.wake_at(4000);
+  scheduler.wake_in(300);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.next_wait(millis()));
+}
+
+void test_wraparound() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  uint32_t now = UINT32_MAX - 99;
+  fake::set_ms(now);
+  // 0x100 after the wrap is later than now + 50 before it
+  scheduler.wake_in(0x200);
+  scheduler.wake_at(now + 50);
+  TEST_ASSERT_EQUAL_UINT32(50, scheduler.next_wait(now));
+
+  scheduler.wake_in(0x200);
+  TEST_ASSERT_EQUAL_UINT32(0x200, scheduler.next_wait(now));
+
+  // a deadline just before the wrap has passed once the clock wrapped
+  scheduler.wake_at(now + 10);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.next_wait(now + 200));
+}
+
+void test_one_wakeup_per_pass() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  scheduler.bind();
+  // every component registers its deadline, the task wakes once for the
+  // earliest
+  scheduler.wake_in(250);
+  scheduler.poll();
+  scheduler.wake_in(40);
+  scheduler.wait();
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.wakeups());
+  TEST_ASSERT_EQUAL_UINT32(pdMS_TO_TICKS(kPollMs), fake::notify_wait_ticks);
+
+  scheduler.wait();
+  TEST_ASSERT_EQUAL_UINT32(2, scheduler.wakeups());
+  TEST_ASSERT_EQUAL_UINT32(pdMS_TO_TICKS(kIdleMs), fake::notify_wait_ticks);
+}
+
+void test_notify_wakes_bound_task() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  scheduler.notify();  // not bound yet, dropped
+  TEST_ASSERT_EQUAL_UINT32(0, fake::task_notifications);
+
+  scheduler.bind();
+  scheduler.notify();
+  scheduler.notify_from_isr();
+  TEST_ASSERT_EQUAL_UINT32(2, fake::task_notifications);
+  scheduler.wait();
+  TEST_ASSERT_EQUAL_UINT32(0, fake::task_notifications);
+}
+
+void test_unbound_wait_delays() {
+  Scheduler scheduler(kPollMs, kIdleMs);
+  scheduler.wake_in(75);
+  scheduler.wait();
+  TEST_ASSERT_EQUAL_UINT32(5075, millis());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_without_deadline);
+  RUN_TEST(test_earliest_deadline);
+  RUN_TEST(test_deadline_in_the_past);
+  RUN_TEST(test_wraparound);
+  RUN_TEST(test_one_wakeup_per_pass);
+  RUN_TEST(test_notify_wakes_bound_task);
+  RUN_TEST(test_unbound_wait_delays);
+  return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "spsc_queue.h"
+#include "user_input.h"
+
+// same queue and event as App::ui_events_
+using EventQueue = SpscQueue<UserInput::Event, 16>;
+
+// the sequence number is spread over fields that are checked on arrival
+static UserInput::Event make_event(uint8_t producer, uint32_t seq) {
+  UserInput::Event event;
+  event.type = UserInput::EventType::kClickSingle;
+  event.point.x = seq >> 16;
+  event.point.y = seq & 0xffff;
+  event.btn_id = producer;
+  event.final = seq & 1;
+  return event;
+}
+
+static uint32_t event_seq(const UserInput::Event& event) {
+  return static_cast<uint32_t>(event.point.x) << 16 |
+         static_cast<uint16_t>(event.point.y);
+}
+
+struct Received {
+  uint32_t count = 0;
+  uint32_t last = 0;
+  bool in_order = true;
+};
+
+// pops until the producers are done and the queue is empty, checks the
+// order of the events of each producer
+static void consume(EventQueue& queue, std::atomic<bool>& done,
+                    std::vector<Received>& received) {
+  UserInput::Event event;
+  while (true) {
+    bool was_done = done.load();
+    while (queue.pop(event)) {
+      Received& r = received[event.btn_id];
+      uint32_t seq = event_seq(event);
+      if ((r.count > 0 && seq <= r.last) || event.final != (seq & 1)) {
+        r.in_order = false;
+      }
+      r.last = seq;
+      r.count++;
+    }
+    if (was_done) break;
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_push_pop_in_order() {
+  EventQueue queue;
+  UserInput::Event event;
+  TEST_ASSERT_NULL(queue.peek());
+  TEST_ASSERT_FALSE(queue.pop(event));
+
+  for (uint32_t i = 1; i <= 3; i++) {
+    TEST_ASSERT_TRUE(queue.push(make_event(0, i)));
+  }
+  TEST_ASSERT_EQUAL(3, queue.size());
+  TEST_ASSERT_EQUAL(1, event_seq(*queue.peek()));
+  for (uint32_t i = 1; i <= 3; i++) {
+    TEST_ASSERT_TRUE(queue.pop(event));
+    TEST_ASSERT_EQUAL(i, event_seq(event));
+  }
+  TEST_ASSERT_EQUAL(0, queue.size());
+}
+
+void test_full_drops_newest() {
+  EventQueue queue;
+  for (uint32_t i = 0; i < 20; i++) queue.push(make_event(0, i));
+  TEST_ASSERT_EQUAL(16, queue.size());
+  TEST_ASSERT_EQUAL(4, queue.dropped());
+  UserInput::Event event;
+  TEST_ASSERT_TRUE(queue.pop(event));
+  TEST_ASSERT_EQUAL(0, event_seq(event));
+}
+
+void test_clear() {
+  EventQueue queue;
+  for (uint32_t i = 0; i < 5; i++) queue.push(make_event(0, i));
+  queue.clear();
+  TEST_ASSERT_EQUAL(0, queue.size());
+  TEST_ASSERT_TRUE(queue.push(make_event(0, 9)));
+  UserInput::Event event;
+  TEST_ASSERT_TRUE(queue.pop(event));
+  TEST_ASSERT_EQUAL(9, event_seq(event));
+}
+
+void test_threads_single_producer() {
+  constexpr uint32_t kEvents = 200000;
+  // flooding, and paced so the queue rarely fills
+  for (int paced = 0; paced < 2; paced++) {
+    EventQueue queue;
+    std::atomic<bool> done{false};
+    std::vector<Received> received(1);
+    std::thread consumer(consume, std::ref(queue), std::ref(done),
+                         std::ref(received));
+    for (uint32_t i = 1; i <= kEvents; i++) {
+      queue.push(make_event(0, i));
+      if (paced && (i & 15) == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      }
+    }
+    done = true;
+    consumer.join();
+    TEST_ASSERT_TRUE(received[0].in_order);
+    TEST_ASSERT_EQUAL(kEvents, received[0].count + queue.dropped());
+    TEST_ASSERT_EQUAL(0, queue.size());
+  }
+}
+
+void test_threads_producers_serialized() {
+  // UI, main and network tasks push through App::_post_ui_event()
+  constexpr uint8_t kProducers = 3;
+  constexpr uint32_t kEvents = 100000;
+  EventQueue queue;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  std::atomic<bool> done{false};
+  std::vector<Received> received(kProducers);
+  std::thread consumer(consume, std::ref(queue), std::ref(done),
+                       std::ref(received));
+  std::vector<std::thread> producers;
+  for (uint8_t p = 0; p < kProducers; p++) {
+    producers.emplace_back([&queue, &mux, p] {
+      for (uint32_t i = 1; i <= kEvents; i++) {
+        portENTER_CRITICAL(&mux);
+        queue.push(make_event(p, i));
+        portEXIT_CRITICAL(&mux);
+      }
+    });
+  }
+  for (auto& producer : producers) producer.join();
+  done = true;
+  consumer.join();
+
+  uint32_t total = 0;
+  for (const Received& r : received) {
+    TEST_ASSERT_TRUE(r.in_order);
+    total += r.count;
+  }
+  TEST_ASSERT_EQUAL(kProducers * kEvents, total + queue.dropped());
+  TEST_ASSERT_EQUAL(0, queue.size());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_pop_in_order);
+  RUN_TEST(test_full_drops_newest);
+  RUN_TEST(test_clear);
+  RUN_TEST(test_threads_single_producer);
+  RUN_TEST(test_threads_producers_serialized);
+  return UNITY_END();
+}
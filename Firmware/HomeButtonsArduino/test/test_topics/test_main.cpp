@@ -0,0 +1,204 @@
+#include <unity.h>
+
+#include <cstring>
+#include <set>
+#include <string>
+
+#include "state.cpp"
+#include "topics.cpp"
+#include "bench.h"
+#include "fake_hardware.h"
+
+static HardwareDefinition hw;
+static DeviceState* device_state;
+static TopicHelper* topics;
+
+void setUp() {
+  fake::nvs.reset();
+  hw.init();
+  device_state = new DeviceState();
+  device_state->load_all(hw);
+  topics = new TopicHelper(*device_state);
+}
+
+void tearDown() {
+  delete topics;
+  delete device_state;
+}
+
+void test_default_topics() {
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/",
+                           topics->t_common());
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/cmd/",
+                           topics->t_cmd());
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/temperature",
+                           topics->t_temperature());
+  TEST_ASSERT_EQUAL_STRING("homeassistant/status", topics->t_ha_status());
+  TEST_ASSERT_EQUAL_STRING(
+      "homeassistant/device/HBTNS-12345678-a1b2c3/config",
+      topics->t_device_config());
+}
+
+void test_button_topics() {
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/button_1",
+                           topics->t_btn_press(1));
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/button_2_double",
+                           topics->t_btn_double_press(2));
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/button_3_triple",
+                           topics->t_btn_triple_press(3));
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/button_4_quad",
+                           topics->t_btn_quad_press(4));
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/cmd/switch_6",
+                           topics->t_switch_cmd(NUM_BUTTONS));
+  TEST_ASSERT_EQUAL_STRING(
+      "homeassistant/device_automation/HBTNS-12345678-a1b2c3/button_5_quad/"
+      "config",
+      topics->t_btn_quad_config(5));
+}
+
+void test_button_index_out_of_range() {
+  TEST_ASSERT_EQUAL_STRING("", topics->t_btn_press(0));
+  TEST_ASSERT_EQUAL_STRING("", topics->t_btn_label_cmd(NUM_BUTTONS + 1));
+  UserInput::Event event;
+  event.type = UserInput::EventType::kClickSingle;
+  event.btn_id = NUM_BUTTONS + 1;
+  TEST_ASSERT_EQUAL_STRING("", topics->get_button_topic(event));
+}
+
+void test_event_topics() {
+  UserInput::Event event;
+  event.btn_id = 2;
+  event.type = UserInput::EventType::kClickSingle;
+  TEST_ASSERT_EQUAL_PTR(topics->t_btn_press(2),
+                        topics->get_button_topic(event));
+  event.type = UserInput::EventType::kClickQuad;
+  TEST_ASSERT_EQUAL_PTR(topics->t_btn_quad_press(2),
+                        topics->get_button_topic(event));
+  event.type = UserInput::EventType::kSwitchOff;
+  TEST_ASSERT_EQUAL_PTR(topics->t_switch_state(2),
+                        topics->get_button_topic(event));
+  event.type = UserInput::EventType::kHoldLong2s;
+  TEST_ASSERT_EQUAL_STRING("", topics->get_button_topic(event));
+}
+
+void test_topics_are_interned() {
+  // same pointer on every call while the settings don't change
+  const char* first = topics->t_btn_label_cmd(1);
+  TEST_ASSERT_EQUAL_PTR(first, topics->t_btn_label_cmd(1));
+  device_state->set_sensor_interval(5);
+  TEST_ASSERT_EQUAL_PTR(first, topics->t_btn_label_cmd(1));
+}
+
+void test_rebuilt_when_name_changes() {
+  TEST_ASSERT_EQUAL_STRING("homebuttons/Home Buttons a1b2c3/available",
+                           topics->t_avlb());
+  device_state->set_device_name(DeviceName("kitchen"));
+  TEST_ASSERT_EQUAL_STRING("homebuttons/kitchen/available", topics->t_avlb());
+  device_state->set_mqtt_parameters("broker", 1883, "", "", "hb", "ha");
+  TEST_ASSERT_EQUAL_STRING("hb/kitchen/available", topics->t_avlb());
+  TEST_ASSERT_EQUAL_STRING("ha/status", topics->t_ha_status());
+}
+
+void test_button_topics_unique() {
+  std::set<std::string> seen;
+  for (uint8_t id = 1; id <= NUM_BUTTONS; id++) {
+    const char* button_topics[] = {
+        topics->t_btn_press(id),         topics->t_btn_double_press(id),
+        topics->t_btn_triple_press(id),  topics->t_btn_quad_press(id),
+        topics->t_btn_label_state(id),   topics->t_btn_label_cmd(id),
+        topics->t_switch_state(id),      topics->t_switch_cmd(id),
+        topics->t_btn_config(id),        topics->t_btn_double_config(id),
+        topics->t_btn_triple_config(id), topics->t_btn_quad_config(id),
+        topics->t_switch_config(id),     topics->t_kill_switch_config(id),
+        topics->t_btn_label_config(id)};
+    for (const char* topic : button_topics) {
+      TEST_ASSERT_TRUE_MESSAGE(seen.insert(topic).second, topic);
+    }
+  }
+}
+
+// topics looked up on a button wake: the event, the subscriptions and the
+// messages published on connect
+static size_t wake_lookups(const TopicHelper& t) {
+  const char* wake[] = {t.t_btn_press(1),
+                        t.t_cmd(),
+                        t.t_ha_status(),
+                        t.t_disp_msg_state(),
+                        t.t_avlb(),
+                        t.t_btn_conf_state(),
+                        t.t_awake_mode_state(),
+                        t.t_sensor_interval_state(),
+                        t.t_sensor_batch_state(),
+                        t.t_report_config_state(),
+                        t.t_temperature(),
+                        t.t_humidity(),
+                        t.t_battery(),
+                        t.t_system_state(),
+                        t.t_wake_metrics()};
+  size_t total = 0;
+  for (const char* topic : wake) total += strlen(topic);
+  for (uint8_t id = 1; id <= NUM_BUTTONS; id++) {
+    total += strlen(t.t_btn_label_state(id));
+  }
+  return total;
+}
+
+// the same lookups built on demand, as before the topic table
+static size_t wake_lookups_on_demand(const DeviceState& state) {
+  auto common = [&state]() {
+    return TopicType(state.user_preferences().mqtt.base_topic.c_str()) +
+           "/" + state.user_preferences().device_name.c_str() + "/";
+  };
+  TopicType wake[] = {
+      common() + "button_" + 1,
+      common() + "cmd/",
+      TopicType("%s/status",
+                state.user_preferences().mqtt.discovery_prefix.c_str()),
+      common() + "disp_msg",
+      common() + "available",
+      common() + "btn_conf",
+      common() + "awake_mode",
+      common() + "sensor_interval",
+      common() + "sensor_batch",
+      common() + "report_config",
+      common() + "temperature",
+      common() + "humidity",
+      common() + "battery",
+      common() + "system_state",
+      common() + "wake_metrics"};
+  size_t total = 0;
+  for (const TopicType& topic : wake) total += topic.length();
+  for (uint8_t id = 1; id <= NUM_BUTTONS; id++) {
+    total += (common() + "btn_" + id + "_label").length();
+  }
+  return total;
+}
+
+void test_benchmark_wake() {
+  // a new TopicHelper builds the whole table on its first lookup
+  size_t table_total = 0;
+  double table_ns = fake::bench_ns(20000, [&](int) {
+    TopicHelper wake_topics(*device_state);
+    table_total += wake_lookups(wake_topics);
+  });
+  size_t on_demand_total = 0;
+  double on_demand_ns = fake::bench_ns(20000, [&](int) {
+    on_demand_total += wake_lookups_on_demand(*device_state);
+  });
+  fake::bench_report("wake, table rebuild + lookups", table_ns);
+  fake::bench_report("wake, topics built on demand", on_demand_ns);
+  TEST_ASSERT_EQUAL(on_demand_total, table_total);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_default_topics);
+  RUN_TEST(test_button_topics);
+  RUN_TEST(test_button_index_out_of_range);
+  RUN_TEST(test_event_topics);
+  RUN_TEST(test_topics_are_interned);
+  RUN_TEST(test_rebuilt_when_name_changes);
+  RUN_TEST(test_button_topics_unique);
+  RUN_TEST(test_benchmark_wake);
+  return UNITY_END();
+}
@@ -0,0 +1,214 @@
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "state.cpp"
+#include "fake_hardware.h"
+
+using Bytes = std::vector<uint8_t>;
+
+static HardwareDefinition hw;
+static DeviceState* device_state;
+
+// a cold boot, loads from NVS
+static void boot() {
+  delete device_state;
+  device_state = new DeviceState();
+  device_state->load_all(hw);
+}
+
+static Bytes& stored_record() { return fake::nvs.namespaces["user"]["prefs"]; }
+
+// record header: uint16_t version, uint16_t size
+static void set_record_size(Bytes& record, uint16_t size) {
+  memcpy(record.data() + 2, &size, sizeof(size));
+}
+
+static void put_string(const char* key, const char* value) {
+  fake::nvs.namespaces["user"][key].assign(value, value + strlen(value) + 1);
+}
+
+static void put_uint(const char* key, uint32_t value) {
+  auto bytes = reinterpret_cast<const uint8_t*>(&value);
+  fake::nvs.namespaces["user"][key].assign(bytes, bytes + sizeof(value));
+}
+
+static void put_bool(const char* key, bool value) {
+  fake::nvs.namespaces["user"][key].assign(1, value);
+}
+
+static void change_settings() {
+  device_state->set_device_name(DeviceName("hall"));
+  device_state->set_btn_label(2, "Lights");
+  device_state->set_sensor_interval(12);
+  device_state->set_temp_unit(StaticString<1>("F"));
+  device_state->set_mqtt_parameters("broker.lan", 8883, "hb", "secret", "base",
+                                    "ha");
+  device_state->set_static_ip_config(
+      SSIDType("wlan"), IPAddress(192, 168, 1, 9), IPAddress(192, 168, 1, 1),
+      IPAddress(255, 255, 255, 0));
+  device_state->set_sensor_batch(4);
+  device_state->set_report_heartbeat(120);
+}
+
+static void expect_changed_settings() {
+  const auto& u = device_state->user_preferences();
+  TEST_ASSERT_EQUAL_STRING("hall", u.device_name.c_str());
+  TEST_ASSERT_EQUAL_STRING("Lights", device_state->get_btn_label(2).c_str());
+  TEST_ASSERT_EQUAL_STRING("mdi:numeric-1",
+                           device_state->get_btn_label(1).c_str());
+  TEST_ASSERT_EQUAL(12, device_state->sensor_interval());
+  TEST_ASSERT_TRUE(device_state->get_use_fahrenheit());
+  TEST_ASSERT_EQUAL_STRING("broker.lan", u.mqtt.server.c_str());
+  TEST_ASSERT_EQUAL(8883, u.mqtt.port);
+  TEST_ASSERT_EQUAL_STRING("secret", u.mqtt.password.c_str());
+  TEST_ASSERT_EQUAL_STRING("ha", u.mqtt.discovery_prefix.c_str());
+  TEST_ASSERT_EQUAL_STRING("wlan", u.network.ssid.c_str());
+  TEST_ASSERT_TRUE(u.network.static_ip == IPAddress(192, 168, 1, 9));
+  TEST_ASSERT_TRUE(u.network.subnet == IPAddress(255, 255, 255, 0));
+}
+
+void setUp() {
+  fake::nvs.reset();
+  fake::reset_reason = ESP_RST_POWERON;
+  hw.init();
+  device_state = nullptr;
+}
+
+void tearDown() {
+  delete device_state;
+  device_state = nullptr;
+}
+
+void test_defaults_without_record() {
+  boot();
+  TEST_ASSERT_EQUAL_STRING("Home Buttons a1b2c3",
+                           device_state->device_name().c_str());
+  TEST_ASSERT_EQUAL(SEN_INTERVAL_DFLT, device_state->sensor_interval());
+  TEST_ASSERT_EQUAL(SENSOR_BATCH_DFLT, device_state->sensor_batch());
+  TEST_ASSERT_EQUAL(REPORT_HEARTBEAT_DFLT, device_state->report_heartbeat());
+  TEST_ASSERT_EQUAL(MQTT_PORT_DFLT,
+                    device_state->user_preferences().mqtt.port);
+}
+
+void test_round_trip() {
+  boot();
+  change_settings();
+  fake::nvs.writes = 0;
+  device_state->save_user();
+  TEST_ASSERT_EQUAL(1, fake::nvs.writes);
+  // one key for all user preferences
+  TEST_ASSERT_EQUAL(1, fake::nvs.namespaces["user"].size());
+
+  boot();
+  expect_changed_settings();
+  TEST_ASSERT_EQUAL(4, device_state->sensor_batch());
+  TEST_ASSERT_EQUAL(120, device_state->report_heartbeat());
+}
+
+void test_legacy_keys_migrated() {
+  put_string("device_name", "porch");
+  put_string("mqtt_srv", "10.0.0.2");
+  put_uint("mqtt_port", 1884);
+  put_uint("sen_itv", 15);
+  put_bool("use_f", true);
+  put_string("btn3_txt", "Fan");
+  put_string("sta_ip", "10.0.0.50");
+
+  boot();
+  const auto& u = device_state->user_preferences();
+  TEST_ASSERT_EQUAL_STRING("porch", u.device_name.c_str());
+  TEST_ASSERT_EQUAL_STRING("10.0.0.2", u.mqtt.server.c_str());
+  TEST_ASSERT_EQUAL(1884, u.mqtt.port);
+  TEST_ASSERT_EQUAL(15, device_state->sensor_interval());
+  TEST_ASSERT_TRUE(device_state->get_use_fahrenheit());
+  TEST_ASSERT_EQUAL_STRING("Fan", device_state->get_btn_label(3).c_str());
+  TEST_ASSERT_TRUE(u.network.static_ip == IPAddress(10, 0, 0, 50));
+  // fields without a legacy key get their defaults
+  TEST_ASSERT_EQUAL(SENSOR_BATCH_DFLT, device_state->sensor_batch());
+
+  // the keys are replaced by the record
+  TEST_ASSERT_EQUAL(1, fake::nvs.namespaces["user"].size());
+  TEST_ASSERT_TRUE(fake::nvs.has("user", "prefs"));
+
+  boot();
+  TEST_ASSERT_EQUAL_STRING("porch", device_state->device_name().c_str());
+  TEST_ASSERT_EQUAL_STRING("Fan", device_state->get_btn_label(3).c_str());
+  TEST_ASSERT_EQUAL(1884, device_state->user_preferences().mqtt.port);
+}
+
+void test_older_record_keeps_defaults() {
+  boot();
+  change_settings();
+  device_state->save_user();
+  Bytes record = stored_record();
+
+  // the sensor batch is the first field after the fields of the first
+  // record version, find it from the bytes that change with it
+  device_state->set_sensor_batch(5);
+  device_state->save_user();
+  size_t batch_offset = 0;
+  while (record[batch_offset] == stored_record()[batch_offset]) batch_offset++;
+
+  // as written by firmware without the sensor batch and report fields
+  record.resize(batch_offset);
+  set_record_size(record, batch_offset);
+  stored_record() = record;
+
+  boot();
+  expect_changed_settings();
+  TEST_ASSERT_EQUAL(SENSOR_BATCH_DFLT, device_state->sensor_batch());
+  TEST_ASSERT_EQUAL(REPORT_HEARTBEAT_DFLT, device_state->report_heartbeat());
+
+  // written with every field on the next change
+  device_state->set_sensor_batch(2);
+  fake::nvs.writes = 0;
+  device_state->save_user();
+  TEST_ASSERT_EQUAL(1, fake::nvs.writes);
+  TEST_ASSERT_GREATER_THAN(batch_offset, stored_record().size());
+}
+
+void test_newer_record_truncated() {
+  boot();
+  change_settings();
+  device_state->save_user();
+
+  // fields appended by newer firmware are ignored
+  Bytes& record = stored_record();
+  record.insert(record.end(), 16, 0xab);
+  set_record_size(record, record.size());
+
+  boot();
+  expect_changed_settings();
+  TEST_ASSERT_EQUAL(120, device_state->report_heartbeat());
+}
+
+void test_corrupt_record_ignored() {
+  boot();
+  change_settings();
+  device_state->save_user();
+
+  // size doesn't match the stored length
+  Bytes& record = stored_record();
+  record.resize(record.size() - 3);
+  boot();
+  TEST_ASSERT_EQUAL_STRING("Home Buttons a1b2c3",
+                           device_state->device_name().c_str());
+
+  // too short for the header
+  stored_record().resize(3);
+  boot();
+  TEST_ASSERT_EQUAL(SEN_INTERVAL_DFLT, device_state->sensor_interval());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_defaults_without_record);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_legacy_keys_migrated);
+  RUN_TEST(test_older_record_keeps_defaults);
+  RUN_TEST(test_newer_record_truncated);
+  RUN_TEST(test_corrupt_record_ignored);
+  return UNITY_END();
+}
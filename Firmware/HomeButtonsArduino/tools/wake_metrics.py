@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+
+# Prints per-phase timing percentiles from wake_metrics payloads.
+#
+# Reads one payload per line from files or stdin, e.g.:
+#   mosquitto_sub -h broker -v -t 'homebuttons/+/wake_metrics' > wake.log
+#   python wake_metrics.py wake.log
+# Anything before the first '{' on a line (like the topic printed by
+# mosquitto_sub -v) is used to tell devices apart.
+
+import argparse
+import json
+import sys
+
+# esp_sleep_source_t
+wakeup_causes = {0: "reset", 2: "ext0", 3: "button", 4: "timer"}
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    index = round(pct / 100 * (len(values) - 1))
+    return values[index]
+
+
+def read_cycles(lines):
+    seen = set()
+    for line in lines:
+        start = line.find("{")
+        if start < 0:
+            continue
+        try:
+            payload = json.loads(line[start:])
+        except json.JSONDecodeError:
+            print("skipped invalid line: {}".format(line.strip()),
+                  file=sys.stderr)
+            continue
+        source = line[:start].strip()
+        phases = payload.get("phases", [])
+        for cycle in payload.get("cycles", []):
+            key = (source, cycle.get("seq"))
+            if key in seen:
+                continue
+            seen.add(key)
+            marks = dict(zip(phases, cycle.get("t", [])))
+            yield cycle.get("cause", 0), phases, marks
+
+
+# time spent in each phase, from the previous reached mark (or boot) in ms.
+# Marks are sorted by time, wifi association overlaps the boot phases
+# since the network starts early.
+def phase_durations(phases, marks):
+    durations = {}
+    last = 0
+    reached = [phase for phase in phases if marks.get(phase, 0) > 0]
+    for phase in sorted(reached, key=lambda phase: marks[phase]):
+        t = marks[phase]
+        durations[phase] = (t - last) / 1000
+        last = t
+    # boot to first publish, the latency of a button press
+    if marks.get("first_pub", 0) > 0:
+        durations["to_first_pub"] = marks["first_pub"] / 1000
+    if last > 0:
+        durations["total"] = last / 1000
+    return durations
+
+
+def print_table(title, order, samples):
+    print(title)
+    print("{:<16}{:>6}{:>10}{:>10}{:>10}{:>10}".format(
+        "phase [ms]", "n", "p50", "p90", "p99", "max"))
+    for phase in order + ["to_first_pub", "total"]:
+        values = samples.get(phase)
+        if not values:
+            continue
+        print("{:<16}{:>6}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}".format(
+            phase, len(values), percentile(values, 50),
+            percentile(values, 90), percentile(values, 99), max(values)))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Per-phase wake cycle timings from wake_metrics payloads")
+    parser.add_argument("files", nargs="*",
+                        help="files with one payload per line, stdin if none")
+    parser.add_argument("--by-cause", action="store_true",
+                        help="separate table per wakeup cause")
+    args = parser.parse_args()
+
+    lines = []
+    if args.files:
+        for file in args.files:
+            with open(file) as f:
+                lines.extend(f.readlines())
+    else:
+        lines = sys.stdin.readlines()
+
+    order = []
+    tables = {}
+    for cause, phases, marks in read_cycles(lines):
+        for phase in phases:
+            if phase not in order:
+                order.append(phase)
+        name = wakeup_causes.get(cause, str(cause)) if args.by_cause else "all"
+        samples = tables.setdefault(name, {})
+        for phase, duration in phase_durations(phases, marks).items():
+            samples.setdefault(phase, []).append(duration)
+
+    if not tables:
+        print("no wake cycles found", file=sys.stderr)
+        sys.exit(1)
+    for name, samples in sorted(tables.items()):
+        print_table("wake cause: {}".format(name), order, samples)
+
+
+if __name__ == "__main__":
+    main()